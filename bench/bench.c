@@ -0,0 +1,224 @@
+#define _GNU_SOURCE
+#include "dataset.h"
+#include "backup_manager.h"
+#include "file_handler.h"
+#include "network.h"
+#include "server.h"
+#include "utilities.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/** Nombre de parcours du jeu de données pour mesurer list_files */
+#define LIST_REPEAT 20
+/** Port de loopback du benchmark réseau */
+#define BENCH_PORT 23999
+
+typedef struct {
+    const char *root;       // Répertoire des benchmarks
+    char source[4096];      // Jeu de données
+    char repository[4096];  // Dépôt des sauvegardes locales
+    char restore[4096];     // Restauration
+    char served[4096];      // Dépôt du serveur du benchmark réseau
+    file_list_t files;      // Fichiers du jeu de données
+    dataset_info_t info;
+} bench_t;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    (void)st;
+    (void)type;
+    (void)ftw;
+    return remove(path);
+}
+
+// Vide un répertoire de travail et le recrée
+static void reset_dir(const char *path) {
+    nftw(path, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    mkdir(path, 0755);
+}
+
+// Exécute un benchmark dans un processus fils pour mesurer son pic de mémoire seul,
+// puis affiche débit, fichiers par seconde et pic de RSS
+static int run_benchmark(const char *name, int (*body)(bench_t*), bench_t *bench, uint64_t bytes, uint64_t files) {
+    fflush(stdout);
+    double start = now_seconds();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        // Les traces des fonctions mesurées ne doivent ni polluer le rapport ni coûter du temps de terminal
+        int null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd >= 0) {
+            dup2(null_fd, STDOUT_FILENO);
+            close(null_fd);
+        }
+        int result = body(bench);
+        fflush(stdout);
+        _exit(result == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0) {
+        perror("wait4");
+        return -1;
+    }
+    double elapsed = now_seconds() - start;
+    int ok = WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+    printf("%-28s %10.1f %12.0f %12.1f %10.3f%s\n", name, bytes / 1e6 / elapsed, files / elapsed,
+           usage.ru_maxrss / 1024.0, elapsed, ok ? "" : "  FAILED");
+    return ok ? 0 : -1;
+}
+
+static int bench_deduplicate(bench_t *bench) {
+    for (file_element *elt = bench->files.head; elt; elt = elt->next) {
+        int chunk_count = 0;
+        Chunk **chunks = load_deduplicated_chunks(elt->path, &chunk_count);
+        free_chunks(chunks, chunk_count);
+    }
+    return 0;
+}
+
+static int bench_md5(bench_t *bench) {
+    unsigned char md5[MD5_DIGEST_LENGTH * 2 + 1];
+    for (file_element *elt = bench->files.head; elt; elt = elt->next) {
+        get_md5(elt->path, md5);
+    }
+    return 0;
+}
+
+static int bench_list_files(bench_t *bench) {
+    for (int i = 0; i < LIST_REPEAT; i++) {
+        file_list_t files = { .head = NULL, .tail = NULL };
+        list_files(bench->source, &files, 1);
+        free_file_list(&files);
+    }
+    return 0;
+}
+
+static int bench_backup(bench_t *bench) {
+    backup_options_t options = { .pack = 0, .compress = 0 };
+    create_backup(bench->source, bench->repository, &options);
+    return 0;
+}
+
+// Les noms de sauvegarde sont des dates : la plus récente est la plus grande
+static int latest_backup(const char *repository, char *path, size_t size) {
+    DIR *dir = opendir(repository);
+    if (!dir) {
+        perror(repository);
+        return -1;
+    }
+    char latest[256] = "";
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] != '.' && strcmp(entry->d_name, PACK_DIR_NAME) != 0 && strcmp(entry->d_name, latest) > 0) {
+            snprintf(latest, sizeof(latest), "%s", entry->d_name);
+        }
+    }
+    closedir(dir);
+    snprintf(path, size, "%s/%s", repository, latest);
+    return latest[0] ? 0 : -1;
+}
+
+static int bench_restore(bench_t *bench) {
+    char backup[4400];
+    if (latest_backup(bench->repository, backup, sizeof(backup)) != 0) {
+        return -1;
+    }
+    restore_backup(backup, bench->restore);
+    return 0;
+}
+
+// Sauvegarde distante complète vers un serveur lancé sur la boucle locale
+static int bench_network(bench_t *bench) {
+    backup_options_t options = { .pack = 0, .compress = 0 };
+    pid_t server = fork();
+    if (server < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (server == 0) {
+        serve_forever("127.0.0.1", BENCH_PORT, bench->served, &options);
+        _exit(EXIT_FAILURE);
+    }
+
+    // Attendre que le serveur écoute
+    int result = -1;
+    usleep(100000);
+    for (int attempt = 0; attempt < 100; attempt++) {
+        int fd = net_connect("127.0.0.1", BENCH_PORT);
+        if (fd >= 0) {
+            close(fd);
+            result = 0;
+            break;
+        }
+        usleep(20000);
+    }
+    if (result == 0) {
+        result = remote_backup(bench->source, "127.0.0.1", BENCH_PORT, &options);
+    }
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s DIR [SCALE]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    bench_t bench = { .root = argv[1] };
+    int scale = argc > 2 ? atoi(argv[2]) : 1;
+    mkdir(bench.root, 0755);
+    snprintf(bench.source, sizeof(bench.source), "%s/source", bench.root);
+    snprintf(bench.repository, sizeof(bench.repository), "%s/repository", bench.root);
+    snprintf(bench.restore, sizeof(bench.restore), "%s/restore", bench.root);
+    snprintf(bench.served, sizeof(bench.served), "%s/served", bench.root);
+
+    // Le jeu de données est toujours régénéré : les passages de modification l'ont changé
+    printf("Generating dataset (scale %d) in %s...\n", scale, bench.source);
+    if (generate_dataset(bench.source, scale, &bench.info) != 0) {
+        return EXIT_FAILURE;
+    }
+    list_files(bench.source, &bench.files, 1);
+    reset_dir(bench.repository);
+    reset_dir(bench.restore);
+    reset_dir(bench.served);
+    uint64_t bytes = bench.info.bytes;
+    uint64_t files = bench.info.files;
+    printf("%llu files, %.1f MB\n\n", (unsigned long long)files, bytes / 1e6);
+
+    printf("%-28s %10s %12s %12s %10s\n", "benchmark", "MB/s", "files/s", "peak RSS MB", "seconds");
+    int failures = 0;
+    failures += run_benchmark("deduplicate_file", bench_deduplicate, &bench, bytes, files) != 0;
+    failures += run_benchmark("get_md5", bench_md5, &bench, bytes, files) != 0;
+    failures += run_benchmark("list_files", bench_list_files, &bench, 0, files * LIST_REPEAT) != 0;
+    failures += run_benchmark("create_backup (first)", bench_backup, &bench, bytes, files) != 0;
+    if (mutate_dataset(bench.source, 1) != 0) {
+        return EXIT_FAILURE;
+    }
+    failures += run_benchmark("create_backup (incremental)", bench_backup, &bench, bytes, files) != 0;
+    failures += run_benchmark("restore_backup", bench_restore, &bench, bytes, files) != 0;
+    failures += run_benchmark("remote_backup (loopback)", bench_network, &bench, bytes, files) != 0;
+
+    free_file_list(&bench.files);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,256 @@
+#define _XOPEN_SOURCE 700
+#include "dataset.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Générateur xorshift64* : rapide et identique d'une machine à l'autre
+static uint64_t next_random(uint64_t *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+static void fill_random(unsigned char *buffer, size_t len, uint64_t *state) {
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t value = next_random(state);
+        memcpy(buffer + i, &value, sizeof(uint64_t));
+    }
+    uint64_t value = next_random(state);
+    memcpy(buffer + i, &value, len - i);
+}
+
+static int write_file(const char *path, const unsigned char *data, size_t len) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        perror(path);
+        return -1;
+    }
+    int result = fwrite(data, 1, len, file) == len ? 0 : -1;
+    if (fclose(file) != 0 || result != 0) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    (void)st;
+    (void)type;
+    (void)ftw;
+    return remove(path);
+}
+
+static int make_dir(const char *dir, const char *name, char *path, size_t size) {
+    snprintf(path, size, "%s/%s", dir, name);
+    if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+static int generate_tiny(const char *dir, int scale, uint64_t *state) {
+    char sub[4096];
+    char path[4200];
+    unsigned char data[512];
+    if (make_dir(dir, "tiny", sub, sizeof(sub)) != 0) {
+        return -1;
+    }
+    // Répartis dans des sous-répertoires de 100 fichiers, comme un arbre de sources
+    for (int i = 0; i < DATASET_TINY_FILES * scale; i++) {
+        if (i % 100 == 0) {
+            snprintf(path, sizeof(path), "%s/d%04d", sub, i / 100);
+            if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+                perror(path);
+                return -1;
+            }
+        }
+        size_t len = next_random(state) % sizeof(data);
+        fill_random(data, len, state);
+        snprintf(path, sizeof(path), "%s/d%04d/f%06d.txt", sub, i / 100, i);
+        if (write_file(path, data, len) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int generate_large(const char *dir, const char *name, int count, size_t size, uint64_t *state) {
+    char sub[4096];
+    char path[4200];
+    if (make_dir(dir, name, sub, sizeof(sub)) != 0) {
+        return -1;
+    }
+    unsigned char *data = malloc(size);
+    if (!data) {
+        perror("Memory allocation failed");
+        return -1;
+    }
+    int result = 0;
+    for (int i = 0; i < count && result == 0; i++) {
+        fill_random(data, size, state);
+        snprintf(path, sizeof(path), "%s/%s%03d.bin", sub, name, i);
+        result = write_file(path, data, size);
+    }
+    free(data);
+    return result;
+}
+
+static int generate_sparse(const char *dir, int count, uint64_t *state) {
+    char sub[4096];
+    char path[4200];
+    unsigned char extent[64 * 1024];
+    if (make_dir(dir, "sparse", sub, sizeof(sub)) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        snprintf(path, sizeof(path), "%s/image%03d.img", sub, i);
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0 || ftruncate(fd, DATASET_SPARSE_SIZE) != 0) {
+            perror(path);
+            if (fd >= 0) {
+                close(fd);
+            }
+            return -1;
+        }
+        for (int e = 0; e < DATASET_SPARSE_EXTENTS; e++) {
+            off_t offset = (off_t)(next_random(state) % (DATASET_SPARSE_SIZE / sizeof(extent))) * sizeof(extent);
+            fill_random(extent, sizeof(extent), state);
+            if (pwrite(fd, extent, sizeof(extent), offset) != (ssize_t)sizeof(extent)) {
+                perror(path);
+                close(fd);
+                return -1;
+            }
+        }
+        close(fd);
+    }
+    return 0;
+}
+
+static int generate_duplicated(const char *dir, int count, uint64_t *state) {
+    char sub[4096];
+    char path[4200];
+    // Blocs de la taille des chunks : les répétitions sont alignées sur le découpage
+    const size_t block = 4095;
+    if (make_dir(dir, "dup", sub, sizeof(sub)) != 0) {
+        return -1;
+    }
+    unsigned char *blocks = malloc(block * DATASET_DUP_BLOCKS);
+    unsigned char *data = malloc(DATASET_DUP_SIZE);
+    if (!blocks || !data) {
+        perror("Memory allocation failed");
+        free(blocks);
+        free(data);
+        return -1;
+    }
+    fill_random(blocks, block * DATASET_DUP_BLOCKS, state);
+    int result = 0;
+    for (int i = 0; i < count && result == 0; i++) {
+        for (size_t pos = 0; pos < DATASET_DUP_SIZE; pos += block) {
+            size_t len = DATASET_DUP_SIZE - pos < block ? DATASET_DUP_SIZE - pos : block;
+            memcpy(data + pos, blocks + (next_random(state) % DATASET_DUP_BLOCKS) * block, len);
+        }
+        snprintf(path, sizeof(path), "%s/dup%03d.bin", sub, i);
+        result = write_file(path, data, DATASET_DUP_SIZE);
+    }
+    free(blocks);
+    free(data);
+    return result;
+}
+
+int generate_dataset(const char *dir, int scale, dataset_info_t *info) {
+    if (scale < 1) {
+        scale = 1;
+    }
+    nftw(dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    if (mkdir(dir, 0755) != 0) {
+        perror(dir);
+        return -1;
+    }
+    uint64_t state = DATASET_SEED;
+    if (generate_tiny(dir, scale, &state) != 0 ||
+        generate_large(dir, "random", DATASET_RANDOM_FILES * scale, DATASET_RANDOM_SIZE, &state) != 0 ||
+        generate_large(dir, "mutated", DATASET_MUTATED_FILES * scale, DATASET_MUTATED_SIZE, &state) != 0 ||
+        generate_sparse(dir, DATASET_SPARSE_FILES * scale, &state) != 0 ||
+        generate_duplicated(dir, DATASET_DUP_FILES * scale, &state) != 0) {
+        return -1;
+    }
+    return info ? scan_dataset(dir, info) : 0;
+}
+
+// Écrase ou insère quelques octets à des positions tirées au hasard
+static int mutate_file(const char *path, uint64_t *state) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return -1;
+    }
+    struct stat st;
+    fstat(fileno(file), &st);
+    size_t size = st.st_size;
+    unsigned char *data = malloc(size + DATASET_MUTATIONS * 64);
+    if (!data || fread(data, 1, size, file) != size) {
+        perror(path);
+        free(data);
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+
+    for (int i = 0; i < DATASET_MUTATIONS && size > 0; i++) {
+        size_t pos = next_random(state) % size;
+        size_t len = 1 + next_random(state) % 64;
+        if (pos + len > size) {
+            len = size - pos;
+        }
+        if (next_random(state) % 2) {
+            memmove(data + pos + len, data + pos, size - pos);
+            size += len;
+        }
+        fill_random(data + pos, len, state);
+    }
+    int result = write_file(path, data, size);
+    free(data);
+    return result;
+}
+
+int mutate_dataset(const char *dir, int round) {
+    uint64_t state = DATASET_SEED ^ ((uint64_t)round * 0x9E3779B97F4A7C15ULL);
+    char path[4200];
+    for (int i = 0; ; i++) {
+        snprintf(path, sizeof(path), "%s/mutated/mutated%03d.bin", dir, i);
+        if (access(path, F_OK) != 0) {
+            return 0;
+        }
+        if (mutate_file(path, &state) != 0) {
+            return -1;
+        }
+    }
+}
+
+static dataset_info_t *scan_target;
+
+static int count_entry(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    (void)path;
+    (void)ftw;
+    if (type == FTW_F) {
+        scan_target->files++;
+        scan_target->bytes += st->st_size;
+    }
+    return 0;
+}
+
+int scan_dataset(const char *dir, dataset_info_t *info) {
+    info->files = 0;
+    info->bytes = 0;
+    scan_target = info;
+    return nftw(dir, count_entry, 16, FTW_PHYS) == 0 ? 0 : -1;
+}
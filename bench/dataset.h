@@ -0,0 +1,66 @@
+#ifndef DATASET_H
+#define DATASET_H
+
+#include <stdint.h>
+
+/** @brief Graine du générateur : deux exécutions produisent les mêmes octets */
+#define DATASET_SEED 0x4C5032354245ULL
+/** @brief Nombre de petits fichiers (0 à 512 octets) par unité d'échelle */
+#define DATASET_TINY_FILES 2000
+/** @brief Nombre et taille des gros fichiers aléatoires par unité d'échelle */
+#define DATASET_RANDOM_FILES 4
+#define DATASET_RANDOM_SIZE (8 * 1024 * 1024)
+/** @brief Nombre et taille des gros fichiers modifiés entre deux sauvegardes par unité d'échelle */
+#define DATASET_MUTATED_FILES 4
+#define DATASET_MUTATED_SIZE (8 * 1024 * 1024)
+/** @brief Nombre de modifications (quelques octets écrasés ou insérés) par fichier et par passage */
+#define DATASET_MUTATIONS 16
+/** @brief Images creuses : taille apparente, et nombre d'extents de données de 64 Ko */
+#define DATASET_SPARSE_FILES 2
+#define DATASET_SPARSE_SIZE (64 * 1024 * 1024)
+#define DATASET_SPARSE_EXTENTS 16
+/** @brief Fichiers très dupliqués : taille, et nombre de blocs distincts qui s'y répètent */
+#define DATASET_DUP_FILES 2
+#define DATASET_DUP_SIZE (8 * 1024 * 1024)
+#define DATASET_DUP_BLOCKS 64
+
+/**
+ * @brief Résumé d'un jeu de données.
+ */
+typedef struct {
+    uint64_t files;
+    uint64_t bytes;     // Taille apparente cumulée
+} dataset_info_t;
+
+/**
+ * @brief Crée un jeu de données déterministe dans un répertoire (vidé au préalable) :
+ * tiny/ (nombreux petits fichiers), random/ (gros fichiers aléatoires), mutated/
+ * (gros fichiers modifiés par mutate_dataset), sparse/ (images creuses) et dup/
+ * (données très dupliquées).
+ *
+ * @param dir Le répertoire du jeu de données.
+ * @param scale Le facteur d'échelle (1 : environ 220 Mo apparents, dont 128 Mo de trous).
+ * @param info Le résumé du jeu créé (peut être NULL).
+ * @return int 0 si succès, -1 si erreur.
+ */
+int generate_dataset(const char *dir, int scale, dataset_info_t *info);
+
+/**
+ * @brief Applique de petites modifications aux fichiers de mutated/, déterministes pour un passage donné.
+ *
+ * @param dir Le répertoire du jeu de données.
+ * @param round Le numéro du passage (la graine en dépend).
+ * @return int 0 si succès, -1 si erreur.
+ */
+int mutate_dataset(const char *dir, int round);
+
+/**
+ * @brief Compte les fichiers et la taille apparente d'un répertoire.
+ *
+ * @param dir Le répertoire.
+ * @param info Le résumé.
+ * @return int 0 si succès, -1 si erreur.
+ */
+int scan_dataset(const char *dir, dataset_info_t *info);
+
+#endif // DATASET_H
@@ -0,0 +1,24 @@
+#include "dataset.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Génère le jeu de données des benchmarks, ou applique un passage de modifications
+int main(int argc, char *argv[]) {
+    if (argc >= 3 && strcmp(argv[1], "--mutate") == 0) {
+        int round = argc > 3 ? atoi(argv[3]) : 1;
+        return mutate_dataset(argv[2], round) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s DIR [SCALE]\n       %s --mutate DIR [ROUND]\n", argv[0], argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    dataset_info_t info;
+    int scale = argc > 2 ? atoi(argv[2]) : 1;
+    if (generate_dataset(argv[1], scale, &info) != 0) {
+        return EXIT_FAILURE;
+    }
+    printf("%s: %llu files, %.1f MB\n", argv[1], (unsigned long long)info.files, info.bytes / 1e6);
+    return EXIT_SUCCESS;
+}
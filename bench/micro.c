@@ -0,0 +1,389 @@
+#define _GNU_SOURCE
+#include "backup_manager.h"
+#include "deduplication.h"
+#include "delta.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/** Passages de chauffe non mesurés avant chaque noyau */
+#define WARMUP_REPEAT 2
+/** Nombre de passages mesurés par défaut */
+#define DEFAULT_REPEAT 10
+/** Volume traité par passage pour les fonctions de hachage */
+#define HASH_BYTES_PER_REPEAT (4 * 1024 * 1024)
+/** Recherches par passage dans la table des MD5 */
+#define LOOKUPS_PER_REPEAT 100000
+/** Insertions mesurées par passage : les 5 % de la table qui précèdent le taux de remplissage */
+#define INSERTS_PER_REPEAT (HASH_TABLE_SIZE / 20)
+/** Taille du fichier parcouru par la somme glissante */
+#define DELTA_FILE_SIZE (8 * 1024 * 1024)
+
+typedef void (*kernel_fn)(void *ctx, long ops);
+
+// Empêche le compilateur d'éliminer les appels dont le résultat n'est pas utilisé
+static volatile uint64_t sink;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Cycles de référence du compteur TSC : 0 lorsqu'il n'existe pas sur cette architecture
+static uint64_t read_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static void fill_random(unsigned char *buffer, size_t len, uint64_t *state) {
+    for (size_t i = 0; i < len; i++) {
+        *state ^= *state << 13;
+        *state ^= *state >> 7;
+        *state ^= *state << 17;
+        buffer[i] = (unsigned char)*state;
+    }
+}
+
+// Mesure un noyau : chauffe, puis repeat passages de ops opérations. Affiche la moyenne,
+// l'écart type relatif et le minimum en ns/op, ainsi que les cycles par octet et le débit
+static void run_kernel(const char *name, const char *param, kernel_fn body, kernel_fn prepare, void *ctx,
+                       long ops, size_t bytes_per_op, int repeat) {
+    double *ns = malloc(repeat * sizeof(double));
+    double *cycles = malloc(repeat * sizeof(double));
+    if (!ns || !cycles) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int r = 0; r < WARMUP_REPEAT; r++) {
+        if (prepare) {
+            prepare(ctx, ops);
+        }
+        body(ctx, ops);
+    }
+    for (int r = 0; r < repeat; r++) {
+        if (prepare) {
+            prepare(ctx, ops);
+        }
+        double start = now_ns();
+        uint64_t start_cycles = read_cycles();
+        body(ctx, ops);
+        uint64_t end_cycles = read_cycles();
+        ns[r] = (now_ns() - start) / ops;
+        cycles[r] = (double)(end_cycles - start_cycles) / ops;
+    }
+
+    double mean = 0;
+    double mean_cycles = 0;
+    double min = ns[0];
+    for (int r = 0; r < repeat; r++) {
+        mean += ns[r] / repeat;
+        mean_cycles += cycles[r] / repeat;
+        if (ns[r] < min) {
+            min = ns[r];
+        }
+    }
+    double variance = 0;
+    for (int r = 0; r < repeat; r++) {
+        variance += (ns[r] - mean) * (ns[r] - mean);
+    }
+    double stddev = repeat > 1 ? sqrt(variance / (repeat - 1)) : 0;
+
+    printf("%-22s %-14s %12.1f %7.1f%% %12.1f", name, param, mean, mean > 0 ? 100 * stddev / mean : 0, min);
+    if (bytes_per_op > 0) {
+        if (mean_cycles > 0) {
+            printf(" %10.2f", mean_cycles / bytes_per_op);
+        }
+        else {
+            printf(" %10s", "-");
+        }
+        printf(" %10.1f\n", bytes_per_op / mean * 1e3);
+    }
+    else {
+        printf(" %10s %10s\n", "-", "-");
+    }
+    free(ns);
+    free(cycles);
+}
+
+// Table des MD5 remplie jusqu'à un taux donné, avec des empreintes absentes pour les échecs
+typedef struct {
+    Md5Entry *table[HASH_TABLE_SIZE];
+    unsigned char keys[HASH_TABLE_SIZE][MD5_DIGEST_LENGTH * 2 + 1];
+    unsigned char missing[HASH_TABLE_SIZE][MD5_DIGEST_LENGTH * 2 + 1];
+    int filled;
+} table_ctx_t;
+
+static void fill_table(table_ctx_t *ctx, int count) {
+    for (int i = 0; i < HASH_TABLE_SIZE; i++) {
+        ctx->table[i]->index = -1;
+    }
+    for (int i = 0; i < count; i++) {
+        add_md5(ctx->table, ctx->keys[i], i);
+    }
+}
+
+static void find_hits(void *arg, long ops) {
+    table_ctx_t *ctx = arg;
+    uint64_t total = 0;
+    for (long i = 0; i < ops; i++) {
+        total += find_md5(ctx->table, ctx->keys[i % ctx->filled]);
+    }
+    sink += total;
+}
+
+static void find_misses(void *arg, long ops) {
+    table_ctx_t *ctx = arg;
+    uint64_t total = 0;
+    for (long i = 0; i < ops; i++) {
+        total += find_md5(ctx->table, ctx->missing[i % HASH_TABLE_SIZE]);
+    }
+    sink += total;
+}
+
+static void prepare_inserts(void *arg, long ops) {
+    table_ctx_t *ctx = arg;
+    fill_table(ctx, ctx->filled - ops);
+}
+
+static void insert_keys(void *arg, long ops) {
+    table_ctx_t *ctx = arg;
+    for (long i = ctx->filled - ops; i < ctx->filled; i++) {
+        add_md5(ctx->table, ctx->keys[i], i);
+    }
+}
+
+static void bench_table(int repeat) {
+    static const int load_percents[] = { 25, 50, 75, 90, 99 };
+    table_ctx_t *ctx = malloc(sizeof(table_ctx_t));
+    if (!ctx) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    init_hash_table(ctx->table);
+    for (int i = 0; i < HASH_TABLE_SIZE; i++) {
+        char seed[32];
+        snprintf(seed, sizeof(seed), "key-%d", i);
+        compute_md5(seed, strlen(seed), ctx->keys[i]);
+        snprintf(seed, sizeof(seed), "missing-%d", i);
+        compute_md5(seed, strlen(seed), ctx->missing[i]);
+    }
+
+    for (size_t l = 0; l < sizeof(load_percents) / sizeof(load_percents[0]); l++) {
+        char param[32];
+        snprintf(param, sizeof(param), "load %d%%", load_percents[l]);
+        ctx->filled = HASH_TABLE_SIZE * load_percents[l] / 100;
+        fill_table(ctx, ctx->filled);
+        run_kernel("find_md5 (hit)", param, find_hits, NULL, ctx, LOOKUPS_PER_REPEAT, 0, repeat);
+        run_kernel("find_md5 (miss)", param, find_misses, NULL, ctx, LOOKUPS_PER_REPEAT, 0, repeat);
+        run_kernel("add_md5", param, insert_keys, prepare_inserts, ctx, INSERTS_PER_REPEAT, 0, repeat);
+    }
+    clean_hash_table(ctx->table);
+    free(ctx);
+}
+
+// Fonctions de hachage comparées sur un même tampon, par taille de chunk
+typedef struct {
+    unsigned char *data;
+    size_t size;
+    const EVP_MD *md;
+    EVP_MD_CTX *md_ctx;
+} hash_ctx_t;
+
+static void hash_compute_md5(void *arg, long ops) {
+    hash_ctx_t *ctx = arg;
+    unsigned char md5[MD5_DIGEST_LENGTH * 2 + 1];
+    for (long i = 0; i < ops; i++) {
+        compute_md5(ctx->data, ctx->size, md5);
+    }
+    sink += md5[0];
+}
+
+// Empreinte brute avec un contexte EVP réutilisé, sans conversion hexadécimale
+static void hash_evp(void *arg, long ops) {
+    hash_ctx_t *ctx = arg;
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    for (long i = 0; i < ops; i++) {
+        EVP_DigestInit_ex(ctx->md_ctx, ctx->md, NULL);
+        EVP_DigestUpdate(ctx->md_ctx, ctx->data, ctx->size);
+        EVP_DigestFinal_ex(ctx->md_ctx, digest, NULL);
+    }
+    sink += digest[0];
+}
+
+static void hash_crc32(void *arg, long ops) {
+    hash_ctx_t *ctx = arg;
+    uLong total = 0;
+    for (long i = 0; i < ops; i++) {
+        total += crc32(0L, ctx->data, ctx->size);
+    }
+    sink += total;
+}
+
+static void hash_adler32(void *arg, long ops) {
+    hash_ctx_t *ctx = arg;
+    uLong total = 0;
+    for (long i = 0; i < ops; i++) {
+        total += adler32(1L, ctx->data, ctx->size);
+    }
+    sink += total;
+}
+
+static void hash_weak(void *arg, long ops) {
+    hash_ctx_t *ctx = arg;
+    uint64_t total = 0;
+    for (long i = 0; i < ops; i++) {
+        total += weak_checksum(ctx->data, ctx->size);
+    }
+    sink += total;
+}
+
+static void bench_hashes(unsigned char *data, int repeat) {
+    static const size_t sizes[] = { 64, 512, CHUNK_SIZE - 1, 64 * 1024 };
+    struct {
+        const char *name;
+        const EVP_MD *md;
+    } digests[] = {
+        { "EVP md5", EVP_md5() },
+        { "EVP sha1", EVP_sha1() },
+        { "EVP sha256", EVP_sha256() },
+        { "EVP blake2b512", EVP_blake2b512() },
+    };
+    hash_ctx_t ctx = { .data = data, .md_ctx = EVP_MD_CTX_new() };
+    if (!ctx.md_ctx) {
+        fprintf(stderr, "Failed to create EVP_MD_CTX\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        char param[32];
+        snprintf(param, sizeof(param), "%zu B", sizes[s]);
+        ctx.size = sizes[s];
+        long ops = HASH_BYTES_PER_REPEAT / sizes[s];
+        run_kernel("compute_md5", param, hash_compute_md5, NULL, &ctx, ops, sizes[s], repeat);
+        for (size_t d = 0; d < sizeof(digests) / sizeof(digests[0]); d++) {
+            if (!digests[d].md) {
+                continue; // Algorithme absent de cette version d'OpenSSL
+            }
+            ctx.md = digests[d].md;
+            run_kernel(digests[d].name, param, hash_evp, NULL, &ctx, ops, sizes[s], repeat);
+        }
+        run_kernel("zlib crc32", param, hash_crc32, NULL, &ctx, ops, sizes[s], repeat);
+        run_kernel("zlib adler32", param, hash_adler32, NULL, &ctx, ops, sizes[s], repeat);
+        run_kernel("weak_checksum", param, hash_weak, NULL, &ctx, ops, sizes[s], repeat);
+    }
+    EVP_MD_CTX_free(ctx.md_ctx);
+}
+
+static void hex_kernel(void *arg, long ops) {
+    unsigned char *digest = arg;
+    unsigned char hex[MD5_DIGEST_LENGTH * 2 + 1];
+    for (long i = 0; i < ops; i++) {
+        digest[0] = (unsigned char)i;
+        bytes_to_hex(digest, MD5_DIGEST_LENGTH, hex);
+    }
+    sink += hex[0];
+}
+
+// Détection des frontières : test des chunks nuls du découpage fixe, et parcours à somme
+// glissante du découpage différentiel (qui hache aussi les littéraux produits)
+typedef struct {
+    unsigned char *block;
+    char path[64];
+    chunk_signature_t *signatures;
+    int signature_count;
+} boundary_ctx_t;
+
+static void zero_kernel(void *arg, long ops) {
+    boundary_ctx_t *ctx = arg;
+    uint64_t total = 0;
+    for (long i = 0; i < ops; i++) {
+        total += is_zero_block(ctx->block, CHUNK_SIZE - 1);
+    }
+    sink += total;
+}
+
+static void delta_kernel(void *arg, long ops) {
+    boundary_ctx_t *ctx = arg;
+    for (long i = 0; i < ops; i++) {
+        int chunk_count = 0;
+        uint64_t matched = 0;
+        Chunk **chunks = delta_chunk_file(ctx->path, ctx->signatures, ctx->signature_count, &chunk_count, &matched);
+        free_chunks(chunks, chunk_count);
+        sink += matched;
+    }
+}
+
+static void bench_boundaries(unsigned char *data, uint64_t *state, int repeat) {
+    boundary_ctx_t ctx = { .block = calloc(1, CHUNK_SIZE) };
+    if (!ctx.block) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    run_kernel("is_zero_block", "4095 B zero", zero_kernel, NULL, &ctx, HASH_BYTES_PER_REPEAT / (CHUNK_SIZE - 1),
+               CHUNK_SIZE - 1, repeat);
+
+    // Signatures d'une autre version sans bloc commun : chaque position est testée
+    snprintf(ctx.path, sizeof(ctx.path), "/tmp/lp25-micro-%d", (int)getpid());
+    unsigned char *file_data = malloc(DELTA_FILE_SIZE);
+    ctx.signature_count = DELTA_FILE_SIZE / DELTA_BLOCK_SIZE;
+    ctx.signatures = malloc(ctx.signature_count * sizeof(chunk_signature_t));
+    FILE *file = fopen(ctx.path, "wb");
+    if (!file_data || !ctx.signatures || !file) {
+        perror(ctx.path);
+        exit(EXIT_FAILURE);
+    }
+    fill_random(file_data, DELTA_FILE_SIZE, state);
+    fwrite(file_data, 1, DELTA_FILE_SIZE, file);
+    fclose(file);
+    for (int i = 0; i < ctx.signature_count; i++) {
+        fill_random(data, DELTA_BLOCK_SIZE, state);
+        ctx.signatures[i].weak = weak_checksum(data, DELTA_BLOCK_SIZE);
+        EVP_Digest(data, DELTA_BLOCK_SIZE, ctx.signatures[i].md5, NULL, EVP_md5(), NULL);
+        ctx.signatures[i].length = DELTA_BLOCK_SIZE;
+    }
+    run_kernel("delta_chunk_file", "8 MB, no match", delta_kernel, NULL, &ctx, 1, DELTA_FILE_SIZE, repeat);
+
+    unlink(ctx.path);
+    free(file_data);
+    free(ctx.signatures);
+    free(ctx.block);
+}
+
+int main(int argc, char *argv[]) {
+    int repeat = argc > 1 ? atoi(argv[1]) : DEFAULT_REPEAT;
+    if (repeat < 2) {
+        fprintf(stderr, "Usage: %s [REPEAT >= 2]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    uint64_t state = 0x4C5032354D4943ULL;
+    unsigned char *data = malloc(64 * 1024);
+    if (!data) {
+        perror("Memory allocation failed");
+        return EXIT_FAILURE;
+    }
+    fill_random(data, 64 * 1024, &state);
+
+    printf("%d warmup + %d measured repetitions per kernel; cycles are TSC reference cycles\n\n",
+           WARMUP_REPEAT, repeat);
+    printf("%-22s %-14s %12s %8s %12s %10s %10s\n", "kernel", "parameter", "ns/op", "rsd", "min ns/op",
+           "cycles/B", "MB/s");
+    bench_table(repeat);
+    bench_hashes(data, repeat);
+    unsigned char digest[MD5_DIGEST_LENGTH];
+    memcpy(digest, data, sizeof(digest));
+    run_kernel("bytes_to_hex", "16 B", hex_kernel, NULL, digest, LOOKUPS_PER_REPEAT, MD5_DIGEST_LENGTH, repeat);
+    bench_boundaries(data, &state, repeat);
+    free(data);
+    return EXIT_SUCCESS;
+}
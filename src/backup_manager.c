@@ -2,6 +2,13 @@
 #include "deduplication.h"
 #include "file_handler.h"
 #include "utilities.h"
+#include "checkpoint.h"
+#include "stats.h"
+#include "trace.h"
+#include "budget.h"
+#include "chunk_cache.h"
+#include "governor.h"
+#include "ingest.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,29 +17,353 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
 #include <math.h>
 
 // Générer le nom de sauvegarde avec la date et l'heure actuelle
 void generate_backup_name(char *buffer, size_t size) {
     struct timespec ts;
-    struct tm *info;
+    struct tm info;
     char date_buffer[64];
     char ms_buffer[16];
 
     // Récupère l'heure actuelle
     clock_gettime(CLOCK_REALTIME, &ts);
-    // Convertir en heure locale
-    info = localtime(&ts.tv_sec);
+    // Convertir en heure locale (localtime_r : appelée par plusieurs workers du serveur à la fois)
+    localtime_r(&ts.tv_sec, &info);
 
     // Formatage de la date (sans millisecondes)
-    strftime(date_buffer, sizeof(date_buffer), "%Y-%m-%d-%H:%M:%S", info);
+    strftime(date_buffer, sizeof(date_buffer), "%Y-%m-%d-%H:%M:%S", &info);
     // Ajouter les millisecondes à la chaîne formatée
     snprintf(ms_buffer, sizeof(ms_buffer), ".%03ld", ts.tv_nsec / 1000000);
     snprintf(buffer, size, "%s%s", date_buffer, ms_buffer);
 }
 
+// Ajoute à la liste de log l'entrée d'un fichier : empreinte et date reprises d'un lien physique déjà
+// relevé ou de la sauvegarde précédente, lues par l'ingestion si le fichier y tenait entier, sinon
+// relues sur le disque
+static int add_log_entry(log_t *logs, const char *source_dir, const char *backup_name, const ingest_file_t *file,
+                         log_index_t *inodes, const log_index_t *previous) {
+    // new_elt est une ligne du fichier backup.log
+    log_element *new_elt = malloc(sizeof(log_element));
+    if (!new_elt) {
+        perror("Memory allocation failed");
+        return -1;
+    }
+    char *file_dest_path = remove_source_dir(source_dir, file->path);
+    new_elt->path = build_full_path(backup_name, file_dest_path);
+    free(file_dest_path);
+    if (!new_elt->path) {
+        perror("Failed to build full path for backup");
+        free(new_elt);
+        return 0;
+    }
+
+    memset(new_elt->md5, 0, sizeof(new_elt->md5));
+    new_elt->content = NULL;
+    new_elt->content_size = 0;
+    new_elt->object = NULL;
+    // Le relevé de l'ingestion (statx ou fstat) donne la taille et l'inode, même sans le contenu
+    int has_stat = S_ISREG(file->st.st_mode);
+    new_elt->size = has_stat ? file->st.st_size : -1;
+    new_elt->dev = has_stat ? file->st.st_dev : 0;
+    new_elt->ino = has_stat ? file->st.st_ino : 0;
+    new_elt->mtime.tv_sec = has_stat ? file->st.st_mtim.tv_sec : 0;
+    new_elt->mtime.tv_nsec = has_stat ? file->st.st_mtim.tv_nsec : 0;
+    log_element *link = has_stat && file->st.st_nlink > 1 ?
+                        log_index_find_inode(inodes, new_elt->dev, new_elt->ino) : NULL;
+    if (link && link->size != new_elt->size) {
+        link = NULL;
+    }
+    // Même inode, même taille et même date exacte qu'à la sauvegarde précédente : le fichier n'a pas
+    // changé, même s'il a été renommé ou déplacé
+    log_element *old = has_stat && !file->error && !link ?
+                       log_index_find_inode(previous, new_elt->dev, new_elt->ino) : NULL;
+    if (old && (old->size != new_elt->size || old->mtime.tv_sec != new_elt->mtime.tv_sec ||
+                old->mtime.tv_nsec != new_elt->mtime.tv_nsec)) {
+        old = NULL;
+    }
+    if (link || old) {
+        // Autre nom d'un fichier déjà relevé, ou fichier inchangé : il n'est pas relu
+        log_element *same = link ? link : old;
+        memcpy(new_elt->md5, same->md5, sizeof(new_elt->md5));
+        strcpy(new_elt->date, same->date);
+        if (same->content) {
+            set_log_content(new_elt, same->content, same->content_size, 0);
+        }
+    }
+    else if (file->complete) {
+        stats_span_t span;
+        stats_begin(STATS_HASH, &span);
+        compute_md5((void*)file->data, file->length, new_elt->md5);
+        stats_end(STATS_HASH, &span, file->length, 1, 0);
+        if (format_modification_date(file->st.st_mtime, new_elt->date) != 0) {
+            new_elt->date[0] = '\0';
+        }
+        // Un petit fichier est conservé dans le log si le budget mémoire le permet
+        if (file->length < LOG_INLINE_MAX_SIZE) {
+            set_log_content(new_elt, file->data, file->length, 0);
+        }
+    }
+    else {
+        get_md5(file->path, new_elt->md5);
+        stats_span_t span;
+        stats_begin(STATS_STAT, &span);
+        char *last_date = get_last_modification_date(file->path);
+        stats_end(STATS_STAT, &span, 0, 1, 0);
+        strcpy(new_elt->date, last_date ? last_date : "");
+        free(last_date);
+    }
+    if (has_stat && file->st.st_nlink > 1 && !link) {
+        // L'index n'est qu'une optimisation : l'entrée reste valable
+        (void)log_index_add_inode(inodes, new_elt);
+    }
+
+    new_elt->next = NULL;
+    new_elt->prev = logs->tail;
+    if (logs->tail) {
+        logs->tail->next = new_elt;
+    }
+    else {
+        logs->head = new_elt;
+    }
+    logs->tail = new_elt;
+    return 0;
+}
+
+// Construit la liste de log des fichiers de la source, chemins préfixés par le nom de la sauvegarde
+log_t build_source_log(const char *source_dir, const char *backup_name, log_t *previous) {
+    log_t logs = { .head = NULL, .tail = NULL };
+
+    // Liste chaînée de tous les fichiers contenus dans la source
+    file_list_t tablist = { .head = NULL, .tail = NULL };
+    stats_span_t span;
+    stats_begin(STATS_WALK, &span);
+    list_files(source_dir, &tablist, 1);
+    uint64_t file_count = 0;
+    for (file_element *elt = tablist.head; elt != NULL; elt = elt->next) {
+        file_count++;
+    }
+    stats_end(STATS_WALK, &span, 0, file_count, 0);
+
+    // Les fichiers sont relevés par lots : les petits sont lus en entier par un seul passage de l'ingestion
+    ingest_t *ingest = ingest_create();
+    ingest_file_t files[INGEST_BATCH];
+    // Fichiers à plusieurs liens physiques déjà relevés, par inode
+    log_index_t inodes;
+    log_index_init(&inodes, 0);
+    // Fichiers de la sauvegarde précédente, par inode : un fichier renommé ou déplacé y est retrouvé
+    log_index_t previous_inodes;
+    log_index_init(&previous_inodes, 0);
+    for (log_element *old = previous ? previous->head : NULL; old != NULL; old = old->next) {
+        if (old->ino != 0 && old->size >= 0 && old->md5[0] != '\0') {
+            log_index_add_inode(&previous_inodes, old);
+        }
+    }
+    file_element *temporary = tablist.head;
+    int failed = 0;
+    while (temporary != NULL && !failed) {
+        int count = 0;
+        for (file_element *elt = temporary; elt != NULL && count < INGEST_BATCH; elt = elt->next) {
+            files[count++].path = elt->path;
+        }
+        stats_begin(STATS_STAT, &span);
+        ingest_batch(ingest, files, count);
+        uint64_t ingested = 0, ingested_bytes = 0;
+        for (int i = 0; i < count; i++) {
+            ingested += files[i].complete;
+            ingested_bytes += files[i].complete ? files[i].length : 0;
+        }
+        // Les fichiers incomplets sont comptés par leur propre stat
+        stats_end(STATS_STAT, &span, ingested_bytes, ingested, 0);
+
+        // Pour chaque fichier du lot, on liste ses caractéristiques
+        for (int i = 0; i < count && !failed; i++) {
+            failed = add_log_entry(&logs, source_dir, backup_name, &files[i], &inodes, &previous_inodes) != 0;
+            temporary = temporary->next;
+        }
+    }
+    log_index_free(&inodes);
+    log_index_free(&previous_inodes);
+    ingest_free(ingest);
+
+    free_file_list(&tablist);
+    return logs;
+}
+
+// Cherche dans un log l'entrée d'un fichier, indépendamment du nom de sauvegarde qui la préfixe
+log_element *find_log_entry(log_t *logs, const char *relative_path) {
+    for (log_element *elt = logs->head; elt != NULL; elt = elt->next) {
+        char *elt_path = cut_after_first_slash(elt->path);
+        int found = elt_path && strcmp(elt_path, relative_path) == 0;
+        free(elt_path);
+        if (found) {
+            return elt;
+        }
+    }
+    return NULL;
+}
+
+// Reprend l'entrée de la sauvegarde précédente si le contenu du fichier n'a pas changé
+int reuse_previous_entry(log_element *elt, log_t *previous) {
+    char *relative_path = cut_after_first_slash(elt->path);
+    log_element *old = relative_path ? find_log_entry(previous, relative_path) : NULL;
+    free(relative_path);
+    if (!old || strcmp((char*)old->md5, (char*)elt->md5) != 0) {
+        return 0;
+    }
+
+    char *old_path = strdup(old->path);
+    if (!old_path) {
+        return 0;
+    }
+    // Un fichier conservé dans l'ancien log n'a pas d'objet sauvegardé : son contenu suit la référence
+    if (old->content && !elt->content && set_log_content(elt, old->content, old->content_size, 1) != 0) {
+        free(old_path);
+        return 0;
+    }
+    // Un doublon garde le fichier sauvegardé qu'il désigne
+    char *old_object = old->object && !elt->content ? strdup(old->object) : NULL;
+    if (old->object && !elt->content && !old_object) {
+        free(old_path);
+        return 0;
+    }
+    free(elt->object);
+    elt->object = old_object;
+    free(elt->path);
+    elt->path = old_path;
+    strcpy(elt->date, old->date);
+    return 1;
+}
+
+// Fichiers à sauvegarder : regroupés par lots pour l'ingestion, les doublons de contenu devenant des références
+typedef struct {
+    ingest_t *ingest;
+    log_element *pending[INGEST_BATCH];
+    int pending_count;
+    const char *source_dir;
+    char *full_backup_path;
+    pack_store_t *store;
+    checkpoint_t *checkpoint;
+    log_index_t stored;         // Entrées dont le fichier est sauvegardé, par contenu
+    log_index_t queued;         // Contenus en attente dans pending
+    log_element **duplicates;   // Doublons d'un contenu en attente, traités une fois celui-ci sauvegardé
+    size_t duplicate_count;
+    size_t duplicate_capacity;
+} backup_queue_t;
+
+static void backup_queue_init(backup_queue_t *queue, const char *source_dir, char *full_backup_path,
+                             pack_store_t *store, checkpoint_t *checkpoint) {
+    memset(queue, 0, sizeof(*queue));
+    queue->ingest = ingest_create();
+    queue->source_dir = source_dir;
+    queue->full_backup_path = full_backup_path;
+    queue->store = store;
+    queue->checkpoint = checkpoint;
+    // Sans index, chaque fichier est simplement sauvegardé
+    log_index_init(&queue->stored, 0);
+    log_index_init(&queue->queued, 0);
+}
+
+// Sauvegarde le lot en attente : les petits fichiers sont lus ensemble par l'ingestion, chaque fichier
+// sauvegardé est ensuite inscrit dans le fichier de reprise et devient la référence de son contenu
+static void backup_queue_flush(backup_queue_t *queue) {
+    ingest_file_t files[INGEST_BATCH];
+    char *relative_paths[INGEST_BATCH];
+    log_element **pending = queue->pending;
+    int ingested = 0;
+    for (int i = 0; i < queue->pending_count; i++) {
+        relative_paths[i] = cut_after_first_slash(pending[i]->path);
+        char *source_path = relative_paths[i] ? build_full_path(queue->source_dir, relative_paths[i]) : NULL;
+        if (source_path) {
+            files[ingested].path = source_path;
+            pending[ingested] = pending[i];
+            relative_paths[ingested] = relative_paths[i];
+            ingested++;
+        }
+        else {
+            free(relative_paths[i]);
+        }
+    }
+    queue->pending_count = 0;
+    ingest_batch(queue->ingest, files, ingested);
+
+    for (int i = 0; i < ingested; i++) {
+        if (backup_ingested_file(relative_paths[i], queue->source_dir, queue->full_backup_path, queue->store,
+                                 &files[i]) == 0) {
+            checkpoint_add(queue->checkpoint, pending[i]);
+            log_index_add_digest(&queue->stored, pending[i]);
+        }
+        free(relative_paths[i]);
+        free((char*)files[i].path);
+    }
+}
+
+// Fait d'une entrée la référence d'un fichier sauvegardé de même contenu ; -1 si aucun ne convient
+static int backup_queue_reference(backup_queue_t *queue, log_element *elt) {
+    log_element *same = log_index_find_digest(&queue->stored, elt->size, elt->md5);
+    if (!same || same == elt) {
+        return -1;
+    }
+    char *object = strdup(log_object_path(same));
+    if (!object) {
+        return -1;
+    }
+    free(elt->object);
+    elt->object = object;
+    stats_count(STATS_INDEX, 0, 1, 0, 1);
+    printf("|%s  =>  Duplicate of %s\n", elt->path, object);
+    return 0;
+}
+
+static void backup_queue_push(backup_queue_t *queue, log_element *elt) {
+    queue->pending[queue->pending_count++] = elt;
+    if (queue->pending_count == INGEST_BATCH) {
+        backup_queue_flush(queue);
+    }
+}
+
+// Ajoute un fichier à sauvegarder : un contenu déjà sauvegardé ou déjà en attente n'est pas relu
+static void backup_queue_add(backup_queue_t *queue, log_element *elt) {
+    if (backup_queue_reference(queue, elt) == 0) {
+        return;
+    }
+    if (elt->size >= 0 && log_index_find_digest(&queue->queued, elt->size, elt->md5)) {
+        if (queue->duplicate_count == queue->duplicate_capacity) {
+            size_t capacity = queue->duplicate_capacity ? queue->duplicate_capacity * 2 : 64;
+            log_element **grown = realloc(queue->duplicates, capacity * sizeof(log_element*));
+            if (grown) {
+                queue->duplicates = grown;
+                queue->duplicate_capacity = capacity;
+            }
+        }
+        if (queue->duplicate_count < queue->duplicate_capacity) {
+            queue->duplicates[queue->duplicate_count++] = elt;
+            return;
+        }
+    }
+    log_index_add_digest(&queue->queued, elt);
+    backup_queue_push(queue, elt);
+}
+
+// Sauvegarde ce qui reste en attente puis les doublons, dont le fichier de référence a pu échouer
+static void backup_queue_finish(backup_queue_t *queue) {
+    backup_queue_flush(queue);
+    for (size_t i = 0; i < queue->duplicate_count; i++) {
+        if (backup_queue_reference(queue, queue->duplicates[i]) != 0) {
+            backup_queue_push(queue, queue->duplicates[i]);
+        }
+    }
+    backup_queue_flush(queue);
+    free(queue->duplicates);
+    log_index_free(&queue->stored);
+    log_index_free(&queue->queued);
+    ingest_free(queue->ingest);
+}
+
 // Fonction pour créer une nouvelle sauvegarde complète puis incrémentale
-void create_backup(const char *source_dir, const char *backup_dir) {
+void create_backup(const char *source_dir, const char *backup_dir, const backup_options_t *options) {
     char backup_name[128];
     //char log_file_path[1024];
     //char full_backup_path[1024];
@@ -65,133 +396,107 @@ void create_backup(const char *source_dir, const char *backup_dir) {
         return;
     }
 
-    // Générer le nom de la sauvegarde avec la date et l'heure actuelle
+    // Le fichier de reprise est créé dans le répertoire : le tester vide avant de l'ouvrir
+    int empty_repository = is_directory_empty(backup_dir_copy) == 1;
+
+    // Générer le nom de la sauvegarde avec la date et l'heure actuelle, sauf si une sauvegarde interrompue est reprise
     generate_backup_name(backup_name, sizeof(backup_name));
+    checkpoint_t checkpoint;
+    int resumed = checkpoint_open(&checkpoint, backup_dir_copy, backup_name, sizeof(backup_name));
+    if (resumed == -1) {
+        free(source_dir_copy);
+        free(backup_dir_copy);
+        return;
+    }
+    if (resumed) {
+        printf("|Reprise de la sauvegarde interrompue %s\n", backup_name);
+    }
 
     // Créer le nom du chemin complet
 
     char *full_backup_path = build_full_path(backup_dir_copy, backup_name);
-    if (!full_backup_path) {
+    char *backup_log_path = build_full_path(backup_dir_copy, ".backup_log");
+    if (!full_backup_path || !backup_log_path) {
         perror("Failed to build full path for backup");
+        checkpoint_close(&checkpoint, 0);
+        free(full_backup_path);
+        free(backup_log_path);
         free(source_dir_copy);
         free(backup_dir_copy);
         return;
     }
 
-    // Vérifier s'il existe une sauvegarde précédente
-    if (is_directory_empty(backup_dir_copy) == 1) {
-
-        // Créer un répertoire pour la nouvelle sauvegarde
-        if (mkdir(full_backup_path, 0755) == -1) {
-            perror("Erreur lors de la création du répertoire de sauvegarde");
+    // Vérifier s'il existe une sauvegarde précédente (la reprise a déjà laissé des fichiers dans le répertoire)
+    int first_backup = resumed ? access(backup_log_path, F_OK) != 0 : empty_repository;
+
+    // La disposition en fichiers pack est choisie à la première sauvegarde puis conservée
+    pack_store_t *store = NULL;
+    if ((first_backup && options && options->pack) || is_pack_repository(backup_dir_copy)) {
+        store = pack_store_open(backup_dir_copy, 0);
+        if (!store) {
+            checkpoint_close(&checkpoint, 0);
+            free(full_backup_path);
+            free(backup_log_path);
             free(source_dir_copy);
             free(backup_dir_copy);
             return;
         }
+    }
+    checkpoint.store = store;
 
-        // Liste chaînée de tous les fichiers contenus dans la source
-        file_list_t tablist = { .head = NULL, .tail = NULL };
-        list_files(source_dir_copy, &tablist, 1);
-        file_element *temporary = tablist.head;
+    char *full_backup_log_path = build_full_path(full_backup_path, ".backup_log");
 
-        // Liste de log représentant le contenu du fichier backup_log
-        log_t tablog = { .head = NULL, .tail = NULL };
+    // .backup_log précédent : ses fichiers inchangés, même renommés, ne sont pas relus, et ses fichiers
+    // sauvegardés servent aussi de référence aux doublons
+    log_t backup_log = { .head = NULL, .tail = NULL };
+    if (!first_backup) {
+        backup_log = read_backup_log(backup_log_path);
+    }
 
-        FILE *log_file = NULL;
-        // Créer le fichier .backup_log
+    // Liste de log représentant le contenu du nouveau fichier backup_log
+    log_t save_log = build_source_log(source_dir_copy, backup_name, &backup_log);
+    int completed = 1;
+    // Fichiers à sauvegarder, en attente d'un lot complet de l'ingestion
+    backup_queue_t queue;
+    backup_queue_init(&queue, source_dir_copy, full_backup_path, store, &checkpoint);
 
-        char *log_file_path = build_full_path(backup_dir_copy, ".backup_log");
-        log_file = fopen(log_file_path, "w");
-        if (!log_file) {
-            perror("Erreur lors de la création du fichier .backup_log");
+    if (first_backup) {
+
+        // Créer un répertoire pour la nouvelle sauvegarde (déjà présent en cas de reprise)
+        if (mkdir(full_backup_path, 0755) == -1 && !(resumed && errno == EEXIST)) {
+            perror("Erreur lors de la création du répertoire de sauvegarde");
+            backup_queue_finish(&queue);
+            free_log_list(&save_log);
+            free(backup_log_path);
+            free(full_backup_log_path);
+            checkpoint_close(&checkpoint, 0);
+            pack_store_close(store);
+            free(full_backup_path);
             free(source_dir_copy);
             free(backup_dir_copy);
             return;
         }
-        // Élément de la liste chaînée de fichiers
 
-        // Pour chaque fichier dans tablist, on liste ses caractéristiques
-        while (temporary != NULL) {
-            // new_elt est une ligne du fichier backup.log
-            log_element *new_elt = malloc(sizeof(log_element));
-            if (!new_elt) {
-                perror("Memory allocation failed");
-                free(source_dir_copy);
-                free(backup_dir_copy);
-                return;
-            }
-            char *file_dest_path = remove_source_dir(source_dir_copy, temporary->path);
-            unsigned char md5_hex[MD5_DIGEST_LENGTH  *2 + 1] = { 0 };
-            get_md5(temporary->path, md5_hex);
-            char *log_element_path = build_full_path(backup_name, file_dest_path);
-
-
-            new_elt->path = log_element_path;
-            if (!new_elt->path) {
-                perror("Failed to build full path for backup");
-                free(new_elt);
-                free(file_dest_path);
-                free(source_dir_copy);
-                free(backup_dir_copy);
-                return;
+        // Sauvegarder chaque fichier de la source, par lots de l'ingestion
+        for (log_element *elt = save_log.head; elt != NULL; elt = elt->next) {
+            // Un petit fichier conservé dans le log n'a rien à écrire
+            if (elt->content) {
+                continue;
             }
-            char *last_date = get_last_modification_date(temporary->path);
-            strcpy(new_elt->date, last_date);
-            strcpy((char*)new_elt->md5, (char*)md5_hex);
-            new_elt->next = NULL;
-            new_elt->prev = tablog.tail;
-
-            if (tablog.tail) {
-                tablog.tail->next = new_elt;
-            }
-            else {
-                tablog.head = new_elt;
+            if (checkpoint_is_done(&checkpoint, elt)) {
+                log_index_add_digest(&queue.stored, elt);
+                continue;
             }
-            tablog.tail = new_elt;
-
-            backup_file(file_dest_path, source_dir_copy, full_backup_path);
-
-            temporary = temporary->next;
-            free(file_dest_path);
-            free(last_date);
+            backup_queue_add(&queue, elt);
         }
-
-
-
-        // Pointeur sur la liste tablog, pour tout écrire dans backup.log
-        log_element *search_elt = tablog.head;
-        while (search_elt != NULL) {
-
-            //fprintf(log_file, "%s,%s,%s\n", search_elt->path, search_elt->date, search_elt->md5);
-
-            write_log_element(search_elt, log_file);
-            search_elt = search_elt->next;
-        }
-        fclose(log_file);
-        char *full_backup_log_path = build_full_path(full_backup_path, ".backup_log");
-        if (copy_file(log_file_path, full_backup_log_path) != 0) {
-            printf("Le fichier des logs n'a pas été dupliquer");
-        };
-        free(log_file_path);
-        free(full_backup_log_path);
-
-
-        free_log_list(&tablog);
-        free_file_list(&tablist);
     }
     else {
-        char *backup_log_path = build_full_path(backup_dir_copy, ".backup_log");
         char *last_backup_directory = get_latest_backup_dir(backup_dir_copy);
-
-
-        log_t backup_log = read_backup_log(backup_log_path);
-
-
-        log_t save_log = { .head = NULL, .tail = NULL };
-
-        file_list_t tablist = { .head = NULL, .tail = NULL };
-        list_files(source_dir_copy, &tablist, 1);
-        file_element *temporary = tablist.head;
+        for (log_element *old = backup_log.head; old != NULL; old = old->next) {
+            if (!old->content) {
+                log_index_add_digest(&queue.stored, old);
+            }
+        }
 
         char *last_backup_directory_path = build_full_path(last_backup_directory, ".backup_log");
         char *last_backup_directory_full_path = build_full_path(backup_dir_copy, last_backup_directory_path);
@@ -200,175 +505,192 @@ void create_backup(const char *source_dir, const char *backup_dir) {
             printf("Le fichier des logs n'a pas été copier");
         };
 
-        FILE *log_file = NULL;
-        // Créer le fichier .backup_log
-        log_file = fopen(backup_log_path, "w");
-        if (!log_file) {
-            perror("Erreur lors de la création du fichier .backup_log");
-            free(source_dir_copy);
-            free(backup_dir_copy);
-            return;
-        }
-
-        while (temporary != NULL) {
-            log_element *new_elt = malloc(sizeof(log_element));
-            if (!new_elt) {
-                perror("Memory allocation failed");
-                free(source_dir_copy);
-                free(backup_dir_copy);
-                return;
-            }
-            char *file_dest_path = remove_source_dir(source_dir_copy, temporary->path);
-            unsigned char md5_hex[MD5_DIGEST_LENGTH  *2 + 1] = { 0 };
-            get_md5(temporary->path, md5_hex);
-            char *log_element_path = build_full_path(backup_name, file_dest_path);
-
-
-            new_elt->path = log_element_path;
-            if (!new_elt->path) {
-                perror("Failed to build full path for backup");
-                free(new_elt);
-                free(file_dest_path);
-                free(source_dir_copy);
-                free(backup_dir_copy);
-                return;
-            }
-            char *last_date = get_last_modification_date(temporary->path);
-            strcpy(new_elt->date, last_date);
-
-            strcpy((char*)new_elt->md5, (char*)md5_hex);
-
-            new_elt->next = NULL;
-            new_elt->prev = save_log.tail;
+        int new_save = 0;
 
-            if (save_log.tail) {
-                save_log.tail->next = new_elt;
+        for (log_element *elt_save_log = save_log.head; elt_save_log != NULL; elt_save_log = elt_save_log->next) {
+            // Un fichier inchangé depuis la sauvegarde précédente garde sa référence
+            if (reuse_previous_entry(elt_save_log, &backup_log)) {
+                continue;
             }
-            else {
-                save_log.head = new_elt;
+            if (checkpoint_is_done(&checkpoint, elt_save_log)) {
+                log_index_add_digest(&queue.stored, elt_save_log);
+                continue;
             }
-            save_log.tail = new_elt;
-            temporary = temporary->next;
-            free(file_dest_path);
-            free(last_date);
-        }
 
-        log_element *elt_save_log = save_log.head;
-
-        int new_save = 0;
-
-        while (elt_save_log != NULL) {
-            char *file_source_path = cut_after_first_slash(elt_save_log->path);
-            log_element *elt_backup_log = backup_log.head;
-            int find_equivalent = 0;
-            while (elt_backup_log != NULL && find_equivalent == 0) {
-                char *file_backup_path = cut_after_first_slash(elt_backup_log->path);
-                if (strcmp(file_source_path, file_backup_path) == 0) {
-                    find_equivalent = 1;
-                    if (strcmp((char*)elt_backup_log->md5, (char*)elt_save_log->md5) != 0) {
-                        if (new_save == 0) {
-                            if (mkdir(full_backup_path, 0755) == -1) {
-                                perror("Erreur lors de la création du répertoire de sauvegarde");
-                                free(source_dir_copy);
-                                free(backup_dir_copy);
-                                return;
-                            }
-                            new_save = 1;
-                        }
-                        backup_file(file_source_path, source_dir_copy, full_backup_path);
-                    }
-                    else {
-                        free(elt_save_log->path);
-                        elt_save_log->path = strdup(elt_backup_log->path);
-                        strcpy((char*)elt_save_log->md5, (char*)elt_backup_log->md5);
-                        strcpy(elt_save_log->date, elt_backup_log->date);
-                    }
+            if (new_save == 0) {
+                if (mkdir(full_backup_path, 0755) == -1 && !(resumed && errno == EEXIST)) {
+                    perror("Erreur lors de la création du répertoire de sauvegarde");
+                    completed = 0;
+                    break;
                 }
-
-                elt_backup_log = elt_backup_log->next;
-                free(file_backup_path);
+                new_save = 1;
             }
-
-            if (find_equivalent == 0) {
-                if (new_save == 0) {
-                    if (mkdir(full_backup_path, 0755) == -1) {
-                        perror("Erreur lors de la création du répertoire de sauvegarde");
-                        free(source_dir_copy);
-                        free(backup_dir_copy);
-                        return;
-                    }
-                    new_save = 1;
-                }
-                backup_file(file_source_path, source_dir_copy, full_backup_path);
+            // Un petit fichier conservé dans le log n'a rien à écrire, mais la sauvegarde qui le contient existe
+            if (elt_save_log->content) {
+                continue;
             }
-            free(file_source_path);
-            elt_save_log = elt_save_log->next;
+            backup_queue_add(&queue, elt_save_log);
         }
 
-        log_element *search_elt = save_log.head;
-        while (search_elt != NULL) {
-            write_log_element(search_elt, log_file);
-            search_elt = search_elt->next;
-        }
+        free(last_backup_directory);
+        free(last_backup_directory_path);
+        free(last_backup_directory_full_path);
+    }
 
-        fclose(log_file);
+    // Les doublons désignent des entrées du log précédent : il est libéré après eux
+    backup_queue_finish(&queue);
+    free_log_list(&backup_log);
+
+    // Les données sont sur le disque avant que le .backup_log ne les désigne
+    if (completed && checkpoint_commit(&checkpoint) != 0) {
+        completed = 0;
+    }
 
-        char *full_backup_log_path = build_full_path(full_backup_path, ".backup_log");
+    // Écrire le fichier .backup_log puis le copier dans le répertoire de la sauvegarde
+    if (completed) {
+        update_backup_log(backup_log_path, &save_log);
         if (copy_file(backup_log_path, full_backup_log_path) != 0) {
             printf("Le fichier des logs n'a pas été copier");
         };
-        free(full_backup_log_path);
-        free(last_backup_directory);
-        free(backup_log_path);
-        free(last_backup_directory_path);
-        free(last_backup_directory_full_path);
-        free_log_list(&backup_log);
-        free_log_list(&save_log);
-        free_file_list(&tablist);
     }
 
+    checkpoint_close(&checkpoint, completed);
+    free(backup_log_path);
+    free(full_backup_log_path);
+    free_log_list(&save_log);
+    pack_store_close(store);
+    reset_directory_cache();
     free(full_backup_path);
     free(source_dir_copy);
     free(backup_dir_copy);
 }
 
-// Fonction permettant d'enregistrer dans un fichier le tableau de chunk dédupliqué
-void write_backup_file(const char *output_filename, Chunk **chunks, int chunk_count) {
-    FILE *file = fopen(output_filename, "w+b");
-    if (file == NULL) {
+// Destination d'un fichier sauvegardé : fichier à part ou objet ajouté au segment pack courant
+typedef struct {
+    FILE *file;
+    pack_store_t *store;
+    const char *name;   // Chemin du fichier ou clé de l'objet
+    uint64_t written;
+    int chunks;
+    writeback_t writeback;
+} backup_output_t;
+
+static int open_backup_output(backup_output_t *out, const char *name, pack_store_t *store) {
+    out->file = NULL;
+    out->store = store;
+    out->name = name;
+    out->written = 0;
+    out->chunks = 0;
+    if (store) {
+        return pack_store_begin(store);
+    }
+    out->file = fopen(name, "w+b");
+    if (out->file == NULL) {
         perror("Failed to open output file");
-        return;
+        return -1;
     }
+    writeback_start(&out->writeback, out->file);
+    return 0;
+}
 
+static int write_backup_bytes(backup_output_t *out, const void *data, size_t size) {
+    if (out->store) {
+        if (pack_store_append(out->store, data, size) != 0) {
+            fprintf(stderr, "Failed to write %s to pack\n", out->name);
+            return -1;
+        }
+    }
+    else if (fwrite(data, 1, size, out->file) != size) {
+        perror("Failed to write chunk data to file");
+        return -1;
+    }
+    return 0;
+}
+
+static int write_backup_output(backup_output_t *out, Chunk **chunks, int chunk_count) {
+    stats_span_t span;
+    stats_begin(STATS_WRITE, &span);
+    uint64_t written = 0;
     for (int i = 0; i < chunk_count; i++) {
-        unsigned char *data = (unsigned char*)chunks[i]->data;
+        const unsigned char *data = chunks[i]->data;
         size_t size = chunks[i]->size; // Utiliser la taille stockée dans le chunk
-        // Écrire la taille du chunk dans le fichier
-        if (fwrite(data, 1, size, file) != size) {
-            perror("Failed to write chunk data to file");
-            fclose(file);
-            return;
+        unsigned char record[CHUNK_SIZE];
+        if (chunks[i]->view) {
+            // Chunk projeté : le marqueur puis les données lues dans le fichier source, protégées
+            // d'une troncature pendant la sauvegarde
+            record[0] = CHUNK_TYPE_DATA;
+            if (mapped_copy(record + 1, chunks[i]->view, size - 1) != 0) {
+                fprintf(stderr, "Source file truncated during backup: %s\n", out->name);
+                return -1;
+            }
+            data = record;
         }
+        if (write_backup_bytes(out, data, size) != 0) {
+            return -1;
+        }
+        written += size;
     }
-
-    fclose(file);
+    if (out->file) {
+        writeback_advance(&out->writeback);
+        governor_write(written);
+    }
+    stats_end(STATS_WRITE, &span, written, 0, chunk_count);
+    out->written += written;
+    out->chunks += chunk_count;
+    return 0;
 }
 
+// Termine la destination : objet enregistré dans l'index du pack, ou fichier fermé
+static int close_backup_output(backup_output_t *out, int result) {
+    if (out->store) {
+        if (result == 0) {
+            result = pack_store_commit(out->store, out->name);
+        }
+    }
+    else if (out->file) {
+        writeback_finish(&out->writeback);
+    }
+    if (out->file && fclose(out->file) != 0 && result == 0) {
+        perror("Failed to write chunk data to file");
+        result = -1;
+    }
+    if (result == 0) {
+        stats_count(STATS_WRITE, 0, 1, 0, 0);
+    }
+    return result;
+}
 
-// Fonction implémentant la logique pour la sauvegarde d'un fichier
-void backup_file(const char *filename, const char *source_path, char *full_backup_path) {
-    // Deduplication from the source directory
-    char *filename_source_path = build_full_path(source_path, filename);
+// Fonction permettant d'enregistrer dans un fichier le tableau de chunk dédupliqué
+int write_backup_file(const char *output_filename, Chunk **chunks, int chunk_count) {
+    uint64_t trace_start = trace_begin();
+    backup_output_t out;
+    if (open_backup_output(&out, output_filename, NULL) != 0) {
+        return -1;
+    }
+    int result = close_backup_output(&out, write_backup_output(&out, chunks, chunk_count));
+    trace_end(trace_start, "backup", "write_backup_file", output_filename, out.written);
+    return result;
+}
 
-    if (!filename_source_path) {
-        perror("Failed to build full path for source file");
-        return;
+// Fonction permettant d'ajouter le tableau de chunk dédupliqué à la suite du segment pack courant
+int write_backup_pack(pack_store_t *store, const char *key, Chunk **chunks, int chunk_count) {
+    uint64_t trace_start = trace_begin();
+    backup_output_t out;
+    if (open_backup_output(&out, key, store) != 0) {
+        return -1;
     }
-    FILE *source_file = fopen(filename_source_path, "rb");
+    int result = close_backup_output(&out, write_backup_output(&out, chunks, chunk_count));
+    trace_end(trace_start, "backup", "write_backup_pack", key, out.written);
+    return result;
+}
+
+// Déduplique un fichier source en un tableau de chunks
+Chunk **load_deduplicated_chunks(const char *file_path, int *chunk_count) {
+    *chunk_count = 0;
+    FILE *source_file = fopen(file_path, "rb");
     if (!source_file) {
         perror("Failed to open source file");
-        free(filename_source_path);
-        return;
+        return NULL;
     }
 
     // Determine the file size to allocate sufficient memory for tab_chunk
@@ -376,51 +698,364 @@ void backup_file(const char *filename, const char *source_path, char *full_backu
     size_t file_size = ftell(source_file);
     rewind(source_file);
 
-    // Calculate the number of chunks
-    size_t num_chunks = (file_size + 4095) / 4096; // Round up to the nearest chunk
+    // Calculate the number of chunks (CHUNK_SIZE - 1 data bytes per chunk)
+    size_t num_chunks = (file_size + CHUNK_SIZE - 2) / (CHUNK_SIZE - 1); // Round up to the nearest chunk
     // Allocate memory for tab_chunk
-    Chunk **tab_chunk = malloc(num_chunks  *sizeof(Chunk));
+    Chunk **tab_chunk = malloc((num_chunks + 1)  *sizeof(Chunk*));
     if (!tab_chunk) {
         perror("Failed to allocate memory for tab_chunk");
         fclose(source_file);
-        free(filename_source_path);
-        return;
+        return NULL;
     }
 
+    // Tout le fichier est en mémoire : compté sur le budget, même au-delà de la limite
+    budget_force(file_size + (num_chunks + 1) * BACKUP_CHUNK_OVERHEAD);
+    stats_span_t span;
+    stats_begin(STATS_CHUNK, &span);
     Md5Entry *hash_table[HASH_TABLE_SIZE];
     init_hash_table(hash_table);
-    deduplicate_file(source_file, tab_chunk, hash_table);
+    *chunk_count = deduplicate_file(source_file, tab_chunk, hash_table);
+    clean_hash_table(hash_table);
+    fclose(source_file);
+    stats_end(STATS_CHUNK, &span, file_size, 1, *chunk_count);
+    budget_release(file_size + (num_chunks + 1) * BACKUP_CHUNK_OVERHEAD);
+    return tab_chunk;
+}
+
+// Libère un tableau de chunks et leurs données
+void free_chunks(Chunk **chunks, int chunk_count) {
+    if (!chunks) {
+        return;
+    }
+    for (int i = 0; i < chunk_count; i++) {
+        if (chunks[i]) {
+            free(chunks[i]->data);
+            free(chunks[i]);
+        }
+    }
+    free(chunks);
+}
+
+int reserve_chunk_batch(void) {
+    uint64_t bytes = budget_reserve_up_to((uint64_t)BACKUP_BATCH_CHUNKS * BACKUP_CHUNK_BYTES,
+                                          (uint64_t)BACKUP_MIN_BATCH_CHUNKS * BACKUP_CHUNK_BYTES);
+    return bytes / BACKUP_CHUNK_BYTES;
+}
+
+void release_chunk_batch(int batch) {
+    budget_release((uint64_t)batch * BACKUP_CHUNK_BYTES);
+}
 
-    // Copy the saved file to the backup directory using the chunk array
+// Fonction implémentant la logique pour la sauvegarde d'un fichier : le fichier est dédupliqué
+// par lots écrits au fur et à mesure, seul un lot de chunks est en mémoire
+int backup_ingested_file(const char *filename, const char *source_path, char *full_backup_path, pack_store_t *store,
+                         const ingest_file_t *content) {
+    uint64_t trace_start = trace_begin();
+    int in_memory = content && content->complete;
+    // Deduplication from the source directory
+    char *filename_source_path = build_full_path(source_path, filename);
     char *backup_path = build_full_path(full_backup_path, filename);
-    if (!backup_path) {
+    if (!filename_source_path || !backup_path) {
         perror("Failed to build full path for backup file");
-        free(tab_chunk);
-        clean_hash_table(hash_table);
-        fclose(source_file);
         free(filename_source_path);
-        return;
+        free(backup_path);
+        return -1;
+    }
+    FILE *source_file = NULL;
+    if (!in_memory) {
+        source_file = fopen(filename_source_path, "rb");
+        if (!source_file) {
+            perror("Failed to open source file");
+            free(filename_source_path);
+            free(backup_path);
+            return -1;
+        }
+        governor_op();
+    }
+
+    // En disposition pack, l'objet est référencé par son chemin relatif au répertoire de sauvegarde
+    char *key = store ? remove_source_dir(store->repository, backup_path) : NULL;
+    if (!store) {
+        // Create intermediate directories if they do not exist
+        create_intermediate_directories(backup_path);
     }
+    backup_output_t out;
+    int result = open_backup_output(&out, store ? key : backup_path, store);
 
-    // Create intermediate directories if they do not exist
-    create_intermediate_directories(backup_path);
-    write_backup_file(backup_path, tab_chunk, num_chunks);
+    int batch = reserve_chunk_batch();
+    Chunk **chunks = malloc(batch * sizeof(Chunk*));
+    Md5Entry *hash_table[HASH_TABLE_SIZE];
+    init_hash_table(hash_table);
+    dedup_state_t state;
+    if (in_memory) {
+        dedup_init_buffer(&state, content->data, content->length, hash_table);
+    }
+    else {
+        dedup_init(&state, source_file, hash_table);
+        dedup_map(&state);
+    }
+    if (!chunks) {
+        perror("Memory allocation failed");
+        result = -1;
+    }
+    while (result == 0) {
+        stats_span_t span;
+        stats_begin(STATS_CHUNK, &span);
+        off_t batch_start = state.offset;
+        int chunk_count = dedup_next(&state, chunks, batch);
+        stats_end(STATS_CHUNK, &span, state.offset - batch_start, 0, chunk_count);
+        if (chunk_count == 0) {
+            break;
+        }
+        result = write_backup_output(&out, chunks, chunk_count);
+        for (int i = 0; i < chunk_count; i++) {
+            free(chunks[i]->data);
+            free(chunks[i]);
+        }
+    }
+    stats_count(STATS_CHUNK, 0, 1, 0, 0);
+    result = close_backup_output(&out, result);
 
-    printf("|%s  =>  Saved\n", filename_source_path);
+    clean_hash_table(hash_table);
+    free(chunks);
+    release_chunk_batch(batch);
+    dedup_finish(&state);
+    if (source_file) {
+        fclose(source_file);
+    }
+    if (result == 0) {
+        printf("|%s  =>  Saved\n", filename_source_path);
+    }
+    trace_end(trace_start, "backup", "backup_file", filename_source_path, out.written);
     // Free allocated memory
+    free(key);
     free(filename_source_path);
     free(backup_path);
-    for (size_t i = 0; i < num_chunks; i++) {
-        free(tab_chunk[i]->data);
-        free(tab_chunk[i]);
+    return result;
+}
+
+int backup_file(const char *filename, const char *source_path, char *full_backup_path, pack_store_t *store) {
+    return backup_ingested_file(filename, source_path, full_backup_path, store, NULL);
+}
+
+// Emplacement des données d'un chunk que les références peuvent désigner
+typedef struct {
+    int index;      // Index du chunk dans le fichier
+    int fd;         // Fichier sauvegardé ou segment pack contenant les données, -1 si le chunk manque
+    int pack;       // Numéro du segment pour un chunk du dépôt, -1 sinon
+    off_t offset;
+    size_t length;
+} restore_range_t;
+
+// Recopie une plage de données à la position courante du fichier restauré. Un chunk du dépôt
+// passe par le cache : partagé entre fichiers ou sauvegardes, il n'est lu qu'une fois
+static int copy_restore_range(const restore_range_t *range, chunk_cache_t *cache, FILE *output) {
+    unsigned char buffer[CHUNK_SIZE];
+    size_t done = 0;
+    if (cache && range->pack >= 0 && range->length <= sizeof(buffer)) {
+        size_t cached_length;
+        const void *cached = chunk_cache_get(cache, range->pack, range->offset, &cached_length);
+        if (cached) {
+            if (fwrite(cached, 1, cached_length, output) != cached_length) {
+                perror("Failed to write chunk data");
+                return -1;
+            }
+            return 0;
+        }
+        while (done < range->length) {
+            ssize_t n = pread(range->fd, buffer + done, range->length - done, range->offset + done);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                perror("Failed to read chunk data");
+                return -1;
+            }
+            done += n;
+        }
+        governor_read(done);
+        chunk_cache_put(cache, range->pack, range->offset, buffer, range->length);
+        if (fwrite(buffer, 1, range->length, output) != range->length) {
+            perror("Failed to write chunk data");
+            return -1;
+        }
+        return 0;
     }
-    free(tab_chunk);
-    clean_hash_table(hash_table);
-    fclose(source_file);
+    while (done < range->length) {
+        size_t want = range->length - done < sizeof(buffer) ? range->length - done : sizeof(buffer);
+        ssize_t n = pread(range->fd, buffer, want, range->offset + done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            perror("Failed to read chunk data");
+            return -1;
+        }
+        governor_read(n);
+        if (fwrite(buffer, 1, n, output) != (size_t)n) {
+            perror("Failed to write chunk data");
+            return -1;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+// Cherche par dichotomie la plage d'un chunk référencé (les plages sont rangées par index croissant)
+static const restore_range_t *find_restore_range(const restore_range_t *ranges, int count, int index) {
+    int low = 0;
+    int high = count - 1;
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        if (ranges[middle].index == index) {
+            return ranges[middle].fd >= 0 ? &ranges[middle] : NULL;
+        }
+        if (ranges[middle].index < index) {
+            low = middle + 1;
+        }
+        else {
+            high = middle - 1;
+        }
+    }
+    return NULL;
+}
+
+// Restaure les length octets d'enregistrements lus dans source vers output. Seules les plages des
+// HASH_TABLE_SIZE premiers chunks de données sont gardées : la table de hachage de la déduplication
+// n'a pas pu en référencer d'autres, la mémoire utilisée ne dépend donc pas de la taille du fichier
+static int restore_records(FILE *source, uint64_t length, pack_store_t *store, chunk_cache_t *cache,
+                           FILE *output, writeback_t *writeback, uint64_t *restored, int *chunk_count) {
+    restore_range_t ranges[HASH_TABLE_SIZE];
+    int range_count = 0;
+    int chunk_index = 0;
+    uint64_t pos = 0;
+    uint64_t total = 0;
+    int result = 0;
+    unsigned char buffer[CHUNK_SIZE];
+
+    while (pos < length && result == 0) {
+        int marker = fgetc(source);
+        if (marker == EOF) {
+            break;
+        }
+        uint64_t record_start = pos;
+        uint64_t total_before = total;
+        pos++;
+        uint64_t left = length - pos;
+        restore_range_t range = { .index = chunk_index, .fd = -1, .pack = -1, .offset = 0, .length = 0 };
+
+        if (marker == CHUNK_TYPE_DATA) {  // Chunk normal
+            size_t want = left < CHUNK_SIZE - 1 ? left : CHUNK_SIZE - 1;
+            range.fd = fileno(source);
+            range.offset = ftello(source);
+            range.length = fread(buffer, 1, want, source);
+            pos += range.length;
+            if (fwrite(buffer, 1, range.length, output) != range.length) {
+                perror("Failed to write chunk data");
+                result = -1;
+            }
+            total += range.length;
+        }
+        else if (marker == CHUNK_TYPE_ZERO) {  // Plage de zéros : avancer sans écrire pour recréer un trou
+            uint64_t zero_length;
+            if (left < sizeof(uint64_t) || fread(&zero_length, 1, sizeof(uint64_t), source) != sizeof(uint64_t)) {
+                fprintf(stderr, "Not enough bytes read for zero run length\n");
+                break;
+            }
+            pos += sizeof(uint64_t);
+            if (fseeko(output, zero_length, SEEK_CUR) != 0) {
+                perror("Failed to seek over zero run");
+                result = -1;
+            }
+            total += zero_length;
+        }
+        else if (marker == CHUNK_TYPE_DIGEST) {  // Chunk stocké dans le dépôt pack
+            char key[MD5_DIGEST_LENGTH * 2 + 1];
+            pack_ref_t ref;
+            if (left < MD5_DIGEST_LENGTH * 2 || fread(key, 1, MD5_DIGEST_LENGTH * 2, source) != MD5_DIGEST_LENGTH * 2) {
+                fprintf(stderr, "Not enough bytes read for chunk digest\n");
+                break;
+            }
+            pos += MD5_DIGEST_LENGTH * 2;
+            key[MD5_DIGEST_LENGTH * 2] = '\0';
+            if (store && pack_store_lookup(store, key, &ref) && (range.fd = pack_store_segment_fd(store, ref.pack)) >= 0) {
+                range.pack = ref.pack;
+                range.offset = ref.offset;
+                range.length = ref.length;
+                result = copy_restore_range(&range, cache, output);
+                total += range.length;
+            }
+            else {
+                // Chunk vide gardé à sa place pour que les références suivantes restent alignées
+                fprintf(stderr, "Missing chunk in repository: %s\n", key);
+                range.fd = -1;
+            }
+        }
+        else if (marker == CHUNK_TYPE_REFERENCE) {  // Sub_chunk
+            int ref_index;
+            size_t want = left < SUB_CHUNK_SIZE - 1 ? left : SUB_CHUNK_SIZE - 1;
+            size_t bytes_read = fread(buffer, 1, want, source);
+            pos += bytes_read;
+            if (bytes_read < sizeof(int)) {
+                fprintf(stderr, "Not enough bytes read for sub_chunk reference\n");
+                break;
+            }
+            memcpy(&ref_index, buffer, sizeof(int));
+            const restore_range_t *target = find_restore_range(ranges, range_count, ref_index);
+            if (!target) {
+                fprintf(stderr, "Invalid reference index: %d\n", ref_index);
+                continue;
+            }
+            result = copy_restore_range(target, cache, output);
+            total += target->length;
+        }
+        else {
+            fprintf(stderr, "Unknown chunk type: %d\n", marker);
+            break;
+        }
+
+        if ((marker == CHUNK_TYPE_DATA || marker == CHUNK_TYPE_DIGEST) && range_count < HASH_TABLE_SIZE) {
+            ranges[range_count++] = range;
+        }
+        chunk_index++;
+        governor_read(pos - record_start);
+        governor_write(total - total_before);
+        writeback_advance(writeback);
+    }
+
+    *restored = total;
+    *chunk_count = chunk_index;
+    return result;
+}
+
+// Restaure un petit fichier dont le contenu est conservé dans le log
+static int restore_log_content(const log_element *elt, const char *dest_path) {
+    governor_op();
+    FILE *output = fopen(dest_path, "wb");
+    if (!output) {
+        perror("Failed to open output file");
+        return -1;
+    }
+    int result = 0;
+    if (fwrite(elt->content, 1, elt->content_size, output) != elt->content_size) {
+        perror("Failed to write restored file");
+        result = -1;
+    }
+    if (fclose(output) != 0) {
+        perror("Failed to write restored file");
+        result = -1;
+    }
+    governor_write(elt->content_size);
+    stats_count(STATS_WRITE, elt->content_size, 1, 0, 0);
+    if (result == 0) {
+        printf("|%s  =>   Restored\n", dest_path);
+    }
+    return result;
 }
 
 //
 void restore_backup(const char *backup_id, const char *restore_dir) {
+    uint64_t trace_start = trace_begin();
     // Vérifier l'accessibilité du répertoire comme dans create_backup 
     char *backup_id_copy = strdup(backup_id);
     char *restore_dir_copy = strdup(restore_dir);
@@ -442,12 +1077,27 @@ void restore_backup(const char *backup_id, const char *restore_dir) {
     log_t backup_log = read_backup_log(backup_log_path);
     log_element *current = backup_log.head;
 
-    while (current) {
+    // Les chemins du log sont relatifs au répertoire parent de la sauvegarde
+    char *dir_backup = strdup(backup_id_copy);
+    char *last_slash = strrchr(dir_backup, '/');
+    if (last_slash) {
+        *last_slash = '\0';
+    }
+    else {
+        strcpy(dir_backup, ".");
+    }
+    pack_store_t *store = is_pack_repository(dir_backup) ? pack_store_open(dir_backup, 1) : NULL;
+    // Les chunks du dépôt peuvent être partagés par plusieurs fichiers restaurés
+    chunk_cache_t *cache = store ? chunk_cache_create(CHUNK_CACHE_SIZE) : NULL;
+
+    for (; current; current = current->next) {
+        uint64_t file_start = trace_begin();
         // Construire les chemins comme dans backup_file
         char *file_path = cut_after_first_slash(current->path);
-        char *dir_backup = remove_after_slash(backup_id_copy);
-        char *source_path = build_full_path(dir_backup, current->path);
+        // Un doublon est restauré depuis le fichier sauvegardé qu'il désigne
+        char *source_path = build_full_path(dir_backup, log_object_path(current));
         char *dest_path = build_full_path(restore_dir_copy, file_path);
+        free(file_path);
         if (!source_path || !dest_path) {
             free(source_path);
             free(dest_path);
@@ -457,72 +1107,134 @@ void restore_backup(const char *backup_id, const char *restore_dir) {
         // Créer les répertoires intermédiaires comme dans backup_file
         create_intermediate_directories(dest_path);
 
-        // Ouvrir le fichier source en binaire comme dans backup_file
-        FILE *source_file = fopen(source_path, "rb");
+        if (current->content) {
+            // Petit fichier conservé dans le log : écrit tel quel
+            restore_log_content(current, dest_path);
+            trace_end(file_start, "restore", "restore_file", current->path, current->content_size);
+            free(source_path);
+            free(dest_path);
+            continue;
+        }
+
+        // Ouvrir le fichier sauvegardé : objet lu directement dans son segment pack ou fichier en binaire
+        FILE *source_file = NULL;
+        uint64_t length = 0;
+        pack_ref_t ref;
+        if (store && pack_store_lookup(store, log_object_path(current), &ref)) {
+            int fd = pack_store_segment_fd(store, ref.pack);
+            int copy = fd >= 0 ? dup(fd) : -1;
+            source_file = copy >= 0 ? fdopen(copy, "rb") : NULL;
+            if (!source_file && copy >= 0) {
+                close(copy);
+            }
+            if (source_file && fseeko(source_file, ref.offset, SEEK_SET) != 0) {
+                fclose(source_file);
+                source_file = NULL;
+            }
+            length = ref.length;
+        }
+        else {
+            struct stat st;
+            source_file = fopen(source_path, "rb");
+            length = (source_file && fstat(fileno(source_file), &st) == 0) ? st.st_size : 0;
+        }
         if (!source_file) {
             perror("Failed to open source file");
             free(source_path);
             free(dest_path);
             continue;
         }
-
-        // Calculer la taille comme dans backup_file
-        fseek(source_file, 0, SEEK_END);
-        size_t file_size = ftell(source_file);
-        rewind(source_file);
-        size_t num_chunks = (size_t)ceil((double)file_size / CHUNK_SIZE);
-
-        // Allouer les chunks comme dans backup_file
-        Chunk **chunks = malloc(num_chunks  *sizeof(Chunk*));
-        if (!chunks) {
-            perror("Failed to allocate memory for chunks");
+        governor_op();
+        FILE *output = fopen(dest_path, "wb");
+        if (!output) {
+            perror("Failed to open output file");
             fclose(source_file);
             free(source_path);
             free(dest_path);
             continue;
         }
 
-        // Initialiser la table de hash comme dans backup_file
-        Md5Entry *hash_table[HASH_TABLE_SIZE];
-        init_hash_table(hash_table);
-
-        // Restaurer le fichier
+        // Restaurer le fichier enregistrement par enregistrement, sans le charger en mémoire
         int chunk_count = 0;
-        undeduplicate_file(source_file, chunks, &chunk_count);
-        write_restored_file(dest_path, chunks, chunk_count);
+        uint64_t restored = 0;
+        stats_span_t span;
+        stats_begin(STATS_READ, &span);
+        uint64_t read_start = trace_begin();
+        off_t object_start = ftello(source_file);
+        writeback_t writeback;
+        writeback_start(&writeback, output);
+        int result = restore_records(source_file, length, store, cache, output, &writeback, &restored, &chunk_count);
+        trace_end(read_start, "restore", "restore_records", current->path, restored);
+        stats_end(STATS_READ, &span, length, 1, chunk_count);
+
+        // Un trou final n'existe qu'une fois la taille du fichier fixée
+        if (fflush(output) != 0 || ftruncate(fileno(output), restored) != 0) {
+            perror("Failed to set restored file size");
+            result = -1;
+        }
+        writeback_finish(&writeback);
+        if (cache_neutral()) {
+            // L'objet sauvegardé lu n'a pas à rester dans le cache
+            posix_fadvise(fileno(source_file), object_start, length, POSIX_FADV_DONTNEED);
+        }
+        if (fclose(output) != 0) {
+            perror("Failed to write chunk data");
+            result = -1;
+        }
+        stats_count(STATS_WRITE, restored, 1, chunk_count, 0);
+        if (result == 0) {
+            printf("|%s  =>   Restored\n", dest_path);
+        }
+        trace_end(file_start, "restore", "restore_file", current->path, restored);
 
         // Nettoyage comme dans backup_file
-        for (size_t i = 0; i < num_chunks; i++) {
-            if (chunks[i]) {
-                free(chunks[i]->data);
-                free(chunks[i]);
-            }
-        }
-        free(chunks);
-        clean_hash_table(hash_table);
         fclose(source_file);
         free(source_path);
-        free(dir_backup);
         free(dest_path);
-        free(file_path);
-        current = current->next;
     }
 
+    if (cache) {
+        uint64_t lookups, hits;
+        chunk_cache_counters(cache, &lookups, &hits);
+        if (lookups > 0) {
+            printf("|%llu/%llu repository chunks read from the restore cache\n",
+                   (unsigned long long)hits, (unsigned long long)lookups);
+        }
+        stats_count(STATS_READ, 0, 0, 0, hits);
+        chunk_cache_free(cache);
+    }
+    pack_store_close(store);
+    reset_directory_cache();
+    free(dir_backup);
     // Libérer la mémoire comme dans create_backup
     free(backup_log_path);
     free_log_list(&backup_log);
+    trace_end(trace_start, "restore", "restore_backup", backup_id, 0);
     free(backup_id_copy);
     free(restore_dir_copy);
 }
 void write_restored_file(const char *output_filename, Chunk **chunks, int chunk_count) {
+    uint64_t trace_start = trace_begin();
+    stats_span_t span;
+    stats_begin(STATS_WRITE, &span);
     FILE *file = fopen(output_filename, "wb");
     if (file == NULL) {
         perror("Failed to open output file");
         return;
     }
 
+    off_t total_size = 0;
     for (int i = 0; i < chunk_count; i++) {
-        if (chunks[i] && chunks[i]->data && chunks[i]->size) {
+        if (chunks[i] && chunks[i]->data == NULL && chunks[i]->size) {
+            // Plage de zéros : avancer sans écrire pour recréer un trou
+            if (fseeko(file, chunks[i]->size, SEEK_CUR) != 0) {
+                perror("Failed to seek over zero run");
+                fclose(file);
+                return;
+            }
+            total_size += chunks[i]->size;
+        }
+        else if (chunks[i] && chunks[i]->data && chunks[i]->size) {
             // Convert size to an integer safely
             size_t size = chunks[i]->size;
             // Write chunk data to the file
@@ -531,10 +1243,18 @@ void write_restored_file(const char *output_filename, Chunk **chunks, int chunk_
                 fclose(file);
                 return;
             }
+            total_size += size;
         }
     }
 
+    // Un trou final n'existe qu'une fois la taille du fichier fixée
+    fflush(file);
+    if (ftruncate(fileno(file), total_size) != 0) {
+        perror("Failed to set restored file size");
+    }
     fclose(file);
+    stats_end(STATS_WRITE, &span, total_size, 1, chunk_count);
+    trace_end(trace_start, "restore", "write_restored_file", output_filename, total_size);
     printf("|%s  =>   Restored\n", output_filename);
 }
 
@@ -553,6 +1273,9 @@ void list_backups(const char *backup_dir) {
         if (strcmp(file_name, ".backup_log") == 0) {
             backup_file = 1;
         }
+        else if (strcmp(file_name, PACK_DIR_NAME) == 0) {
+            // Répertoire des fichiers pack, ce n'est pas une sauvegarde
+        }
         else {
             if (!is_directory_accessible(current->path)) {
                 backup_folder = 0;
@@ -570,7 +1293,7 @@ void list_backups(const char *backup_dir) {
     if (backup_file && backup_folder) {
         while (current) {
             char *file_name = remove_source_dir(backup_dir, current->path);
-            if (strcmp(file_name, ".backup_log") != 0) {
+            if (strcmp(file_name, ".backup_log") != 0 && strcmp(file_name, PACK_DIR_NAME) != 0) {
                 printf("%d# | %s\n", i, file_name);
                 i++;
             }
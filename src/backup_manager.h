@@ -3,6 +3,8 @@
 
 #include "deduplication.h"
 #include "file_handler.h"
+#include "pack_store.h"
+#include "ingest.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,6 +13,23 @@
 #include <sys/stat.h>
 #include <math.h>
 
+/** @brief Nombre de chunks d'un lot de déduplication quand le budget mémoire le permet */
+#define BACKUP_BATCH_CHUNKS 1024
+/** @brief Taille minimale d'un lot, réservée même au-delà du budget */
+#define BACKUP_MIN_BATCH_CHUNKS 16
+/** @brief Mémoire d'un chunk en plus de ses données (structure et pointeur du tableau) */
+#define BACKUP_CHUNK_OVERHEAD (sizeof(Chunk) + sizeof(Chunk*))
+/** @brief Mémoire maximale d'un chunk dans un lot */
+#define BACKUP_CHUNK_BYTES (CHUNK_SIZE + BACKUP_CHUNK_OVERHEAD)
+
+/**
+ * @brief Options de sauvegarde choisies en ligne de commande.
+ */
+typedef struct {
+    int pack; // Regrouper les fichiers sauvegardés dans des fichiers pack (première sauvegarde)
+    int compress; // Compresser les trames échangées avec un serveur distant (niveau adaptatif)
+} backup_options_t;
+
 /**
  * @brief Génère un nom de fichier de sauvegarde basé sur la date et l'heure actuelles.
  *
@@ -19,13 +38,50 @@
  */
 void generate_backup_name(char *buffer, size_t size);
 
+/**
+ * @brief Construit la liste de log (chemin, date, md5) des fichiers d'un répertoire source.
+ *
+ * Un fichier de même inode, même taille et même date exacte qu'une entrée de la sauvegarde
+ * précédente, à son chemin ou ailleurs (fichier renommé ou déplacé), reprend son MD5 sans être relu.
+ *
+ * @param source_dir Le répertoire source.
+ * @param backup_name Le nom de la sauvegarde qui préfixe chaque chemin.
+ * @param previous Le log de la sauvegarde précédente, ou NULL.
+ * @return log_t La liste de log, à libérer avec free_log_list.
+ */
+log_t build_source_log(const char *source_dir, const char *backup_name, log_t *previous);
+
+/**
+ * @brief Cherche l'entrée d'un fichier dans un log, quel que soit le nom de sauvegarde qui la préfixe.
+ *
+ * @param logs La liste de log.
+ * @param relative_path Le chemin du fichier relatif à la source.
+ * @return log_element* L'entrée trouvée ou NULL.
+ */
+log_element *find_log_entry(log_t *logs, const char *relative_path);
+
+/**
+ * @brief Reprend le chemin et la date de la sauvegarde précédente si le md5 du fichier est inchangé.
+ *
+ * @param elt L'entrée du fichier dans la nouvelle sauvegarde.
+ * @param previous Le log de la sauvegarde précédente.
+ * @return int 1 si l'entrée a été reprise (rien à sauvegarder), 0 sinon.
+ */
+int reuse_previous_entry(log_element *elt, log_t *previous);
+
 /**
  * @brief Crée un nouveau backup incrémental d'un répertoire source vers un répertoire de sauvegarde.
  *
  * @param source_dir Le chemin du répertoire source à sauvegarder.
  * @param backup_dir Le chemin du répertoire de sauvegarde où les fichiers seront copiés.
+ * @param options Les options de sauvegarde (peut être NULL). Un répertoire déjà en
+ * disposition pack la conserve quelles que soient les options.
+ *
+ * L'avancement est enregistré par points de reprise (voir checkpoint.h) : une sauvegarde
+ * interrompue est reprise sous le même nom par l'exécution suivante, sans refaire les
+ * fichiers déjà terminés.
  */
-void create_backup(const char *source_dir, const char *backup_dir);
+void create_backup(const char *source_dir, const char *backup_dir, const backup_options_t *options);
 
 /**
  * @brief Restaure une sauvegarde à partir d'un identifiant de sauvegarde vers un répertoire de restauration.
@@ -41,17 +97,80 @@ void restore_backup(const char *backup_id, const char *restore_dir);
  * @param output_filename Le nom du fichier où les chunks seront enregistrés.
  * @param chunks Un tableau de pointeurs vers les chunks à enregistrer.
  * @param chunk_count Le nombre de chunks dans le tableau.
+ * @return int 0 si succès, -1 si erreur.
+ */
+int write_backup_file(const char *output_filename, Chunk **chunks, int chunk_count);
+
+/**
+ * @brief Enregistre un tableau de chunks dédupliqués comme un objet d'un dépôt pack.
+ *
+ * @param store Le dépôt pack.
+ * @param key La référence de l'objet (chemin relatif au répertoire de sauvegarde).
+ * @param chunks Un tableau de pointeurs vers les chunks à enregistrer.
+ * @param chunk_count Le nombre de chunks dans le tableau.
+ * @return int 0 si succès, -1 si erreur.
+ */
+int write_backup_pack(pack_store_t *store, const char *key, Chunk **chunks, int chunk_count);
+
+/**
+ * @brief Déduplique un fichier source en un tableau de chunks.
+ *
+ * @param file_path Le chemin du fichier à dédupliquer.
+ * @param chunk_count Le nombre de chunks produits.
+ * @return Chunk** Le tableau de chunks, à libérer avec free_chunks, ou NULL en cas d'erreur.
+ */
+Chunk **load_deduplicated_chunks(const char *file_path, int *chunk_count);
+
+/**
+ * @brief Libère un tableau de chunks et leurs données.
+ *
+ * @param chunks Le tableau de chunks (peut être NULL).
+ * @param chunk_count Le nombre de chunks dans le tableau.
+ */
+void free_chunks(Chunk **chunks, int chunk_count);
+
+/**
+ * @brief Réserve sur le budget mémoire un lot de chunks pour dedup_next.
+ *
+ * @return int Le nombre de chunks du lot, entre BACKUP_MIN_BATCH_CHUNKS et BACKUP_BATCH_CHUNKS.
  */
-void write_backup_file(const char *output_filename, Chunk **chunks, int chunk_count);
+int reserve_chunk_batch(void);
+
+/**
+ * @brief Rend au budget mémoire un lot réservé par reserve_chunk_batch.
+ *
+ * @param batch Le nombre de chunks du lot.
+ */
+void release_chunk_batch(int batch);
 
 /**
  * @brief Effectue une sauvegarde d'un fichier dédupliqué.
  *
+ * Le fichier est lu et écrit par lots de chunks : la mémoire utilisée ne dépend pas de sa taille.
+ *
+ * @param filename Le nom du fichier à sauvegarder.
+ * @param source_path Le chemin du répertoire source contenant le fichier.
+ * @param full_backup_path Le chemin complet où le fichier de sauvegarde sera enregistré.
+ * @param store Le dépôt pack où écrire le fichier, ou NULL pour un fichier par source.
+ * @return int 0 si le fichier est sauvegardé, -1 sinon.
+ */
+int backup_file(const char *filename,const char *source_path, char *full_backup_path, pack_store_t *store);
+
+/**
+ * @brief Effectue la sauvegarde d'un fichier éventuellement déjà lu par l'ingestion par lots.
+ *
+ * Un fichier lu en entier (content->complete) est dédupliqué depuis le tampon de l'ingestion,
+ * sans être rouvert ; les autres sont sauvegardés comme par backup_file.
+ *
  * @param filename Le nom du fichier à sauvegarder.
  * @param source_path Le chemin du répertoire source contenant le fichier.
  * @param full_backup_path Le chemin complet où le fichier de sauvegarde sera enregistré.
+ * @param store Le dépôt pack où écrire le fichier, ou NULL pour un fichier par source.
+ * @param content Le fichier relevé par ingest_batch, ou NULL.
+ * @return int 0 si le fichier est sauvegardé, -1 sinon.
  */
-void backup_file(const char *filename,const char *source_path, char *full_backup_path);
+int backup_ingested_file(const char *filename, const char *source_path, char *full_backup_path, pack_store_t *store,
+                         const ingest_file_t *content);
 
 /**
  * @brief Restaure un fichier de sauvegarde en utilisant un tableau de chunks.
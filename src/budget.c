@@ -0,0 +1,86 @@
+#include "budget.h"
+#include <stdlib.h>
+#include <ctype.h>
+
+// Compteurs partagés par les threads du serveur : mis à jour atomiquement
+static uint64_t limit = 0;
+static uint64_t current = 0;
+static uint64_t peak = 0;
+
+static void update_peak(uint64_t value) {
+    uint64_t seen = __atomic_load_n(&peak, __ATOMIC_RELAXED);
+    while (value > seen && !__atomic_compare_exchange_n(&peak, &seen, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        // seen contient le nouveau pic lu
+    }
+}
+
+void budget_set_limit(uint64_t bytes) {
+    limit = bytes;
+}
+
+int budget_reserve(uint64_t bytes) {
+    uint64_t used = __atomic_load_n(&current, __ATOMIC_RELAXED);
+    do {
+        if (limit && used + bytes > limit) {
+            return -1;
+        }
+    } while (!__atomic_compare_exchange_n(&current, &used, used + bytes, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    update_peak(used + bytes);
+    return 0;
+}
+
+void budget_force(uint64_t bytes) {
+    update_peak(__atomic_add_fetch(&current, bytes, __ATOMIC_RELAXED));
+}
+
+void budget_release(uint64_t bytes) {
+    __atomic_sub_fetch(&current, bytes, __ATOMIC_RELAXED);
+}
+
+uint64_t budget_reserve_up_to(uint64_t wanted, uint64_t minimum) {
+    for (uint64_t size = wanted; size > minimum; size /= 2) {
+        if (budget_reserve(size) == 0) {
+            return size;
+        }
+    }
+    budget_force(minimum);
+    return minimum;
+}
+
+uint64_t budget_available(void) {
+    if (!limit) {
+        return UINT64_MAX;
+    }
+    uint64_t used = __atomic_load_n(&current, __ATOMIC_RELAXED);
+    return used < limit ? limit - used : 0;
+}
+
+void budget_usage(uint64_t *limit_out, uint64_t *current_out, uint64_t *peak_out) {
+    *limit_out = limit;
+    *current_out = __atomic_load_n(&current, __ATOMIC_RELAXED);
+    *peak_out = __atomic_load_n(&peak, __ATOMIC_RELAXED);
+}
+
+int parse_size(const char *text, uint64_t *bytes) {
+    char *end;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (end == text) {
+        return -1;
+    }
+    int shift = 0;
+    switch (toupper((unsigned char)*end)) {
+    case 'T': shift = 40; end++; break;
+    case 'G': shift = 30; end++; break;
+    case 'M': shift = 20; end++; break;
+    case 'K': shift = 10; end++; break;
+    default: break;
+    }
+    if (*end == 'B' || *end == 'b') {
+        end++;
+    }
+    if (*end != '\0') {
+        return -1;
+    }
+    *bytes = (uint64_t)value << shift;
+    return 0;
+}
@@ -0,0 +1,80 @@
+#ifndef BUDGET_H
+#define BUDGET_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Budget mémoire global fixé par --memory-limit.
+ *
+ * Les tampons dont la taille dépend des données (lots de chunks, empreintes d'un fichier
+ * envoyé, tampons de lecture) sont réservés sur ce budget. Quand une réservation échoue,
+ * le composant se contente de moins (lot plus petit, données déversées dans un fichier
+ * temporaire) au lieu d'épuiser la mémoire. Sans limite, les réservations réussissent
+ * toujours mais l'utilisation courante et le pic restent suivis.
+ */
+
+/**
+ * @brief Fixe la limite du budget.
+ *
+ * @param bytes La limite en octets, 0 pour aucune limite.
+ */
+void budget_set_limit(uint64_t bytes);
+
+/**
+ * @brief Réserve de la mémoire sur le budget.
+ *
+ * @param bytes La taille à réserver.
+ * @return int 0 si la réservation est faite, -1 si elle dépasserait la limite (rien n'est réservé).
+ */
+int budget_reserve(uint64_t bytes);
+
+/**
+ * @brief Réserve de la mémoire même au-delà de la limite : minimum indispensable d'un composant.
+ *
+ * @param bytes La taille à réserver.
+ */
+void budget_force(uint64_t bytes);
+
+/**
+ * @brief Rend de la mémoire réservée.
+ *
+ * @param bytes La taille à rendre.
+ */
+void budget_release(uint64_t bytes);
+
+/**
+ * @brief Réserve la plus grande taille possible entre un minimum et un maximum, en divisant par deux.
+ *
+ * @param wanted La taille souhaitée.
+ * @param minimum La taille en dessous de laquelle le composant ne fonctionne plus (réservée de force).
+ * @return uint64_t La taille réservée, entre minimum et wanted.
+ */
+uint64_t budget_reserve_up_to(uint64_t wanted, uint64_t minimum);
+
+/**
+ * @brief Indique la mémoire encore disponible.
+ *
+ * @return uint64_t Les octets disponibles, UINT64_MAX sans limite.
+ */
+uint64_t budget_available(void);
+
+/**
+ * @brief Limite, utilisation courante et pic d'utilisation du budget.
+ *
+ * @param limit La limite (0 : aucune).
+ * @param current Les octets réservés.
+ * @param peak Le maximum atteint.
+ */
+void budget_usage(uint64_t *limit, uint64_t *current, uint64_t *peak);
+
+/**
+ * @brief Convertit une taille écrite avec un suffixe (K, M, G, T : puissances de 1024).
+ *
+ * @param text La taille, par exemple "512M".
+ * @param bytes La taille en octets.
+ * @return int 0 si succès, -1 si le texte n'est pas une taille.
+ */
+int parse_size(const char *text, uint64_t *bytes);
+
+#endif // BUDGET_H
@@ -0,0 +1,114 @@
+#include "checkpoint.h"
+#include "backup_manager.h"
+#include "utilities.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Lit le fichier de reprise d'une sauvegarde interrompue : nom de la sauvegarde puis fichiers terminés
+static int load_checkpoint(checkpoint_t *checkpoint, char *backup_name, size_t size) {
+    FILE *file = fopen(checkpoint->path, "r");
+    if (!file) {
+        return 0;
+    }
+
+    char name[128];
+    if (!fgets(name, sizeof(name), file)) {
+        fclose(file);
+        return 0;
+    }
+    name[strcspn(name, "\n")] = '\0';
+    if (name[0] == '\0' || strchr(name, '/') || strlen(name) >= size) {
+        fprintf(stderr, "Fichier de reprise invalide ignoré : %s\n", checkpoint->path);
+        fclose(file);
+        return 0;
+    }
+
+    strcpy(backup_name, name);
+    checkpoint->done = parse_backup_log(file);
+    fclose(file);
+    return 1;
+}
+
+int checkpoint_open(checkpoint_t *checkpoint, const char *backup_dir, char *backup_name, size_t size) {
+    memset(checkpoint, 0, sizeof(checkpoint_t));
+    checkpoint->path = build_full_path(backup_dir, CHECKPOINT_FILE_NAME);
+    if (!checkpoint->path) {
+        return -1;
+    }
+
+    int resumed = load_checkpoint(checkpoint, backup_name, size);
+    checkpoint->file = fopen(checkpoint->path, resumed ? "a" : "w");
+    checkpoint->pending = open_memstream(&checkpoint->pending_data, &checkpoint->pending_size);
+    if (!checkpoint->file || !checkpoint->pending) {
+        perror("Erreur lors de l'ouverture du fichier de reprise");
+        checkpoint_close(checkpoint, 0);
+        return -1;
+    }
+    if (!resumed) {
+        fprintf(checkpoint->file, "%s\n", backup_name);
+        fflush(checkpoint->file);
+    }
+    checkpoint->last_commit = time(NULL);
+    return resumed;
+}
+
+int checkpoint_is_done(checkpoint_t *checkpoint, log_element *elt) {
+    char *relative_path = cut_after_first_slash(elt->path);
+    log_element *done = relative_path ? find_log_entry(&checkpoint->done, relative_path) : NULL;
+    free(relative_path);
+    // Le fichier doit être inchangé depuis sa sauvegarde et sauvegardé sous le même nom
+    return done && strcmp(done->path, elt->path) == 0 && strcmp((char*)done->md5, (char*)elt->md5) == 0 &&
+           strcmp(done->date, elt->date) == 0;
+}
+
+void checkpoint_add(checkpoint_t *checkpoint, log_element *elt) {
+    if (!checkpoint->file) {
+        return;
+    }
+    write_log_element(elt, checkpoint->pending);
+    checkpoint->pending_files++;
+    if (checkpoint->pending_files >= CHECKPOINT_FILES || time(NULL) - checkpoint->last_commit >= CHECKPOINT_SECONDS) {
+        checkpoint_commit(checkpoint);
+    }
+}
+
+int checkpoint_commit(checkpoint_t *checkpoint) {
+    if (!checkpoint->file) {
+        return -1;
+    }
+    checkpoint->last_commit = time(NULL);
+    if (checkpoint->pending_files == 0) {
+        return 0;
+    }
+    if (checkpoint->store && pack_store_sync(checkpoint->store) != 0) {
+        return -1;
+    }
+
+    fflush(checkpoint->pending);
+    if (fwrite(checkpoint->pending_data, 1, checkpoint->pending_size, checkpoint->file) != checkpoint->pending_size ||
+        fflush(checkpoint->file) != 0 || fsync(fileno(checkpoint->file)) != 0) {
+        perror("Erreur lors de l'écriture du point de reprise");
+        return -1;
+    }
+    rewind(checkpoint->pending);
+    checkpoint->pending_size = 0;
+    checkpoint->pending_files = 0;
+    return 0;
+}
+
+void checkpoint_close(checkpoint_t *checkpoint, int completed) {
+    if (checkpoint->pending) {
+        fclose(checkpoint->pending);
+    }
+    free(checkpoint->pending_data);
+    if (checkpoint->file) {
+        fclose(checkpoint->file);
+    }
+    if (completed && checkpoint->path) {
+        unlink(checkpoint->path);
+    }
+    free_log_list(&checkpoint->done);
+    free(checkpoint->path);
+    memset(checkpoint, 0, sizeof(checkpoint_t));
+}
@@ -0,0 +1,83 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "file_handler.h"
+#include "pack_store.h"
+#include <stdio.h>
+#include <time.h>
+
+/** @brief Fichier de reprise d'une sauvegarde en cours, à la racine du répertoire de sauvegarde */
+#define CHECKPOINT_FILE_NAME ".backup_checkpoint"
+/** @brief Un point de reprise est écrit au plus tard après ce nombre de fichiers sauvegardés */
+#define CHECKPOINT_FILES 256
+/** @brief ... ou après ce nombre de secondes depuis le précédent */
+#define CHECKPOINT_SECONDS 10
+
+/**
+ * @brief Suivi de l'avancement d'une sauvegarde.
+ *
+ * Le fichier de reprise contient le nom de la sauvegarde sur sa première ligne, puis
+ * une ligne au format du .backup_log par fichier terminé. Les fichiers terminés depuis
+ * le dernier point de reprise sont gardés en mémoire ; à chaque point, le dépôt pack
+ * est écrit sur le disque avant eux, pour qu'une ligne ne désigne jamais des données perdues.
+ */
+typedef struct {
+    char *path;                 // Chemin du fichier de reprise
+    FILE *file;                 // Fichier de reprise ouvert en ajout
+    FILE *pending;              // Lignes des fichiers terminés depuis le dernier point
+    char *pending_data;
+    size_t pending_size;
+    int pending_files;
+    time_t last_commit;
+    pack_store_t *store;        // Dépôt pack à écrire avant chaque point (peut être NULL)
+    log_t done;                 // Fichiers terminés lors d'une exécution interrompue
+} checkpoint_t;
+
+/**
+ * @brief Ouvre le fichier de reprise d'un répertoire de sauvegarde.
+ *
+ * S'il existe, la sauvegarde interrompue est reprise : son nom remplace backup_name et
+ * ses fichiers terminés sont chargés. Sinon un nouveau fichier est créé pour backup_name.
+ *
+ * @param checkpoint Le suivi à initialiser.
+ * @param backup_dir Le répertoire de sauvegarde.
+ * @param backup_name Le nom de la nouvelle sauvegarde, remplacé en cas de reprise.
+ * @param size La taille du tampon backup_name.
+ * @return int 1 si une sauvegarde interrompue est reprise, 0 sinon, -1 en cas d'erreur.
+ */
+int checkpoint_open(checkpoint_t *checkpoint, const char *backup_dir, char *backup_name, size_t size);
+
+/**
+ * @brief Indique si un fichier a déjà été sauvegardé, inchangé, avant l'interruption.
+ *
+ * @param checkpoint Le suivi.
+ * @param elt L'entrée du fichier dans la sauvegarde en cours.
+ * @return int 1 si le fichier peut être ignoré, 0 sinon.
+ */
+int checkpoint_is_done(checkpoint_t *checkpoint, log_element *elt);
+
+/**
+ * @brief Note un fichier terminé et écrit un point de reprise si l'intervalle est atteint.
+ *
+ * @param checkpoint Le suivi.
+ * @param elt L'entrée du fichier terminé.
+ */
+void checkpoint_add(checkpoint_t *checkpoint, log_element *elt);
+
+/**
+ * @brief Écrit un point de reprise : dépôt pack puis fichiers terminés, synchronisés sur le disque.
+ *
+ * @param checkpoint Le suivi.
+ * @return int 0 si succès, -1 si erreur.
+ */
+int checkpoint_commit(checkpoint_t *checkpoint);
+
+/**
+ * @brief Ferme le suivi ; le fichier de reprise est supprimé si la sauvegarde est terminée.
+ *
+ * @param checkpoint Le suivi.
+ * @param completed 1 si la sauvegarde est terminée (le .backup_log est écrit), 0 sinon.
+ */
+void checkpoint_close(checkpoint_t *checkpoint, int completed);
+
+#endif // CHECKPOINT_H
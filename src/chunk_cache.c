@@ -0,0 +1,185 @@
+#include "chunk_cache.h"
+#include "budget.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Mémoire d'une entrée en plus de ses données
+#define ENTRY_OVERHEAD (sizeof(cache_entry_t) + sizeof(cache_entry_t*))
+
+typedef struct cache_entry {
+    unsigned int pack;
+    uint64_t offset;
+    size_t length;
+    int is_protected;
+    struct cache_entry *hash_next;
+    struct cache_entry *prev;     // Vers la tête (plus récent)
+    struct cache_entry *next;     // Vers la queue (moins récent)
+    unsigned char data[];
+} cache_entry_t;
+
+typedef struct {
+    cache_entry_t *head;
+    cache_entry_t *tail;
+    uint64_t bytes;
+} cache_list_t;
+
+struct chunk_cache {
+    uint64_t capacity;
+    cache_entry_t **buckets;
+    size_t bucket_count;          // Puissance de 2
+    cache_list_t probation;       // Chunks lus une fois
+    cache_list_t protected_list;  // Chunks relus
+    uint64_t lookups;
+    uint64_t hits;
+};
+
+static size_t bucket_of(const chunk_cache_t *cache, unsigned int pack, uint64_t offset) {
+    uint64_t hash = (offset ^ ((uint64_t)pack << 40)) * 0x9E3779B97F4A7C15ULL;
+    return (hash >> 32) & (cache->bucket_count - 1);
+}
+
+static void list_remove(cache_list_t *list, cache_entry_t *entry) {
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    }
+    else {
+        list->head = entry->next;
+    }
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    }
+    else {
+        list->tail = entry->prev;
+    }
+    list->bytes -= entry->length + ENTRY_OVERHEAD;
+}
+
+static void list_push_front(cache_list_t *list, cache_entry_t *entry) {
+    entry->prev = NULL;
+    entry->next = list->head;
+    if (list->head) {
+        list->head->prev = entry;
+    }
+    else {
+        list->tail = entry;
+    }
+    list->head = entry;
+    list->bytes += entry->length + ENTRY_OVERHEAD;
+}
+
+chunk_cache_t *chunk_cache_create(uint64_t capacity) {
+    chunk_cache_t *cache = calloc(1, sizeof(chunk_cache_t));
+    if (!cache) {
+        perror("Memory allocation failed");
+        return NULL;
+    }
+    cache->capacity = budget_reserve_up_to(capacity, CHUNK_CACHE_MIN_SIZE);
+    // Environ une alvéole par chunk de 4 Ko
+    cache->bucket_count = 1024;
+    while (cache->bucket_count < cache->capacity / 4096) {
+        cache->bucket_count *= 2;
+    }
+    cache->buckets = calloc(cache->bucket_count, sizeof(cache_entry_t*));
+    if (!cache->buckets) {
+        perror("Memory allocation failed");
+        budget_release(cache->capacity);
+        free(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+static void free_list(cache_list_t *list) {
+    cache_entry_t *entry = list->head;
+    while (entry) {
+        cache_entry_t *next = entry->next;
+        free(entry);
+        entry = next;
+    }
+}
+
+void chunk_cache_free(chunk_cache_t *cache) {
+    if (!cache) {
+        return;
+    }
+    free_list(&cache->probation);
+    free_list(&cache->protected_list);
+    free(cache->buckets);
+    budget_release(cache->capacity);
+    free(cache);
+}
+
+const void *chunk_cache_get(chunk_cache_t *cache, unsigned int pack, uint64_t offset, size_t *length) {
+    cache->lookups++;
+    cache_entry_t *entry = cache->buckets[bucket_of(cache, pack, offset)];
+    while (entry && (entry->pack != pack || entry->offset != offset)) {
+        entry = entry->hash_next;
+    }
+    if (!entry) {
+        return NULL;
+    }
+    cache->hits++;
+
+    // Deuxième lecture : le chunk passe (ou reste) en tête du segment protégé
+    list_remove(entry->is_protected ? &cache->protected_list : &cache->probation, entry);
+    entry->is_protected = 1;
+    list_push_front(&cache->protected_list, entry);
+    // Le segment protégé trop grand rend ses plus anciens chunks au segment d'essai
+    uint64_t protected_max = cache->capacity / 100 * CHUNK_CACHE_PROTECTED_PERCENT;
+    while (cache->protected_list.bytes > protected_max && cache->protected_list.tail != entry) {
+        cache_entry_t *demoted = cache->protected_list.tail;
+        list_remove(&cache->protected_list, demoted);
+        demoted->is_protected = 0;
+        list_push_front(&cache->probation, demoted);
+    }
+    *length = entry->length;
+    return entry->data;
+}
+
+// Retire le moins récemment utilisé : segment d'essai d'abord
+static int evict_one(chunk_cache_t *cache) {
+    cache_list_t *list = cache->probation.tail ? &cache->probation : &cache->protected_list;
+    cache_entry_t *victim = list->tail;
+    if (!victim) {
+        return -1;
+    }
+    list_remove(list, victim);
+    cache_entry_t **link = &cache->buckets[bucket_of(cache, victim->pack, victim->offset)];
+    while (*link != victim) {
+        link = &(*link)->hash_next;
+    }
+    *link = victim->hash_next;
+    free(victim);
+    return 0;
+}
+
+void chunk_cache_put(chunk_cache_t *cache, unsigned int pack, uint64_t offset, const void *data, size_t length) {
+    uint64_t size = length + ENTRY_OVERHEAD;
+    if (size > cache->capacity) {
+        return;
+    }
+    while (cache->probation.bytes + cache->protected_list.bytes + size > cache->capacity) {
+        if (evict_one(cache) != 0) {
+            return;
+        }
+    }
+    cache_entry_t *entry = malloc(sizeof(cache_entry_t) + length);
+    if (!entry) {
+        return; // Le cache n'est qu'une optimisation
+    }
+    entry->pack = pack;
+    entry->offset = offset;
+    entry->length = length;
+    entry->is_protected = 0;
+    memcpy(entry->data, data, length);
+    size_t bucket = bucket_of(cache, pack, offset);
+    entry->hash_next = cache->buckets[bucket];
+    cache->buckets[bucket] = entry;
+    list_push_front(&cache->probation, entry);
+}
+
+void chunk_cache_counters(const chunk_cache_t *cache, uint64_t *lookups, uint64_t *hits) {
+    *lookups = cache->lookups;
+    *hits = cache->hits;
+}
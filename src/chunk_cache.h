@@ -0,0 +1,70 @@
+#ifndef CHUNK_CACHE_H
+#define CHUNK_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** @brief Taille du cache de chunks d'une restauration quand le budget mémoire le permet (64 Mo) */
+#define CHUNK_CACHE_SIZE (64ULL * 1024 * 1024)
+/** @brief Taille minimale de ce cache (1 Mo) */
+#define CHUNK_CACHE_MIN_SIZE (1024 * 1024)
+/** @brief Part du cache réservée aux chunks lus au moins deux fois, en pourcentage */
+#define CHUNK_CACHE_PROTECTED_PERCENT 80
+
+/**
+ * @brief Cache des chunks du dépôt lus pendant une restauration.
+ *
+ * LRU segmenté : un chunk entre dans le segment d'essai et ne passe dans le segment
+ * protégé qu'à sa deuxième lecture. Un parcours de chunks lus une seule fois ne
+ * remplace donc que le segment d'essai, les chunks partagés entre fichiers ou
+ * sauvegardes restent en mémoire.
+ */
+typedef struct chunk_cache chunk_cache_t;
+
+/**
+ * @brief Crée un cache dont la taille est réservée sur le budget mémoire.
+ *
+ * @param capacity La taille souhaitée en octets (réduite si le budget ne le permet pas).
+ * @return chunk_cache_t* Le cache, ou NULL en cas d'erreur.
+ */
+chunk_cache_t *chunk_cache_create(uint64_t capacity);
+
+/**
+ * @brief Libère le cache et rend sa réservation au budget.
+ *
+ * @param cache Le cache (peut être NULL).
+ */
+void chunk_cache_free(chunk_cache_t *cache);
+
+/**
+ * @brief Cherche un chunk par son emplacement dans le dépôt.
+ *
+ * @param cache Le cache.
+ * @param pack Le numéro du segment.
+ * @param offset La position du chunk dans le segment.
+ * @param length La taille du chunk trouvé.
+ * @return const void* Les données du chunk, valides jusqu'au prochain chunk_cache_put, ou NULL.
+ */
+const void *chunk_cache_get(chunk_cache_t *cache, unsigned int pack, uint64_t offset, size_t *length);
+
+/**
+ * @brief Ajoute un chunk lu dans le dépôt, en évinçant les moins récemment utilisés.
+ *
+ * @param cache Le cache.
+ * @param pack Le numéro du segment.
+ * @param offset La position du chunk dans le segment.
+ * @param data Les données du chunk, copiées.
+ * @param length La taille du chunk.
+ */
+void chunk_cache_put(chunk_cache_t *cache, unsigned int pack, uint64_t offset, const void *data, size_t length);
+
+/**
+ * @brief Compteurs du cache.
+ *
+ * @param cache Le cache.
+ * @param lookups Le nombre de recherches.
+ * @param hits Le nombre de chunks trouvés dans le cache.
+ */
+void chunk_cache_counters(const chunk_cache_t *cache, uint64_t *lookups, uint64_t *hits);
+
+#endif // CHUNK_CACHE_H
@@ -0,0 +1,677 @@
+#include "chunk_index.h"
+#include "utilities.h"
+#include "budget.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// En-tête d'un run : magique, nombre d'enregistrements, taille du filtre, nombre de blocs
+#define RUN_MAGIC "LP25RUN1"
+#define RUN_HEADER_SIZE 32
+#define BLOCK_BYTES (CHUNK_INDEX_BLOCK_RECORDS * CHUNK_INDEX_RECORD_SIZE)
+
+// Run ouvert : le filtre et l'index épars sont en mémoire, les enregistrements restent sur le disque
+typedef struct {
+    unsigned int number;
+    int fd;
+    uint64_t count;
+    unsigned char *bloom;
+    uint64_t bloom_bits;     // Puissance de 2
+    unsigned char *fences;   // Première empreinte de chaque bloc
+    uint64_t block_count;
+} run_t;
+
+typedef struct {
+    unsigned char digest[CHUNK_INDEX_DIGEST_SIZE];
+    pack_ref_t ref;
+    int used;
+} index_entry_t;
+
+struct chunk_index {
+    char *dir;
+    run_t *runs;             // Du plus ancien au plus récent
+    int run_count;
+    unsigned int next_run;
+    index_entry_t *table;    // Empreintes pas encore écrites dans un run (adressage ouvert)
+    size_t table_size;       // Puissance de 2
+    size_t table_count;
+    index_entry_t cache[CHUNK_INDEX_CACHE_SIZE];
+    unsigned char block[BLOCK_BYTES];   // Dernier bloc lu
+    unsigned int block_run;
+    uint64_t block_number;
+    int block_valid;
+};
+
+// Les empreintes MD5 sont uniformes : leurs octets servent directement de hachages
+static uint64_t digest_hash(const unsigned char *digest, int half) {
+    uint64_t hash;
+    memcpy(&hash, digest + half * 8, sizeof(hash));
+    return hash;
+}
+
+static char *run_path(const chunk_index_t *index, unsigned int number, int temporary) {
+    char name[32];
+    snprintf(name, sizeof(name), "chunks-%06u.run%s", number, temporary ? ".tmp" : "");
+    return build_full_path(index->dir, name);
+}
+
+static void encode_record(unsigned char *out, const unsigned char *digest, const pack_ref_t *ref) {
+    uint32_t pack = ref->pack;
+    memcpy(out, digest, CHUNK_INDEX_DIGEST_SIZE);
+    memcpy(out + CHUNK_INDEX_DIGEST_SIZE, &pack, 4);
+    memcpy(out + CHUNK_INDEX_DIGEST_SIZE + 4, &ref->offset, 8);
+    memcpy(out + CHUNK_INDEX_DIGEST_SIZE + 12, &ref->length, 8);
+}
+
+static void decode_record(const unsigned char *in, pack_ref_t *ref) {
+    uint32_t pack;
+    memcpy(&pack, in + CHUNK_INDEX_DIGEST_SIZE, 4);
+    ref->pack = pack;
+    memcpy(&ref->offset, in + CHUNK_INDEX_DIGEST_SIZE + 4, 8);
+    memcpy(&ref->length, in + CHUNK_INDEX_DIGEST_SIZE + 12, 8);
+}
+
+static uint64_t bloom_size(uint64_t count) {
+    uint64_t bits = 64;
+    while (bits < count * CHUNK_INDEX_BLOOM_BITS) {
+        bits *= 2;
+    }
+    return bits;
+}
+
+static void bloom_add(unsigned char *bloom, uint64_t bits, const unsigned char *digest) {
+    uint64_t h1 = digest_hash(digest, 0);
+    uint64_t h2 = digest_hash(digest, 1) | 1;
+    for (int i = 0; i < CHUNK_INDEX_BLOOM_HASHES; i++) {
+        uint64_t bit = (h1 + i * h2) & (bits - 1);
+        bloom[bit / 8] |= 1 << (bit % 8);
+    }
+}
+
+static int bloom_test(const unsigned char *bloom, uint64_t bits, const unsigned char *digest) {
+    uint64_t h1 = digest_hash(digest, 0);
+    uint64_t h2 = digest_hash(digest, 1) | 1;
+    for (int i = 0; i < CHUNK_INDEX_BLOOM_HASHES; i++) {
+        uint64_t bit = (h1 + i * h2) & (bits - 1);
+        if (!(bloom[bit / 8] & (1 << (bit % 8)))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void free_run(run_t *run) {
+    if (run->fd >= 0) {
+        close(run->fd);
+    }
+    budget_release(run->bloom_bits / 8 + run->block_count * CHUNK_INDEX_DIGEST_SIZE);
+    free(run->bloom);
+    free(run->fences);
+}
+
+// Ouvre un run écrit par finish_run et charge son filtre et son index épars
+static int load_run(chunk_index_t *index, unsigned int number, run_t *run) {
+    memset(run, 0, sizeof(run_t));
+    run->number = number;
+    char *path = run_path(index, number, 0);
+    run->fd = path ? open(path, O_RDONLY | O_CLOEXEC) : -1;
+    free(path);
+    if (run->fd < 0) {
+        perror("Erreur lors de l'ouverture d'un run de l'index des chunks");
+        return -1;
+    }
+
+    unsigned char header[RUN_HEADER_SIZE];
+    uint64_t bloom_bytes;
+    if (pread(run->fd, header, RUN_HEADER_SIZE, 0) != RUN_HEADER_SIZE || memcmp(header, RUN_MAGIC, 8) != 0) {
+        fprintf(stderr, "Run de l'index des chunks invalide : %u\n", number);
+        close(run->fd);
+        run->fd = -1;
+        return -1;
+    }
+    memcpy(&run->count, header + 8, 8);
+    memcpy(&bloom_bytes, header + 16, 8);
+    memcpy(&run->block_count, header + 24, 8);
+    run->bloom_bits = bloom_bytes * 8;
+
+    off_t position = RUN_HEADER_SIZE + (off_t)run->count * CHUNK_INDEX_RECORD_SIZE;
+    size_t fence_bytes = run->block_count * CHUNK_INDEX_DIGEST_SIZE;
+    run->bloom = malloc(bloom_bytes ? bloom_bytes : 1);
+    run->fences = malloc(fence_bytes ? fence_bytes : 1);
+    if (!run->bloom || !run->fences ||
+        pread(run->fd, run->bloom, bloom_bytes, position) != (ssize_t)bloom_bytes ||
+        pread(run->fd, run->fences, fence_bytes, position + bloom_bytes) != (ssize_t)fence_bytes) {
+        fprintf(stderr, "Run de l'index des chunks incomplet : %u\n", number);
+        free(run->bloom);
+        free(run->fences);
+        close(run->fd);
+        run->fd = -1;
+        return -1;
+    }
+    // Le filtre et l'index épars restent en mémoire tant que l'index est ouvert
+    budget_force(bloom_bytes + fence_bytes);
+    return 0;
+}
+
+static int compare_numbers(const void *a, const void *b) {
+    unsigned int x = *(const unsigned int*)a;
+    unsigned int y = *(const unsigned int*)b;
+    return (x > y) - (x < y);
+}
+
+chunk_index_t *chunk_index_open(const char *dir, int read_only) {
+    chunk_index_t *index = calloc(1, sizeof(chunk_index_t));
+    if (!index || !(index->dir = strdup(dir))) {
+        perror("Memory allocation failed");
+        free(index);
+        return NULL;
+    }
+
+    // Retrouver les runs existants ; un run temporaire est une écriture interrompue
+    DIR *d = opendir(dir);
+    unsigned int *numbers = NULL;
+    int count = 0;
+    struct dirent *entry;
+    while (d && (entry = readdir(d)) != NULL) {
+        unsigned int number;
+        int end = 0;
+        if (sscanf(entry->d_name, "chunks-%u.run%n", &number, &end) != 1 || end == 0) {
+            continue;
+        }
+        if (number >= index->next_run) {
+            index->next_run = number + 1;
+        }
+        if (entry->d_name[end] != '\0') {
+            char *path = read_only ? NULL : build_full_path(dir, entry->d_name);
+            if (path) {
+                unlink(path);
+            }
+            free(path);
+            continue;
+        }
+        unsigned int *grown = realloc(numbers, (count + 1) * sizeof(unsigned int));
+        if (!grown) {
+            perror("Memory allocation failed");
+            break;
+        }
+        numbers = grown;
+        numbers[count++] = number;
+    }
+    if (d) {
+        closedir(d);
+    }
+
+    if (count > 0) {
+        qsort(numbers, count, sizeof(unsigned int), compare_numbers);
+    }
+    index->runs = calloc(count ? count : 1, sizeof(run_t));
+    if (!index->runs) {
+        perror("Memory allocation failed");
+        free(numbers);
+        chunk_index_close(index);
+        return NULL;
+    }
+    for (int i = 0; i < count; i++) {
+        if (load_run(index, numbers[i], &index->runs[index->run_count]) == 0) {
+            index->run_count++;
+        }
+    }
+    free(numbers);
+    return index;
+}
+
+void chunk_index_close(chunk_index_t *index) {
+    if (!index) {
+        return;
+    }
+    for (int i = 0; i < index->run_count; i++) {
+        free_run(&index->runs[i]);
+    }
+    free(index->runs);
+    budget_release(index->table_size * sizeof(index_entry_t));
+    free(index->table);
+    free(index->dir);
+    free(index);
+}
+
+// Place d'une empreinte dans la table en mémoire : son entrée ou la case vide où l'ajouter
+static index_entry_t *table_slot(index_entry_t *table, size_t size, const unsigned char *digest) {
+    size_t slot = digest_hash(digest, 0) & (size - 1);
+    while (table[slot].used && memcmp(table[slot].digest, digest, CHUNK_INDEX_DIGEST_SIZE) != 0) {
+        slot = (slot + 1) & (size - 1);
+    }
+    return &table[slot];
+}
+
+// Double la table à moitié pleine
+static int grow_table(chunk_index_t *index) {
+    size_t size = index->table_size ? index->table_size * 2 : 1024;
+    index_entry_t *table = calloc(size, sizeof(index_entry_t));
+    if (!table) {
+        perror("Memory allocation failed");
+        return -1;
+    }
+    for (size_t i = 0; i < index->table_size; i++) {
+        if (index->table[i].used) {
+            *table_slot(table, size, index->table[i].digest) = index->table[i];
+        }
+    }
+    budget_force(size * sizeof(index_entry_t));
+    budget_release(index->table_size * sizeof(index_entry_t));
+    free(index->table);
+    index->table = table;
+    index->table_size = size;
+    return 0;
+}
+
+int chunk_index_insert(chunk_index_t *index, const unsigned char *digest, const pack_ref_t *ref) {
+    if ((index->table_count + 1) * 2 > index->table_size && grow_table(index) != 0) {
+        return -1;
+    }
+    index_entry_t *entry = table_slot(index->table, index->table_size, digest);
+    if (!entry->used) {
+        memcpy(entry->digest, digest, CHUNK_INDEX_DIGEST_SIZE);
+        entry->used = 1;
+        index->table_count++;
+    }
+    entry->ref = *ref;
+    return 0;
+}
+
+size_t chunk_index_pending(const chunk_index_t *index) {
+    return index->table_count;
+}
+
+// Lit un bloc d'un run, sauf si c'est le dernier bloc lu (recherches triées)
+static const unsigned char *read_block(chunk_index_t *index, const run_t *run, uint64_t block, int *records) {
+    uint64_t first = block * CHUNK_INDEX_BLOCK_RECORDS;
+    *records = run->count - first < CHUNK_INDEX_BLOCK_RECORDS ? (int)(run->count - first) : CHUNK_INDEX_BLOCK_RECORDS;
+    if (index->block_valid && index->block_run == run->number && index->block_number == block) {
+        return index->block;
+    }
+    size_t bytes = (size_t)*records * CHUNK_INDEX_RECORD_SIZE;
+    if (pread(run->fd, index->block, bytes, RUN_HEADER_SIZE + first * CHUNK_INDEX_RECORD_SIZE) != (ssize_t)bytes) {
+        perror("Erreur de lecture de l'index des chunks");
+        index->block_valid = 0;
+        return NULL;
+    }
+    index->block_run = run->number;
+    index->block_number = block;
+    index->block_valid = 1;
+    return index->block;
+}
+
+// Cherche une empreinte dans un run : filtre de Bloom, index épars, puis un bloc
+static int run_lookup(chunk_index_t *index, const run_t *run, const unsigned char *digest, pack_ref_t *ref) {
+    if (run->count == 0 || !bloom_test(run->bloom, run->bloom_bits, digest)) {
+        return 0;
+    }
+    // Dernier bloc dont la première empreinte est inférieure ou égale
+    int64_t low = 0;
+    int64_t high = (int64_t)run->block_count - 1;
+    int64_t block = -1;
+    while (low <= high) {
+        int64_t middle = (low + high) / 2;
+        if (memcmp(run->fences + middle * CHUNK_INDEX_DIGEST_SIZE, digest, CHUNK_INDEX_DIGEST_SIZE) <= 0) {
+            block = middle;
+            low = middle + 1;
+        }
+        else {
+            high = middle - 1;
+        }
+    }
+    if (block < 0) {
+        return 0;
+    }
+
+    int records;
+    const unsigned char *data = read_block(index, run, block, &records);
+    if (!data) {
+        return 0;
+    }
+    int first = 0;
+    int last = records - 1;
+    while (first <= last) {
+        int middle = (first + last) / 2;
+        int order = memcmp(data + middle * CHUNK_INDEX_RECORD_SIZE, digest, CHUNK_INDEX_DIGEST_SIZE);
+        if (order == 0) {
+            decode_record(data + middle * CHUNK_INDEX_RECORD_SIZE, ref);
+            return 1;
+        }
+        if (order < 0) {
+            first = middle + 1;
+        }
+        else {
+            last = middle - 1;
+        }
+    }
+    return 0;
+}
+
+// Table en mémoire puis cache des empreintes déjà trouvées dans les runs
+static int memory_lookup(chunk_index_t *index, const unsigned char *digest, pack_ref_t *ref) {
+    if (index->table_count) {
+        index_entry_t *entry = table_slot(index->table, index->table_size, digest);
+        if (entry->used) {
+            *ref = entry->ref;
+            return 1;
+        }
+    }
+    index_entry_t *cached = &index->cache[digest_hash(digest, 0) & (CHUNK_INDEX_CACHE_SIZE - 1)];
+    if (cached->used && memcmp(cached->digest, digest, CHUNK_INDEX_DIGEST_SIZE) == 0) {
+        *ref = cached->ref;
+        return 1;
+    }
+    return 0;
+}
+
+static void cache_entry(chunk_index_t *index, const unsigned char *digest, const pack_ref_t *ref) {
+    index_entry_t *cached = &index->cache[digest_hash(digest, 0) & (CHUNK_INDEX_CACHE_SIZE - 1)];
+    memcpy(cached->digest, digest, CHUNK_INDEX_DIGEST_SIZE);
+    cached->ref = *ref;
+    cached->used = 1;
+}
+
+int chunk_index_lookup(chunk_index_t *index, const unsigned char *digest, pack_ref_t *ref) {
+    if (memory_lookup(index, digest, ref)) {
+        return 1;
+    }
+    for (int i = index->run_count - 1; i >= 0; i--) {
+        if (run_lookup(index, &index->runs[i], digest, ref)) {
+            cache_entry(index, digest, ref);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Empreinte d'un lot à chercher, triée avec sa position dans le lot
+typedef struct {
+    const unsigned char *digest;
+    size_t position;
+} batch_query_t;
+
+static int compare_queries(const void *a, const void *b) {
+    return memcmp(((const batch_query_t*)a)->digest, ((const batch_query_t*)b)->digest, CHUNK_INDEX_DIGEST_SIZE);
+}
+
+int chunk_index_lookup_batch(chunk_index_t *index, const unsigned char *digests, size_t count,
+                             pack_ref_t *refs, unsigned char *found) {
+    batch_query_t *queries = malloc((count ? count : 1) * sizeof(batch_query_t));
+    if (!queries) {
+        perror("Memory allocation failed");
+        return -1;
+    }
+    size_t missing = 0;
+    for (size_t i = 0; i < count; i++) {
+        pack_ref_t ref;
+        found[i] = memory_lookup(index, digests + i * CHUNK_INDEX_DIGEST_SIZE, &ref);
+        if (found[i] && refs) {
+            refs[i] = ref;
+        }
+        else if (!found[i]) {
+            queries[missing].digest = digests + i * CHUNK_INDEX_DIGEST_SIZE;
+            queries[missing++].position = i;
+        }
+    }
+
+    // Dans l'ordre des empreintes, les blocs d'un run sont lus une fois chacun et dans l'ordre du fichier
+    qsort(queries, missing, sizeof(batch_query_t), compare_queries);
+    for (int r = index->run_count - 1; r >= 0 && missing > 0; r--) {
+        size_t still_missing = 0;
+        for (size_t i = 0; i < missing; i++) {
+            pack_ref_t ref;
+            if (run_lookup(index, &index->runs[r], queries[i].digest, &ref)) {
+                found[queries[i].position] = 1;
+                if (refs) {
+                    refs[queries[i].position] = ref;
+                }
+                cache_entry(index, queries[i].digest, &ref);
+            }
+            else {
+                queries[still_missing++] = queries[i];
+            }
+        }
+        missing = still_missing;
+    }
+    free(queries);
+    return 0;
+}
+
+// Écriture d'un run : enregistrements triés, puis filtre et index épars, l'en-tête en dernier
+typedef struct {
+    FILE *file;
+    char *path;
+    uint64_t count;
+    unsigned char *bloom;
+    uint64_t bloom_bits;
+    unsigned char *fences;
+    uint64_t max_count;
+} run_writer_t;
+
+static int begin_run(chunk_index_t *index, run_writer_t *writer, uint64_t max_count) {
+    memset(writer, 0, sizeof(run_writer_t));
+    writer->max_count = max_count;
+    writer->bloom_bits = bloom_size(max_count);
+    writer->path = run_path(index, index->next_run, 1);
+    writer->bloom = calloc(writer->bloom_bits / 8, 1);
+    writer->fences = malloc((max_count / CHUNK_INDEX_BLOCK_RECORDS + 1) * CHUNK_INDEX_DIGEST_SIZE);
+    writer->file = writer->path ? fopen(writer->path, "wb") : NULL;
+    unsigned char header[RUN_HEADER_SIZE] = { 0 };
+    if (!writer->bloom || !writer->fences || !writer->file ||
+        fwrite(header, 1, RUN_HEADER_SIZE, writer->file) != RUN_HEADER_SIZE) {
+        perror("Erreur lors de l'écriture d'un run de l'index des chunks");
+        return -1;
+    }
+    return 0;
+}
+
+static int write_run_record(run_writer_t *writer, const unsigned char *digest, const pack_ref_t *ref) {
+    unsigned char record[CHUNK_INDEX_RECORD_SIZE];
+    encode_record(record, digest, ref);
+    if (writer->count % CHUNK_INDEX_BLOCK_RECORDS == 0) {
+        memcpy(writer->fences + (writer->count / CHUNK_INDEX_BLOCK_RECORDS) * CHUNK_INDEX_DIGEST_SIZE,
+               digest, CHUNK_INDEX_DIGEST_SIZE);
+    }
+    bloom_add(writer->bloom, writer->bloom_bits, digest);
+    writer->count++;
+    if (fwrite(record, 1, CHUNK_INDEX_RECORD_SIZE, writer->file) != CHUNK_INDEX_RECORD_SIZE) {
+        perror("Erreur lors de l'écriture d'un run de l'index des chunks");
+        return -1;
+    }
+    return 0;
+}
+
+// Termine le run et le rend visible sous son nom définitif, puis l'ajoute aux runs ouverts
+static int finish_run(chunk_index_t *index, run_writer_t *writer, int result) {
+    uint64_t bloom_bytes = writer->bloom_bits / 8;
+    uint64_t block_count = (writer->count + CHUNK_INDEX_BLOCK_RECORDS - 1) / CHUNK_INDEX_BLOCK_RECORDS;
+    unsigned char header[RUN_HEADER_SIZE];
+    memcpy(header, RUN_MAGIC, 8);
+    memcpy(header + 8, &writer->count, 8);
+    memcpy(header + 16, &bloom_bytes, 8);
+    memcpy(header + 24, &block_count, 8);
+    if (result == 0 &&
+        (fwrite(writer->bloom, 1, bloom_bytes, writer->file) != bloom_bytes ||
+         fwrite(writer->fences, CHUNK_INDEX_DIGEST_SIZE, block_count, writer->file) != block_count ||
+         fseeko(writer->file, 0, SEEK_SET) != 0 ||
+         fwrite(header, 1, RUN_HEADER_SIZE, writer->file) != RUN_HEADER_SIZE ||
+         fflush(writer->file) != 0 || fsync(fileno(writer->file)) != 0)) {
+        perror("Erreur lors de l'écriture d'un run de l'index des chunks");
+        result = -1;
+    }
+    if (writer->file && fclose(writer->file) != 0) {
+        result = -1;
+    }
+    free(writer->bloom);
+    free(writer->fences);
+
+    char *path = run_path(index, index->next_run, 0);
+    if (result == 0 && (!path || rename(writer->path, path) != 0)) {
+        perror("Erreur lors de l'écriture d'un run de l'index des chunks");
+        result = -1;
+    }
+    if (result != 0 && writer->path) {
+        unlink(writer->path);
+    }
+    free(path);
+    free(writer->path);
+    if (result != 0) {
+        return -1;
+    }
+
+    run_t *runs = realloc(index->runs, (index->run_count + 1) * sizeof(run_t));
+    if (!runs) {
+        perror("Memory allocation failed");
+        return -1;
+    }
+    index->runs = runs;
+    if (load_run(index, index->next_run++, &index->runs[index->run_count]) != 0) {
+        return -1;
+    }
+    index->run_count++;
+    return 0;
+}
+
+static int compare_entries(const void *a, const void *b) {
+    return memcmp(((const index_entry_t*)a)->digest, ((const index_entry_t*)b)->digest, CHUNK_INDEX_DIGEST_SIZE);
+}
+
+// Curseur de lecture séquentielle d'un run pendant une fusion
+typedef struct {
+    const run_t *run;
+    uint64_t position;
+    unsigned char block[BLOCK_BYTES];
+    int records;
+    int next;
+} run_cursor_t;
+
+static const unsigned char *cursor_record(run_cursor_t *cursor) {
+    if (cursor->next == cursor->records) {
+        uint64_t first = cursor->position;
+        if (first >= cursor->run->count) {
+            return NULL;
+        }
+        cursor->records = cursor->run->count - first < CHUNK_INDEX_BLOCK_RECORDS ?
+                          (int)(cursor->run->count - first) : CHUNK_INDEX_BLOCK_RECORDS;
+        size_t bytes = (size_t)cursor->records * CHUNK_INDEX_RECORD_SIZE;
+        if (pread(cursor->run->fd, cursor->block, bytes, RUN_HEADER_SIZE + first * CHUNK_INDEX_RECORD_SIZE) != (ssize_t)bytes) {
+            perror("Erreur de lecture de l'index des chunks");
+            return NULL;
+        }
+        cursor->next = 0;
+    }
+    return cursor->block + cursor->next * CHUNK_INDEX_RECORD_SIZE;
+}
+
+static void cursor_advance(run_cursor_t *cursor) {
+    cursor->next++;
+    cursor->position++;
+}
+
+// Fusionne tous les runs en un seul ; pour une empreinte présente dans plusieurs runs, le plus récent l'emporte
+static int merge_runs(chunk_index_t *index) {
+    int count = index->run_count;
+    uint64_t total = 0;
+    run_cursor_t *cursors = calloc(count, sizeof(run_cursor_t));
+    if (!cursors) {
+        perror("Memory allocation failed");
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        cursors[i].run = &index->runs[i];
+        total += index->runs[i].count;
+    }
+
+    run_writer_t writer;
+    int result = begin_run(index, &writer, total);
+    while (result == 0) {
+        const unsigned char *smallest = NULL;
+        int newest = -1;
+        for (int i = 0; i < count; i++) {
+            const unsigned char *record = cursor_record(&cursors[i]);
+            if (record && (!smallest || memcmp(record, smallest, CHUNK_INDEX_DIGEST_SIZE) <= 0)) {
+                // À égalité, le curseur d'un run plus récent (indice plus grand) l'emporte
+                smallest = record;
+                newest = i;
+            }
+        }
+        if (!smallest) {
+            break;
+        }
+        pack_ref_t ref;
+        unsigned char digest[CHUNK_INDEX_DIGEST_SIZE];
+        memcpy(digest, smallest, CHUNK_INDEX_DIGEST_SIZE);
+        decode_record(smallest, &ref);
+        result = write_run_record(&writer, digest, &ref);
+        for (int i = 0; i < count; i++) {
+            const unsigned char *record = cursor_record(&cursors[i]);
+            if (record && (i == newest || memcmp(record, digest, CHUNK_INDEX_DIGEST_SIZE) == 0)) {
+                cursor_advance(&cursors[i]);
+            }
+        }
+    }
+    free(cursors);
+    if (finish_run(index, &writer, result) != 0) {
+        return -1;
+    }
+
+    // Le nouveau run remplace les anciens, retirés du disque une fois qu'il y est
+    run_t merged = index->runs[index->run_count - 1];
+    for (int i = 0; i < count; i++) {
+        char *path = run_path(index, index->runs[i].number, 0);
+        if (path) {
+            unlink(path);
+        }
+        free(path);
+        free_run(&index->runs[i]);
+    }
+    index->runs[0] = merged;
+    index->run_count = 1;
+    index->block_valid = 0;
+    return 0;
+}
+
+int chunk_index_flush(chunk_index_t *index) {
+    if (index->table_count == 0) {
+        return 0;
+    }
+    // Les empreintes en mémoire, triées, forment le nouveau run
+    index_entry_t *entries = malloc(index->table_count * sizeof(index_entry_t));
+    if (!entries) {
+        perror("Memory allocation failed");
+        return -1;
+    }
+    size_t count = 0;
+    for (size_t i = 0; i < index->table_size; i++) {
+        if (index->table[i].used) {
+            entries[count++] = index->table[i];
+        }
+    }
+    qsort(entries, count, sizeof(index_entry_t), compare_entries);
+
+    run_writer_t writer;
+    int result = begin_run(index, &writer, count);
+    for (size_t i = 0; i < count && result == 0; i++) {
+        result = write_run_record(&writer, entries[i].digest, &entries[i].ref);
+    }
+    free(entries);
+    if (finish_run(index, &writer, result) != 0) {
+        return -1;
+    }
+
+    budget_release(index->table_size * sizeof(index_entry_t));
+    free(index->table);
+    index->table = NULL;
+    index->table_size = 0;
+    index->table_count = 0;
+
+    if (index->run_count > CHUNK_INDEX_MAX_RUNS) {
+        return merge_runs(index);
+    }
+    return 0;
+}
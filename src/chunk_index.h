@@ -0,0 +1,105 @@
+#ifndef CHUNK_INDEX_H
+#define CHUNK_INDEX_H
+
+#include "pack_store.h"
+#include <stdint.h>
+#include <stddef.h>
+
+/** @brief Taille d'une empreinte de chunk dans l'index (MD5 binaire) */
+#define CHUNK_INDEX_DIGEST_SIZE 16
+/** @brief Taille d'un enregistrement d'un run : empreinte, pack (4 octets), offset et length (8 octets chacun) */
+#define CHUNK_INDEX_RECORD_SIZE (CHUNK_INDEX_DIGEST_SIZE + 4 + 8 + 8)
+/** @brief Nombre d'enregistrements d'un bloc de run, lu d'un seul pread */
+#define CHUNK_INDEX_BLOCK_RECORDS 128
+/** @brief Bits du filtre de Bloom par empreinte (environ 1 % de faux positifs avec 7 fonctions) */
+#define CHUNK_INDEX_BLOOM_BITS 10
+/** @brief Nombre de fonctions de hachage du filtre de Bloom */
+#define CHUNK_INDEX_BLOOM_HASHES 7
+/** @brief Au-delà de ce nombre de runs, ils sont fusionnés en un seul */
+#define CHUNK_INDEX_MAX_RUNS 8
+/** @brief Nombre d'empreintes en mémoire au-delà duquel un point de reprise les écrit dans un nouveau run */
+#define CHUNK_INDEX_MEMTABLE_MAX (256 * 1024)
+/** @brief Nombre d'entrées du cache des empreintes trouvées dans les runs (puissance de 2) */
+#define CHUNK_INDEX_CACHE_SIZE 4096
+
+/**
+ * @brief Index des chunks d'un dépôt pack, conservé sur le disque.
+ *
+ * Les empreintes sont rangées dans des runs triés (fichiers chunks-NNNNNN.run du répertoire
+ * packs), suivis chacun d'un filtre de Bloom et d'un index épars (première empreinte de chaque
+ * bloc) gardés en mémoire : une empreinte absente ne coûte aucune lecture dans la plupart des cas,
+ * une empreinte présente coûte un bloc. Les nouvelles empreintes restent en mémoire jusqu'à
+ * chunk_index_flush, qui les écrit dans un nouveau run. Le journal de pack_store garde les
+ * empreintes pas encore écrites dans un run.
+ */
+typedef struct chunk_index chunk_index_t;
+
+/**
+ * @brief Ouvre l'index des chunks d'un répertoire packs : charge les filtres et index épars des runs.
+ *
+ * @param dir Le répertoire packs.
+ * @param read_only Ne rien modifier : un run temporaire (écriture interrompue, ou en cours dans
+ * une autre session) est laissé en place.
+ * @return chunk_index_t* L'index ouvert, ou NULL en cas d'erreur.
+ */
+chunk_index_t *chunk_index_open(const char *dir, int read_only);
+
+/**
+ * @brief Ferme l'index. Les empreintes pas encore écrites dans un run sont perdues (le journal les garde).
+ *
+ * @param index L'index (peut être NULL).
+ */
+void chunk_index_close(chunk_index_t *index);
+
+/**
+ * @brief Ajoute ou remplace une empreinte dans la table en mémoire.
+ *
+ * @param index L'index.
+ * @param digest L'empreinte binaire (CHUNK_INDEX_DIGEST_SIZE octets).
+ * @param ref L'emplacement du chunk.
+ * @return int 0 si succès, -1 si erreur.
+ */
+int chunk_index_insert(chunk_index_t *index, const unsigned char *digest, const pack_ref_t *ref);
+
+/**
+ * @brief Cherche une empreinte : table en mémoire, cache, puis runs du plus récent au plus ancien.
+ *
+ * @param index L'index.
+ * @param digest L'empreinte binaire.
+ * @param ref L'emplacement trouvé.
+ * @return int 1 si trouvée, 0 sinon.
+ */
+int chunk_index_lookup(chunk_index_t *index, const unsigned char *digest, pack_ref_t *ref);
+
+/**
+ * @brief Cherche un lot d'empreintes en les triant : chaque run est parcouru une fois, dans l'ordre.
+ *
+ * @param index L'index.
+ * @param digests Les empreintes binaires, à la suite.
+ * @param count Le nombre d'empreintes.
+ * @param refs Les emplacements trouvés (count éléments, peut être NULL).
+ * @param found found[i] vaut 1 si l'empreinte i est trouvée, 0 sinon.
+ * @return int 0 si succès, -1 si erreur.
+ */
+int chunk_index_lookup_batch(chunk_index_t *index, const unsigned char *digests, size_t count,
+                             pack_ref_t *refs, unsigned char *found);
+
+/**
+ * @brief Nombre d'empreintes de la table en mémoire, pas encore écrites dans un run.
+ *
+ * @param index L'index.
+ * @return size_t Le nombre d'empreintes.
+ */
+size_t chunk_index_pending(const chunk_index_t *index);
+
+/**
+ * @brief Écrit la table en mémoire dans un nouveau run, puis fusionne les runs s'ils sont trop nombreux.
+ *
+ * Les chunks désignés doivent déjà être sur le disque.
+ *
+ * @param index L'index.
+ * @return int 0 si succès, -1 si erreur.
+ */
+int chunk_index_flush(chunk_index_t *index);
+
+#endif // CHUNK_INDEX_H
@@ -0,0 +1,279 @@
+#include "compression.h"
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+static const int compress_levels[COMPRESS_LEVEL_COUNT] = COMPRESS_LEVELS;
+
+// Fin d'un vidage Z_SYNC_FLUSH : toujours présente, elle n'est pas envoyée et le receveur la rajoute
+static const unsigned char sync_flush_tail[4] = { 0x00, 0x00, 0xFF, 0xFF };
+
+static double cpu_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+compressor_t *compressor_create(void) {
+    compressor_t *compressor = calloc(1, sizeof(compressor_t));
+    if (!compressor) {
+        perror("Memory allocation failed");
+        return NULL;
+    }
+    compressor->level_index = COMPRESS_INITIAL_INDEX;
+    // Flux deflate brut (sans en-tête zlib) : un seul flux par sens pour toute la connexion
+    if (deflateInit2(&compressor->deflater, compress_levels[COMPRESS_INITIAL_INDEX], Z_DEFLATED,
+                     -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        fprintf(stderr, "Impossible d'initialiser la compression\n");
+        free(compressor);
+        return NULL;
+    }
+    if (inflateInit2(&compressor->inflater, -MAX_WBITS) != Z_OK) {
+        fprintf(stderr, "Impossible d'initialiser la décompression\n");
+        deflateEnd(&compressor->deflater);
+        free(compressor);
+        return NULL;
+    }
+    return compressor;
+}
+
+void compressor_free(compressor_t *compressor) {
+    if (!compressor) {
+        return;
+    }
+    deflateEnd(&compressor->deflater);
+    inflateEnd(&compressor->inflater);
+    free(compressor->buffer);
+    free(compressor);
+}
+
+int compressor_active(const compressor_t *compressor) {
+    return compressor && compress_levels[compressor->level_index] > 0;
+}
+
+void compressor_note_wait(compressor_t *compressor, size_t bytes, double seconds) {
+    if (compressor) {
+        compressor->link_bytes += bytes;
+        compressor->link_seconds += seconds;
+    }
+}
+
+// Estime l'entropie d'un contenu sur quelques échantillons répartis
+static double sample_entropy(const unsigned char *data, uint32_t length) {
+    unsigned int counts[256] = { 0 };
+    const uint32_t span = 256;
+    uint32_t total = 0;
+    if (length <= 4 * span) {
+        for (uint32_t i = 0; i < length; i++) {
+            counts[data[i]]++;
+        }
+        total = length;
+    }
+    else {
+        for (int sample = 0; sample < 4; sample++) {
+            const unsigned char *start = data + (uint64_t)(length - span) * sample / 3;
+            for (uint32_t i = 0; i < span; i++) {
+                counts[start[i]]++;
+            }
+        }
+        total = 4 * span;
+    }
+    double entropy = 0;
+    for (int i = 0; i < 256; i++) {
+        if (counts[i]) {
+            double p = (double)counts[i] / total;
+            entropy -= p * log2(p);
+        }
+    }
+    return entropy;
+}
+
+// Un niveau jamais mesuré, ou mesuré il y a trop longtemps, doit être réessayé
+static int is_stale(const compressor_t *compressor, int index) {
+    const level_stats_t *stats = &compressor->stats[index];
+    return stats->window == 0 || compressor->windows - stats->window > COMPRESS_PROBE_WINDOWS;
+}
+
+// Temps d'envoi estimé par octet d'entrée : compression puis passage sur le lien
+static double cost_per_byte(const compressor_t *compressor, int index) {
+    if (index == 0) {
+        return 1.0 / compressor->link_rate;
+    }
+    const level_stats_t *stats = &compressor->stats[index];
+    return 1.0 / stats->speed + stats->ratio / compressor->link_rate;
+}
+
+static void choose_level(compressor_t *compressor) {
+    if (compressor->link_rate <= 0) {
+        return; // Rien n'a encore été envoyé : garder le niveau courant
+    }
+    int best = 0;
+    for (int i = 1; i < COMPRESS_LEVEL_COUNT; i++) {
+        if (!is_stale(compressor, i) && cost_per_byte(compressor, i) < cost_per_byte(compressor, best)) {
+            best = i;
+        }
+    }
+    // Essayer pendant une fenêtre le voisin du meilleur niveau dont la mesure manque
+    int next = best;
+    if (best + 1 < COMPRESS_LEVEL_COUNT && is_stale(compressor, best + 1)) {
+        next = best + 1;
+    }
+    else if (best - 1 > 0 && is_stale(compressor, best - 1)) {
+        next = best - 1;
+    }
+    compressor->level_index = next;
+}
+
+// Termine une fenêtre : met à jour les mesures du niveau courant et du lien, puis choisit le niveau suivant
+static void end_window(compressor_t *compressor) {
+    compressor->windows++;
+    if (compressor->window_compressed > 0 && compressor->window_cpu > 0) {
+        level_stats_t *stats = &compressor->stats[compressor->level_index];
+        double ratio = (double)compressor->window_output / compressor->window_compressed;
+        double speed = compressor->window_compressed / compressor->window_cpu;
+        int fresh = stats->window == 0;
+        stats->ratio = fresh ? ratio : (stats->ratio + ratio) / 2;
+        stats->speed = fresh ? speed : (stats->speed + speed) / 2;
+        stats->window = compressor->windows;
+    }
+    // Octets et temps d'attente cumulés avec un amortissement de moitié par fenêtre : une fenêtre
+    // absorbée par les tampons du noyau (attente quasi nulle) ne fausse pas longtemps l'estimation
+    if (compressor->link_seconds > 0) {
+        compressor->link_rate = compressor->link_bytes / compressor->link_seconds;
+    }
+    compressor->link_bytes /= 2;
+    compressor->link_seconds /= 2;
+    choose_level(compressor);
+    compressor->window_input = 0;
+    compressor->window_compressed = 0;
+    compressor->window_output = 0;
+    compressor->window_cpu = 0;
+}
+
+void compressor_count_plain(compressor_t *compressor, uint32_t length) {
+    if (!compressor) {
+        return;
+    }
+    compressor->window_input += length;
+    if (compressor->window_input >= COMPRESS_WINDOW) {
+        end_window(compressor);
+    }
+}
+
+static int ensure_buffer(unsigned char **buffer, size_t *capacity, size_t needed) {
+    if (needed <= *capacity) {
+        return 0;
+    }
+    unsigned char *grown = realloc(*buffer, needed);
+    if (!grown) {
+        perror("Memory allocation failed");
+        return -1;
+    }
+    *buffer = grown;
+    *capacity = needed;
+    return 0;
+}
+
+int compressor_deflate(compressor_t *compressor, const void *data, uint32_t length,
+                       const unsigned char **output, uint32_t *output_length) {
+    if (length < COMPRESS_MIN_SIZE) {
+        return 0;
+    }
+    compressor->window_input += length;
+    int level = compress_levels[compressor->level_index];
+    int compressed = 0;
+    if (level > 0 && sample_entropy(data, length) <= COMPRESS_ENTROPY_LIMIT) {
+        z_stream *stream = &compressor->deflater;
+        size_t bound = deflateBound(stream, length) + 16;
+        if (ensure_buffer(&compressor->buffer, &compressor->buffer_capacity, bound) != 0) {
+            return -1;
+        }
+        stats_span_t span;
+        stats_begin(STATS_COMPRESS, &span);
+        double start = cpu_seconds();
+        stream->next_out = compressor->buffer;
+        stream->avail_out = compressor->buffer_capacity;
+        // Le flux est vidé après chaque trame : le niveau peut changer sans rien perdre
+        if (deflateParams(stream, level, Z_DEFAULT_STRATEGY) != Z_OK) {
+            fprintf(stderr, "Impossible de changer le niveau de compression\n");
+            return -1;
+        }
+        stream->next_in = (unsigned char*)data;
+        stream->avail_in = length;
+        if (deflate(stream, Z_SYNC_FLUSH) != Z_OK || stream->avail_in != 0 || stream->avail_out == 0) {
+            fprintf(stderr, "Erreur de compression\n");
+            return -1;
+        }
+        size_t produced = compressor->buffer_capacity - stream->avail_out;
+        if (produced < sizeof(sync_flush_tail) ||
+            memcmp(compressor->buffer + produced - sizeof(sync_flush_tail), sync_flush_tail, sizeof(sync_flush_tail)) != 0) {
+            fprintf(stderr, "Erreur de compression\n");
+            return -1;
+        }
+        *output = compressor->buffer;
+        *output_length = produced - sizeof(sync_flush_tail);
+        compressor->window_cpu += cpu_seconds() - start;
+        stats_end(STATS_COMPRESS, &span, length, 0, 1);
+        compressor->window_compressed += length;
+        compressor->window_output += *output_length;
+        compressor->bytes_in += length;
+        compressor->bytes_out += *output_length;
+        compressed = 1;
+    }
+    if (compressor->window_input >= COMPRESS_WINDOW) {
+        end_window(compressor);
+    }
+    return compressed;
+}
+
+int compressor_inflate(compressor_t *compressor, const unsigned char *data, uint32_t length,
+                       unsigned char **output, size_t *capacity, uint32_t *output_length) {
+    z_stream *stream = &compressor->inflater;
+    stats_span_t span;
+    stats_begin(STATS_COMPRESS, &span);
+    size_t produced = 0;
+    int tail_fed = 0;
+    stream->next_in = (unsigned char*)data;
+    stream->avail_in = length;
+
+    while (1) {
+        if (stream->avail_in == 0 && !tail_fed) {
+            stream->next_in = (unsigned char*)sync_flush_tail;
+            stream->avail_in = sizeof(sync_flush_tail);
+            tail_fed = 1;
+        }
+        // Toujours un octet de réserve pour terminer les contenus texte
+        if (*capacity < produced + 2) {
+            size_t needed = *capacity ? *capacity * 2 : (size_t)length * 4 + 1024;
+            if (needed > COMPRESS_MAX_OUTPUT + 1) {
+                needed = COMPRESS_MAX_OUTPUT + 1;
+            }
+            if (needed < produced + 2 || ensure_buffer(output, capacity, needed) != 0) {
+                fprintf(stderr, "Contenu décompressé trop grand\n");
+                return -1;
+            }
+        }
+        stream->next_out = *output + produced;
+        stream->avail_out = *capacity - produced - 1;
+        int result = inflate(stream, Z_SYNC_FLUSH);
+        produced = *capacity - 1 - stream->avail_out;
+        if (result != Z_OK && result != Z_BUF_ERROR) {
+            fprintf(stderr, "Contenu compressé invalide\n");
+            return -1;
+        }
+        if (result == Z_BUF_ERROR && stream->avail_in > 0 && stream->avail_out > 0) {
+            fprintf(stderr, "Contenu compressé invalide\n");
+            return -1;
+        }
+        // Tout est lu et la sortie n'a pas été remplie : le contenu est complet
+        if (tail_fed && stream->avail_in == 0 && stream->avail_out > 0) {
+            break;
+        }
+    }
+    *output_length = produced;
+    stats_end(STATS_COMPRESS, &span, produced, 0, 1);
+    return 0;
+}
@@ -0,0 +1,132 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <zlib.h>
+
+/** @brief Niveaux zlib entre lesquels le compresseur choisit (0 : trames envoyées telles quelles) */
+#define COMPRESS_LEVELS { 0, 1, 3, 6, 9 }
+/** @brief Nombre de niveaux de COMPRESS_LEVELS */
+#define COMPRESS_LEVEL_COUNT 5
+/** @brief Niveau utilisé au début d'une connexion, le temps de mesurer le lien */
+#define COMPRESS_INITIAL_INDEX 1
+/** @brief Volume de données compressibles après lequel le niveau est réévalué */
+#define COMPRESS_WINDOW (1024 * 1024)
+/** @brief Après ce nombre de fenêtres, la mesure d'un niveau est périmée et il est réessayé */
+#define COMPRESS_PROBE_WINDOWS 64
+/** @brief Les contenus plus petits ne sont pas compressés */
+#define COMPRESS_MIN_SIZE 512
+/** @brief Taille maximale d'un contenu décompressé (celle d'une trame) */
+#define COMPRESS_MAX_OUTPUT (64u * 1024 * 1024)
+/** @brief Au-delà de cette entropie (bits par octet), un contenu est déjà compressé et passe tel quel */
+#define COMPRESS_ENTROPY_LIMIT 7.5
+
+/**
+ * @brief Mesures d'un niveau de compression (moyennes glissantes).
+ */
+typedef struct {
+    double ratio;           // Octets compressés par octet d'entrée
+    double speed;           // Octets d'entrée compressés par seconde de CPU
+    unsigned long window;   // Fenêtre de la dernière mesure (0 : jamais mesuré)
+} level_stats_t;
+
+/**
+ * @brief Compression d'une connexion : un flux deflate par sens, dont l'historique
+ * est partagé par toutes les trames, et le choix adaptatif du niveau d'émission.
+ *
+ * Le niveau retenu est celui qui minimise le temps par octet d'entrée, compression
+ * comprise : 1 / vitesse de compression + taux / débit du lien. Le débit du lien est
+ * mesuré sur le temps passé à attendre le réseau (envois bloqués et réponses du pair) ;
+ * un lien rapide fait donc choisir l'envoi sans compression, un lien lent les niveaux élevés.
+ */
+typedef struct {
+    z_stream deflater;
+    z_stream inflater;
+    int level_index;            // Indice du niveau d'émission dans COMPRESS_LEVELS
+    level_stats_t stats[COMPRESS_LEVEL_COUNT];
+    unsigned long windows;      // Fenêtres terminées
+    uint64_t window_input;      // Octets compressibles de la fenêtre en cours (compressés ou non)
+    uint64_t window_compressed; // Octets compressés dans la fenêtre, et leur taille en sortie
+    uint64_t window_output;
+    double window_cpu;          // Secondes de CPU passées à compresser dans la fenêtre
+    double link_bytes;          // Octets envoyés (moyenne amortie sur les fenêtres)
+    double link_seconds;        // ... et temps passé à attendre le réseau
+    double link_rate;           // Débit mesuré du lien (octets par seconde, 0 si inconnu)
+    unsigned char *buffer;      // Sortie de la dernière compression
+    size_t buffer_capacity;
+    uint64_t bytes_in;          // Totaux de la connexion, pour le résumé
+    uint64_t bytes_out;
+} compressor_t;
+
+/**
+ * @brief Crée les flux de compression d'une connexion.
+ *
+ * @return compressor_t* Le compresseur, NULL en cas d'erreur.
+ */
+compressor_t *compressor_create(void);
+
+/**
+ * @brief Libère un compresseur.
+ *
+ * @param compressor Le compresseur (peut être NULL).
+ */
+void compressor_free(compressor_t *compressor);
+
+/**
+ * @brief Compresse un contenu à émettre avec le niveau courant.
+ *
+ * Un contenu déjà compressé (forte entropie) ou trop petit n'entre pas dans le flux,
+ * pour que le pair puisse le lire tel quel.
+ *
+ * @param compressor Le compresseur.
+ * @param data Le contenu.
+ * @param length Sa taille.
+ * @param output Le contenu compressé (tampon du compresseur, valide jusqu'à l'appel suivant).
+ * @param output_length Sa taille.
+ * @return int 1 si le contenu est compressé, 0 s'il doit partir tel quel, -1 si erreur.
+ */
+int compressor_deflate(compressor_t *compressor, const void *data, uint32_t length,
+                       const unsigned char **output, uint32_t *output_length);
+
+/**
+ * @brief Compte un contenu compressible envoyé sans passer par le compresseur (sendfile),
+ * pour que le niveau continue d'être réévalué.
+ *
+ * @param compressor Le compresseur (peut être NULL).
+ * @param length La taille du contenu.
+ */
+void compressor_count_plain(compressor_t *compressor, uint32_t length);
+
+/**
+ * @brief Décompresse un contenu reçu, dans l'ordre des trames du pair.
+ *
+ * @param compressor Le compresseur.
+ * @param data Le contenu compressé.
+ * @param length Sa taille.
+ * @param output Le tampon de sortie, agrandi si besoin (un octet de plus est toujours disponible).
+ * @param capacity La taille du tampon de sortie.
+ * @param output_length La taille décompressée.
+ * @return int 0 si succès, -1 si le contenu est invalide ou trop grand.
+ */
+int compressor_inflate(compressor_t *compressor, const unsigned char *data, uint32_t length,
+                       unsigned char **output, size_t *capacity, uint32_t *output_length);
+
+/**
+ * @brief Indique si les contenus émis passent actuellement par le flux compressé.
+ *
+ * @param compressor Le compresseur (peut être NULL).
+ * @return int 1 si le niveau courant compresse, 0 sinon.
+ */
+int compressor_active(const compressor_t *compressor);
+
+/**
+ * @brief Enregistre une attente du réseau, pour estimer le débit du lien.
+ *
+ * @param compressor Le compresseur (peut être NULL).
+ * @param bytes Les octets envoyés pendant l'attente (0 pour l'attente d'une réponse).
+ * @param seconds Le temps passé à attendre.
+ */
+void compressor_note_wait(compressor_t *compressor, size_t bytes, double seconds);
+
+#endif // COMPRESSION_H
@@ -1,11 +1,23 @@
+#define _GNU_SOURCE // SEEK_DATA / SEEK_HOLE
 #include "deduplication.h"
 #include "file_handler.h"
+#include "stats.h"
+#include "trace.h"
+#include "governor.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <openssl/evp.h>
 #include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
 #include <arpa/inet.h> // For htonl and ntohl
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 unsigned int hash_md5(unsigned char *md5) {
     unsigned int hash = 0;
@@ -24,14 +36,30 @@ void bytes_to_hex(const unsigned char *bytes, size_t len, unsigned char *hex) {
     hex[2  *len] = '\0';
 }
 
-void compute_md5(void *data, size_t len, unsigned char *md5_hex_out) {
-    unsigned char md5_out[MD5_DIGEST_LENGTH];
+int hex_to_bytes(const unsigned char *hex, size_t len, unsigned char *bytes) {
+    for (size_t i = 0; i < len; i++) {
+        unsigned int value;
+        char pair[3] = { (char)hex[2 * i], (char)hex[2 * i + 1], '\0' };
+        if (sscanf(pair, "%2x", &value) != 1) {
+            return -1;
+        }
+        bytes[i] = (unsigned char)value;
+    }
+    return 0;
+}
+
+static EVP_MD_CTX *new_md5_context(void) {
     EVP_MD_CTX *mdctx = EVP_MD_CTX_new();
     if (mdctx == NULL) {
         fprintf(stderr, "Failed to create EVP_MD_CTX\n");
         exit(EXIT_FAILURE);
     }
+    return mdctx;
+}
 
+// Calcule le MD5 avec un contexte fourni, que l'appelant libère
+static void compute_md5_with(EVP_MD_CTX *mdctx, const void *data, size_t len, unsigned char *md5_hex_out) {
+    unsigned char md5_out[MD5_DIGEST_LENGTH];
     if (EVP_DigestInit_ex(mdctx, EVP_md5(), NULL) != 1 ||
         EVP_DigestUpdate(mdctx, data, len) != 1 ||
         EVP_DigestFinal_ex(mdctx, md5_out, NULL) != 1) {
@@ -40,15 +68,51 @@ void compute_md5(void *data, size_t len, unsigned char *md5_hex_out) {
         exit(EXIT_FAILURE);
     }
 
-    EVP_MD_CTX_free(mdctx);
-
     // Convertir le hachage en chaîne hexadécimale
     bytes_to_hex(md5_out, MD5_DIGEST_LENGTH, md5_hex_out);
 }
 
+void compute_md5(void *data, size_t len, unsigned char *md5_hex_out) {
+    EVP_MD_CTX *mdctx = new_md5_context();
+    compute_md5_with(mdctx, data, len, md5_hex_out);
+    EVP_MD_CTX_free(mdctx);
+}
+
+int is_zero_block(const void *data, size_t len) {
+    const unsigned char *bytes = (const unsigned char*)data;
+    size_t i = 0;
+#ifdef __SSE2__
+    // OU logique de blocs de 64 octets, testé une seule fois par bloc
+    for (; i + 64 <= len; i += 64) {
+        __m128i acc = _mm_or_si128(
+            _mm_or_si128(_mm_loadu_si128((const __m128i*)(bytes + i)),
+                         _mm_loadu_si128((const __m128i*)(bytes + i + 16))),
+            _mm_or_si128(_mm_loadu_si128((const __m128i*)(bytes + i + 32)),
+                         _mm_loadu_si128((const __m128i*)(bytes + i + 48))));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) != 0xFFFF) {
+            return 0;
+        }
+    }
+#endif
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        if (word != 0) {
+            return 0;
+        }
+    }
+    for (; i < len; i++) {
+        if (bytes[i] != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
 int find_md5(Md5Entry *hash_table[HASH_TABLE_SIZE  ], unsigned char *md5) {
     unsigned int index = hash_md5(md5);
-    while (hash_table[index]->index != -1) {
+    // Le sondage s'arrête après un tour complet pour ne pas boucler sur une table pleine
+    for (int probes = 0; probes < HASH_TABLE_SIZE && hash_table[index]->index != -1; probes++) {
         if (memcmp(hash_table[index]->md5, md5, MD5_DIGEST_LENGTH  ) == 0) {
             return hash_table[index]->index;
         }
@@ -59,7 +123,11 @@ int find_md5(Md5Entry *hash_table[HASH_TABLE_SIZE  ], unsigned char *md5) {
 
 void add_md5(Md5Entry *hash_table[HASH_TABLE_SIZE ], unsigned char *md5, int index) {
     unsigned int hash = hash_md5(md5);
-    while (hash_table[hash]->index != -1) {
+    for (int probes = 0; hash_table[hash]->index != -1; probes++) {
+        if (probes == HASH_TABLE_SIZE) {
+            // Table pleine : le chunk reste stocké mais ne servira pas de référence
+            return;
+        }
         hash = (hash + 1) % HASH_TABLE_SIZE;
     }
     memcpy(hash_table[hash]->md5, md5, MD5_DIGEST_LENGTH);
@@ -87,92 +155,387 @@ void clean_hash_table(Md5Entry *hash_table[HASH_TABLE_SIZE  ]) {
 }
 
 
-void deduplicate_file(FILE *file, Chunk **chunks, Md5Entry *hash_table[HASH_TABLE_SIZE  ]) {
-    int chunk_index = 0;
+// Lit jusqu'à len octets à la position offset, en répétant pread jusqu'à la fin du fichier
+static size_t read_full(int fd, unsigned char *buffer, size_t len, off_t offset) {
+    size_t total = 0;
+    while (total < len) {
+        ssize_t n = pread(fd, buffer + total, len - total, offset + total);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Failed to read source file");
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+        total += n;
+    }
+    return total;
+}
+
+// Alloue un chunk et y copie l'enregistrement fourni
+static Chunk *new_chunk(const void *record, size_t size) {
+    Chunk *chunk = malloc(sizeof(Chunk));
+    if (chunk == NULL) {
+        fprintf(stderr, "Failed to allocate memory for chunk\n");
+        exit(EXIT_FAILURE);
+    }
+    chunk->data = malloc(size);
+    if (chunk->data == NULL) {
+        fprintf(stderr, "Failed to allocate memory for chunk data\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(chunk->data, record, size);
+    chunk->view = NULL;
+    chunk->size = size;
+    chunk->md5[0] = '\0';
+    return chunk;
+}
+
+// Crée un chunk normal désignant ses données dans la projection du fichier, sans copie
+static Chunk *new_view_chunk(const unsigned char *view, size_t len) {
+    Chunk *chunk = malloc(sizeof(Chunk));
+    if (chunk == NULL) {
+        fprintf(stderr, "Failed to allocate memory for chunk\n");
+        exit(EXIT_FAILURE);
+    }
+    chunk->data = NULL;
+    chunk->view = view;
+    chunk->size = len + 1;
+    chunk->md5[0] = '\0';
+    return chunk;
+}
+
+const unsigned char *chunk_payload(const Chunk *chunk) {
+    return chunk->view ? chunk->view : (const unsigned char*)chunk->data + 1;
+}
+
+// Crée l'enregistrement CHUNK_TYPE_ZERO d'une plage de zéros
+static Chunk *new_zero_chunk(uint64_t length) {
+    unsigned char record[ZERO_RUN_SIZE];
+    record[0] = CHUNK_TYPE_ZERO;
+    memcpy(record + 1, &length, sizeof(uint64_t));
+    return new_chunk(record, ZERO_RUN_SIZE);
+}
+
+Chunk *make_data_chunk(const void *data, size_t len) {
+    unsigned char record[CHUNK_SIZE];
+    record[0] = CHUNK_TYPE_DATA;
+    memcpy(record + 1, data, len);
+    Chunk *chunk = new_chunk(record, len + 1);
+    compute_md5((void*)data, len, chunk->md5);
+    return chunk;
+}
+
+Chunk *make_zero_chunk(uint64_t length) {
+    return new_zero_chunk(length);
+}
+
+void dedup_init(dedup_state_t *state, FILE *file, Md5Entry *hash_table[HASH_TABLE_SIZE]) {
+    state->fd = fileno(file);
+    state->offset = ftello(file);
+    state->data_start = state->offset;
+    state->data_end = state->offset;
+    state->zero_run = 0;
+    state->chunk_index = 0;
+    state->done = 0;
+    state->hash_table = hash_table;
+    state->input.data = NULL;
+    state->input_truncated = 0;
+}
+
+void dedup_init_buffer(dedup_state_t *state, const unsigned char *data, size_t size,
+                       Md5Entry *hash_table[HASH_TABLE_SIZE]) {
+    state->fd = -1;
+    state->offset = 0;
+    // Aucun trou à chercher : tout le contenu est une seule plage de données
+    state->data_start = 0;
+    state->data_end = (off_t)INT64_MAX;
+    state->zero_run = 0;
+    state->chunk_index = 0;
+    state->done = 0;
+    state->hash_table = hash_table;
+    memset(&state->input, 0, sizeof(state->input));
+    state->input.fd = -1;
+    state->input.data = data;
+    state->input.size = size;
+    state->input_truncated = 0;
+}
+
+int dedup_map(dedup_state_t *state) {
+    if (mapped_file_open(&state->input, state->fd) != 0) {
+        state->input.data = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void dedup_finish(dedup_state_t *state) {
+    if (state->input.data && state->fd >= 0) {
+        mapped_file_close(&state->input);
+        state->input.data = NULL;
+    }
+}
+
+// Examine un chunk lu en place dans la projection : zéros, sinon son MD5. Renvoie -1 si le
+// fichier a été tronqué pendant la lecture (SIGBUS), le contexte MD5 est alors tout de même libéré
+static int scan_mapped_chunk(const unsigned char *data, size_t len, int *zero, unsigned char *md5) {
+    EVP_MD_CTX *mdctx = new_md5_context();
+    if (MAPPED_GUARD() != 0) {
+        EVP_MD_CTX_free(mdctx);
+        return -1;
+    }
+    *zero = is_zero_block(data, len);
+    if (!*zero) {
+        stats_span_t span;
+        stats_begin(STATS_HASH, &span);
+        compute_md5_with(mdctx, data, len, md5);
+        stats_end(STATS_HASH, &span, len, 0, 1);
+    }
+    mapped_guard_disarm();
+    EVP_MD_CTX_free(mdctx);
+    return 0;
+}
+
+int dedup_next(dedup_state_t *state, Chunk **chunks, int max_chunks) {
+    uint64_t trace_start = trace_begin();
+    off_t batch_start = state->offset;
+    int count = 0;
     unsigned char buffer[CHUNK_SIZE];
     size_t bytes_read;
+    uint64_t batch_read = 0; // Octets lus, hors trous sautés
+
+    if (state->input.data && state->fd >= 0) {
+        // Les chunks du lot précédent sont écrits : leurs pages peuvent être rendues au noyau
+        mapped_file_release(&state->input, state->offset);
+    }
+
+    // Un tour de boucle produit au plus deux chunks (plage de zéros puis chunk de données)
+    while (!state->done && count + 2 <= max_chunks) {
+        size_t want = CHUNK_SIZE - 1;
+
+        if (state->offset >= state->data_end) {
+            // Demander au noyau où commence le prochain extent de données
+            state->data_start = lseek(state->fd, state->offset, SEEK_DATA);
+            if (state->data_start == -1) {
+                if (errno == ENXIO) {
+                    // Plus aucune donnée : le reste du fichier est un trou
+                    struct stat st;
+                    state->data_start = (fstat(state->fd, &st) == 0) ? st.st_size : state->offset;
+                    state->data_end = state->data_start;
+                }
+                else {
+                    // Système de fichiers sans support des trous : tout est donnée
+                    state->data_start = state->offset;
+                    state->data_end = (off_t)INT64_MAX;
+                }
+            }
+            else {
+                state->data_end = lseek(state->fd, state->data_start, SEEK_HOLE);
+                if (state->data_end == -1) {
+                    state->data_end = (off_t)INT64_MAX;
+                }
+            }
+        }
 
-    while ((bytes_read = fread(buffer, 1, CHUNK_SIZE - 1, file)) > 0) {
+        if (state->offset + (off_t)want <= state->data_start) {
+            // Chunk entièrement dans un trou : aucune lecture nécessaire
+            state->zero_run += want;
+            state->offset += want;
+            continue;
+        }
+
+        const unsigned char *data = buffer;
         unsigned char md5[MD5_DIGEST_LENGTH  *2 + 1];
-        compute_md5(buffer, bytes_read, md5);
+        int zero = 0;
+        int mapped = state->input.data && !state->input_truncated;
+        if (mapped) {
+            // Fichier projeté : les données sont lues en place
+            bytes_read = state->offset < state->input.size ? (size_t)(state->input.size - state->offset) : 0;
+            if (bytes_read > want) {
+                bytes_read = want;
+            }
+            data = state->input.data + state->offset;
+            if (bytes_read > 0 && scan_mapped_chunk(data, bytes_read, &zero, md5) != 0) {
+                // Fichier tronqué pendant la sauvegarde : la suite est lue par pread, jusqu'à sa nouvelle fin
+                state->input_truncated = 1;
+                continue;
+            }
+        }
+        else {
+            bytes_read = read_full(state->fd, buffer, want, state->offset);
+            zero = is_zero_block(data, bytes_read);
+        }
+        if (bytes_read == 0) {
+            state->done = 1;
+            break;
+        }
+        state->offset += bytes_read;
+        batch_read += bytes_read;
+
+        if (zero) {
+            state->zero_run += bytes_read;
+            continue;
+        }
+        if (state->zero_run > 0) {
+            chunks[count++] = new_zero_chunk(state->zero_run);
+            state->chunk_index++;
+            state->zero_run = 0;
+        }
+
+        stats_span_t span;
+        if (!mapped) {
+            stats_begin(STATS_HASH, &span);
+            compute_md5((void*)data, bytes_read, md5);
+            stats_end(STATS_HASH, &span, bytes_read, 0, 1);
+        }
 
-        int index = find_md5(hash_table, md5);
+        stats_begin(STATS_INDEX, &span);
+        int index = find_md5(state->hash_table, md5);
         if (index == -1) {
             // Nouveau chunk, ajouter à la table de hachage
-            add_md5(hash_table, md5, chunk_index);
-            chunks[chunk_index] = malloc(sizeof(Chunk)); // Allocate memory for the chunk
-            if (chunks[chunk_index] == NULL) {
-                fprintf(stderr, "Failed to allocate memory for chunk\n");
-                exit(EXIT_FAILURE);
+            add_md5(state->hash_table, md5, state->chunk_index);
+            stats_end(STATS_INDEX, &span, 0, 0, 1);
+            if (mapped) {
+                chunks[count] = new_view_chunk(data, bytes_read);
             }
-            chunks[chunk_index]->data = malloc(CHUNK_SIZE);
-            if (chunks[chunk_index]->data == NULL) {
-                fprintf(stderr, "Failed to allocate memory for chunk data\n");
-                exit(EXIT_FAILURE);
+            else {
+                unsigned char record[CHUNK_SIZE];
+                record[0] = CHUNK_TYPE_DATA; // Indiquer que c'est un chunk normal
+                memcpy(record + 1, buffer, bytes_read);
+                chunks[count] = new_chunk(record, bytes_read + 1);
             }
-            unsigned char *data = (unsigned char*)chunks[chunk_index]->data;
-            data[0] = 01; // Indiquer que c'est un chunk normal
-            memcpy(data + 1, buffer, bytes_read);
-            // Remplir les octets restants avec des zéros
-            chunks[chunk_index]->size = bytes_read + 1;
-            chunk_index++;
+            memcpy(chunks[count]->md5, md5, sizeof(md5));
         }
         else {
             // Chunk déjà présent, créer un sub_chunk de référence
-            unsigned char sub_chunk[SUB_CHUNK_SIZE];
-            sub_chunk[0] = 00; // Premier bit à 0 pour indiquer un sub_chunk
+            stats_end(STATS_INDEX, &span, 0, 0, 1);
+            stats_count(STATS_INDEX, 0, 0, 0, 1);
+            unsigned char sub_chunk[SUB_CHUNK_SIZE] = { 0 };
+            sub_chunk[0] = CHUNK_TYPE_REFERENCE; // Premier octet à 0 pour indiquer un sub_chunk
             memcpy(sub_chunk + 1, &index, sizeof(int)); // Stocker l'index en binaire
-            chunks[chunk_index] = malloc(sizeof(Chunk)); // Allocate memory for the chunk
-            if (chunks[chunk_index] == NULL) {
-                fprintf(stderr, "Failed to allocate memory for chunk\n");
-                exit(EXIT_FAILURE);
-            }
-            chunks[chunk_index]->data = malloc(SUB_CHUNK_SIZE);
-            if (chunks[chunk_index]->data == NULL) {
-                fprintf(stderr, "Failed to allocate memory for chunk data\n");
-                exit(EXIT_FAILURE);
-            }
-            memcpy(chunks[chunk_index]->data, sub_chunk, SUB_CHUNK_SIZE);
+            chunks[count] = new_chunk(sub_chunk, SUB_CHUNK_SIZE);
+        }
+        count++;
+        state->chunk_index++;
+    }
 
-            chunks[chunk_index]->size = SUB_CHUNK_SIZE;
-            // Remplir les octets restants avec des zéros
-            chunk_index++;
+    if (state->done && state->zero_run > 0 && count < max_chunks) {
+        // Une plage de trous peut dépasser la fin réelle du fichier : la ramener à sa taille
+        struct stat st;
+        if (state->fd >= 0 && fstat(state->fd, &st) == 0 && state->offset > st.st_size) {
+            state->zero_run -= state->offset - st.st_size;
+        }
+        if (state->zero_run > 0) {
+            chunks[count++] = new_zero_chunk(state->zero_run);
+            state->chunk_index++;
         }
+        state->zero_run = 0;
+    }
+
+    if (!state->input.data && cache_neutral() && state->offset > batch_start) {
+        // Mode --cache-neutral sans projection : les pages lues par ce lot quittent le cache
+        posix_fadvise(state->fd, batch_start, state->offset - batch_start, POSIX_FADV_DONTNEED);
     }
+    if (state->fd >= 0) {
+        governor_read(batch_read);
+    }
+    trace_end(trace_start, "backup", "deduplicate_file", NULL, state->offset - batch_start);
+    return count;
+}
+
+int deduplicate_file(FILE *file, Chunk **chunks, Md5Entry *hash_table[HASH_TABLE_SIZE  ]) {
+    dedup_state_t state;
+    dedup_init(&state, file, hash_table);
+    return dedup_next(&state, chunks, INT_MAX);
 }
 
 
-void undeduplicate_file(FILE *file, Chunk **chunks, int *chunk_count) {
+// Agrandit le tableau de chunks restaurés si nécessaire
+static Chunk **grow_chunks(Chunk **chunks, int *capacity, int needed) {
+    if (needed <= *capacity) {
+        return chunks;
+    }
+    int new_capacity = *capacity ? *capacity * 2 : 64;
+    Chunk **grown = realloc(chunks, new_capacity * sizeof(Chunk*));
+    if (grown == NULL) {
+        fprintf(stderr, "Failed to allocate memory for chunk array\n");
+        exit(EXIT_FAILURE);
+    }
+    *capacity = new_capacity;
+    return grown;
+}
+
+Chunk **undeduplicate_file(FILE *file, pack_store_t *store, int *chunk_count) {
     int chunk_index = 0;
+    int capacity = 0;
+    Chunk **chunks = NULL;
     unsigned char buffer[CHUNK_SIZE];
     size_t bytes_read;
+    int marker;
 
-    while ((bytes_read = fread(buffer, 1, CHUNK_SIZE, file)) > 0) {
+    // Les enregistrements sont lus un par un selon leur marqueur, leur taille dépend du type
+    while ((marker = fgetc(file)) != EOF) {
+        chunks = grow_chunks(chunks, &capacity, chunk_index + 1);
         chunks[chunk_index] = malloc(sizeof(Chunk));
         if (chunks[chunk_index] == NULL) {
             fprintf(stderr, "Failed to allocate memory for chunk\n");
             exit(EXIT_FAILURE);
         }
+        chunks[chunk_index]->view = NULL;
 
-        if (buffer[0] == 1) {  // Chunk normal
-            chunks[chunk_index]->data = malloc(bytes_read - 1);
+        if (marker == CHUNK_TYPE_DATA) {  // Chunk normal
+            bytes_read = fread(buffer, 1, CHUNK_SIZE - 1, file);
+            chunks[chunk_index]->data = malloc(bytes_read);
             if (chunks[chunk_index]->data == NULL) {
                 fprintf(stderr, "Failed to allocate memory for chunk data\n");
                 exit(EXIT_FAILURE);
             }
             // Copier tout le contenu sauf le marqueur
-            memcpy(chunks[chunk_index]->data, buffer + 1, bytes_read - 1);
-            chunks[chunk_index]->size = bytes_read - 1;  // Taille en octets
+            memcpy(chunks[chunk_index]->data, buffer, bytes_read);
+            chunks[chunk_index]->size = bytes_read;  // Taille en octets
+        }
+        else if (marker == CHUNK_TYPE_ZERO) {  // Plage de zéros
+            uint64_t length;
+            if (fread(&length, 1, sizeof(uint64_t), file) != sizeof(uint64_t)) {
+                fprintf(stderr, "Not enough bytes read for zero run length\n");
+                free(chunks[chunk_index]);
+                break;
+            }
+            chunks[chunk_index]->data = NULL;
+            chunks[chunk_index]->size = length;
+        }
+        else if (marker == CHUNK_TYPE_DIGEST) {  // Chunk stocké dans le dépôt pack
+            unsigned char key[MD5_DIGEST_LENGTH * 2 + 1];
+            pack_ref_t ref;
+            if (fread(key, 1, MD5_DIGEST_LENGTH * 2, file) != MD5_DIGEST_LENGTH * 2) {
+                fprintf(stderr, "Not enough bytes read for chunk digest\n");
+                free(chunks[chunk_index]);
+                break;
+            }
+            key[MD5_DIGEST_LENGTH * 2] = '\0';
+            if (!store || !pack_store_lookup(store, (char*)key, &ref) ||
+                (chunks[chunk_index]->data = pack_store_read(store, &ref)) == NULL) {
+                // Chunk vide gardé à sa place pour que les références suivantes restent alignées
+                fprintf(stderr, "Missing chunk in repository: %s\n", key);
+                chunks[chunk_index]->data = NULL;
+                chunks[chunk_index]->size = 0;
+            }
+            else {
+                chunks[chunk_index]->size = ref.length;
+            }
         }
-        else if (buffer[0] == 0) {  // Sub_chunk
+        else if (marker == CHUNK_TYPE_REFERENCE) {  // Sub_chunk
             int ref_index;
-            if (bytes_read < sizeof(int) + 1) {
+            bytes_read = fread(buffer, 1, SUB_CHUNK_SIZE - 1, file);
+            if (bytes_read < sizeof(int)) {
                 fprintf(stderr, "Not enough bytes read for sub_chunk reference\n");
                 free(chunks[chunk_index]);
-                chunks[chunk_index] = NULL;
-                continue;
+                break;
             }
-            memcpy(&ref_index, buffer + 1, sizeof(int));
+            memcpy(&ref_index, buffer, sizeof(int));
 
             if (ref_index >= 0 && ref_index < chunk_index && chunks[ref_index] && chunks[ref_index]->data) {
                 chunks[chunk_index]->data = malloc(chunks[ref_index]->size);
@@ -191,14 +554,14 @@ void undeduplicate_file(FILE *file, Chunk **chunks, int *chunk_count) {
             }
         }
         else {
-            fprintf(stderr, "Unknown chunk type: %d\n", buffer[0]);
+            fprintf(stderr, "Unknown chunk type: %d\n", marker);
             free(chunks[chunk_index]);
-            chunks[chunk_index] = NULL;
-            continue;
+            break;
         }
 
         chunk_index++;
     }
 
     *chunk_count = chunk_index;
+    return chunks;
 }
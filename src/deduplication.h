@@ -8,10 +8,14 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
 #include <string.h>
 #include <openssl/evp.h>
 #include <openssl/md5.h>
 #include <dirent.h>
+#include "pack_store.h"
+#include "file_handler.h"
 
 // Constantes pour la gestion des chunks
 /** @brief Taille d'un chunk normal (4096 octets) */
@@ -22,14 +26,41 @@
 /** dont on a déjà calculé le MD5 pour effectuer les comparaisons*/
 #define HASH_TABLE_SIZE 1000
 
+// Marqueurs placés en tête de chaque enregistrement du fichier dédupliqué
+/** @brief Référence vers un chunk déjà écrit dans le même fichier */
+#define CHUNK_TYPE_REFERENCE 0
+/** @brief Chunk normal, suivi de ses données */
+#define CHUNK_TYPE_DATA 1
+/** @brief Plage de zéros (trou ou bloc nul), suivie de sa longueur sur 64 bits */
+#define CHUNK_TYPE_ZERO 2
+/** @brief Chunk stocké dans le dépôt pack, suivi de son MD5 en hexadécimal */
+#define CHUNK_TYPE_DIGEST 3
+/** @brief Taille d'un enregistrement de plage de zéros (marqueur + longueur) */
+#define ZERO_RUN_SIZE (1 + sizeof(uint64_t))
+/** @brief Taille d'un enregistrement de référence par empreinte (marqueur + MD5 hexadécimal) */
+#define DIGEST_RECORD_SIZE (1 + MD5_DIGEST_LENGTH * 2)
+
 /**
  * @brief Structure représentant un chunk de données.
+ *
+ * Une fois restauré, un chunk dont data vaut NULL représente une plage
+ * de size octets nuls à recréer sous forme de trou.
  */
 typedef struct {
     size_t size;  // Taille du chunk
-    void *data;   // Données du chunk
+    void *data;   // Données du chunk, NULL pour un chunk normal lu dans une projection
+    const unsigned char *view; // Chunk normal projeté : ses size - 1 octets, sans le marqueur et sans copie
+    unsigned char md5[MD5_DIGEST_LENGTH * 2 + 1]; // MD5 des données d'un chunk normal, vide sinon
 } Chunk;
 
+/**
+ * @brief Donne les données d'un chunk normal, sans son marqueur CHUNK_TYPE_DATA.
+ *
+ * @param chunk Le chunk (copié ou projeté).
+ * @return const unsigned char* Ses chunk->size - 1 octets de données.
+ */
+const unsigned char *chunk_payload(const Chunk *chunk);
+
 /**
  * @brief Structure pour stocker un MD5 et son index dans la table de hachage.
  */
@@ -55,6 +86,36 @@ unsigned int hash_md5(unsigned char *md5);
  */
 void compute_md5(void *data, size_t len, unsigned char *md5_out);
 
+/**
+ * @brief Convertit des octets en chaîne hexadécimale.
+ *
+ * @param bytes Les octets à convertir.
+ * @param len Le nombre d'octets.
+ * @param hex Le buffer de sortie (2 * len + 1 octets).
+ */
+void bytes_to_hex(const unsigned char *bytes, size_t len, unsigned char *hex);
+
+/**
+ * @brief Convertit une chaîne hexadécimale en octets.
+ *
+ * @param hex La chaîne hexadécimale (2 * len caractères).
+ * @param len Le nombre d'octets attendus.
+ * @param bytes Le buffer de sortie.
+ * @return int 0 si succès, -1 si la chaîne n'est pas hexadécimale.
+ */
+int hex_to_bytes(const unsigned char *hex, size_t len, unsigned char *bytes);
+
+/**
+ * @brief Vérifie si un bloc de données ne contient que des zéros.
+ *
+ * Utilise SSE2 lorsqu'il est disponible, sinon une comparaison par mots de 64 bits.
+ *
+ * @param data Les données à tester.
+ * @param len La taille des données.
+ * @return int 1 si le bloc est entièrement nul, 0 sinon.
+ */
+int is_zero_block(const void *data, size_t len);
+
 /**
  * @brief Cherche un MD5 dans la table de hachage.
  *
@@ -87,22 +148,119 @@ void init_hash_table(Md5Entry *hash_table[HASH_TABLE_SIZE]);
  */
 void clean_hash_table(Md5Entry *hash_table[HASH_TABLE_SIZE]);
 
+/**
+ * @brief État d'une déduplication menée par lots (voir dedup_next).
+ */
+typedef struct {
+    int fd;              // -1 : contenu en mémoire (dedup_init_buffer)
+    off_t offset;        // Prochain octet à lire
+    off_t data_start;    // Extent de données courant : [offset, data_start) est un trou
+    off_t data_end;
+    uint64_t zero_run;   // Plage de zéros en cours, pas encore émise
+    int chunk_index;     // Index dans le fichier du prochain chunk (les références s'y rapportent)
+    int done;
+    Md5Entry **hash_table;
+    mapped_file_t input;        // Projection du fichier (dedup_map), input.data NULL : lecture par pread et copie
+    int input_truncated;        // Le fichier a rétréci pendant la lecture projetée : la suite est lue par pread
+} dedup_state_t;
+
+/**
+ * @brief Prépare la déduplication par lots d'un fichier, à partir de sa position courante.
+ *
+ * @param state L'état à initialiser.
+ * @param file Le fichier à dédupliquer.
+ * @param hash_table La table de hachage pour la déduplication, partagée par tous les lots.
+ */
+void dedup_init(dedup_state_t *state, FILE *file, Md5Entry *hash_table[HASH_TABLE_SIZE]);
+
+/**
+ * @brief Prépare la déduplication par lots d'un contenu déjà en mémoire (fichier lu par l'ingestion).
+ *
+ * Les chunks normaux désignent le contenu (Chunk.view), qui doit rester valide jusqu'à leur
+ * écriture ; dedup_finish n'a rien à libérer.
+ *
+ * @param state L'état à initialiser.
+ * @param data Le contenu du fichier.
+ * @param size Sa taille.
+ * @param hash_table La table de hachage pour la déduplication.
+ */
+void dedup_init_buffer(dedup_state_t *state, const unsigned char *data, size_t size,
+                       Md5Entry *hash_table[HASH_TABLE_SIZE]);
+
+/**
+ * @brief Projette en mémoire le fichier d'une déduplication par lots (mapped_file_open) : les
+ * chunks normaux produits ensuite désignent la projection (Chunk.view) au lieu d'une copie.
+ *
+ * Les pages lues pendant un lot sont rendues au noyau au début du lot suivant, une fois ses
+ * chunks écrits (mapped_file_release). Les chunks projetés restent lisibles jusqu'à dedup_finish.
+ * Si le fichier est tronqué pendant la lecture, la suite est lue par pread ; les chunks projetés
+ * au-delà de sa nouvelle fin ne se lisent plus que par mapped_copy, qui signale l'erreur.
+ *
+ * @param state L'état initialisé par dedup_init.
+ * @return int 0 si le fichier est projeté, -1 sinon (la déduplication se fait alors par copie).
+ */
+int dedup_map(dedup_state_t *state);
+
+/**
+ * @brief Termine une déduplication par lots : libère la projection et le cache des pages lues.
+ *
+ * @param state L'état de la déduplication.
+ */
+void dedup_finish(dedup_state_t *state);
+
+/**
+ * @brief Produit le lot suivant de chunks d'un fichier.
+ *
+ * Les chunks d'un lot peuvent être écrits puis libérés avant le lot suivant : seule la
+ * table de hachage relie les lots, et les références désignent l'index du chunk dans le fichier.
+ *
+ * @param state L'état de la déduplication.
+ * @param chunks Le tableau des chunks du lot.
+ * @param max_chunks Sa taille (au moins 2).
+ * @return int Le nombre de chunks produits, 0 à la fin du fichier.
+ */
+int dedup_next(dedup_state_t *state, Chunk **chunks, int max_chunks);
+
 /**
  * @brief Déduplique un fichier en chunks.
  *
+ * Les trous signalés par le noyau (SEEK_DATA/SEEK_HOLE) sont sautés sans être lus
+ * et les chunks entièrement nuls ne sont ni hachés ni indexés : les chunks nuls
+ * consécutifs sont fusionnés en un seul enregistrement CHUNK_TYPE_ZERO.
+ *
  * @param file Le fichier à dédupliquer.
- * @param chunks Le tableau de chunks résultant.
+ * @param chunks Le tableau de chunks résultant, d'au moins
+ * (taille + CHUNK_SIZE - 2) / (CHUNK_SIZE - 1) entrées.
  * @param hash_table La table de hachage pour la déduplication.
+ * @return int Le nombre de chunks produits.
+ */
+int deduplicate_file(FILE *file, Chunk **chunks, Md5Entry *hash_table[HASH_TABLE_SIZE]);
+
+/**
+ * @brief Crée un chunk normal (enregistrement CHUNK_TYPE_DATA) et calcule son MD5.
+ *
+ * @param data Les données du chunk.
+ * @param len Leur taille, au plus CHUNK_SIZE - 1 octets.
+ * @return Chunk* Le chunk alloué.
+ */
+Chunk *make_data_chunk(const void *data, size_t len);
+
+/**
+ * @brief Crée l'enregistrement CHUNK_TYPE_ZERO d'une plage de zéros.
+ *
+ * @param length La longueur de la plage.
+ * @return Chunk* Le chunk alloué.
  */
-void deduplicate_file(FILE *file, Chunk **chunks, Md5Entry *hash_table[HASH_TABLE_SIZE]);
+Chunk *make_zero_chunk(uint64_t length);
 
 /**
  * @brief Reconstruit un fichier à partir de ses chunks dédupliqués.
  *
  * @param file Le fichier source contenant les chunks.
- * @param chunks Le tableau pour stocker les chunks reconstruits.
+ * @param store Le dépôt pack où chercher les chunks référencés par empreinte (peut être NULL).
  * @param chunk_count Le nombre de chunks lus.
+ * @return Chunk** Le tableau des chunks reconstruits (à libérer par l'appelant), NULL si vide.
  */
-void undeduplicate_file(FILE *file, Chunk **chunks, int *chunk_count);
+Chunk **undeduplicate_file(FILE *file, pack_store_t *store, int *chunk_count);
 
 #endif // DEDUPLICATION_H
\ No newline at end of file
@@ -0,0 +1,272 @@
+#include "delta.h"
+#include "backup_manager.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+uint32_t weak_checksum(const unsigned char *data, size_t len) {
+    uint32_t a = 0;
+    uint32_t b = 0;
+    for (size_t i = 0; i < len; i++) {
+        a += data[i];
+        b += (uint32_t)(len - i) * data[i];
+    }
+    return (a & 0xFFFF) | (b << 16);
+}
+
+void encode_signature(const chunk_signature_t *signature, unsigned char *out) {
+    uint32_t weak = htonl(signature->weak);
+    uint32_t length = htonl(signature->length);
+    memcpy(out, &weak, 4);
+    memcpy(out + 4, signature->md5, MD5_DIGEST_LENGTH);
+    memcpy(out + 4 + MD5_DIGEST_LENGTH, &length, 4);
+}
+
+void decode_signature(const unsigned char *data, chunk_signature_t *signature) {
+    uint32_t weak;
+    uint32_t length;
+    memcpy(&weak, data, 4);
+    memcpy(signature->md5, data + 4, MD5_DIGEST_LENGTH);
+    memcpy(&length, data + 4 + MD5_DIGEST_LENGTH, 4);
+    signature->weak = ntohl(weak);
+    signature->length = ntohl(length);
+}
+
+// Table d'adressage ouvert des signatures, indexée par somme faible
+typedef struct {
+    const chunk_signature_t *signatures;
+    int *slots;          // Index de la signature, -1 si libre
+    uint32_t mask;
+} signature_table_t;
+
+static uint32_t slot_of(uint32_t weak, uint32_t mask) {
+    return (weak ^ (weak >> 15)) * 2654435761u & mask;
+}
+
+static int build_signature_table(signature_table_t *table, const chunk_signature_t *signatures, int count) {
+    uint32_t size = 16;
+    while (size < (uint32_t)count * 2) {
+        size *= 2;
+    }
+    table->signatures = signatures;
+    table->mask = size - 1;
+    table->slots = malloc(size * sizeof(int));
+    if (!table->slots) {
+        perror("Memory allocation failed");
+        return -1;
+    }
+    memset(table->slots, -1, size * sizeof(int));
+    for (int i = 0; i < count; i++) {
+        if (signatures[i].length == 0 || signatures[i].length > DELTA_BLOCK_SIZE) {
+            continue;
+        }
+        uint32_t slot = slot_of(signatures[i].weak, table->mask);
+        while (table->slots[slot] != -1) {
+            slot = (slot + 1) & table->mask;
+        }
+        table->slots[slot] = i;
+    }
+    return 0;
+}
+
+// Cherche un bloc connu de même somme et de même taille ; le MD5 tranche entre les candidats.
+// Retourne le chunk déjà construit en cas de correspondance, NULL sinon
+static Chunk *match_block(const signature_table_t *table, uint32_t weak, const unsigned char *data, size_t len) {
+    Chunk *chunk = NULL;
+    for (uint32_t slot = slot_of(weak, table->mask); table->slots[slot] != -1; slot = (slot + 1) & table->mask) {
+        const chunk_signature_t *signature = &table->signatures[table->slots[slot]];
+        if (signature->weak != weak || signature->length != len) {
+            continue;
+        }
+        if (!chunk) {
+            chunk = make_data_chunk(data, len);
+        }
+        unsigned char md5[MD5_DIGEST_LENGTH * 2 + 1];
+        bytes_to_hex(signature->md5, MD5_DIGEST_LENGTH, md5);
+        if (strcmp((char*)md5, (char*)chunk->md5) == 0) {
+            return chunk;
+        }
+    }
+    if (chunk) {
+        free(chunk->data);
+        free(chunk);
+    }
+    return NULL;
+}
+
+// Chunks produits, les zéros en attente étant fusionnés en une seule plage
+typedef struct {
+    Chunk **chunks;
+    int count;
+    int capacity;
+    uint64_t zero_run;
+} delta_output_t;
+
+static int push_chunk(delta_output_t *out, Chunk *chunk) {
+    if (out->count == out->capacity) {
+        int capacity = out->capacity ? out->capacity * 2 : 64;
+        Chunk **grown = realloc(out->chunks, capacity * sizeof(Chunk*));
+        if (!grown) {
+            perror("Memory allocation failed");
+            free(chunk->data);
+            free(chunk);
+            return -1;
+        }
+        out->chunks = grown;
+        out->capacity = capacity;
+    }
+    out->chunks[out->count++] = chunk;
+    return 0;
+}
+
+static int flush_zero_run(delta_output_t *out) {
+    if (out->zero_run == 0) {
+        return 0;
+    }
+    uint64_t length = out->zero_run;
+    out->zero_run = 0;
+    return push_chunk(out, make_zero_chunk(length));
+}
+
+// Découpe les octets non retrouvés en chunks normaux de DELTA_BLOCK_SIZE octets au plus
+static int emit_literal(delta_output_t *out, const unsigned char *data, size_t len) {
+    for (size_t done = 0; done < len; ) {
+        size_t piece = len - done < DELTA_BLOCK_SIZE ? len - done : DELTA_BLOCK_SIZE;
+        if (is_zero_block(data + done, piece)) {
+            out->zero_run += piece;
+        }
+        else if (flush_zero_run(out) != 0 || push_chunk(out, make_data_chunk(data + done, piece)) != 0) {
+            return -1;
+        }
+        done += piece;
+    }
+    return 0;
+}
+
+static int emit_copy(delta_output_t *out, Chunk *chunk) {
+    if (flush_zero_run(out) != 0) {
+        free(chunk->data);
+        free(chunk);
+        return -1;
+    }
+    return push_chunk(out, chunk);
+}
+
+// Parcourt le fichier avec une fenêtre glissante : [literal, pos) n'a pas été retrouvé
+static int match_file(delta_output_t *out, const signature_table_t *table, const chunk_signature_t *signatures,
+                      int signature_count, const unsigned char *data, size_t size, uint64_t *matched_bytes) {
+    const size_t block = DELTA_BLOCK_SIZE;
+    size_t literal = 0;
+    size_t pos = 0;
+    uint32_t a = 0;
+    uint32_t b = 0;
+    int window_ready = 0;
+
+    while (pos + block <= size) {
+        if (!window_ready) {
+            uint32_t weak = weak_checksum(data + pos, block);
+            a = weak & 0xFFFF;
+            b = weak >> 16;
+            window_ready = 1;
+        }
+        Chunk *copy = match_block(table, (a & 0xFFFF) | (b << 16), data + pos, block);
+        if (copy) {
+            if (emit_literal(out, data + literal, pos - literal) != 0 || emit_copy(out, copy) != 0) {
+                return -1;
+            }
+            *matched_bytes += block;
+            pos += block;
+            literal = pos;
+            window_ready = 0;
+            continue;
+        }
+
+        // Un bloc entier sans correspondance part en littéral sans attendre
+        if (pos - literal == block) {
+            if (emit_literal(out, data + literal, block) != 0) {
+                return -1;
+            }
+            literal = pos;
+        }
+        if (pos + block == size) {
+            break;
+        }
+        unsigned char removed = data[pos];
+        unsigned char added = data[pos + block];
+        a = (a - removed + added) & 0xFFFF;
+        b = (b - (uint32_t)block * removed + a) & 0xFFFF;
+        pos++;
+    }
+
+    // Le dernier chunk de l'ancienne version est plus court que les autres : le chercher à la fin
+    Chunk *tail = NULL;
+    for (int i = 0; i < signature_count && !tail; i++) {
+        size_t length = signatures[i].length;
+        if (length > 0 && length < block && length <= size - literal) {
+            tail = match_block(table, weak_checksum(data + size - length, length), data + size - length, length);
+        }
+    }
+    if (tail) {
+        if (emit_literal(out, data + literal, size - tail->size + 1 - literal) != 0 || emit_copy(out, tail) != 0) {
+            return -1;
+        }
+        *matched_bytes += tail->size - 1;
+        literal = size;
+    }
+    if (emit_literal(out, data + literal, size - literal) != 0) {
+        return -1;
+    }
+    return flush_zero_run(out);
+}
+
+Chunk **delta_chunk_file(const char *file_path, const chunk_signature_t *signatures, int signature_count,
+                         int *chunk_count, uint64_t *matched_bytes) {
+    *chunk_count = 0;
+    *matched_bytes = 0;
+    int fd = open(file_path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror("Failed to open source file");
+        if (fd >= 0) {
+            close(fd);
+        }
+        return NULL;
+    }
+
+    delta_output_t out = { .chunks = NULL, .count = 0, .capacity = 0, .zero_run = 0 };
+    signature_table_t table = { .slots = NULL };
+    unsigned char *data = NULL;
+    int result = build_signature_table(&table, signatures, signature_count);
+    if (result == 0 && st.st_size > 0) {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            perror("Erreur lors de la projection du fichier source");
+            data = NULL;
+            result = -1;
+        }
+        else {
+            madvise(data, st.st_size, MADV_SEQUENTIAL);
+            result = match_file(&out, &table, signatures, signature_count, data, st.st_size, matched_bytes);
+            munmap(data, st.st_size);
+        }
+    }
+    close(fd);
+    free(table.slots);
+
+    if (result == 0 && !out.chunks) {
+        // Fichier vide : tableau sans chunk
+        out.chunks = malloc(sizeof(Chunk*));
+        result = out.chunks ? 0 : -1;
+    }
+    if (result != 0) {
+        free_chunks(out.chunks, out.count);
+        return NULL;
+    }
+    *chunk_count = out.count;
+    return out.chunks;
+}
@@ -0,0 +1,67 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include "deduplication.h"
+#include <stdint.h>
+
+/** @brief Taille des blocs comparés par somme glissante : celle des chunks normaux */
+#define DELTA_BLOCK_SIZE (CHUNK_SIZE - 1)
+/** @brief Taille d'une signature sur le réseau : somme faible (4 octets), MD5 (16 octets), longueur (4 octets) */
+#define SIGNATURE_SIZE (4 + MD5_DIGEST_LENGTH + 4)
+/** @brief En dessous de cette taille, un fichier modifié est envoyé sans demander les signatures */
+#define DELTA_MIN_SIZE (64 * 1024)
+
+/**
+ * @brief Signature d'un chunk de la version précédente d'un fichier.
+ */
+typedef struct {
+    uint32_t weak;                           // Somme glissante des données
+    unsigned char md5[MD5_DIGEST_LENGTH];    // Empreinte sous laquelle le chunk est stocké
+    uint32_t length;
+} chunk_signature_t;
+
+/**
+ * @brief Calcule la somme faible d'un bloc (somme glissante à la rsync).
+ *
+ * @param data Les données.
+ * @param len Leur taille.
+ * @return uint32_t La somme : octets cumulés sur 16 bits, pondérés par position sur les 16 bits hauts.
+ */
+uint32_t weak_checksum(const unsigned char *data, size_t len);
+
+/**
+ * @brief Sérialise une signature dans son format réseau (entiers en big-endian).
+ *
+ * @param signature La signature.
+ * @param out Le tampon de SIGNATURE_SIZE octets.
+ */
+void encode_signature(const chunk_signature_t *signature, unsigned char *out);
+
+/**
+ * @brief Lit une signature dans son format réseau.
+ *
+ * @param data Le tampon de SIGNATURE_SIZE octets.
+ * @param signature La signature lue.
+ */
+void decode_signature(const unsigned char *data, chunk_signature_t *signature);
+
+/**
+ * @brief Découpe un fichier modifié en s'alignant sur les chunks de sa version précédente.
+ *
+ * La somme faible d'une fenêtre de la taille de chaque bloc connu glisse octet par octet ;
+ * une somme reconnue est confirmée par le MD5 et le bloc devient un chunk de même empreinte
+ * que l'ancien (une copie, que le serveur possède déjà). Les octets entre deux copies sont
+ * découpés en chunks normaux (littéraux) ou en plages de zéros. Une insertion au début
+ * d'un gros fichier ne décale donc plus tous ses chunks.
+ *
+ * @param file_path Le chemin du fichier.
+ * @param signatures Les signatures de la version précédente.
+ * @param signature_count Leur nombre.
+ * @param chunk_count Le nombre de chunks produits.
+ * @param matched_bytes Le nombre d'octets retrouvés dans la version précédente.
+ * @return Chunk** Le tableau des chunks (à libérer avec free_chunks), NULL si erreur.
+ */
+Chunk **delta_chunk_file(const char *file_path, const chunk_signature_t *signatures, int signature_count,
+                         int *chunk_count, uint64_t *matched_bytes);
+
+#endif // DELTA_H
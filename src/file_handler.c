@@ -1,14 +1,24 @@
+#define _GNU_SOURCE // O_DIRECT, sync_file_range
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
 #include <dirent.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <openssl/evp.h>
 #include "utilities.h"
 #include "file_handler.h"
 #include "deduplication.h"
+#include "stats.h"
+#include "trace.h"
+#include "budget.h"
+#include "governor.h"
 
 // Fonction permettant de lire un élément du fichier .backup_log
 log_t read_backup_log(const char *logfile) {
@@ -19,18 +29,77 @@ log_t read_backup_log(const char *logfile) {
         return logs;
     }
 
-    char line[2048];
-    while (fgets(line, sizeof(line), file)) {
+    logs = parse_backup_log(file);
+    fclose(file);
+    return logs;
+}
+
+// Taille du contenu d'un petit fichier encodé en base64 dans sa ligne du .backup_log, '\0' compris
+#define LOG_INLINE_ENCODED_SIZE (4 * ((LOG_INLINE_MAX_SIZE + 2) / 3) + 1)
+// Préfixes des champs facultatifs d'une ligne, après le MD5 : taille, inode et date exacte du fichier
+// source, fichier sauvegardé d'un doublon et contenu d'un fichier conservé dans le log
+#define LOG_SIZE_PREFIX "s:"
+#define LOG_INODE_PREFIX "n:"
+#define LOG_OBJECT_PREFIX "r:"
+#define LOG_INLINE_PREFIX "i:"
+
+int set_log_content(log_element *elt, const unsigned char *data, size_t size, int force) {
+    if (size >= LOG_INLINE_MAX_SIZE) {
+        return -1;
+    }
+    if (force) {
+        budget_force(size + 1);
+    }
+    else if (budget_reserve(size + 1) != 0) {
+        return -1;
+    }
+    elt->content = malloc(size + 1);
+    if (!elt->content) {
+        perror("Memory allocation failed");
+        budget_release(size + 1);
+        return -1;
+    }
+    memcpy(elt->content, data, size);
+    elt->content_size = size;
+    return 0;
+}
+
+// Décode le contenu base64 d'une ligne du log ; -1 si le champ n'est pas un contenu valide
+static int decode_log_content(log_element *elt, const char *field) {
+    size_t length = strcspn(field, "\r\n");
+    if (length % 4 != 0 || length >= LOG_INLINE_ENCODED_SIZE) {
+        return -1;
+    }
+    unsigned char decoded[LOG_INLINE_ENCODED_SIZE];
+    int size = length ? EVP_DecodeBlock(decoded, (const unsigned char*)field, length) : 0;
+    if (size < 0) {
+        return -1;
+    }
+    // EVP_DecodeBlock compte les octets de remplissage
+    for (size_t i = length; i > 0 && field[i - 1] == '='; i--) {
+        size--;
+    }
+    return set_log_content(elt, decoded, size, 1);
+}
+
+// Fonction permettant de lire les lignes d'un .backup_log depuis un flux déjà ouvert
+log_t parse_backup_log(FILE *file) {
+    log_t logs = { .head = NULL, .tail = NULL };
+    // Une ligne qui contient un petit fichier dépasse la taille d'un chemin
+    char *line = NULL;
+    size_t line_size = 0;
+    while (getline(&line, &line_size, file) != -1) {
         log_element *new_elt = malloc(sizeof(log_element));
         if (!new_elt) {
             perror("Memory allocation failed");
-            fclose(file);
-            return logs;
+            break;
         }
 
-        char *path = strtok(line, ",");
-        char *date = strtok(NULL, ",");
-        char *md5_hex = strtok(NULL, ",");
+        // strtok_r : le serveur lit des .backup_log sur plusieurs workers à la fois
+        char *saveptr = NULL;
+        char *path = strtok_r(line, ",", &saveptr);
+        char *date = strtok_r(NULL, ",", &saveptr);
+        char *md5_hex = strtok_r(NULL, ",", &saveptr);
 
         if (!path || !date || !md5_hex) {
             fprintf(stderr, "Error parsing line: %s\n", line);
@@ -45,9 +114,43 @@ log_t read_backup_log(const char *logfile) {
             continue;
         }
 
-        strcpy(new_elt->date, date);
-
-        strcpy((char*)new_elt->md5, md5_hex);
+        snprintf(new_elt->date, sizeof(new_elt->date), "%s", date);
+
+        snprintf((char*)new_elt->md5, sizeof(new_elt->md5), "%s", md5_hex);
+
+        new_elt->content = NULL;
+        new_elt->content_size = 0;
+        new_elt->object = NULL;
+        new_elt->size = -1;
+        new_elt->dev = 0;
+        new_elt->ino = 0;
+        new_elt->mtime.tv_sec = 0;
+        new_elt->mtime.tv_nsec = 0;
+        // Champs facultatifs, reconnus à leur préfixe ; ceux d'une version plus récente sont ignorés
+        for (char *field = strtok_r(NULL, ",", &saveptr); field; field = strtok_r(NULL, ",", &saveptr)) {
+            if (strncmp(field, LOG_SIZE_PREFIX, strlen(LOG_SIZE_PREFIX)) == 0) {
+                new_elt->size = strtoll(field + strlen(LOG_SIZE_PREFIX), NULL, 10);
+            }
+            else if (strncmp(field, LOG_INODE_PREFIX, strlen(LOG_INODE_PREFIX)) == 0) {
+                // périphérique:inode:secondes.nanosecondes ; un champ incomplet laisse l'inode inconnu
+                unsigned long long dev, ino;
+                long long sec;
+                long nsec;
+                if (sscanf(field + strlen(LOG_INODE_PREFIX), "%llu:%llu:%lld.%ld", &dev, &ino, &sec, &nsec) == 4) {
+                    new_elt->dev = dev;
+                    new_elt->ino = ino;
+                    new_elt->mtime.tv_sec = sec;
+                    new_elt->mtime.tv_nsec = nsec;
+                }
+            }
+            else if (strncmp(field, LOG_OBJECT_PREFIX, strlen(LOG_OBJECT_PREFIX)) == 0 && !new_elt->object) {
+                new_elt->object = strdup(field + strlen(LOG_OBJECT_PREFIX));
+            }
+            else if (strncmp(field, LOG_INLINE_PREFIX, strlen(LOG_INLINE_PREFIX)) == 0 && !new_elt->content &&
+                     decode_log_content(new_elt, field + strlen(LOG_INLINE_PREFIX)) != 0) {
+                fprintf(stderr, "Invalid inline content for %s\n", new_elt->path);
+            }
+        }
 
         new_elt->next = NULL;
         new_elt->prev = logs.tail;
@@ -60,27 +163,182 @@ log_t read_backup_log(const char *logfile) {
         }
         logs.tail = new_elt;
     }
+    free(line);
 
-    fclose(file);
     return logs;
 }
 
 
 // Fonction permettant de mettre à jour une ligne du fichier .backup_log
 void update_backup_log(const char *logfile, log_t *logs) {
-    FILE *file = fopen(logfile, "w");
+    // Écrit à côté puis renomme : une interruption laisse l'ancien .backup_log intact
+    size_t len = strlen(logfile);
+    char *temporary = malloc(len + 5);
+    if (!temporary) {
+        perror("Memory allocation failed");
+        return;
+    }
+    snprintf(temporary, len + 5, "%s.tmp", logfile);
+
+    FILE *file = fopen(temporary, "w");
     if (!file) {
         perror("Error opening backup log for writing");
+        free(temporary);
         return;
     }
 
+    write_backup_log(logs, file);
+    if (fflush(file) != 0 || fsync(fileno(file)) != 0 || fclose(file) != 0 || rename(temporary, logfile) != 0) {
+        perror("Error writing backup log");
+        unlink(temporary);
+    }
+    free(temporary);
+}
+
+const char *log_object_path(const log_element *elt) {
+    return elt->object ? elt->object : elt->path;
+}
+
+int log_index_init(log_index_t *index, size_t expected) {
+    index->count = 0;
+    index->bucket_count = 64;
+    while (index->bucket_count < expected) {
+        index->bucket_count *= 2;
+    }
+    index->buckets = calloc(index->bucket_count, sizeof(log_index_entry*));
+    if (!index->buckets) {
+        perror("Memory allocation failed");
+        index->bucket_count = 0;
+        return -1;
+    }
+    budget_force(index->bucket_count * sizeof(log_index_entry*));
+    return 0;
+}
+
+static uint64_t mix_key(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xFF51AFD7ED558CCDULL;
+    key ^= key >> 33;
+    return key;
+}
+
+// Clé de contenu : la taille, puis les premiers chiffres du MD5 qui la départagent
+static uint64_t digest_key(off_t size, const unsigned char *md5) {
+    uint64_t key = mix_key((uint64_t)size);
+    for (int i = 0; i < 16 && md5[i]; i++) {
+        key = key * 31 + md5[i];
+    }
+    return key;
+}
+
+static uint64_t inode_key(dev_t dev, ino_t ino) {
+    return mix_key((uint64_t)ino ^ ((uint64_t)dev << 40));
+}
+
+// Double le nombre d'alvéoles quand elles contiennent en moyenne plus d'une entrée
+static void log_index_grow(log_index_t *index) {
+    size_t bucket_count = index->bucket_count * 2;
+    log_index_entry **buckets = calloc(bucket_count, sizeof(log_index_entry*));
+    if (!buckets) {
+        return; // Les chaînes s'allongent, l'index reste correct
+    }
+    for (size_t i = 0; i < index->bucket_count; i++) {
+        log_index_entry *entry = index->buckets[i];
+        while (entry) {
+            log_index_entry *next = entry->next;
+            size_t bucket = entry->key & (bucket_count - 1);
+            entry->next = buckets[bucket];
+            buckets[bucket] = entry;
+            entry = next;
+        }
+    }
+    free(index->buckets);
+    budget_force((bucket_count - index->bucket_count) * sizeof(log_index_entry*));
+    index->buckets = buckets;
+    index->bucket_count = bucket_count;
+}
+
+static int log_index_add(log_index_t *index, uint64_t key, log_element *elt) {
+    if (!index->buckets) {
+        return -1;
+    }
+    if (index->count >= index->bucket_count) {
+        log_index_grow(index);
+    }
+    log_index_entry *entry = malloc(sizeof(log_index_entry));
+    if (!entry) {
+        perror("Memory allocation failed");
+        return -1;
+    }
+    budget_force(sizeof(log_index_entry));
+    size_t bucket = key & (index->bucket_count - 1);
+    entry->key = key;
+    entry->elt = elt;
+    entry->next = index->buckets[bucket];
+    index->buckets[bucket] = entry;
+    index->count++;
+    return 0;
+}
+
+int log_index_add_digest(log_index_t *index, log_element *elt) {
+    if (elt->size < 0 || elt->md5[0] == '\0') {
+        return 0;
+    }
+    return log_index_add(index, digest_key(elt->size, elt->md5), elt);
+}
+
+log_element *log_index_find_digest(const log_index_t *index, off_t size, const unsigned char *md5) {
+    uint64_t key = digest_key(size, md5);
+    if (!index->buckets) {
+        return NULL;
+    }
+    for (log_index_entry *entry = index->buckets[key & (index->bucket_count - 1)]; entry; entry = entry->next) {
+        if (entry->key == key && entry->elt->size == size && strcmp((char*)entry->elt->md5, (char*)md5) == 0) {
+            return entry->elt;
+        }
+    }
+    return NULL;
+}
+
+int log_index_add_inode(log_index_t *index, log_element *elt) {
+    return log_index_add(index, inode_key(elt->dev, elt->ino), elt);
+}
+
+log_element *log_index_find_inode(const log_index_t *index, dev_t dev, ino_t ino) {
+    uint64_t key = inode_key(dev, ino);
+    if (!index->buckets) {
+        return NULL;
+    }
+    for (log_index_entry *entry = index->buckets[key & (index->bucket_count - 1)]; entry; entry = entry->next) {
+        if (entry->key == key && entry->elt->dev == dev && entry->elt->ino == ino) {
+            return entry->elt;
+        }
+    }
+    return NULL;
+}
+
+void log_index_free(log_index_t *index) {
+    for (size_t i = 0; index->buckets && i < index->bucket_count; i++) {
+        log_index_entry *entry = index->buckets[i];
+        while (entry) {
+            log_index_entry *next = entry->next;
+            free(entry);
+            entry = next;
+        }
+    }
+    free(index->buckets);
+    budget_release(index->bucket_count * sizeof(log_index_entry*) + index->count * sizeof(log_index_entry));
+    index->buckets = NULL;
+    index->count = 0;
+}
+
+// Fonction permettant d'écrire toute une liste de logs dans un flux
+void write_backup_log(log_t *logs, FILE *file) {
     log_element *current = logs->head;
     while (current) {
         write_log_element(current, file);
         current = current->next;
     }
-
-    fclose(file);
 }
 
 // Fonction permettant d'écrire un élément log dans le fichier .backup_log
@@ -90,7 +348,7 @@ void write_log_element(log_element *element, FILE *log_file) {
     }
 
     // Vérifiez que les chaînes de caractères sont correctement initialisées
-    if (element->path == NULL || element->date == NULL || element->md5 == NULL) {
+    if (element->path == NULL) {
         fprintf(stderr, "Invalid log element\n");
         return;
     }
@@ -98,11 +356,29 @@ void write_log_element(log_element *element, FILE *log_file) {
     // Écrire les éléments dans le fichier de log
     fprintf(log_file, "%s,", element->path);
     fprintf(log_file, "%s,", element->date);
-    fprintf(log_file, "%s,\n", element->md5);
+    fprintf(log_file, "%s,", element->md5);
+    if (element->size >= 0) {
+        fprintf(log_file, "%s%lld,", LOG_SIZE_PREFIX, (long long)element->size);
+    }
+    if (element->ino != 0) {
+        fprintf(log_file, "%s%llu:%llu:%lld.%09ld,", LOG_INODE_PREFIX, (unsigned long long)element->dev,
+                (unsigned long long)element->ino, (long long)element->mtime.tv_sec, element->mtime.tv_nsec);
+    }
+    if (element->object) {
+        fprintf(log_file, "%s%s,", LOG_OBJECT_PREFIX, element->object);
+    }
+    if (element->content) {
+        // Petit fichier : son contenu en base64 après les champs habituels
+        char encoded[LOG_INLINE_ENCODED_SIZE];
+        EVP_EncodeBlock((unsigned char*)encoded, element->content, element->content_size);
+        fprintf(log_file, "%s%s,", LOG_INLINE_PREFIX, encoded);
+    }
+    fprintf(log_file, "\n");
 }
 
 // Fonction pour lister les fichiers dans un répertoire et les ajouter à une liste chaînée
 void list_files(const char *path, file_list_t *file_list, int recursive) {
+    uint64_t trace_start = trace_begin();
     // Buffer pour le chemin
     char *path_buffer = strdup(path);
     if (!path_buffer) {
@@ -131,7 +407,11 @@ void list_files(const char *path, file_list_t *file_list, int recursive) {
             }
 
             struct stat path_stat;
-            if (stat(full_path, &path_stat) == -1) {
+            stats_span_t span;
+            stats_begin(STATS_STAT, &span);
+            int stat_result = stat(full_path, &path_stat);
+            stats_end(STATS_STAT, &span, 0, 1, 0);
+            if (stat_result == -1) {
                 perror("Error getting file status");
                 free(full_path);
                 continue;
@@ -167,6 +447,7 @@ void list_files(const char *path, file_list_t *file_list, int recursive) {
 
     closedir(dir);
     free(path_buffer);
+    trace_end(trace_start, "walk", "list_files", path, 0);
 }
 
 // Fonction pour libérer une liste d'index de fichiers
@@ -192,6 +473,11 @@ void free_log_list(log_t *logs) {
         if (current->path) {
             free((char*)current->path); // Appel void pour éviter tout warning
         }
+        if (current->content) {
+            free(current->content);
+            budget_release(current->content_size + 1);
+        }
+        free(current->object);
         // Ne pas libérer current->md5 et current->date car ils ne sont pas alloués dynamiquement
 
         // Libérer la mémoire allouée pour l'élément lui-même
@@ -208,6 +494,19 @@ void free_log_list(log_t *logs) {
 
 
 // Fonction pour copier un fichier
+// Ouvre un fichier en lecture, en O_DIRECT en mode --cache-neutral si le système de fichiers le permet
+static int open_for_copy(const char *path, int *direct) {
+    *direct = 0;
+    if (cache_neutral()) {
+        int fd = open(path, O_RDONLY | O_DIRECT);
+        if (fd >= 0) {
+            *direct = 1;
+            return fd;
+        }
+    }
+    return open(path, O_RDONLY);
+}
+
 int copy_file(const char *source_path, const char *dest_path) {
     // Ouvre le fichier source en mode lecture binaire
     struct stat st;
@@ -218,8 +517,10 @@ int copy_file(const char *source_path, const char *dest_path) {
         perror("Impossible d'obtenir des informations sur le fichier source");
         return -1;
     }
-    FILE *source_file = fopen(source_path, "rb");
-    if (source_file == NULL) {
+    int direct;
+    governor_op();
+    int source_fd = open_for_copy(source_path, &direct);
+    if (source_fd < 0) {
         perror("Erreur lors de l'ouverture du fichier source");
         return -1;
     }
@@ -228,35 +529,252 @@ int copy_file(const char *source_path, const char *dest_path) {
     FILE *dest_file = fopen(dest_path, "wb");
     if (dest_file == NULL) {
         perror("Erreur lors de l'ouverture du fichier de destination");
-        fclose(source_file);
+        close(source_fd);
         return -1;
     }
 
-    // Copie les données par blocs
-    char buffer[4096]; // Taille du tampon pour la copie
-    size_t bytes_read;
-    size_t total_bytes_copied = 0;
-
-    while ((bytes_read = fread(buffer, 1, sizeof(buffer), source_file)) > 0) {
-        if (fwrite(buffer, 1, bytes_read, dest_file) != bytes_read) {
+    // Copie les données par blocs, dans un tampon aligné pour O_DIRECT
+    void *buffer = NULL;
+    if (posix_memalign(&buffer, DIRECT_IO_ALIGN, COPY_BUFFER_SIZE) != 0) {
+        perror("Erreur d'allocation mémoire pour la copie");
+        close(source_fd);
+        fclose(dest_file);
+        return -1;
+    }
+    budget_force(COPY_BUFFER_SIZE);
+    writeback_t writeback;
+    writeback_start(&writeback, dest_file);
+    ssize_t bytes_read;
+    off_t total_bytes_copied = 0;
+    int result = 0;
+
+    while ((bytes_read = read(source_fd, buffer, COPY_BUFFER_SIZE)) != 0) {
+        if (bytes_read < 0 && errno == EINVAL && direct) {
+            // O_DIRECT refusé à la lecture : continuer en lecture normale suivie de POSIX_FADV_DONTNEED
+            fcntl(source_fd, F_SETFL, fcntl(source_fd, F_GETFL) & ~O_DIRECT);
+            direct = 0;
+            continue;
+        }
+        if (bytes_read < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Erreur lors de la lecture du fichier source");
+            result = -1;
+            break;
+        }
+        if (fwrite(buffer, 1, bytes_read, dest_file) != (size_t)bytes_read) {
             perror("Erreur lors de l'écriture dans le fichier de destination");
-            fclose(source_file);
-            fclose(dest_file);
-            return -1;
+            result = -1;
+            break;
+        }
+        if (cache_neutral() && !direct) {
+            posix_fadvise(source_fd, total_bytes_copied, bytes_read, POSIX_FADV_DONTNEED);
         }
         total_bytes_copied += bytes_read;
+        writeback_advance(&writeback);
+        governor_read(bytes_read);
+        governor_write(bytes_read);
     }
+    writeback_finish(&writeback);
 
-    if (ferror(source_file)) {
-        perror("Erreur lors de la lecture du fichier source");
-        fclose(source_file);
-        fclose(dest_file);
+    // Ferme les fichiers
+    free(buffer);
+    budget_release(COPY_BUFFER_SIZE);
+    close(source_fd);
+    if (fclose(dest_file) != 0 && result == 0) {
+        perror("Erreur lors de l'écriture dans le fichier de destination");
+        result = -1;
+    }
+
+    return result;
+}
+
+static int cache_neutral_io = 0;
+
+void set_cache_neutral(int enabled) {
+    cache_neutral_io = enabled;
+}
+
+int cache_neutral(void) {
+    return cache_neutral_io;
+}
+
+void writeback_start(writeback_t *wb, FILE *file) {
+    wb->file = cache_neutral_io ? file : NULL;
+    wb->start = 0;
+    wb->end = 0;
+    if (wb->file) {
+        off_t position = ftello(file);
+        wb->start = wb->end = position > 0 ? position : 0;
+    }
+}
+
+void writeback_advance(writeback_t *wb) {
+    if (!wb->file) {
+        return;
+    }
+    off_t position = ftello(wb->file);
+    if (position - wb->end < WRITEBACK_SIZE || fflush(wb->file) != 0) {
+        return; // Une erreur d'écriture sera signalée à la fermeture
+    }
+    int fd = fileno(wb->file);
+    // Lancer l'écriture de la nouvelle tranche sans l'attendre
+    sync_file_range(fd, wb->end, position - wb->end, SYNC_FILE_RANGE_WRITE);
+    // La tranche précédente a eu le temps d'arriver sur le disque : l'attendre puis la retirer du cache
+    if (wb->end > wb->start) {
+        sync_file_range(fd, wb->start, wb->end - wb->start,
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(fd, wb->start, wb->end - wb->start, POSIX_FADV_DONTNEED);
+    }
+    wb->start = wb->end;
+    wb->end = position;
+}
+
+void writeback_finish(writeback_t *wb) {
+    if (!wb->file) {
+        return;
+    }
+    if (fflush(wb->file) == 0) {
+        int fd = fileno(wb->file);
+        sync_file_range(fd, wb->start, 0,
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(fd, wb->start, 0, POSIX_FADV_DONTNEED);
+    }
+    wb->file = NULL;
+}
+
+int mapped_file_open(mapped_file_t *map, int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
         return -1;
     }
+    long page = sysconf(_SC_PAGESIZE);
+    size_t pages = (st.st_size + page - 1) / page;
+    size_t window_pages = MAPPED_RELEASE_SIZE / page;
+    map->resident_bytes = (pages + 7) / 8;
+    map->resident = calloc(map->resident_bytes, 1);
+    unsigned char *vector = malloc(window_pages);
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (!map->resident || !vector || data == MAP_FAILED) {
+        if (data != MAP_FAILED) {
+            munmap(data, st.st_size);
+        }
+        free(map->resident);
+        free(vector);
+        return -1;
+    }
+    budget_force(map->resident_bytes);
+
+    // Relever les pages en cache avant toute lecture : la lecture anticipée les y mettrait
+    for (size_t first = 0; first < pages; first += window_pages) {
+        size_t count = pages - first < window_pages ? pages - first : window_pages;
+        if (mincore((unsigned char*)data + first * page, count * page, vector) != 0) {
+            // Sans mincore, ne rien retirer du cache
+            memset(vector, 1, count);
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (vector[i] & 1) {
+                map->resident[(first + i) / 8] |= 1 << ((first + i) % 8);
+            }
+        }
+    }
+    free(vector);
+
+    // Lecture séquentielle : lecture anticipée plus large, pages lues libérées en premier
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    posix_fadvise(fd, 0, st.st_size, POSIX_FADV_SEQUENTIAL);
+    map->fd = fd;
+    map->data = data;
+    map->size = st.st_size;
+    map->released = 0;
+    return 0;
+}
 
-    // Ferme les fichiers
-    fclose(source_file);
-    fclose(dest_file);
+// Retire du cache les pages [start, end) du fichier projeté
+static void drop_pages(mapped_file_t *map, off_t start, off_t end) {
+    madvise((void*)(map->data + start), end - start, MADV_DONTNEED);
+    posix_fadvise(map->fd, start, end - start, POSIX_FADV_DONTNEED);
+}
+
+// Retire du cache les pages de [map->released, end) qui n'y étaient pas avant la projection
+static void drop_read_pages(mapped_file_t *map, off_t end) {
+    long page = sysconf(_SC_PAGESIZE);
+    off_t run = -1; // Début de la suite de pages à retirer en cours
+    for (off_t pos = map->released; pos < end; pos += page) {
+        size_t index = pos / page;
+        int resident_before = map->resident[index / 8] & (1 << (index % 8));
+        if (!resident_before && run < 0) {
+            run = pos;
+        }
+        else if (resident_before && run >= 0) {
+            drop_pages(map, run, pos);
+            run = -1;
+        }
+    }
+    if (run >= 0) {
+        drop_pages(map, run, end);
+    }
+    map->released = end;
+}
+
+void mapped_file_release(mapped_file_t *map, off_t offset) {
+    // Seules les pages entièrement utilisées sont retirées, par tranches
+    off_t end = offset - offset % MAPPED_RELEASE_SIZE;
+    if (end > map->released) {
+        drop_read_pages(map, end);
+    }
+}
+
+void mapped_file_close(mapped_file_t *map) {
+    drop_read_pages(map, map->size);
+    munmap((void*)map->data, map->size);
+    free(map->resident);
+    budget_release(map->resident_bytes);
+}
+
+// Point de reprise des lectures protégées, propre à chaque thread (SIGBUS est reçu par le thread fautif)
+static __thread sigjmp_buf mapped_guard_jump;
+static __thread volatile sig_atomic_t mapped_guard_armed;
+static pthread_once_t mapped_guard_once = PTHREAD_ONCE_INIT;
+
+static void mapped_guard_handler(int sig) {
+    if (mapped_guard_armed) {
+        mapped_guard_armed = 0;
+        siglongjmp(mapped_guard_jump, 1);
+    }
+    // SIGBUS hors d'une lecture protégée : comportement par défaut
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+static void mapped_guard_install(void) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = mapped_guard_handler;
+    sigemptyset(&action.sa_mask);
+    // SA_NODEFER : SIGBUS reste débloqué après le retour au point de reprise (sigsetjmp sans masque)
+    action.sa_flags = SA_NODEFER;
+    if (sigaction(SIGBUS, &action, NULL) != 0) {
+        perror("sigaction SIGBUS");
+    }
+}
+
+sigjmp_buf *mapped_guard_arm(void) {
+    pthread_once(&mapped_guard_once, mapped_guard_install);
+    mapped_guard_armed = 1;
+    return &mapped_guard_jump;
+}
+
+void mapped_guard_disarm(void) {
+    mapped_guard_armed = 0;
+}
 
-    return 0; // Succès
+int mapped_copy(void *dest, const void *src, size_t size) {
+    if (MAPPED_GUARD() != 0) {
+        return -1;
+    }
+    memcpy(dest, src, size);
+    mapped_guard_disarm();
+    return 0;
 }
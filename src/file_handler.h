@@ -2,13 +2,36 @@
 #define FILE_HANDLER_H
 
 #include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <setjmp.h>
+#include <sys/types.h>
 #include <openssl/md5.h>
 
+/** @brief Quantité lue d'un fichier projeté au-delà de laquelle ses pages sont rendues au noyau (8 Mo) */
+#define MAPPED_RELEASE_SIZE (8 * 1024 * 1024)
+/** @brief Taille en dessous de laquelle un fichier est conservé dans sa ligne du .backup_log (4 Ko) */
+#define LOG_INLINE_MAX_SIZE 4096
+
+/** @brief Quantité écrite au-delà de laquelle un fichier est envoyé au disque puis retiré du cache (8 Mo) */
+#define WRITEBACK_SIZE (8 * 1024 * 1024)
+/** @brief Alignement des tampons, positions et tailles des lectures O_DIRECT */
+#define DIRECT_IO_ALIGN 4096
+/** @brief Taille du tampon de copy_file (multiple de DIRECT_IO_ALIGN) */
+#define COPY_BUFFER_SIZE (256 * 1024)
+
 // Structure pour une ligne du fichier log
 typedef struct log_element {
     char *path; // Chemin du fichier/dossier
     unsigned char md5[MD5_DIGEST_LENGTH  *2 + 1]; // MD5 du fichier dédupliqué
     char date[17]; // Date de dernière modification
+    unsigned char *content; // Contenu d'un petit fichier conservé dans le log, NULL s'il est sauvegardé à part
+    size_t content_size;
+    char *object; // Fichier sauvegardé d'un doublon (chemin d'une autre entrée), NULL : path lui-même
+    off_t size; // Taille du fichier source, -1 si inconnue (log antérieur)
+    dev_t dev; // Périphérique et inode du fichier source, 0 si inconnus
+    ino_t ino;
+    struct timespec mtime; // Date de modification exacte du fichier source, à la nanoseconde
     struct log_element *next;
     struct log_element *prev;
 } log_element;
@@ -19,6 +42,38 @@ typedef struct {
     log_element *tail; // Fin de la liste de log
 } log_t;
 
+// Entrée d'un index de log
+typedef struct log_index_entry {
+    uint64_t key;
+    log_element *elt;
+    struct log_index_entry *next;
+} log_index_entry;
+
+// Index des entrées d'un log par contenu (taille, MD5) ou par inode (périphérique, inode)
+typedef struct {
+    log_index_entry **buckets;
+    size_t bucket_count;    // Puissance de 2
+    size_t count;
+} log_index_t;
+
+// Fichier source projeté en mémoire pour une lecture séquentielle sans copie
+typedef struct {
+    int fd;
+    const unsigned char *data;  // Projection du fichier
+    off_t size;
+    unsigned char *resident;    // Un bit par page : en cache avant la projection (mincore)
+    size_t resident_bytes;
+    off_t released;             // Les pages avant cette position ont été rendues au noyau
+} mapped_file_t;
+
+// Écriture d'un fichier en mode --cache-neutral : les données écrites sont envoyées au disque
+// par tranches de WRITEBACK_SIZE octets puis retirées du cache
+typedef struct {
+    FILE *file;                 // NULL hors mode --cache-neutral
+    off_t start;                // Tranche précédente [start, end), en cours d'écriture sur le disque
+    off_t end;
+} writeback_t;
+
 // Structure pour un élément de la liste chaînée de fichiers
 typedef struct file_element {
     char *path; // Chemin du fichier
@@ -39,6 +94,100 @@ typedef struct {
  */
 log_t read_backup_log(const char *logfile);
 
+/**
+  *@brief Lit les lignes d'un fichier de sauvegarde depuis un flux ouvert (fichier ou mémoire).
+ *
+  *@param file Le flux à lire.
+  *@return log_t Une structure log_t contenant la liste chaînée des logs lus.
+ */
+log_t parse_backup_log(FILE *file);
+
+/**
+  *@brief Conserve le contenu d'un petit fichier dans son élément de log.
+ *
+ * Le contenu est écrit en base64 dans la ligne du .backup_log : le fichier n'a pas d'objet
+ * sauvegardé à part. La mémoire est réservée sur le budget.
+ *
+  *@param elt L'élément de log.
+  *@param data Le contenu du fichier.
+  *@param size Sa taille, inférieure à LOG_INLINE_MAX_SIZE.
+  *@param force Réserver même au-delà de la limite du budget.
+  *@return int 0 si le contenu est conservé, -1 sinon (le fichier doit alors être sauvegardé à part).
+ */
+int set_log_content(log_element *elt, const unsigned char *data, size_t size, int force);
+
+/**
+  *@brief Donne le chemin du fichier sauvegardé d'une entrée : celui de l'entrée dont elle est
+  * le doublon, ou son propre chemin.
+ *
+  *@param elt L'élément de log.
+  *@return const char* Le chemin, relatif au répertoire des sauvegardes.
+ */
+const char *log_object_path(const log_element *elt);
+
+/**
+  *@brief Prépare un index d'entrées de log vide.
+ *
+  *@param index L'index à initialiser.
+  *@param expected Le nombre d'entrées attendu, pour dimensionner les alvéoles.
+  *@return int 0 si succès, -1 en cas d'erreur d'allocation.
+ */
+int log_index_init(log_index_t *index, size_t expected);
+
+/**
+  *@brief Indexe une entrée par son contenu (taille et MD5, taille connue).
+ *
+  *@param index L'index.
+  *@param elt L'entrée.
+  *@return int 0 si succès, -1 en cas d'erreur d'allocation.
+ */
+int log_index_add_digest(log_index_t *index, log_element *elt);
+
+/**
+  *@brief Cherche une entrée de même contenu.
+ *
+  *@param index L'index.
+  *@param size La taille du fichier.
+  *@param md5 Le MD5 du fichier en hexadécimal.
+  *@return log_element* La première entrée indexée de même taille et même MD5, ou NULL.
+ */
+log_element *log_index_find_digest(const log_index_t *index, off_t size, const unsigned char *md5);
+
+/**
+  *@brief Indexe une entrée par l'inode de son fichier source.
+ *
+  *@param index L'index.
+  *@param elt L'entrée, dev et ino remplis.
+  *@return int 0 si succès, -1 en cas d'erreur d'allocation.
+ */
+int log_index_add_inode(log_index_t *index, log_element *elt);
+
+/**
+  *@brief Cherche l'entrée d'un inode déjà relevé (lien physique, ou fichier renommé depuis
+  * la sauvegarde précédente).
+ *
+  *@param index L'index.
+  *@param dev Le périphérique.
+  *@param ino L'inode.
+  *@return log_element* L'entrée, ou NULL.
+ */
+log_element *log_index_find_inode(const log_index_t *index, dev_t dev, ino_t ino);
+
+/**
+  *@brief Libère un index (les entrées de log indexées ne sont pas libérées).
+ *
+  *@param index L'index.
+ */
+void log_index_free(log_index_t *index);
+
+/**
+  *@brief Écrit toute une liste de logs dans un flux ouvert.
+ *
+  *@param logs La liste de logs à écrire.
+  *@param file Le flux de destination.
+ */
+void write_backup_log(log_t *logs, FILE *file);
+
 /**
   *@brief Met à jour le fichier de sauvegarde avec les logs fournis.
  *
@@ -86,4 +235,108 @@ void free_log_list(log_t *logs);
  */
 int copy_file(const char *source_path, const char *dest_path);
 
+/**
+  *@brief Projette en mémoire un fichier régulier non vide, pour une lecture séquentielle sans copie.
+ *
+  *Le noyau est prévenu de la lecture séquentielle (MADV_SEQUENTIAL, POSIX_FADV_SEQUENTIAL), et
+  *les pages déjà en cache sont relevées : mapped_file_release ne retire du cache que les pages
+  *que la lecture y a mises, pour qu'une sauvegarde complète n'évince pas le cache des autres programmes.
+ *
+  *@param map La projection à initialiser.
+  *@param fd Le descripteur du fichier, ouvert en lecture.
+  *@return int 0 si le fichier est projeté, -1 sinon (le fichier doit alors être lu).
+ */
+int mapped_file_open(mapped_file_t *map, int fd);
+
+/**
+  *@brief Indique que les données avant une position ont été utilisées : par tranches de
+  *MAPPED_RELEASE_SIZE octets, leurs pages qui n'étaient pas en cache en sont retirées (POSIX_FADV_DONTNEED).
+ *
+  *Les données retirées restent lisibles (relues depuis le disque si besoin).
+ *
+  *@param map La projection.
+  *@param offset La position jusqu'à laquelle le fichier a été utilisé.
+ */
+void mapped_file_release(mapped_file_t *map, off_t offset);
+
+/**
+  *@brief Rend au noyau les dernières pages lues et libère la projection.
+ *
+  *@param map La projection.
+ */
+void mapped_file_close(mapped_file_t *map);
+
+/**
+  *@brief Arme la protection des lectures d'une projection pour le thread appelant (voir MAPPED_GUARD).
+ *
+  *Un fichier tronqué pendant sa lecture lève SIGBUS sur les pages au-delà de sa nouvelle fin :
+  *le signal ramène alors au point de reprise au lieu d'arrêter le programme.
+ *
+  *@return sigjmp_buf* Le point de reprise du thread.
+ */
+sigjmp_buf *mapped_guard_arm(void);
+
+/**
+  *@brief Désarme la protection armée par MAPPED_GUARD, une fois les lectures terminées.
+ */
+void mapped_guard_disarm(void);
+
+/**
+  *@brief Protège les lectures d'une projection qui suivent, jusqu'à mapped_guard_disarm.
+ *
+  *Vaut 0, puis 1 si une lecture a levé SIGBUS (la protection est alors désarmée). S'utilise
+  *dans une fonction courte, sans variable locale modifiée entre les deux retours.
+ */
+#define MAPPED_GUARD() sigsetjmp(*mapped_guard_arm(), 0)
+
+/**
+  *@brief Copie des données d'une projection sous la protection de MAPPED_GUARD.
+ *
+  *@param dest La destination.
+  *@param src Les données projetées.
+  *@param size Le nombre d'octets à copier.
+  *@return int 0 si la copie a réussi, -1 si le fichier a été tronqué pendant la lecture.
+ */
+int mapped_copy(void *dest, const void *src, size_t size);
+
+/**
+  *@brief Active le mode --cache-neutral : les sauvegardes et restaurations ne laissent pas
+  *leurs données dans le cache du noyau (lectures O_DIRECT ou suivies de POSIX_FADV_DONTNEED,
+  *écritures envoyées au disque par sync_file_range puis retirées du cache).
+ *
+  *@param enabled 1 pour activer le mode, 0 sinon.
+ */
+void set_cache_neutral(int enabled);
+
+/**
+  *@brief Indique si le mode --cache-neutral est actif.
+ *
+  *@return int 1 si actif, 0 sinon.
+ */
+int cache_neutral(void);
+
+/**
+  *@brief Commence le suivi des écritures d'un fichier ouvert (sans effet hors mode --cache-neutral).
+ *
+  *@param wb Le suivi à initialiser.
+  *@param file Le fichier ouvert en écriture, à sa position d'écriture.
+ */
+void writeback_start(writeback_t *wb, FILE *file);
+
+/**
+  *@brief À appeler après des écritures : chaque tranche de WRITEBACK_SIZE octets est envoyée au
+  *disque sans l'attendre, et la tranche précédente, attendue, est retirée du cache. Les écritures
+  *continuent pendant que le disque travaille, sans perte de débit.
+ *
+  *@param wb Le suivi des écritures.
+ */
+void writeback_advance(writeback_t *wb);
+
+/**
+  *@brief Envoie au disque les dernières écritures et les retire du cache, avant la fermeture du fichier.
+ *
+  *@param wb Le suivi des écritures.
+ */
+void writeback_finish(writeback_t *wb);
+
 #endif // FILE_HANDLER_H
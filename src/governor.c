@@ -0,0 +1,189 @@
+#include "governor.h"
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+
+typedef struct {
+    uint64_t limit;     // Débit fixé par l'option (0 : aucun)
+    double rate;        // Débit appliqué (0 : aucun), réduit par le mode adaptatif
+    double tokens;      // Jetons disponibles, négatifs pendant une attente
+    double last;        // Dernier remplissage
+    double consumed;    // Consommé depuis le dernier relevé de pression
+} bucket_t;
+
+// Seaux partagés par tous les threads, protégés par un verrou
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static bucket_t buckets[GOVERNOR_BUCKETS];
+static int active = 0;             // Une limite est en place : fixé avant le lancement des threads
+static unsigned int cpu_percent = 0;
+static double cpu_window_wall = 0; // Début de la fenêtre de mesure du temps processeur
+static double cpu_window_cpu = 0;
+static int adaptive = 0;
+static double sample_time = 0;     // Dernier relevé de /proc/pressure/io
+static uint64_t sample_stall = 0;  // Temps d'attente cumulé (µs) à ce relevé
+
+static double clock_seconds(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Temps cumulé pendant lequel au moins une tâche de la machine a attendu le disque, en µs
+static int read_io_stall(uint64_t *stall) {
+    FILE *file = fopen("/proc/pressure/io", "r");
+    if (!file) {
+        return -1;
+    }
+    unsigned long long total;
+    int found = fscanf(file, "some avg10=%*f avg60=%*f avg300=%*f total=%llu", &total) == 1;
+    fclose(file);
+    if (!found) {
+        return -1;
+    }
+    *stall = total;
+    return 0;
+}
+
+void governor_set_rate(governor_bucket_t bucket, uint64_t rate) {
+    buckets[bucket].limit = rate;
+    buckets[bucket].rate = rate;
+    buckets[bucket].tokens = 0;
+    buckets[bucket].last = clock_seconds(CLOCK_MONOTONIC);
+    if (rate) {
+        active = 1;
+    }
+}
+
+void governor_set_cpu(unsigned int percent) {
+    cpu_percent = percent;
+    cpu_window_wall = clock_seconds(CLOCK_MONOTONIC);
+    cpu_window_cpu = clock_seconds(CLOCK_PROCESS_CPUTIME_ID);
+    if (percent) {
+        active = 1;
+    }
+}
+
+int governor_set_adaptive(void) {
+    if (read_io_stall(&sample_stall) != 0) {
+        return -1;
+    }
+    sample_time = clock_seconds(CLOCK_MONOTONIC);
+    adaptive = 1;
+    active = 1;
+    return 0;
+}
+
+// Prend des jetons dans un seau et renvoie le temps à attendre pour rembourser le manque
+static double take(bucket_t *bucket, double amount, double now) {
+    bucket->consumed += amount;
+    if (bucket->rate <= 0) {
+        return 0;
+    }
+    double burst = bucket->rate * GOVERNOR_BURST_MS / 1000.0;
+    bucket->tokens += (now - bucket->last) * bucket->rate;
+    if (bucket->tokens > burst) {
+        bucket->tokens = burst;
+    }
+    bucket->last = now;
+    bucket->tokens -= amount;
+    return bucket->tokens < 0 ? -bucket->tokens / bucket->rate : 0;
+}
+
+// Temps à attendre pour que le temps processeur du processus revienne sous sa part
+static double cpu_wait(double now) {
+    if (!cpu_percent) {
+        return 0;
+    }
+    double cpu = clock_seconds(CLOCK_PROCESS_CPUTIME_ID);
+    double elapsed = now - cpu_window_wall;
+    double allowed = (cpu - cpu_window_cpu) * 100.0 / cpu_percent;
+    if (elapsed >= GOVERNOR_SAMPLE_MS / 1000.0 && allowed <= elapsed) {
+        // Fenêtre respectée : en commencer une autre, l'avance passée ne se reporte pas
+        cpu_window_wall = now;
+        cpu_window_cpu = cpu;
+        return 0;
+    }
+    return allowed > elapsed ? allowed - elapsed : 0;
+}
+
+// Mode adaptatif : divise les débits quand la machine attend le disque, les remonte quand elle ne l'attend plus
+static void sample_pressure(double now) {
+    double interval = now - sample_time;
+    uint64_t stall;
+    if (!adaptive || interval < GOVERNOR_SAMPLE_MS / 1000.0 || read_io_stall(&stall) != 0) {
+        return;
+    }
+    double pressure = (stall - sample_stall) / 1e6 / interval * 100.0;
+    sample_time = now;
+    sample_stall = stall;
+
+    for (int i = 0; i < GOVERNOR_BUCKETS; i++) {
+        bucket_t *bucket = &buckets[i];
+        double observed = bucket->consumed / interval;
+        double minimum = i == GOVERNOR_IOPS ? GOVERNOR_MIN_IOPS : GOVERNOR_MIN_RATE;
+        bucket->consumed = 0;
+        if (pressure > GOVERNOR_PRESSURE_HIGH && observed > 0) {
+            double current = bucket->rate > 0 && bucket->rate < observed ? bucket->rate : observed;
+            bucket->rate = current / 2 > minimum ? current / 2 : minimum;
+            bucket->last = now;
+        }
+        else if (pressure < GOVERNOR_PRESSURE_LOW && bucket->rate > 0 && bucket->rate != bucket->limit) {
+            bucket->rate *= 1.25;
+            if (bucket->limit && bucket->rate > bucket->limit) {
+                bucket->rate = bucket->limit;
+            }
+            else if (!bucket->limit && bucket->rate > observed * 4) {
+                // Le débit réduit ne freine plus rien : retour à aucune limite
+                bucket->rate = 0;
+            }
+        }
+    }
+}
+
+static void pause_for(double seconds) {
+    uint64_t trace_start = trace_begin();
+    struct timespec ts = { .tv_sec = (time_t)seconds, .tv_nsec = (long)((seconds - (time_t)seconds) * 1e9) };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+        // Reprendre l'attente restante
+    }
+    trace_end(trace_start, "governor", "throttle", NULL, 0);
+}
+
+// Compte une consommation dans un seau (GOVERNOR_BUCKETS : aucun) et en opérations, puis attend si nécessaire
+static void charge(governor_bucket_t bucket, double amount, double ops) {
+    if (!active) {
+        return;
+    }
+    double now = clock_seconds(CLOCK_MONOTONIC);
+    pthread_mutex_lock(&lock);
+    sample_pressure(now);
+    double wait = bucket < GOVERNOR_BUCKETS ? take(&buckets[bucket], amount, now) : 0;
+    double wait_ops = take(&buckets[GOVERNOR_IOPS], ops, now);
+    double wait_cpu = cpu_wait(now);
+    pthread_mutex_unlock(&lock);
+
+    if (wait_ops > wait) {
+        wait = wait_ops;
+    }
+    if (wait_cpu > wait) {
+        wait = wait_cpu;
+    }
+    if (wait > 0) {
+        pause_for(wait);
+    }
+}
+
+void governor_read(uint64_t bytes) {
+    charge(GOVERNOR_READ, bytes, (double)bytes / GOVERNOR_IO_SIZE);
+}
+
+void governor_write(uint64_t bytes) {
+    charge(GOVERNOR_WRITE, bytes, (double)bytes / GOVERNOR_IO_SIZE);
+}
+
+void governor_op(void) {
+    charge(GOVERNOR_BUCKETS, 0, 1);
+}
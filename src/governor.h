@@ -0,0 +1,84 @@
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include <stdint.h>
+
+/** @brief Taille d'une requête comptée comme une opération par --max-iops (128 Ko) */
+#define GOVERNOR_IO_SIZE (128 * 1024)
+/** @brief Avance accumulable par un seau à jetons, en millisecondes de débit */
+#define GOVERNOR_BURST_MS 100
+/** @brief Intervalle de mesure de la pression d'entrées-sorties en mode adaptatif, en millisecondes */
+#define GOVERNOR_SAMPLE_MS 1000
+/** @brief Pression (pourcentage du temps où une tâche attend le disque) au-delà de laquelle les débits sont divisés par deux */
+#define GOVERNOR_PRESSURE_HIGH 10.0
+/** @brief Pression en dessous de laquelle les débits remontent de 25 % par intervalle */
+#define GOVERNOR_PRESSURE_LOW 2.0
+/** @brief Débit minimal d'un seau d'octets réduit par le mode adaptatif (1 Mo/s) */
+#define GOVERNOR_MIN_RATE (1024 * 1024)
+/** @brief Nombre minimal d'opérations par seconde laissé par le mode adaptatif */
+#define GOVERNOR_MIN_IOPS 16
+
+/**
+ * @brief Seaux à jetons du régulateur de ressources.
+ */
+typedef enum {
+    GOVERNOR_READ,    // Octets lus par seconde (--max-read-rate)
+    GOVERNOR_WRITE,   // Octets écrits par seconde (--max-write-rate)
+    GOVERNOR_IOPS,    // Opérations par seconde (--max-iops)
+    GOVERNOR_BUCKETS
+} governor_bucket_t;
+
+/**
+ * @brief Régulateur des ressources d'une sauvegarde ou d'une restauration.
+ *
+ * Les lectures, écritures et ouvertures de fichiers de tous les threads prennent des jetons
+ * dans des seaux partagés : un thread qui dépasse le débit fixé attend le temps nécessaire.
+ * La part de processeur est limitée en comparant le temps processeur consommé au temps écoulé.
+ * En mode adaptatif, la pression d'entrées-sorties de la machine (/proc/pressure/io) est relevée
+ * toutes les GOVERNOR_SAMPLE_MS : quand les autres programmes attendent le disque, les débits
+ * sont divisés par deux, puis remontent quand la pression retombe. Sans limite, chaque appel
+ * ne coûte qu'un test.
+ */
+
+/**
+ * @brief Fixe le débit maximal d'un seau.
+ *
+ * @param bucket Le seau.
+ * @param rate Le débit par seconde (octets, ou opérations pour GOVERNOR_IOPS), 0 pour aucune limite.
+ */
+void governor_set_rate(governor_bucket_t bucket, uint64_t rate);
+
+/**
+ * @brief Limite la part de processeur utilisée par le processus.
+ *
+ * @param percent Le pourcentage d'un processeur (1 à 100 par processeur), 0 pour aucune limite.
+ */
+void governor_set_cpu(unsigned int percent);
+
+/**
+ * @brief Active l'adaptation des débits à la pression d'entrées-sorties de la machine.
+ *
+ * @return int 0 si succès, -1 si /proc/pressure/io n'est pas disponible.
+ */
+int governor_set_adaptive(void);
+
+/**
+ * @brief Compte des octets lus : attend si le débit de lecture ou d'opérations est dépassé.
+ *
+ * @param bytes Les octets lus.
+ */
+void governor_read(uint64_t bytes);
+
+/**
+ * @brief Compte des octets écrits : attend si le débit d'écriture ou d'opérations est dépassé.
+ *
+ * @param bytes Les octets écrits.
+ */
+void governor_write(uint64_t bytes);
+
+/**
+ * @brief Compte une opération sans données (ouverture d'un fichier).
+ */
+void governor_op(void);
+
+#endif // GOVERNOR_H
@@ -0,0 +1,346 @@
+#define _GNU_SOURCE
+#include "ingest.h"
+#include "budget.h"
+#include "governor.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/sysmacros.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+// Opérations soumises pour un fichier, retrouvées par user_data = index * INGEST_OPS + opération
+enum { OP_OPEN, OP_READ, OP_CLOSE, OP_STATX, INGEST_OPS };
+
+struct ingest {
+    int ring_fd;                    // -1 : lots répartis entre des threads
+    unsigned char *buffers;         // INGEST_BATCH tampons de INGEST_SLOT_SIZE octets
+    // Anneau de soumission
+    void *sq_ring;
+    size_t sq_ring_size;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    // Anneau des résultats
+    void *cq_ring;
+    size_t cq_ring_size;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    struct statx stats[INGEST_BATCH];
+    // Lot en cours pour les threads
+    ingest_file_t *files;
+    int count;
+    int next;
+};
+
+static int ring_setup(struct io_uring_params *params) {
+    return syscall(__NR_io_uring_setup, INGEST_BATCH * INGEST_OPS, params);
+}
+
+static int ring_enter(int fd, unsigned submit, unsigned wait) {
+    return syscall(__NR_io_uring_enter, fd, submit, wait, IORING_ENTER_GETEVENTS, NULL, 0);
+}
+
+static int ring_register(int fd, unsigned opcode, const void *arg, unsigned count) {
+    return syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+static void unmap_ring(ingest_t *ingest) {
+    if (ingest->sqes) {
+        munmap(ingest->sqes, ingest->sqes_size);
+    }
+    if (ingest->cq_ring && ingest->cq_ring != ingest->sq_ring) {
+        munmap(ingest->cq_ring, ingest->cq_ring_size);
+    }
+    if (ingest->sq_ring) {
+        munmap(ingest->sq_ring, ingest->sq_ring_size);
+    }
+    close(ingest->ring_fd);
+    ingest->ring_fd = -1;
+}
+
+// Prépare l'anneau io_uring, ses tampons et ses descripteurs enregistrés ; -1 si io_uring n'est pas utilisable
+static int open_ring(ingest_t *ingest) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ingest->ring_fd = ring_setup(&params);
+    if (ingest->ring_fd < 0) {
+        return -1;
+    }
+    ingest->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ingest->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        // Les deux anneaux partagent une seule projection
+        if (ingest->cq_ring_size > ingest->sq_ring_size) {
+            ingest->sq_ring_size = ingest->cq_ring_size;
+        }
+        ingest->cq_ring_size = ingest->sq_ring_size;
+    }
+    ingest->sq_ring = mmap(NULL, ingest->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                           ingest->ring_fd, IORING_OFF_SQ_RING);
+    if (ingest->sq_ring == MAP_FAILED) {
+        ingest->sq_ring = NULL;
+        unmap_ring(ingest);
+        return -1;
+    }
+    ingest->cq_ring = ingest->sq_ring;
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        ingest->cq_ring = mmap(NULL, ingest->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                               ingest->ring_fd, IORING_OFF_CQ_RING);
+        if (ingest->cq_ring == MAP_FAILED) {
+            ingest->cq_ring = NULL;
+            unmap_ring(ingest);
+            return -1;
+        }
+    }
+    ingest->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ingest->sqes = mmap(NULL, ingest->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ingest->ring_fd, IORING_OFF_SQES);
+    if (ingest->sqes == MAP_FAILED) {
+        ingest->sqes = NULL;
+        unmap_ring(ingest);
+        return -1;
+    }
+    unsigned char *sq = ingest->sq_ring;
+    unsigned char *cq = ingest->cq_ring;
+    ingest->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    ingest->sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    ingest->sq_array = (unsigned*)(sq + params.sq_off.array);
+    ingest->cq_head = (unsigned*)(cq + params.cq_off.head);
+    ingest->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    ingest->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    ingest->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    // Tampons enregistrés (lectures sans reprise des pages à chaque appel) et emplacements de
+    // descripteurs directs : la lecture liée à l'ouverture désigne le fichier par son emplacement
+    struct iovec iovecs[INGEST_BATCH];
+    int fds[INGEST_BATCH];
+    for (int i = 0; i < INGEST_BATCH; i++) {
+        iovecs[i].iov_base = ingest->buffers + (size_t)i * INGEST_SLOT_SIZE;
+        iovecs[i].iov_len = INGEST_SLOT_SIZE;
+        fds[i] = -1;
+    }
+    if (ring_register(ingest->ring_fd, IORING_REGISTER_BUFFERS, iovecs, INGEST_BATCH) != 0 ||
+        ring_register(ingest->ring_fd, IORING_REGISTER_FILES, fds, INGEST_BATCH) != 0) {
+        unmap_ring(ingest);
+        return -1;
+    }
+    return 0;
+}
+
+ingest_t *ingest_create(void) {
+    ingest_t *ingest = calloc(1, sizeof(ingest_t));
+    if (!ingest) {
+        perror("Memory allocation failed");
+        return NULL;
+    }
+    if (posix_memalign((void**)&ingest->buffers, 4096, (size_t)INGEST_BATCH * INGEST_SLOT_SIZE) != 0) {
+        perror("Memory allocation failed");
+        free(ingest);
+        return NULL;
+    }
+    budget_force((uint64_t)INGEST_BATCH * INGEST_SLOT_SIZE);
+    if (open_ring(ingest) != 0) {
+        ingest->ring_fd = -1;
+    }
+    return ingest;
+}
+
+void ingest_free(ingest_t *ingest) {
+    if (!ingest) {
+        return;
+    }
+    if (ingest->ring_fd >= 0) {
+        unmap_ring(ingest);
+    }
+    free(ingest->buffers);
+    budget_release((uint64_t)INGEST_BATCH * INGEST_SLOT_SIZE);
+    free(ingest);
+}
+
+static struct io_uring_sqe *next_sqe(ingest_t *ingest, unsigned *tail, int index, int op) {
+    unsigned slot = *tail & *ingest->sq_mask;
+    struct io_uring_sqe *sqe = &ingest->sqes[slot];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = (unsigned long long)index * INGEST_OPS + op;
+    ingest->sq_array[slot] = slot;
+    (*tail)++;
+    return sqe;
+}
+
+// Soumet les opérations du lot et attend tous leurs résultats
+static void ring_batch(ingest_t *ingest, ingest_file_t *files, int count) {
+    unsigned tail = *ingest->sq_tail;
+    for (int i = 0; i < count; i++) {
+        unsigned char *buffer = ingest->buffers + (size_t)i * INGEST_SLOT_SIZE;
+        // Ouverture dans l'emplacement direct i, liée à la lecture qui le désigne
+        struct io_uring_sqe *sqe = next_sqe(ingest, &tail, i, OP_OPEN);
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (unsigned long)files[i].path;
+        sqe->open_flags = O_RDONLY; // Un descripteur direct n'est pas hérité : O_CLOEXEC y est refusé
+        sqe->file_index = i + 1;
+        sqe->flags = IOSQE_IO_LINK;
+
+        // Lecture dans le tampon enregistré i ; la fermeture suit même si la lecture échoue
+        sqe = next_sqe(ingest, &tail, i, OP_READ);
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->fd = i;
+        sqe->addr = (unsigned long)buffer;
+        sqe->len = INGEST_MAX_SIZE + 1;
+        sqe->off = 0;
+        sqe->buf_index = i;
+        sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+
+        sqe = next_sqe(ingest, &tail, i, OP_CLOSE);
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->file_index = i + 1;
+
+        sqe = next_sqe(ingest, &tail, i, OP_STATX);
+        sqe->opcode = IORING_OP_STATX;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (unsigned long)files[i].path;
+        sqe->len = STATX_BASIC_STATS;
+        sqe->off = (unsigned long)&ingest->stats[i];
+    }
+    __atomic_store_n(ingest->sq_tail, tail, __ATOMIC_RELEASE);
+
+    unsigned to_submit = count * INGEST_OPS;
+    unsigned pending = to_submit;
+    while (pending > 0) {
+        int submitted = ring_enter(ingest->ring_fd, to_submit, 1);
+        if (submitted < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                continue;
+            }
+            // L'anneau ne répond plus : les fichiers restants seront lus un par un
+            perror("io_uring_enter");
+            return;
+        }
+        to_submit -= submitted;
+
+        unsigned head = *ingest->cq_head;
+        unsigned ready = __atomic_load_n(ingest->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != ready && pending > 0; head++, pending--) {
+            struct io_uring_cqe *cqe = &ingest->cqes[head & *ingest->cq_mask];
+            ingest_file_t *file = &files[cqe->user_data / INGEST_OPS];
+            int op = cqe->user_data % INGEST_OPS;
+            if (op == OP_READ && cqe->res >= 0) {
+                file->length = cqe->res;
+            }
+            else if (op != OP_CLOSE && cqe->res < 0 && !file->error && cqe->res != -ECANCELED) {
+                file->error = -cqe->res;
+            }
+        }
+        __atomic_store_n(ingest->cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    for (int i = 0; i < count; i++) {
+        const struct statx *stx = &ingest->stats[i];
+        files[i].st.st_mode = stx->stx_mode;
+        files[i].st.st_size = stx->stx_size;
+        files[i].st.st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+        files[i].st.st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+        files[i].st.st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+        files[i].st.st_ino = stx->stx_ino;
+        files[i].st.st_nlink = stx->stx_nlink;
+    }
+}
+
+// Lit un fichier du lot avec les appels système habituels
+static void read_one(ingest_file_t *file, unsigned char *buffer) {
+    int fd = open(file->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        file->error = errno;
+        return;
+    }
+    if (fstat(fd, &file->st) != 0) {
+        file->error = errno;
+    }
+    else if (S_ISREG(file->st.st_mode)) {
+        size_t length = 0;
+        ssize_t n;
+        while (length <= INGEST_MAX_SIZE &&
+               (n = pread(fd, buffer + length, INGEST_MAX_SIZE + 1 - length, length)) != 0) {
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                file->error = errno;
+                break;
+            }
+            length += n;
+        }
+        file->length = length;
+    }
+    close(fd);
+}
+
+static void *ingest_worker(void *arg) {
+    ingest_t *ingest = arg;
+    int index;
+    while ((index = __atomic_fetch_add(&ingest->next, 1, __ATOMIC_RELAXED)) < ingest->count) {
+        read_one(&ingest->files[index], ingest->buffers + (size_t)index * INGEST_SLOT_SIZE);
+    }
+    return NULL;
+}
+
+// Répartit le lot entre des threads quand io_uring n'est pas disponible
+static void thread_batch(ingest_t *ingest, ingest_file_t *files, int count) {
+    ingest->files = files;
+    ingest->count = count;
+    ingest->next = 0;
+    pthread_t threads[INGEST_THREADS];
+    int started = 0;
+    while (started < INGEST_THREADS && started < count &&
+           pthread_create(&threads[started], NULL, ingest_worker, ingest) == 0) {
+        started++;
+    }
+    ingest_worker(ingest);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+void ingest_batch(ingest_t *ingest, ingest_file_t *files, int count) {
+    for (int i = 0; i < count; i++) {
+        files[i].error = 0;
+        files[i].length = 0;
+        files[i].complete = 0;
+        files[i].data = NULL;
+        memset(&files[i].st, 0, sizeof(files[i].st));
+    }
+    if (!ingest || count == 0) {
+        return;
+    }
+    if (ingest->ring_fd >= 0) {
+        ring_batch(ingest, files, count);
+    }
+    else {
+        thread_batch(ingest, files, count);
+    }
+
+    uint64_t bytes = 0;
+    for (int i = 0; i < count; i++) {
+        ingest_file_t *file = &files[i];
+        // Un fichier modifié entre le stat et la lecture n'est pas complet : il sera relu
+        file->complete = !file->error && S_ISREG(file->st.st_mode) && file->length <= INGEST_MAX_SIZE &&
+                         (off_t)file->length == file->st.st_size;
+        if (file->complete) {
+            file->data = ingest->buffers + (size_t)i * INGEST_SLOT_SIZE;
+        }
+        bytes += file->length;
+        governor_op();
+    }
+    governor_read(bytes);
+}
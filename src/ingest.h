@@ -0,0 +1,63 @@
+#ifndef INGEST_H
+#define INGEST_H
+
+#include <stddef.h>
+#include <sys/stat.h>
+
+/** @brief Taille maximale d'un fichier lu en entier par l'ingestion par lots (16 Ko) */
+#define INGEST_MAX_SIZE (16 * 1024)
+/** @brief Nombre de fichiers d'un lot */
+#define INGEST_BATCH 64
+/** @brief Taille d'un tampon de lecture : le fichier et un octet de plus pour reconnaître un fichier plus grand */
+#define INGEST_SLOT_SIZE (INGEST_MAX_SIZE + 4096)
+/** @brief Nombre de threads de l'ingestion sans io_uring */
+#define INGEST_THREADS 4
+
+/**
+ * @brief Fichier d'un lot d'ingestion.
+ */
+typedef struct {
+    const char *path;           // Chemin du fichier, fourni par l'appelant
+    int error;                  // 0, ou errno de l'ouverture, du stat ou de la lecture
+    struct stat st;             // Type, taille, date de modification, périphérique et inode
+    const unsigned char *data;  // Contenu du fichier si complete, valide jusqu'au lot suivant
+    size_t length;
+    int complete;               // Le fichier tient entier dans data (au plus INGEST_MAX_SIZE octets)
+} ingest_file_t;
+
+/**
+ * @brief Ingestion par lots des petits fichiers.
+ *
+ * Pour chaque fichier d'un lot, l'ouverture, la lecture des INGEST_MAX_SIZE premiers octets
+ * dans un tampon enregistré, la fermeture et le statx sont soumis ensemble à io_uring (appels
+ * système directs, sans liburing) : un lot entier coûte quelques appels système au lieu de
+ * cinq par fichier. Sans io_uring (noyau ancien ou désactivé), le lot est réparti entre
+ * INGEST_THREADS threads. Les fichiers plus grands sont seulement relevés (st) et doivent
+ * être lus autrement.
+ */
+typedef struct ingest ingest_t;
+
+/**
+ * @brief Crée une ingestion : anneau io_uring et tampons enregistrés, ou threads à défaut.
+ *
+ * @return ingest_t* L'ingestion, ou NULL en cas d'erreur (les fichiers sont alors lus un par un).
+ */
+ingest_t *ingest_create(void);
+
+/**
+ * @brief Libère l'ingestion.
+ *
+ * @param ingest L'ingestion (peut être NULL).
+ */
+void ingest_free(ingest_t *ingest);
+
+/**
+ * @brief Lit un lot de fichiers.
+ *
+ * @param ingest L'ingestion (NULL : aucun fichier n'est lu, tous sont marqués incomplets).
+ * @param files Les fichiers, path rempli par l'appelant.
+ * @param count Le nombre de fichiers, au plus INGEST_BATCH.
+ */
+void ingest_batch(ingest_t *ingest, ingest_file_t *files, int count);
+
+#endif // INGEST_H
@@ -6,9 +6,14 @@
 #include "deduplication.h"
 #include "backup_manager.h"
 #include "network.h"
+#include "server.h"
+#include "stats.h"
+#include "trace.h"
+#include "budget.h"
+#include "governor.h"
 
 // Modes possibles
-typedef enum { NONE, BACKUP, RESTORE, LIST_BACKUPS } ProgramMode;
+typedef enum { NONE, BACKUP, RESTORE, LIST_BACKUPS, SERVE } ProgramMode;
 
 // Fonction pour afficher l'usage du programme
 void print_usage(const char *prog_name) {
@@ -17,12 +22,24 @@ void print_usage(const char *prog_name) {
     printf("  --backup                Create a backup (cannot be used with --restore or --list-backups)\n");
     printf("  --restore               Restore a backup (cannot be used with --backup or --list-backups)\n");
     printf("  --list-backups          List available backups (cannot be used with --backup or --restore)\n");
+    printf("  --serve                 Run a backup server for many clients, one repository per client under --dest\n");
     printf("  --dry-run               Test backup or restore without performing actual operations\n");
+    printf("  --pack                  Store the first backup in 64 MB pack files instead of one file per source file\n");
+    printf("  --compress              Compress network traffic, the level adapting to the link speed\n");
     printf("  --dest [PATH]           Specify the destination path\n");
     printf("  --source [PATH]         Specify the source path\n");
     printf("  --s-server [IP]         Specify the source server IP\n");
     printf("  --d-server [IP]         Specify the destination server IP\n");
     printf("  --port [PORT]           Specify the port number\n");
+    printf("  --memory-limit [SIZE]   Keep buffers, batches and queues under SIZE bytes (K, M, G suffixes)\n");
+    printf("  --max-read-rate [SIZE]  Read at most SIZE bytes per second, across all threads (K, M, G suffixes)\n");
+    printf("  --max-write-rate [SIZE] Write at most SIZE bytes per second, across all threads\n");
+    printf("  --max-iops [N]          Issue at most N I/O operations per second (opens and 128 KB requests)\n");
+    printf("  --max-cpu [PERCENT]     Use at most PERCENT of one CPU (100 per CPU)\n");
+    printf("  --adaptive-io           Slow down while other programs wait for the disk (/proc/pressure/io)\n");
+    printf("  --cache-neutral         Keep backed up and restored data out of the page cache (O_DIRECT, fadvise, sync_file_range)\n");
+    printf("  --trace [FILE]          Record per-thread spans of --backup or --restore as a Chrome trace in FILE\n");
+    printf("  --stats [FILE]          Write per-phase counters of --backup or --restore as JSON to FILE (- for stdout)\n");
     printf("  -v, --verbose           Display verbose output\n");
     printf("  -h, --help              Display this help message\n");
 }
@@ -37,18 +54,33 @@ int main(int argc, char *argv[]) {
     char *s_server = NULL;
     char *d_server = NULL;
     int port = 12345; // Port par défaut
+    char *stats_path = NULL;
+    char *trace_path = NULL;
+    backup_options_t options = { .pack = 0, .compress = 0 };
 
     // Définition des options longues
     static struct option long_options[] = {
         {"backup", no_argument, 0, 0},
         {"restore", no_argument, 0, 0},
         {"list-backups", no_argument, 0, 0},
+        {"serve", no_argument, 0, 0},
         {"dry-run", no_argument, 0, 0},
+        {"pack", no_argument, 0, 0},
+        {"compress", no_argument, 0, 0},
         {"dest", required_argument, 0, 0},
         {"source", required_argument, 0, 0},
         {"s-server", required_argument, 0, 0},
         {"d-server", required_argument, 0, 0},
         {"port", required_argument, 0, 0},
+        {"stats", required_argument, 0, 0},
+        {"memory-limit", required_argument, 0, 0},
+        {"trace", required_argument, 0, 0},
+        {"cache-neutral", no_argument, 0, 0},
+        {"max-read-rate", required_argument, 0, 0},
+        {"max-write-rate", required_argument, 0, 0},
+        {"max-iops", required_argument, 0, 0},
+        {"max-cpu", required_argument, 0, 0},
+        {"adaptive-io", no_argument, 0, 0},
         {"verbose", no_argument, 0, 'v'},
         {"help", no_argument, 0, 'h'},
         {0, 0, 0, 0}
@@ -81,8 +113,18 @@ int main(int argc, char *argv[]) {
                     return EXIT_FAILURE;
                 }
                 mode = LIST_BACKUPS;
+            } else if (strcmp("serve", long_options[option_index].name) == 0) {
+                if (mode != NONE) {
+                    fprintf(stderr, "Error: Only one of --backup, --restore, --list-backups or --serve can be used.\n");
+                    return EXIT_FAILURE;
+                }
+                mode = SERVE;
             } else if (strcmp("dry-run", long_options[option_index].name) == 0) {
                 dry_run = 1;
+            } else if (strcmp("pack", long_options[option_index].name) == 0) {
+                options.pack = 1;
+            } else if (strcmp("compress", long_options[option_index].name) == 0) {
+                options.compress = 1;
             } else if (strcmp("dest", long_options[option_index].name) == 0) {
                 dest_path = optarg;
             } else if (strcmp("source", long_options[option_index].name) == 0) {
@@ -93,6 +135,46 @@ int main(int argc, char *argv[]) {
                 d_server = optarg;
             } else if (strcmp("port", long_options[option_index].name) == 0) {
                 port = atoi(optarg);
+            } else if (strcmp("stats", long_options[option_index].name) == 0) {
+                stats_path = optarg;
+            } else if (strcmp("trace", long_options[option_index].name) == 0) {
+                trace_path = optarg;
+            } else if (strcmp("cache-neutral", long_options[option_index].name) == 0) {
+                set_cache_neutral(1);
+            } else if (strcmp("max-read-rate", long_options[option_index].name) == 0 ||
+                       strcmp("max-write-rate", long_options[option_index].name) == 0) {
+                uint64_t rate;
+                if (parse_size(optarg, &rate) != 0) {
+                    fprintf(stderr, "Error: Invalid --%s '%s'.\n", long_options[option_index].name, optarg);
+                    return EXIT_FAILURE;
+                }
+                governor_set_rate(strcmp("max-read-rate", long_options[option_index].name) == 0 ?
+                                  GOVERNOR_READ : GOVERNOR_WRITE, rate);
+            } else if (strcmp("max-iops", long_options[option_index].name) == 0) {
+                uint64_t iops;
+                if (parse_size(optarg, &iops) != 0) {
+                    fprintf(stderr, "Error: Invalid --max-iops '%s'.\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                governor_set_rate(GOVERNOR_IOPS, iops);
+            } else if (strcmp("max-cpu", long_options[option_index].name) == 0) {
+                int percent = atoi(optarg);
+                if (percent <= 0) {
+                    fprintf(stderr, "Error: Invalid --max-cpu '%s'.\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                governor_set_cpu(percent);
+            } else if (strcmp("adaptive-io", long_options[option_index].name) == 0) {
+                if (governor_set_adaptive() != 0) {
+                    fprintf(stderr, "Warning: /proc/pressure/io is not available, --adaptive-io is ignored.\n");
+                }
+            } else if (strcmp("memory-limit", long_options[option_index].name) == 0) {
+                uint64_t memory_limit;
+                if (parse_size(optarg, &memory_limit) != 0) {
+                    fprintf(stderr, "Error: Invalid --memory-limit '%s'.\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                budget_set_limit(memory_limit);
             }
             break;
         case 'h': // Option -h ou --help
@@ -113,30 +195,54 @@ int main(int argc, char *argv[]) {
         fprintf(stderr, "Error: One of --backup, --restore, or --list-backups must be specified.\n");
         return EXIT_FAILURE;
     }
+    if (stats_path) {
+        stats_enable();
+    }
+    if (trace_path && (mode == BACKUP || mode == RESTORE)) {
+        trace_enable(trace_path); // Écrite à la sortie du programme
+    }
+
+    if (mode == SERVE) {
+        // Démon : les clients se connectent avec --backup --d-server, l'adresse d'écoute est --s-server
+        if (dest_path == NULL) {
+            fprintf(stderr, "Error: --dest is required for --serve.\n");
+            return EXIT_FAILURE;
+        }
+        if (verbose) printf("|Serving backups from '%s' on port %d\n", dest_path, port);
+        return serve_forever(s_server, port, dest_path, &options) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
     if (mode == BACKUP) {
-        if (source_path == NULL || dest_path == NULL) {
+        if (s_server) {
+            // Mode serveur : recevoir une sauvegarde dans --dest, en écoute sur l'adresse --s-server
+            if (dest_path == NULL) {
+                fprintf(stderr, "Error: --dest is required to receive a backup.\n");
+                return EXIT_FAILURE;
+            }
+            if (serve_connection(s_server, port, dest_path, &options) != 0) {
+                return EXIT_FAILURE;
+            }
+            return EXIT_SUCCESS;
+        }
+        if (source_path == NULL || (dest_path == NULL && d_server == NULL)) {
             fprintf(stderr, "Error: --source and --dest are required for --backup.\n");
             return EXIT_FAILURE;
         }
-        if (verbose) printf("|Starting backup from '%s' to '%s'\n", source_path, dest_path);
+        if (verbose) printf("|Starting backup from '%s' to '%s'\n", source_path, d_server ? d_server : dest_path);
 
-        if(s_server || d_server) {
-            if (strcmp(s_server, "0.0.0.0") == 0 || strcmp(d_server, "127.0.0.1") == 0) {
-                // Mode serveur
-                receive_data(port, NULL); // Utiliser le port spécifié
-            } else if (strcmp(s_server, "127.0.0.1") == 0) {
-                // Mode client
-                send_data(d_server, port, "BACKUP", strlen("BACKUP") + 1);
-                receive_data(port, NULL); // Recevoir le fichier .backup_log
-                // Comparer les données et envoyer les fichiers dédupliqués
-                send_data(d_server, port, "EXIT", strlen("EXIT") + 1);
+        if (d_server) {
+            // Mode client : envoyer la sauvegarde au serveur sur une seule connexion
+            if (remote_backup(source_path, d_server, port, &options) != 0) {
+                return EXIT_FAILURE;
             }
         } else {
-            create_backup(source_path, dest_path);
+            create_backup(source_path, dest_path, &options);
         }
 
         if (verbose) printf("|Backup done \n");
+        if (stats_path && stats_write_json(stats_path, "backup") != 0) {
+            return EXIT_FAILURE;
+        }
     } else if (mode == RESTORE) {
         if (source_path == NULL || dest_path == NULL) {
             fprintf(stderr, "Error: --source and --dest are required for --restore.\n");
@@ -144,33 +250,33 @@ int main(int argc, char *argv[]) {
         }
         if (verbose) printf("|Starting restore from '%s' to '%s'\n", source_path, dest_path);
 
-        if(s_server || d_server) {
-            if (strcmp(s_server, "0.0.0.0") == 0 || strcmp(d_server, "127.0.0.1") == 0) {
-                // Mode serveur
-                receive_data(port, NULL); // Utiliser le port spécifié
-            } else if (strcmp(s_server, "127.0.0.1") == 0) {
-                // Mode client
-                send_data(d_server, port, "RESTORE BACKUP_ID", strlen("RESTORE BACKUP_ID") + 1);
-                receive_data(port, NULL); // Recevoir les fichiers restaurés
+        if (s_server) {
+            // La source est le nom d'une sauvegarde sur le serveur
+            if (remote_restore(source_path, dest_path, s_server, port, &options) != 0) {
+                return EXIT_FAILURE;
             }
         } else {
             restore_backup(source_path, dest_path);
         }
 
         if (verbose) printf("|Restore done \n");
+        if (stats_path && stats_write_json(stats_path, "restore") != 0) {
+            return EXIT_FAILURE;
+        }
     } else if (mode == LIST_BACKUPS) {
-        if(s_server || d_server) {
-            if (source_path != NULL) {
-                if (verbose) printf("|Listing backups...\n\n");
-                list_backups(source_path);
-                if (verbose) printf("\n|Pick a backup name to restore from folder.\n");
-                if (verbose) printf("|Remember to add backslashes.\n");
-            } else {
-                fprintf(stderr, "Error: --source is required for --list-backups.\n");
+        if (s_server) {
+            if (verbose) printf("|Listing backups on %s...\n\n", s_server);
+            if (remote_list_backups(s_server, port) != 0) {
                 return EXIT_FAILURE;
             }
+        } else if (source_path != NULL) {
+            if (verbose) printf("|Listing backups...\n\n");
+            list_backups(source_path);
+            if (verbose) printf("\n|Pick a backup name to restore from folder.\n");
+            if (verbose) printf("|Remember to add backslashes.\n");
         } else {
-            send_data(d_server, port, "LIST_BACKUP", strlen("LIST_BACKUP") + 1);
+            fprintf(stderr, "Error: --source is required for --list-backups.\n");
+            return EXIT_FAILURE;
         }
     }
 
@@ -1,67 +1,2381 @@
 #include "network.h"
+#include "delta.h"
+#include "utilities.h"
+#include "stats.h"
+#include "trace.h"
+#include "budget.h"
+#include "governor.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <time.h>
 
-void send_data(const char *server_address, int port, const void *data, size_t size) {
-     int sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0) {
-        perror("Erreur dans la création du socket");
+static double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Attend que le socket accepte de nouveau des données (sockets non bloquants du démon)
+static int wait_writable(int fd) {
+    struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+    while (poll(&pfd, 1, -1) < 0) {
+        if (errno != EINTR) {
+            perror("Erreur dans poll");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Envoie tout un tampon ; MSG_MORE indique au noyau que des données suivent (fusion avec un sendfile)
+static int send_all_flags(int fd, const void *data, size_t size, int flags) {
+    const unsigned char *bytes = (const unsigned char*)data;
+    while (size > 0) {
+        ssize_t sent = send(fd, bytes, size, MSG_NOSIGNAL | flags);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && wait_writable(fd) == 0) {
+                continue;
+            }
+            perror("Erreur dans l'envoi des données");
+            return -1;
+        }
+        bytes += sent;
+        size -= sent;
+    }
+    return 0;
+}
+
+int send_all(int fd, const void *data, size_t size) {
+    return send_all_flags(fd, data, size, 0);
+}
+
+int recv_all(int fd, void *data, size_t size) {
+    unsigned char *bytes = (unsigned char*)data;
+    while (size > 0) {
+        ssize_t received = recv(fd, bytes, size, 0);
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Erreur dans la réception des données");
+            return -1;
+        }
+        if (received == 0) {
+            fprintf(stderr, "Connexion fermée par le pair\n");
+            return -1;
+        }
+        bytes += received;
+        size -= received;
+    }
+    return 0;
+}
+
+int net_connect(const char *server_address, int port) {
+    const char *target;
+    const transport_t *transport = transport_select(server_address, &target);
+    return transport->connect(target, port);
+}
+
+int net_listen(const char *address, int port) {
+    const char *target;
+    const transport_t *transport = transport_select(address, &target);
+    return transport->listen(target, port);
+}
+
+connection_t *connection_open(int fd) {
+    connection_t *conn = calloc(1, sizeof(connection_t));
+    if (!conn) {
+        perror("Memory allocation failed");
+        close(fd);
+        return NULL;
+    }
+    conn->fd = fd;
+    conn->pass_fd = -1;
+    conn->received_fd = -1;
+    conn->out = malloc(NET_BUFFER_SIZE);
+    conn->in = malloc(NET_BUFFER_SIZE);
+    conn->out_capacity = NET_BUFFER_SIZE;
+    conn->in_capacity = NET_BUFFER_SIZE;
+    if (!conn->out || !conn->in) {
+        perror("Memory allocation failed");
+        connection_close(conn);
+        return NULL;
+    }
+    return conn;
+}
+
+int connection_set_nonblocking(connection_t *conn) {
+    int flags = fcntl(conn->fd, F_GETFL, 0);
+    if (flags == -1 || fcntl(conn->fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        perror("Erreur lors du passage du socket en mode non bloquant");
+        return -1;
+    }
+    conn->nonblocking = 1;
+    return 0;
+}
+
+void connection_close(connection_t *conn) {
+    if (!conn) {
         return;
     }
+    if (conn->out_used > conn->out_sent && !conn->nonblocking) {
+        flush_connection(conn);
+    }
+    close(conn->fd);
+    if (conn->received_fd >= 0) {
+        close(conn->received_fd);
+    }
+    shm_area_close(conn->shm);
+    compressor_free(conn->compressor);
+    free(conn->out);
+    free(conn->in);
+    free(conn->payload);
+    free(conn);
+}
+
+// Agrandit un tampon pour qu'il puisse contenir needed octets
+static int ensure_capacity(unsigned char **buffer, size_t *capacity, size_t needed) {
+    if (needed <= *capacity) {
+        return 0;
+    }
+    size_t new_capacity = *capacity;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+    unsigned char *grown = realloc(*buffer, new_capacity);
+    if (!grown) {
+        perror("Memory allocation failed");
+        return -1;
+    }
+    *buffer = grown;
+    *capacity = new_capacity;
+    return 0;
+}
+
+// Envoie le début du tampon avec un descripteur attaché (SCM_RIGHTS), que le pair reçoit avec ces octets
+static int send_passed_fd(connection_t *conn) {
+    char control[CMSG_SPACE(sizeof(int))];
+    memset(control, 0, sizeof(control));
+    struct iovec iov = { .iov_base = conn->out + conn->out_sent, .iov_len = conn->out_used - conn->out_sent };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = control, .msg_controllen = sizeof(control) };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &conn->pass_fd, sizeof(int));
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(conn->fd, &msg, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    if (sent < 0) {
+        perror("Erreur lors de l'envoi du descripteur");
+        return -1;
+    }
+    conn->out_sent += sent;
+    conn->pass_fd = -1;
+    return 0;
+}
+
+static int flush_connection_flags(connection_t *conn, int flags) {
+    if (conn->out_used == conn->out_sent) {
+        return 0;
+    }
+    if (conn->pass_fd >= 0 && send_passed_fd(conn) != 0) {
+        return -1;
+    }
+    // Le temps passé à attendre le réseau mesure le débit du lien pour la compression adaptative
+    size_t pending = conn->out_used - conn->out_sent;
+    stats_span_t span;
+    stats_begin(STATS_NETWORK, &span);
+    double start = conn->compressor ? monotonic_seconds() : 0;
+    int result = send_all_flags(conn->fd, conn->out + conn->out_sent, pending, flags);
+    stats_end(STATS_NETWORK, &span, pending, 0, 0);
+    if (conn->compressor) {
+        compressor_note_wait(conn->compressor, pending, monotonic_seconds() - start);
+    }
+    conn->out_used = 0;
+    conn->out_sent = 0;
+    return result;
+}
+
+int flush_connection(connection_t *conn) {
+    return flush_connection_flags(conn, 0);
+}
+
+int write_pending(connection_t *conn) {
+    while (conn->out_sent < conn->out_used) {
+        ssize_t sent = send(conn->fd, conn->out + conn->out_sent, conn->out_used - conn->out_sent,
+                            MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 0;
+            }
+            perror("Erreur dans l'envoi des données");
+            return -1;
+        }
+        conn->out_sent += sent;
+    }
+    conn->out_used = 0;
+    conn->out_sent = 0;
+    return 1;
+}
+
+// Les contenus DATA assez gros passent par l'anneau en mémoire partagée plutôt que par le socket
+static int use_shared_memory(const connection_t *conn, uint8_t type, uint32_t length) {
+    return conn->shm_tx && type == FRAME_DATA && length >= SHM_MIN_PAYLOAD && length <= conn->shm_tx->size / 4;
+}
+
+// Réserve une place dans l'anneau d'émission, en attendant que le pair en libère si besoin.
+// Le démon n'attend pas : NULL si l'anneau est plein, la trame passe alors par le socket
+static unsigned char *reserve_shared_memory(connection_t *conn, uint32_t length, uint64_t *position) {
+    unsigned char *data;
+    while ((data = shm_ring_reserve(conn->shm_tx, length, position)) == NULL && !conn->nonblocking) {
+        // Le pair ne libère de place qu'en lisant les trames : lui envoyer celles en attente
+        if (flush_connection(conn) != 0) {
+            return NULL;
+        }
+        shm_ring_wait(conn->shm_tx, length);
+        struct pollfd pfd = { .fd = conn->fd, .events = 0 };
+        if (poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLHUP | POLLERR))) {
+            fprintf(stderr, "Connexion fermée par le pair\n");
+            return NULL;
+        }
+    }
+    return data;
+}
+
+// Envoie la trame qui désigne un contenu publié dans l'anneau : position (8 octets) et taille (4 octets)
+static int send_shared_memory_frame(connection_t *conn, uint8_t type, uint64_t position, uint32_t length) {
+    unsigned char descriptor[SHM_DESCRIPTOR_SIZE];
+    uint32_t net_length = htonl(length);
+    shm_ring_publish(conn->shm_tx, position, length);
+    memcpy(descriptor, &position, sizeof(uint64_t));
+    memcpy(descriptor + sizeof(uint64_t), &net_length, sizeof(uint32_t));
+    return send_frame_flags(conn, type, FRAME_FLAG_SHM, descriptor, SHM_DESCRIPTOR_SIZE);
+}
+
+// Seuls les contenus de données et les .backup_log passent par le flux compressé
+static int use_compression(const connection_t *conn, uint8_t type) {
+    return conn->compressor && (type == FRAME_DATA || type == FRAME_MANIFEST);
+}
+
+// Noms des trames dans la trace, par type
+static const char *const frame_send_names[] = {
+    "send ?", "send HELLO", "send MANIFEST", "send FILE", "send CHUNK", "send HAVE", "send NEED",
+    "send ACK", "send ERROR", "send END", "send DATA", "send SIGNATURES"
+};
+static const char *const frame_recv_names[] = {
+    "recv ?", "recv HELLO", "recv MANIFEST", "recv FILE", "recv CHUNK", "recv HAVE", "recv NEED",
+    "recv ACK", "recv ERROR", "recv END", "recv DATA", "recv SIGNATURES"
+};
+
+static const char *frame_name(const char *const names[], uint8_t type) {
+    return type <= FRAME_SIGNATURES ? names[type] : names[0];
+}
+
+static int encode_frame(connection_t *conn, uint8_t type, const void *payload, uint32_t length) {
+    if (use_compression(conn, type)) {
+        const unsigned char *compressed;
+        uint32_t compressed_length;
+        int result = compressor_deflate(conn->compressor, payload, length, &compressed, &compressed_length);
+        if (result < 0) {
+            return -1;
+        }
+        if (result == 1) {
+            return send_frame_flags(conn, type, FRAME_FLAG_DEFLATE, compressed, compressed_length);
+        }
+    }
+    if (use_shared_memory(conn, type, length)) {
+        uint64_t position;
+        unsigned char *data = reserve_shared_memory(conn, length, &position);
+        if (data) {
+            memcpy(data, payload, length);
+            return send_shared_memory_frame(conn, type, position, length);
+        }
+        if (!conn->nonblocking) {
+            return -1;
+        }
+    }
+    return send_frame_flags(conn, type, 0, payload, length);
+}
+
+int send_frame(connection_t *conn, uint8_t type, const void *payload, uint32_t length) {
+    uint64_t start = trace_begin();
+    int result = encode_frame(conn, type, payload, length);
+    trace_end(start, "network", frame_name(frame_send_names, type), NULL, length);
+    return result;
+}
+
+int send_frame_flags(connection_t *conn, uint8_t type, uint8_t flags, const void *payload, uint32_t length) {
+    unsigned char header[FRAME_HEADER_SIZE] = { 0 };
+    uint32_t net_length = htonl(length);
+    header[0] = type;
+    header[1] = flags;
+    memcpy(header + 4, &net_length, sizeof(uint32_t));
+
+    if (!conn->nonblocking) {
+        if (conn->out_used + FRAME_HEADER_SIZE + length > conn->out_capacity) {
+            if (flush_connection(conn) != 0) {
+                return -1;
+            }
+        }
+        if (FRAME_HEADER_SIZE + length > conn->out_capacity) {
+            // Trame plus grande que le tampon : envoyée directement
+            stats_span_t span;
+            stats_begin(STATS_NETWORK, &span);
+            if (send_all(conn->fd, header, FRAME_HEADER_SIZE) != 0 || send_all(conn->fd, payload, length) != 0) {
+                return -1;
+            }
+            stats_end(STATS_NETWORK, &span, FRAME_HEADER_SIZE + length, 0, 0);
+            return 0;
+        }
+    }
+    else if (ensure_capacity(&conn->out, &conn->out_capacity, conn->out_used + FRAME_HEADER_SIZE + length) != 0) {
+        return -1; // En mode événementiel, le tampon grandit et la boucle l'envoie quand le socket est prêt
+    }
+
+    // Cas courant : la trame rejoint le tampon et partira avec les suivantes
+    memcpy(conn->out + conn->out_used, header, FRAME_HEADER_SIZE);
+    if (length > 0) {
+        memcpy(conn->out + conn->out_used + FRAME_HEADER_SIZE, payload, length);
+    }
+    conn->out_used += FRAME_HEADER_SIZE + length;
+    return 0;
+}
+
+// Connexion non bloquante du démon : le contenu part par sendfile tant que le socket l'accepte, le reste
+// est copié dans le tampon d'émission que la boucle d'événements enverra. Le worker n'attend jamais le réseau
+static int queue_frame_from_file(connection_t *conn, const unsigned char *header, int fd, off_t offset,
+                                 uint32_t length) {
+    if (ensure_capacity(&conn->out, &conn->out_capacity, conn->out_used + FRAME_HEADER_SIZE + length) != 0) {
+        return -1;
+    }
+    memcpy(conn->out + conn->out_used, header, FRAME_HEADER_SIZE);
+    conn->out_used += FRAME_HEADER_SIZE;
+    int drained = write_pending(conn);
+    if (drained < 0) {
+        return -1;
+    }
+
+    governor_read(length);
+    stats_span_t span;
+    stats_begin(STATS_NETWORK, &span);
+    uint32_t total = length;
+    while (drained == 1 && length > 0) {
+        ssize_t sent = sendfile(conn->fd, fd, &offset, length);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (sent < 0) {
+            perror("Erreur dans l'envoi du fichier");
+            return -1;
+        }
+        if (sent == 0) {
+            fprintf(stderr, "Fichier tronqué pendant l'envoi\n");
+            return -1;
+        }
+        length -= sent;
+    }
+    stats_end(STATS_NETWORK, &span, total - length, 0, 0);
+    if (length > 0) {
+        if (pread(fd, conn->out + conn->out_used, length, offset) != (ssize_t)length) {
+            perror("Erreur de lecture des données à envoyer");
+            return -1;
+        }
+        conn->out_used += length;
+    }
+    return 0;
+}
+
+int send_frame_from_file(connection_t *conn, uint8_t type, int fd, off_t offset, uint32_t length) {
+    if (use_shared_memory(conn, type, length)) {
+        // Les données sont lues directement dans la mémoire que le pair lira
+        uint64_t position;
+        unsigned char *data = reserve_shared_memory(conn, length, &position);
+        if (data) {
+            if (pread(fd, data, length, offset) != (ssize_t)length) {
+                perror("Erreur de lecture des données à envoyer");
+                return -1;
+            }
+            return send_shared_memory_frame(conn, type, position, length);
+        }
+        if (!conn->nonblocking) {
+            return -1;
+        }
+    }
+    if (use_compression(conn, type) && compressor_active(conn->compressor)) {
+        // Le contenu doit passer par le compresseur : lu puis envoyé comme une trame ordinaire
+        unsigned char *data = malloc(length ? length : 1);
+        if (!data) {
+            perror("Memory allocation failed");
+            return -1;
+        }
+        int result = 0;
+        if (pread(fd, data, length, offset) != (ssize_t)length) {
+            perror("Erreur de lecture des données à envoyer");
+            result = -1;
+        }
+        if (result == 0) {
+            result = send_frame(conn, type, data, length);
+        }
+        free(data);
+        return result;
+    }
+
+    unsigned char header[FRAME_HEADER_SIZE] = { 0 };
+    uint32_t net_length = htonl(length);
+    header[0] = type;
+    memcpy(header + 4, &net_length, sizeof(uint32_t));
+    if (use_compression(conn, type)) {
+        compressor_count_plain(conn->compressor, length);
+    }
+    if (conn->nonblocking) {
+        return queue_frame_from_file(conn, header, fd, offset, length);
+    }
+
+    // L'en-tête part avec les petites trames en attente, le contenu suit directement du cache de pages
+    if (ensure_capacity(&conn->out, &conn->out_capacity, conn->out_used + FRAME_HEADER_SIZE) != 0) {
+        return -1;
+    }
+    memcpy(conn->out + conn->out_used, header, FRAME_HEADER_SIZE);
+    conn->out_used += FRAME_HEADER_SIZE;
+    if (flush_connection_flags(conn, MSG_MORE) != 0) {
+        return -1;
+    }
+
+    stats_span_t span;
+    stats_begin(STATS_NETWORK, &span);
+    governor_read(length);
+    double start = conn->compressor ? monotonic_seconds() : 0;
+    uint32_t total = length;
+    while (length > 0) {
+        ssize_t sent = sendfile(conn->fd, fd, &offset, length);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && wait_writable(conn->fd) == 0) {
+                continue;
+            }
+            perror("Erreur dans l'envoi du fichier");
+            return -1;
+        }
+        if (sent == 0) {
+            fprintf(stderr, "Fichier tronqué pendant l'envoi\n");
+            return -1;
+        }
+        length -= sent;
+    }
+    stats_end(STATS_NETWORK, &span, total, 0, 0);
+    if (conn->compressor) {
+        compressor_note_wait(conn->compressor, total, monotonic_seconds() - start);
+    }
+    return 0;
+}
+
+int has_complete_frame(const connection_t *conn) {
+    size_t available = conn->in_end - conn->in_start;
+    if (available < FRAME_HEADER_SIZE) {
+        return 0;
+    }
+    uint32_t net_length;
+    memcpy(&net_length, conn->in + conn->in_start + 4, sizeof(uint32_t));
+    uint32_t length = ntohl(net_length);
+    // Une trame invalide est signalée comme complète pour que next_frame la rejette
+    return length > FRAME_MAX_PAYLOAD || available >= FRAME_HEADER_SIZE + (size_t)length;
+}
+
+// Fait pointer la trame vers son contenu dans l'anneau de réception, libéré à la trame suivante
+static int resolve_shared_memory_frame(connection_t *conn, frame_t *frame) {
+    uint64_t position;
+    uint32_t net_length;
+    unsigned char *data = NULL;
+    // Seules les trames DATA passent par l'anneau (use_shared_memory) : toute autre trame marquée est refusée
+    if (conn->shm_rx && frame->type == FRAME_DATA && frame->length == SHM_DESCRIPTOR_SIZE) {
+        memcpy(&position, frame->payload, sizeof(uint64_t));
+        memcpy(&net_length, frame->payload + sizeof(uint64_t), sizeof(uint32_t));
+        data = shm_ring_data(conn->shm_rx, position, ntohl(net_length));
+    }
+    if (!data) {
+        fprintf(stderr, "Trame en mémoire partagée invalide\n");
+        return -1;
+    }
+    frame->payload = data;
+    frame->length = ntohl(net_length);
+    frame->flags &= ~FRAME_FLAG_SHM;
+    conn->shm_release = position + frame->length;
+    return 1;
+}
+
+int next_frame(connection_t *conn, frame_t *frame) {
+    // Le contenu de la trame précédente n'est plus utilisé : sa place dans l'anneau est rendue
+    if (conn->shm_release) {
+        shm_ring_release(conn->shm_rx, conn->shm_release);
+        conn->shm_release = 0;
+    }
+    size_t available = conn->in_end - conn->in_start;
+    if (available < FRAME_HEADER_SIZE) {
+        return 0;
+    }
+    unsigned char *header = conn->in + conn->in_start;
+    uint32_t net_length;
+    memcpy(&net_length, header + 4, sizeof(uint32_t));
+    uint32_t length = ntohl(net_length);
+    if (length > FRAME_MAX_PAYLOAD) {
+        fprintf(stderr, "Trame trop grande : %u octets\n", length);
+        return -1;
+    }
+    if (available < FRAME_HEADER_SIZE + (size_t)length) {
+        return 0;
+    }
+
+    // Un octet de plus pour pouvoir terminer les contenus texte par '\0'
+    if (length + 1 > conn->payload_capacity) {
+        unsigned char *grown = realloc(conn->payload, length + 1);
+        if (!grown) {
+            perror("Memory allocation failed");
+            return -1;
+        }
+        conn->payload = grown;
+        conn->payload_capacity = length + 1;
+    }
+    frame->type = header[0];
+    frame->flags = header[1];
+    frame->length = length;
+    frame->payload = conn->payload;
+    conn->in_start += FRAME_HEADER_SIZE + length;
+    if (frame->flags & FRAME_FLAG_DEFLATE) {
+        // Contenu du flux compressé du pair : décompressé directement depuis le tampon de réception
+        if (!conn->compressor ||
+            compressor_inflate(conn->compressor, header + FRAME_HEADER_SIZE, length,
+                               &conn->payload, &conn->payload_capacity, &frame->length) != 0) {
+            fprintf(stderr, "Trame compressée invalide\n");
+            return -1;
+        }
+        frame->payload = conn->payload;
+        frame->payload[frame->length] = '\0';
+        frame->flags &= ~FRAME_FLAG_DEFLATE;
+        return 1;
+    }
+    memcpy(conn->payload, header + FRAME_HEADER_SIZE, length);
+    conn->payload[length] = '\0';
+    if (frame->flags & FRAME_FLAG_SHM) {
+        return resolve_shared_memory_frame(conn, frame);
+    }
+    return 1;
+}
+
+// Lit les octets disponibles à la suite du tampon de réception, qui grandit pour contenir une trame entière
+// Retourne le nombre d'octets lus, 0 si le pair a fermé, -1 en cas d'erreur (errno conservé)
+static ssize_t fill_connection(connection_t *conn) {
+    if (conn->in_start > 0) {
+        memmove(conn->in, conn->in + conn->in_start, conn->in_end - conn->in_start);
+        conn->in_end -= conn->in_start;
+        conn->in_start = 0;
+    }
+    if (conn->in_end == conn->in_capacity &&
+        ensure_capacity(&conn->in, &conn->in_capacity, conn->in_capacity * 2) != 0) {
+        return -1;
+    }
+    // recvmsg plutôt que recv : sur un socket Unix, le pair peut joindre un descripteur (mémoire partagée)
+    char control[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = { .iov_base = conn->in + conn->in_end, .iov_len = conn->in_capacity - conn->in_end };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = control, .msg_controllen = sizeof(control) };
+    ssize_t received;
+    do {
+        received = recvmsg(conn->fd, &msg, MSG_CMSG_CLOEXEC);
+    } while (received < 0 && errno == EINTR);
+    if (received > 0) {
+        conn->in_end += received;
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            if (conn->received_fd >= 0) {
+                close(conn->received_fd);
+            }
+            memcpy(&conn->received_fd, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+    return received;
+}
+
+int read_available(connection_t *conn) {
+    while (1) {
+        ssize_t received = fill_connection(conn);
+        if (received == 0) {
+            conn->peer_closed = 1;
+            return 0;
+        }
+        if (received < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 0;
+            }
+            perror("Erreur dans la réception des données");
+            return -1;
+        }
+    }
+}
+
+static int wait_frame(connection_t *conn, frame_t *frame) {
+    // Les trames en attente peuvent être celles auxquelles le pair doit répondre
+    if (flush_connection(conn) != 0) {
+        return -1;
+    }
+
+    while (1) {
+        int found = next_frame(conn, frame);
+        if (found != 0) {
+            return found == 1 ? 0 : -1;
+        }
+        // L'attente d'une réponse compte dans le temps de passage des données sur le lien
+        stats_span_t span;
+        stats_begin(STATS_NETWORK, &span);
+        double start = conn->compressor ? monotonic_seconds() : 0;
+        ssize_t received = fill_connection(conn);
+        stats_end(STATS_NETWORK, &span, received > 0 ? received : 0, 0, 0);
+        if (conn->compressor) {
+            compressor_note_wait(conn->compressor, 0, monotonic_seconds() - start);
+        }
+        if (received == 0) {
+            return -1; // Connexion fermée par le pair
+        }
+        if (received < 0) {
+            perror("Erreur dans la réception des données");
+            return -1;
+        }
+    }
+}
+
+// L'événement de la trace couvre l'attente de la trame : les blocages du pair y sont visibles
+int recv_frame(connection_t *conn, frame_t *frame) {
+    uint64_t start = trace_begin();
+    int result = wait_frame(conn, frame);
+    trace_end(start, "network", result == 0 ? frame_name(frame_recv_names, frame->type) : "recv ?", NULL,
+              result == 0 ? frame->length : 0);
+    return result;
+}
+
+void send_error(connection_t *conn, const char *message) {
+    send_frame(conn, FRAME_ERROR, message, strlen(message));
+    if (!conn->nonblocking) {
+        flush_connection(conn);
+    }
+}
+
+// Contenu de la trame HELLO : magic (4 octets), version (2 octets), commande (1 octet),
+// puis le nom du client (facultatif) qui désigne son sous-dépôt sur le serveur
+#define HELLO_SIZE 7
+#define CLIENT_NAME_MAX 64
+
+int client_handshake(connection_t *conn, command_t command) {
+    unsigned char hello[HELLO_SIZE + CLIENT_NAME_MAX + 1];
+    uint32_t magic = htonl(PROTOCOL_MAGIC);
+    uint16_t version = htons(PROTOCOL_VERSION);
+    memcpy(hello, &magic, sizeof(uint32_t));
+    memcpy(hello + 4, &version, sizeof(uint16_t));
+    hello[6] = (unsigned char)command;
+
+    char name[CLIENT_NAME_MAX + 1] = { 0 };
+    if (gethostname(name, CLIENT_NAME_MAX) != 0) {
+        name[0] = '\0';
+    }
+    size_t name_length = strlen(name);
+    memcpy(hello + HELLO_SIZE, name, name_length);
+
+    // Mémoire partagée proposée : le descripteur voyage avec la trame HELLO
+    uint8_t flags = 0;
+    if (conn->shm) {
+        flags = FRAME_FLAG_SHM_OFFER;
+        conn->pass_fd = conn->shm->fd;
+    }
+    if (conn->compressor) {
+        flags |= FRAME_FLAG_COMPRESS_OFFER;
+    }
+
+    frame_t frame;
+    if (send_frame_flags(conn, FRAME_HELLO, flags, hello, HELLO_SIZE + name_length) != 0 ||
+        recv_frame(conn, &frame) != 0) {
+        return -1;
+    }
+    if (frame.type == FRAME_ERROR) {
+        fprintf(stderr, "Erreur du serveur : %s\n", (char*)frame.payload);
+        return -1;
+    }
+    if (frame.type != FRAME_HELLO) {
+        fprintf(stderr, "Réponse inattendue du serveur lors de la poignée de main\n");
+        return -1;
+    }
+    if (conn->shm && (frame.flags & FRAME_FLAG_SHM_OFFER)) {
+        conn->shm_tx = &conn->shm->rings[0];
+        conn->shm_rx = &conn->shm->rings[1];
+    }
+    else if (conn->shm) {
+        // Serveur distant ou ancien : tout passe par le socket
+        shm_area_close(conn->shm);
+        conn->shm = NULL;
+    }
+    if (conn->compressor && !(frame.flags & FRAME_FLAG_COMPRESS_OFFER)) {
+        compressor_free(conn->compressor);
+        conn->compressor = NULL;
+    }
+    return 0;
+}
+
+// Ouvre une connexion et effectue la poignée de main
+static connection_t *open_session(const char *server_address, int port, command_t command,
+                                  const backup_options_t *options) {
+    const char *target;
+    const transport_t *transport = transport_select(server_address, &target);
+    int sock = transport->connect(target, port);
+    if (sock < 0) {
+        return NULL;
+    }
+    connection_t *conn = connection_open(sock);
+    if (!conn) {
+        return NULL;
+    }
+    if (transport->shared_memory) {
+        conn->shm = shm_area_create();
+    }
+    else if (options && options->compress) {
+        // Inutile de compresser ce qui passe par la mémoire partagée d'un pair local
+        conn->compressor = compressor_create();
+    }
+    if (client_handshake(conn, command) != 0) {
+        connection_close(conn);
+        return NULL;
+    }
+    return conn;
+}
+
+// Attend une trame d'un type donné, en affichant les erreurs du pair
+static int expect_frame(connection_t *conn, frame_t *frame, uint8_t type) {
+    if (recv_frame(conn, frame) != 0) {
+        return -1;
+    }
+    if (frame->type == FRAME_ERROR) {
+        fprintf(stderr, "Erreur du pair : %s\n", (char*)frame->payload);
+        return -1;
+    }
+    if (frame->type != type) {
+        fprintf(stderr, "Trame inattendue : type %u au lieu de %u\n", frame->type, type);
+        return -1;
+    }
+    return 0;
+}
+
+// Compteurs de la négociation des chunks pour le résumé de fin de sauvegarde
+typedef struct {
+    unsigned long offered;  // Chunks normaux proposés au serveur
+    unsigned long sent;     // Chunks absents effectivement envoyés
+    unsigned long long bytes_sent;
+    unsigned long long bytes_matched; // Octets retrouvés dans la version précédente d'un fichier
+} transfer_stats_t;
+
+// Propose au serveur les empreintes des chunks normaux, par lots, et envoie ceux qui lui manquent
+static int negotiate_chunks(connection_t *conn, Chunk **chunks, int chunk_count, transfer_stats_t *stats) {
+    int *data_indexes = malloc((chunk_count ? chunk_count : 1) * sizeof(int));
+    if (!data_indexes) {
+        perror("Memory allocation failed");
+        return -1;
+    }
+    int data_count = 0;
+    for (int i = 0; i < chunk_count; i++) {
+        if (chunks[i]->md5[0] != '\0') {
+            data_indexes[data_count++] = i;
+        }
+    }
+
+    unsigned char digests[HAVE_BATCH_SIZE * MD5_DIGEST_LENGTH];
+    unsigned char need[(HAVE_BATCH_SIZE + 7) / 8];
+    unsigned char data[MD5_DIGEST_LENGTH + CHUNK_SIZE];
+    int result = 0;
+    for (int start = 0; start < data_count && result == 0; start += HAVE_BATCH_SIZE) {
+        int batch = data_count - start < HAVE_BATCH_SIZE ? data_count - start : HAVE_BATCH_SIZE;
+        for (int i = 0; i < batch; i++) {
+            hex_to_bytes(chunks[data_indexes[start + i]]->md5, MD5_DIGEST_LENGTH, digests + i * MD5_DIGEST_LENGTH);
+        }
+
+        frame_t frame;
+        if (send_frame(conn, FRAME_HAVE, digests, batch * MD5_DIGEST_LENGTH) != 0 ||
+            expect_frame(conn, &frame, FRAME_NEED) != 0) {
+            result = -1;
+            break;
+        }
+        if (frame.length < (uint32_t)(batch + 7) / 8) {
+            fprintf(stderr, "Réponse NEED incomplète\n");
+            result = -1;
+            break;
+        }
+        memcpy(need, frame.payload, (batch + 7) / 8);
+        stats->offered += batch;
+        unsigned long sent_before = stats->sent;
+
+        // Bit i à 1 : le serveur n'a pas le chunk i du lot, l'envoyer sans son marqueur
+        for (int i = 0; i < batch && result == 0; i++) {
+            if (!(need[i / 8] & (1 << (i % 8)))) {
+                continue;
+            }
+            Chunk *chunk = chunks[data_indexes[start + i]];
+            memcpy(data, digests + i * MD5_DIGEST_LENGTH, MD5_DIGEST_LENGTH);
+            if (mapped_copy(data + MD5_DIGEST_LENGTH, chunk_payload(chunk), chunk->size - 1) != 0) {
+                fprintf(stderr, "Fichier source tronqué pendant l'envoi\n");
+                result = -1;
+                break;
+            }
+            result = send_frame(conn, FRAME_DATA, data, MD5_DIGEST_LENGTH + chunk->size - 1);
+            stats->sent++;
+            stats->bytes_sent += chunk->size - 1;
+        }
+        // Les chunks que le serveur possède déjà sont les doublons trouvés par le réseau
+        stats_count(STATS_NETWORK, 0, 0, batch, batch - (stats->sent - sent_before));
+    }
+
+    free(data_indexes);
+    return result;
+}
+
+// Demande les signatures de la version précédente d'un fichier et découpe le fichier sur ses blocs.
+// Retourne 0 sans chunks si le serveur n'a pas de signatures à proposer
+static int load_delta_chunks(connection_t *conn, const char *file_path, const char *previous_path,
+                             Chunk ***chunks, int *chunk_count, transfer_stats_t *stats) {
+    frame_t frame;
+    *chunks = NULL;
+    if (send_frame(conn, FRAME_SIGNATURES, previous_path, strlen(previous_path)) != 0 ||
+        expect_frame(conn, &frame, FRAME_SIGNATURES) != 0) {
+        return -1;
+    }
+    int signature_count = frame.length / SIGNATURE_SIZE;
+    if (signature_count == 0) {
+        return 0;
+    }
+    chunk_signature_t *signatures = malloc(signature_count * sizeof(chunk_signature_t));
+    if (!signatures) {
+        perror("Memory allocation failed");
+        return -1;
+    }
+    for (int i = 0; i < signature_count; i++) {
+        decode_signature(frame.payload + i * SIGNATURE_SIZE, &signatures[i]);
+    }
+
+    uint64_t matched = 0;
+    stats_span_t span;
+    stats_begin(STATS_CHUNK, &span);
+    *chunks = delta_chunk_file(file_path, signatures, signature_count, chunk_count, &matched);
+    free(signatures);
+    if (!*chunks) {
+        return -1;
+    }
+    struct stat st;
+    stats_end(STATS_CHUNK, &span, stats_enabled() && stat(file_path, &st) == 0 ? st.st_size : 0, 1, *chunk_count);
+    stats->bytes_matched += matched;
+    return 0;
+}
+
+// Enregistrements compacts d'un fichier en cours d'envoi (empreinte, plage de zéros ou référence) :
+// gardés en mémoire tant que le budget le permet, déversés ensuite dans un fichier temporaire
+typedef struct {
+    unsigned char *data;
+    size_t length;
+    size_t capacity;    // Octets réservés sur le budget mémoire
+    FILE *spill;
+} record_queue_t;
+
+// Taille d'un enregistrement d'après son marqueur
+static size_t record_size(int marker) {
+    switch (marker) {
+    case CHUNK_TYPE_DIGEST: return DIGEST_RECORD_SIZE;
+    case CHUNK_TYPE_ZERO: return ZERO_RUN_SIZE;
+    case CHUNK_TYPE_REFERENCE: return SUB_CHUNK_SIZE;
+    default: return 0;
+    }
+}
+
+// Ajoute l'enregistrement d'un chunk : un chunk normal est remplacé par son empreinte
+static int queue_chunk_record(record_queue_t *queue, const Chunk *chunk) {
+    unsigned char digest[DIGEST_RECORD_SIZE];
+    const void *record = chunk->data;
+    size_t size = chunk->size;
+    if (chunk->md5[0] != '\0') {
+        digest[0] = CHUNK_TYPE_DIGEST;
+        memcpy(digest + 1, chunk->md5, MD5_DIGEST_LENGTH * 2);
+        record = digest;
+        size = DIGEST_RECORD_SIZE;
+    }
+
+    if (!queue->spill && queue->length + size > queue->capacity) {
+        size_t capacity = queue->capacity ? queue->capacity * 2 : RECORD_QUEUE_INITIAL;
+        unsigned char *grown = NULL;
+        if (budget_reserve(capacity - queue->capacity) == 0) {
+            grown = realloc(queue->data, capacity);
+            if (!grown) {
+                budget_release(capacity - queue->capacity);
+            }
+        }
+        if (grown) {
+            queue->data = grown;
+            queue->capacity = capacity;
+        }
+        else {
+            // Budget épuisé : la suite des enregistrements part dans un fichier temporaire
+            queue->spill = tmpfile();
+            if (!queue->spill || fwrite(queue->data, 1, queue->length, queue->spill) != queue->length) {
+                perror("Erreur lors de l'écriture du fichier temporaire");
+                return -1;
+            }
+            free(queue->data);
+            budget_release(queue->capacity);
+            queue->data = NULL;
+            queue->capacity = 0;
+        }
+    }
+
+    if (queue->spill) {
+        if (fwrite(record, 1, size, queue->spill) != size) {
+            perror("Erreur lors de l'écriture du fichier temporaire");
+            return -1;
+        }
+    }
+    else {
+        memcpy(queue->data + queue->length, record, size);
+    }
+    queue->length += size;
+    return 0;
+}
+
+// Envoie une trame CHUNK par enregistrement de la file
+static int send_queued_records(connection_t *conn, record_queue_t *queue) {
+    if (!queue->spill) {
+        size_t pos = 0;
+        while (pos < queue->length) {
+            size_t size = record_size(queue->data[pos]);
+            if (send_frame(conn, FRAME_CHUNK, queue->data + pos, size) != 0) {
+                return -1;
+            }
+            pos += size;
+        }
+        return 0;
+    }
+
+    unsigned char record[SUB_CHUNK_SIZE];
+    int marker;
+    rewind(queue->spill);
+    while ((marker = fgetc(queue->spill)) != EOF) {
+        size_t size = record_size(marker);
+        record[0] = marker;
+        if (size == 0 || fread(record + 1, 1, size - 1, queue->spill) != size - 1) {
+            fprintf(stderr, "Fichier temporaire des enregistrements corrompu\n");
+            return -1;
+        }
+        if (send_frame(conn, FRAME_CHUNK, record, size) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void free_record_queue(record_queue_t *queue) {
+    if (queue->spill) {
+        fclose(queue->spill);
+    }
+    free(queue->data);
+    budget_release(queue->capacity);
+}
+
+// Envoie un fichier déjà découpé en chunks : ses chunks absents du serveur, puis une trame FILE
+// et une trame CHUNK par enregistrement, les chunks normaux étant remplacés par leur empreinte
+static int send_chunk_array(connection_t *conn, const char *relative_path, Chunk **chunks, int chunk_count,
+                            transfer_stats_t *stats) {
+    record_queue_t queue = { .data = NULL, .length = 0, .capacity = 0, .spill = NULL };
+    int result = negotiate_chunks(conn, chunks, chunk_count, stats);
+    for (int i = 0; i < chunk_count && result == 0; i++) {
+        result = queue_chunk_record(&queue, chunks[i]);
+    }
+    if (result == 0) {
+        result = send_frame(conn, FRAME_FILE, relative_path, strlen(relative_path));
+    }
+    if (result == 0) {
+        result = send_queued_records(conn, &queue);
+    }
+    free_record_queue(&queue);
+    return result;
+}
+
+// Même envoi en dédupliquant le fichier par lots : chaque lot est négocié puis libéré, seuls
+// ses enregistrements compacts sont gardés jusqu'à la trame FILE
+static int stream_backup_file(connection_t *conn, const char *file_path, const char *relative_path,
+                              transfer_stats_t *stats) {
+    FILE *source_file = fopen(file_path, "rb");
+    if (!source_file) {
+        perror("Failed to open source file");
+        return -1;
+    }
+    governor_op();
+    int batch = reserve_chunk_batch();
+    Chunk **chunks = malloc(batch * sizeof(Chunk*));
+    Md5Entry *hash_table[HASH_TABLE_SIZE];
+    init_hash_table(hash_table);
+    dedup_state_t state;
+    dedup_init(&state, source_file, hash_table);
+    dedup_map(&state);
+    record_queue_t queue = { .data = NULL, .length = 0, .capacity = 0, .spill = NULL };
+    int result = 0;
+    if (!chunks) {
+        perror("Memory allocation failed");
+        result = -1;
+    }
+
+    while (result == 0) {
+        stats_span_t span;
+        stats_begin(STATS_CHUNK, &span);
+        off_t batch_start = state.offset;
+        int chunk_count = dedup_next(&state, chunks, batch);
+        stats_end(STATS_CHUNK, &span, state.offset - batch_start, 0, chunk_count);
+        if (chunk_count == 0) {
+            break;
+        }
+        result = negotiate_chunks(conn, chunks, chunk_count, stats);
+        for (int i = 0; i < chunk_count; i++) {
+            if (result == 0) {
+                result = queue_chunk_record(&queue, chunks[i]);
+            }
+            free(chunks[i]->data);
+            free(chunks[i]);
+        }
+    }
+    stats_count(STATS_CHUNK, 0, 1, 0, 0);
+    if (result == 0) {
+        result = send_frame(conn, FRAME_FILE, relative_path, strlen(relative_path));
+    }
+    if (result == 0) {
+        result = send_queued_records(conn, &queue);
+    }
+
+    free_record_queue(&queue);
+    clean_hash_table(hash_table);
+    free(chunks);
+    release_chunk_batch(batch);
+    dedup_finish(&state);
+    fclose(source_file);
+    return result;
+}
+
+// Envoie un fichier source dédupliqué. previous_path désigne la version précédente du fichier
+// sur le serveur (NULL pour un nouveau fichier) : le découpage delta garde tout le fichier en
+// mémoire, il n'est tenté que si le budget mémoire peut le contenir
+static int send_backup_file(connection_t *conn, const char *source_dir, const char *relative_path,
+                            const char *previous_path, transfer_stats_t *stats) {
+    uint64_t trace_start = trace_begin();
+    char *file_path = build_full_path(source_dir, relative_path);
+    if (!file_path) {
+        return -1;
+    }
+    int result = 0;
+    int chunk_count = 0;
+    Chunk **chunks = NULL;
+    struct stat st;
+    if (previous_path && stat(file_path, &st) == 0 && st.st_size >= DELTA_MIN_SIZE &&
+        (uint64_t)st.st_size <= budget_available() / 2) {
+        budget_force(st.st_size);
+        result = load_delta_chunks(conn, file_path, previous_path, &chunks, &chunk_count, stats);
+        if (result == 0 && chunks) {
+            result = send_chunk_array(conn, relative_path, chunks, chunk_count, stats);
+        }
+        free_chunks(chunks, chunk_count);
+        budget_release(st.st_size);
+    }
+    if (result == 0 && !chunks) {
+        result = stream_backup_file(conn, file_path, relative_path, stats);
+    }
+    if (result == 0) {
+        printf("|%s  =>  Saved\n", file_path);
+    }
+    trace_end(trace_start, "backup", "send_backup_file", file_path, 0);
+
+    free(file_path);
+    return result;
+}
+
+int remote_backup(const char *source_dir, const char *server_address, int port, const backup_options_t *options) {
+    char *source_dir_copy = strdup(source_dir);
+    if (!source_dir_copy) {
+        perror("Memory allocation failed");
+        return -1;
+    }
+    remove_trailing_slash(source_dir_copy);
+    if (!is_directory_accessible(source_dir_copy)) {
+        fprintf(stderr, "Le répertoire source '%s' n'est pas accessible ou n'existe pas.\n", source_dir_copy);
+        free(source_dir_copy);
+        return -1;
+    }
+
+    connection_t *conn = open_session(server_address, port, COMMAND_BACKUP, options);
+    if (!conn) {
+        free(source_dir_copy);
+        return -1;
+    }
+
+    // Le serveur annonce le nom de la nouvelle sauvegarde puis envoie son .backup_log
+    frame_t frame;
+    char backup_name[128];
+    if (expect_frame(conn, &frame, FRAME_ACK) != 0) {
+        connection_close(conn);
+        free(source_dir_copy);
+        return -1;
+    }
+    snprintf(backup_name, sizeof(backup_name), "%s", (char*)frame.payload);
+
+    log_t backup_log = { .head = NULL, .tail = NULL };
+    if (expect_frame(conn, &frame, FRAME_MANIFEST) != 0) {
+        connection_close(conn);
+        free(source_dir_copy);
+        return -1;
+    }
+    if (frame.length > 0) {
+        FILE *manifest = fmemopen(frame.payload, frame.length, "r");
+        if (manifest) {
+            backup_log = parse_backup_log(manifest);
+            fclose(manifest);
+        }
+    }
+
+    // Seuls les fichiers dont le md5 a changé sont envoyés, à la suite, sans attendre d'acquittement
+    int result = 0;
+    transfer_stats_t stats = { 0 };
+    log_t save_log = build_source_log(source_dir_copy, backup_name, &backup_log);
+    // Fichiers présents sur le serveur, par contenu : un fichier identique n'est pas envoyé
+    log_index_t stored;
+    log_index_init(&stored, 0);
+    for (log_element *old = backup_log.head; old != NULL; old = old->next) {
+        if (!old->content) {
+            log_index_add_digest(&stored, old);
+        }
+    }
+    for (log_element *elt = save_log.head; elt != NULL && result == 0; elt = elt->next) {
+        // Un petit fichier conservé dans le log part avec le nouveau .backup_log
+        if (reuse_previous_entry(elt, &backup_log) || elt->content) {
+            continue;
+        }
+        log_element *same = log_index_find_digest(&stored, elt->size, elt->md5);
+        if (same && (elt->object = strdup(log_object_path(same))) != NULL) {
+            stats_count(STATS_INDEX, 0, 1, 0, 1);
+            continue;
+        }
+        char *relative_path = cut_after_first_slash(elt->path);
+        log_element *previous = relative_path ? find_log_entry(&backup_log, relative_path) : NULL;
+        const char *previous_object = previous && !previous->content ? log_object_path(previous) : NULL;
+        result = send_backup_file(conn, source_dir_copy, relative_path, previous_object, &stats);
+        if (result == 0) {
+            log_index_add_digest(&stored, elt);
+        }
+        free(relative_path);
+    }
+    log_index_free(&stored);
+
+    // Nouveau .backup_log, puis fin de session acquittée par le serveur
+    if (result == 0) {
+        char *manifest_data = NULL;
+        size_t manifest_size = 0;
+        FILE *manifest = open_memstream(&manifest_data, &manifest_size);
+        if (manifest) {
+            write_backup_log(&save_log, manifest);
+            fclose(manifest);
+            result = send_frame(conn, FRAME_MANIFEST, manifest_data, manifest_size);
+        }
+        else {
+            result = -1;
+        }
+        free(manifest_data);
+    }
+    if (result == 0) {
+        result = send_frame(conn, FRAME_END, NULL, 0);
+    }
+    if (result == 0) {
+        result = expect_frame(conn, &frame, FRAME_ACK);
+    }
+    if (result == 0) {
+        printf("|%lu/%lu chunks sent to the server (%llu bytes)\n", stats.sent, stats.offered, stats.bytes_sent);
+        if (stats.bytes_matched > 0) {
+            printf("|%llu bytes matched against previous versions\n", stats.bytes_matched);
+        }
+        if (conn->compressor && conn->compressor->bytes_in > 0) {
+            printf("|%llu bytes compressed to %llu\n", (unsigned long long)conn->compressor->bytes_in,
+                   (unsigned long long)conn->compressor->bytes_out);
+        }
+    }
+
+    free_log_list(&backup_log);
+    free_log_list(&save_log);
+    connection_close(conn);
+    free(source_dir_copy);
+    return result;
+}
+
+int remote_list_backups(const char *server_address, int port) {
+    connection_t *conn = open_session(server_address, port, COMMAND_LIST, NULL);
+    if (!conn) {
+        return -1;
+    }
 
-    struct sockaddr_in server_addr;
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(port);
+    frame_t frame;
+    if (expect_frame(conn, &frame, FRAME_MANIFEST) != 0) {
+        connection_close(conn);
+        return -1;
+    }
 
-    // Convertir l'adresse IP
-    if (inet_pton(AF_INET, server_address, &server_addr.sin_addr) <= 0) {
-        perror("Erreur de la conversion de l'adresse IP");
-        close(sock);
-        return;
+    // Une sauvegarde par ligne
+    int i = 1;
+    char *saveptr = NULL;
+    for (char *name = strtok_r((char*)frame.payload, "\n", &saveptr); name; name = strtok_r(NULL, "\n", &saveptr)) {
+        printf("%d# | %s\n", i, name);
+        i++;
+    }
+
+    connection_close(conn);
+    return 0;
+}
+
+// Refuse les chemins absolus et les remontées qui sortiraient du dépôt
+static int is_safe_relative_path(const char *path) {
+    if (path[0] == '\0' || path[0] == '/') {
+        return 0;
+    }
+    for (const char *p = path; *p; ) {
+        const char *end = strchr(p, '/');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        if (len == 2 && p[0] == '.' && p[1] == '.') {
+            return 0;
+        }
+        p += len;
+        if (*p == '/') {
+            p++;
+        }
+    }
+    return 1;
+}
+
+// Un nom de client ou de sauvegarde doit désigner un seul répertoire, distinct des packs et des fichiers cachés
+static int is_valid_entry_name(const char *name) {
+    return name[0] != '\0' && name[0] != '.' && strchr(name, '/') == NULL &&
+           strcmp(name, PACK_DIR_NAME) != 0;
+}
+
+// Termine le fichier en cours de restauration ; la taille finale recrée un trou final éventuel
+static int finish_restored_file(FILE *file, writeback_t *writeback, off_t size) {
+    if (!file) {
+        return 0;
+    }
+    int result = 0;
+    if (fflush(file) != 0 || ftruncate(fileno(file), size) != 0) {
+        perror("Failed to write restored file");
+        result = -1;
+    }
+    writeback_finish(writeback);
+    fclose(file);
+    return result;
+}
+
+int remote_restore(const char *backup_name, const char *restore_dir, const char *server_address, int port,
+                   const backup_options_t *options) {
+    if (!is_directory_accessible(restore_dir)) {
+        fprintf(stderr, "Le répertoire de restauration '%s' n'est pas accessible.\n", restore_dir);
+        return -1;
+    }
+    connection_t *conn = open_session(server_address, port, COMMAND_RESTORE, options);
+    if (!conn) {
+        return -1;
+    }
+    if (send_frame(conn, FRAME_FILE, backup_name, strlen(backup_name)) != 0) {
+        connection_close(conn);
+        return -1;
+    }
+
+    FILE *file = NULL;
+    writeback_t writeback = { .file = NULL, .start = 0, .end = 0 };
+    off_t size = 0;
+    unsigned long files = 0;
+    unsigned long long bytes = 0;
+    int result = 0;
+    frame_t frame;
+    while (result == 0) {
+        if (recv_frame(conn, &frame) != 0) {
+            result = -1;
+            break;
+        }
+        if (frame.type == FRAME_FILE) {
+            result = finish_restored_file(file, &writeback, size);
+            file = NULL;
+            size = 0;
+            char *dest_path = is_safe_relative_path((char*)frame.payload) ?
+                              build_full_path(restore_dir, (char*)frame.payload) : NULL;
+            if (!dest_path) {
+                fprintf(stderr, "Chemin refusé : %s\n", (char*)frame.payload);
+                result = -1;
+                break;
+            }
+            create_intermediate_directories(dest_path);
+            file = fopen(dest_path, "wb");
+            if (!file) {
+                perror("Failed to open output file");
+                result = -1;
+            }
+            else {
+                writeback_start(&writeback, file);
+                governor_op();
+            }
+            free(dest_path);
+            files++;
+            stats_count(STATS_WRITE, 0, 1, 0, 0);
+        }
+        else if (frame.type == FRAME_DATA && file) {
+            stats_span_t span;
+            stats_begin(STATS_WRITE, &span);
+            if (fwrite(frame.payload, 1, frame.length, file) != frame.length) {
+                perror("Failed to write chunk data to file");
+                result = -1;
+            }
+            writeback_advance(&writeback);
+            governor_write(frame.length);
+            stats_end(STATS_WRITE, &span, frame.length, 0, 1);
+            size += frame.length;
+            bytes += frame.length;
+        }
+        else if (frame.type == FRAME_CHUNK && file && frame.length == ZERO_RUN_SIZE &&
+                 frame.payload[0] == CHUNK_TYPE_ZERO) {
+            // Plage de zéros : avancer sans écrire pour recréer un trou
+            uint64_t length;
+            memcpy(&length, frame.payload + 1, sizeof(uint64_t));
+            if (fseeko(file, length, SEEK_CUR) != 0) {
+                perror("Failed to seek over zero run");
+                result = -1;
+            }
+            size += length;
+        }
+        else if (frame.type == FRAME_END) {
+            break;
+        }
+        else if (frame.type == FRAME_ERROR) {
+            fprintf(stderr, "Erreur du serveur : %s\n", (char*)frame.payload);
+            result = -1;
+        }
+        else {
+            fprintf(stderr, "Trame inattendue : type %u\n", frame.type);
+            result = -1;
+        }
+    }
+
+    if (finish_restored_file(file, &writeback, size) != 0) {
+        result = -1;
+    }
+    if (result == 0) {
+        printf("|%lu files restored from the server (%llu bytes received)\n", files, bytes);
+    }
+    reset_directory_cache();
+    connection_close(conn);
+    return result;
+}
+
+// État d'une sauvegarde reçue par le serveur
+typedef struct {
+    const char *repository;
+    char backup_name[128];
+    char *full_backup_path;
+    pack_store_t *store;
+    int snapshot_created;
+    char *current_key;   // Objet en cours d'écriture dans le pack
+    uint64_t unsynced;   // Octets de chunks reçus depuis le dernier point de reprise
+} incoming_backup_t;
+
+// Termine le fichier en cours de réception
+static void close_incoming_file(incoming_backup_t *backup) {
+    if (backup->current_key) {
+        pack_store_commit(backup->store, backup->current_key);
+        free(backup->current_key);
+        backup->current_key = NULL;
+    }
+}
+
+// Crée le répertoire de la sauvegarde au premier fichier reçu
+static int ensure_snapshot(incoming_backup_t *backup) {
+    if (backup->snapshot_created) {
+        return 0;
+    }
+    if (mkdir(backup->full_backup_path, 0755) == -1) {
+        perror("Erreur lors de la création du répertoire de sauvegarde");
+        return -1;
+    }
+    backup->snapshot_created = 1;
+    return 0;
+}
+
+// Commence la réception d'un fichier, à écrire comme le ferait backup_file dans le pack
+static int open_incoming_file(incoming_backup_t *backup, const char *relative_path) {
+    close_incoming_file(backup);
+    if (!is_safe_relative_path(relative_path) || ensure_snapshot(backup) != 0) {
+        return -1;
+    }
+
+    char *backup_path = build_full_path(backup->full_backup_path, relative_path);
+    if (!backup_path) {
+        return -1;
+    }
+    backup->current_key = remove_source_dir(backup->store->repository, backup_path);
+    free(backup_path);
+    return pack_store_begin(backup->store);
+}
+
+static int append_incoming_chunk(incoming_backup_t *backup, const void *data, size_t size) {
+    if (!backup->current_key) {
+        return -1; // Chunk reçu hors d'un fichier
+    }
+    return pack_store_append(backup->store, data, size);
+}
+
+// Répond à un lot d'empreintes par le bitmap des chunks absents du dépôt
+static int answer_have(connection_t *conn, incoming_backup_t *backup, const unsigned char *digests, size_t size) {
+    size_t count = size / MD5_DIGEST_LENGTH;
+    unsigned char *need = calloc((count + 7) / 8 + 1, 1);
+    unsigned char *found = malloc(count ? count : 1);
+    if (!need || !found || pack_store_contains_batch(backup->store, digests, count, found) != 0) {
+        send_error(conn, "server out of memory");
+        free(need);
+        free(found);
+        return -1;
+    }
+    // Le lot est cherché trié dans l'index des chunks : un parcours séquentiel par run
+    for (size_t i = 0; i < count; i++) {
+        if (!found[i]) {
+            need[i / 8] |= 1 << (i % 8);
+        }
+    }
+    int result = send_frame(conn, FRAME_NEED, need, (count + 7) / 8);
+    free(need);
+    free(found);
+    return result;
+}
+
+// Ajoute au tampon la signature d'un chunk du dépôt désigné par un enregistrement CHUNK_TYPE_DIGEST
+static int append_signature(pack_store_t *store, const unsigned char *record, FILE *out) {
+    char key[MD5_DIGEST_LENGTH * 2 + 1];
+    pack_ref_t ref;
+    memcpy(key, record + 1, MD5_DIGEST_LENGTH * 2);
+    key[MD5_DIGEST_LENGTH * 2] = '\0';
+    if (!pack_store_lookup(store, key, &ref) || ref.length == 0 || ref.length > DELTA_BLOCK_SIZE) {
+        return 0;
+    }
+    unsigned char *data = pack_store_read(store, &ref);
+    if (!data) {
+        return -1;
+    }
+    chunk_signature_t signature = { .weak = weak_checksum(data, ref.length), .length = (uint32_t)ref.length };
+    free(data);
+    if (hex_to_bytes((unsigned char*)key, MD5_DIGEST_LENGTH, signature.md5) != 0) {
+        return 0;
+    }
+    unsigned char encoded[SIGNATURE_SIZE];
+    encode_signature(&signature, encoded);
+    return fwrite(encoded, 1, SIGNATURE_SIZE, out) == SIGNATURE_SIZE ? 0 : -1;
+}
+
+// Répond par les signatures des chunks de la version précédente d'un fichier (liste vide si inconnue) ;
+// seuls les chunks stockés par empreinte peuvent être désignés par le client
+static int answer_signatures(connection_t *conn, incoming_backup_t *backup, const char *previous_path) {
+    close_incoming_file(backup);
+    pack_ref_t ref;
+    unsigned char *object = NULL;
+    if (is_safe_relative_path(previous_path) && pack_store_lookup(backup->store, previous_path, &ref)) {
+        object = pack_store_read(backup->store, &ref);
+    }
+
+    char *signatures = NULL;
+    size_t size = 0;
+    FILE *out = open_memstream(&signatures, &size);
+    if (!out) {
+        free(object);
+        send_error(conn, "server out of memory");
+        return -1;
+    }
+    int result = 0;
+    for (uint64_t pos = 0; object && pos < ref.length && result == 0; ) {
+        // Les enregistrements d'un fichier reçu sont des empreintes et des plages de zéros
+        if (object[pos] == CHUNK_TYPE_DIGEST && ref.length - pos >= DIGEST_RECORD_SIZE) {
+            if (size + SIGNATURE_SIZE > FRAME_MAX_PAYLOAD) {
+                break;
+            }
+            result = append_signature(backup->store, object + pos, out);
+            pos += DIGEST_RECORD_SIZE;
+        }
+        else if (object[pos] == CHUNK_TYPE_ZERO) {
+            pos += ZERO_RUN_SIZE;
+        }
+        else {
+            break;
+        }
+        fflush(out);
+    }
+    fclose(out);
+    free(object);
+
+    if (result == 0) {
+        result = send_frame(conn, FRAME_SIGNATURES, signatures, size);
+    }
+    else {
+        send_error(conn, "cannot read previous version");
+    }
+    free(signatures);
+    return result;
+}
+
+// Stocke un chunk reçu dans le dépôt pack, sous son empreinte après vérification
+static int store_incoming_data(incoming_backup_t *backup, const unsigned char *payload, size_t size) {
+    if (size < MD5_DIGEST_LENGTH) {
+        return -1;
+    }
+    // Les trames CHUNK d'un fichier suivent toujours sa trame FILE : l'objet en cours est terminé
+    close_incoming_file(backup);
+
+    unsigned char key[MD5_DIGEST_LENGTH * 2 + 1];
+    unsigned char md5[MD5_DIGEST_LENGTH * 2 + 1];
+    pack_ref_t ref;
+    bytes_to_hex(payload, MD5_DIGEST_LENGTH, key);
+    compute_md5((void*)(payload + MD5_DIGEST_LENGTH), size - MD5_DIGEST_LENGTH, md5);
+    if (strcmp((char*)key, (char*)md5) != 0) {
+        fprintf(stderr, "Chunk reçu corrompu : %s\n", key);
+        return -1;
+    }
+    if (pack_store_lookup(backup->store, (char*)key, &ref)) {
+        return 0;
+    }
+    if (pack_store_begin(backup->store) != 0 ||
+        pack_store_append(backup->store, payload + MD5_DIGEST_LENGTH, size - MD5_DIGEST_LENGTH) != 0 ||
+        pack_store_commit(backup->store, (char*)key) != 0) {
+        return -1;
+    }
+
+    // Point de reprise : les chunks reçus sont sur le disque, une connexion coupée ne les fera pas renvoyer
+    backup->unsynced += size - MD5_DIGEST_LENGTH;
+    if (backup->unsynced >= REMOTE_CHECKPOINT_BYTES) {
+        backup->unsynced = 0;
+        return pack_store_sync(backup->store);
+    }
+    return 0;
+}
+
+// Indique si le chemin commence par la nouvelle sauvegarde ou par une sauvegarde existante du dépôt
+static int names_known_snapshot(incoming_backup_t *backup, const char *path) {
+    const char *slash = strchr(path, '/');
+    if (!is_safe_relative_path(path) || !slash || slash == path) {
+        return 0;
+    }
+    size_t name_length = slash - path;
+    if (strlen(backup->backup_name) == name_length && strncmp(path, backup->backup_name, name_length) == 0) {
+        return 1;
+    }
+    char name[sizeof(backup->backup_name)];
+    if (name_length >= sizeof(name)) {
+        return 0;
+    }
+    memcpy(name, path, name_length);
+    name[name_length] = '\0';
+    if (!is_valid_entry_name(name)) {
+        return 0;
+    }
+    char *snapshot_path = build_full_path(backup->repository, name);
+    int known = snapshot_path && is_directory_accessible(snapshot_path);
+    free(snapshot_path);
+    return known;
+}
+
+// Vérifie le .backup_log reçu avant de l'écrire : chaque entrée et chaque objet r: doivent désigner
+// une sauvegarde de ce dépôt, le serveur les ouvrira lors d'une restauration.
+// new_entries indique si des entrées appartiennent à la nouvelle sauvegarde, même sans fichier envoyé à part
+static int check_incoming_manifest(incoming_backup_t *backup, const void *data, size_t size, int *new_entries) {
+    *new_entries = 0;
+    if (size == 0) {
+        return 0;
+    }
+    FILE *manifest = fmemopen((void*)data, size, "r");
+    if (!manifest) {
+        perror("Erreur lors de la lecture du .backup_log reçu");
+        return -1;
+    }
+    log_t logs = parse_backup_log(manifest);
+    fclose(manifest);
+    size_t name_length = strlen(backup->backup_name);
+    int result = 0;
+    for (log_element *elt = logs.head; elt != NULL && result == 0; elt = elt->next) {
+        if (!names_known_snapshot(backup, elt->path) || (elt->object && !names_known_snapshot(backup, elt->object))) {
+            fprintf(stderr, "Entrée refusée dans le .backup_log reçu : %s\n", elt->path);
+            result = -1;
+        }
+        else if (strncmp(elt->path, backup->backup_name, name_length) == 0 && elt->path[name_length] == '/') {
+            *new_entries = 1;
+        }
+    }
+    free_log_list(&logs);
+    return result;
+}
+
+// Écrit un .backup_log reçu comme update_backup_log : à côté, synchronisé puis renommé,
+// une interruption laisse l'ancien log intact
+static int write_incoming_log(const char *logfile, const void *data, size_t size) {
+    size_t len = strlen(logfile);
+    char *temporary = malloc(len + 5);
+    if (!temporary) {
+        perror("Memory allocation failed");
+        return -1;
+    }
+    snprintf(temporary, len + 5, "%s.tmp", logfile);
+
+    FILE *file = fopen(temporary, "w");
+    if (!file) {
+        perror("Erreur lors de l'écriture du fichier .backup_log");
+        free(temporary);
+        return -1;
+    }
+    int written = fwrite(data, 1, size, file) == size && fflush(file) == 0 && fsync(fileno(file)) == 0;
+    if (fclose(file) != 0 || !written || rename(temporary, logfile) != 0) {
+        perror("Erreur lors de l'écriture du fichier .backup_log");
+        unlink(temporary);
+        free(temporary);
+        return -1;
+    }
+    free(temporary);
+    return 0;
+}
+
+// Écrit le .backup_log reçu à la racine du dépôt et dans la sauvegarde
+static int store_incoming_manifest(incoming_backup_t *backup, const void *data, size_t size) {
+    close_incoming_file(backup);
+    int new_entries;
+    if (check_incoming_manifest(backup, data, size, &new_entries) != 0 ||
+        (new_entries && ensure_snapshot(backup) != 0)) {
+        return -1;
+    }
+    char *backup_log_path = build_full_path(backup->repository, ".backup_log");
+    if (!backup_log_path || write_incoming_log(backup_log_path, data, size) != 0) {
+        free(backup_log_path);
+        return -1;
+    }
+    free(backup_log_path);
+
+    if (backup->snapshot_created) {
+        char *full_backup_log_path = build_full_path(backup->full_backup_path, ".backup_log");
+        if (!full_backup_log_path || write_incoming_log(full_backup_log_path, data, size) != 0) {
+            printf("Le fichier des logs n'a pas été copier");
+        }
+        free(full_backup_log_path);
+    }
+    return 0;
+}
+
+// Envoie le contenu du .backup_log du dépôt (vide pour une première sauvegarde)
+static int send_repository_log(connection_t *conn, const char *repository) {
+    char *backup_log_path = build_full_path(repository, ".backup_log");
+    if (!backup_log_path) {
+        return -1;
+    }
+    char *data = NULL;
+    size_t size = 0;
+    FILE *log_file = fopen(backup_log_path, "rb");
+    if (log_file) {
+        fseek(log_file, 0, SEEK_END);
+        size = ftell(log_file);
+        rewind(log_file);
+        data = malloc(size ? size : 1);
+        if (!data || fread(data, 1, size, log_file) != size) {
+            size = 0;
+        }
+        fclose(log_file);
+    }
+    int result = send_frame(conn, FRAME_MANIFEST, data, size);
+    free(data);
+    free(backup_log_path);
+    return result;
+}
+
+static int handle_list(connection_t *conn, const char *repository) {
+    DIR *dir = opendir(repository);
+    if (!dir) {
+        send_error(conn, "cannot open repository");
+        return -1;
+    }
+
+    char *data = NULL;
+    size_t size = 0;
+    FILE *names = open_memstream(&data, &size);
+    if (!names) {
+        closedir(dir);
+        send_error(conn, "server out of memory");
+        return -1;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_type == DT_DIR && strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0 &&
+            strcmp(entry->d_name, PACK_DIR_NAME) != 0) {
+            fprintf(names, "%s\n", entry->d_name);
+        }
+    }
+    closedir(dir);
+    fclose(names);
+
+    int result = send_frame(conn, FRAME_MANIFEST, data, size);
+    free(data);
+    return result;
+}
+
+// Plage d'octets stockés, envoyée telle quelle au client : fichier (segment pack ou fichier sauvegardé) et position
+typedef struct {
+    int fd;             // -1 pour une plage de zéros
+    off_t offset;
+    uint64_t length;
+} stored_range_t;
+
+// Flux de restauration : les plages contiguës du même fichier sont fusionnées en une seule trame
+typedef struct {
+    connection_t *conn;
+    stored_range_t pending;
+    unsigned long long bytes;
+    uint64_t queued;        // Octets mis en trames, pour borner un pas de restauration
+} restore_stream_t;
+
+// Envoie la plage en attente : zéros en enregistrement CHUNK, données par sendfile ou copiées si elles sont petites
+static int flush_restore_range(restore_stream_t *stream) {
+    stored_range_t *range = &stream->pending;
+    int result = 0;
+    if (range->length == 0) {
+        return 0;
+    }
+    if (range->fd < 0) {
+        unsigned char record[ZERO_RUN_SIZE];
+        record[0] = CHUNK_TYPE_ZERO;
+        memcpy(record + 1, &range->length, sizeof(uint64_t));
+        result = send_frame(stream->conn, FRAME_CHUNK, record, ZERO_RUN_SIZE);
+        stream->queued += ZERO_RUN_SIZE;
+    }
+    else if (range->length < SENDFILE_MIN_SIZE) {
+        // Un appel système par petite plage coûterait plus que la copie : elle rejoint le tampon d'émission
+        unsigned char buffer[SENDFILE_MIN_SIZE];
+        if (pread(range->fd, buffer, range->length, range->offset) != (ssize_t)range->length) {
+            perror("Erreur de lecture des données sauvegardées");
+            return -1;
+        }
+        result = send_frame(stream->conn, FRAME_DATA, buffer, range->length);
+    }
+    else {
+        result = send_frame_from_file(stream->conn, FRAME_DATA, range->fd, range->offset, range->length);
+    }
+    stream->bytes += range->fd < 0 ? 0 : range->length;
+    stream->queued += range->fd < 0 ? 0 : range->length;
+    range->length = 0;
+    return result;
+}
+
+static int emit_restore_range(restore_stream_t *stream, const stored_range_t *range) {
+    stored_range_t *pending = &stream->pending;
+    if (range->length == 0) {
+        return 0;
+    }
+    if (pending->length > 0 && pending->fd == range->fd && pending->length + range->length <= RESTORE_MAX_FRAME &&
+        (range->fd < 0 || pending->offset + (off_t)pending->length == range->offset)) {
+        pending->length += range->length;
+        return 0;
+    }
+    if (flush_restore_range(stream) != 0) {
+        return -1;
+    }
+    *pending = *range;
+    return 0;
+}
+
+// Restauration servie à un client : reprise pas à pas, le démon rend la main entre deux pas
+typedef struct {
+    log_t backup_log;
+    log_element *next;          // Prochain fichier du .backup_log à envoyer
+    pack_store_t *store;
+    char *backup_name;
+    restore_stream_t stream;
+    // Fichier sauvegardé en cours d'envoi
+    int fd;                     // -1 entre deux fichiers
+    int owns_fd;                // Fichier à part, fermé à la fin (un segment pack appartient au dépôt)
+    off_t base;
+    uint64_t length;
+    uint64_t pos;
+    stored_range_t *records;    // Plages des enregistrements déjà lus, pour les références
+    int record_count;
+    int record_capacity;
+    const char *error;          // Message envoyé au client si la restauration échoue, NULL : erreur de lecture
+} restore_job_t;
+
+// Termine le fichier en cours : dernière plage envoyée, descripteur fermé
+static int finish_stored_file(restore_job_t *job) {
+    int result = flush_restore_range(&job->stream);
+    if (job->owns_fd) {
+        close(job->fd);
+    }
+    job->fd = -1;
+    job->owns_fd = 0;
+    job->record_count = 0;
+    return result;
+}
+
+// Parcourt les enregistrements du fichier en cours sans charger ses données : seuls les marqueurs,
+// empreintes et références sont lus, les données partent ensuite du fichier ou du segment qui les contient.
+// S'arrête à la fin du fichier ou quand le pas de restauration a mis limit octets en trames
+static int stream_stored_file(restore_job_t *job, uint64_t limit) {
+    int result = 0;
+    while (job->pos < job->length && job->stream.queued < limit && result == 0) {
+        unsigned char header[DIGEST_RECORD_SIZE];
+        uint64_t pos = job->pos;
+        size_t wanted = job->length - pos < sizeof(header) ? job->length - pos : sizeof(header);
+        if (pread(job->fd, header, wanted, job->base + pos) != (ssize_t)wanted) {
+            perror("Erreur de lecture du fichier sauvegardé");
+            return -1;
+        }
+
+        stored_range_t range = { .fd = -1, .offset = 0, .length = 0 };
+        if (header[0] == CHUNK_TYPE_DATA) {
+            range.fd = job->fd;
+            range.offset = job->base + pos + 1;
+            range.length = job->length - pos - 1 < CHUNK_SIZE - 1 ? job->length - pos - 1 : CHUNK_SIZE - 1;
+            job->pos += 1 + range.length;
+        }
+        else if (header[0] == CHUNK_TYPE_ZERO && wanted >= ZERO_RUN_SIZE) {
+            memcpy(&range.length, header + 1, sizeof(uint64_t));
+            job->pos += ZERO_RUN_SIZE;
+        }
+        else if (header[0] == CHUNK_TYPE_DIGEST && wanted >= DIGEST_RECORD_SIZE) {
+            char key[MD5_DIGEST_LENGTH * 2 + 1];
+            pack_ref_t ref;
+            memcpy(key, header + 1, MD5_DIGEST_LENGTH * 2);
+            key[MD5_DIGEST_LENGTH * 2] = '\0';
+            if (job->store && pack_store_lookup(job->store, key, &ref) &&
+                (range.fd = pack_store_segment_fd(job->store, ref.pack)) >= 0) {
+                range.offset = ref.offset;
+                range.length = ref.length;
+            }
+            else {
+                // Chunk vide gardé à sa place pour que les références suivantes restent alignées
+                fprintf(stderr, "Missing chunk in repository: %s\n", key);
+            }
+            job->pos += DIGEST_RECORD_SIZE;
+        }
+        else if (header[0] == CHUNK_TYPE_REFERENCE && wanted > sizeof(int)) {
+            int ref_index;
+            memcpy(&ref_index, header + 1, sizeof(int));
+            job->pos += SUB_CHUNK_SIZE;
+            if (ref_index < 0 || ref_index >= job->record_count) {
+                // Comme pour un chunk manquant, un chunk vide garde les références suivantes alignées
+                fprintf(stderr, "Invalid reference index: %d\n", ref_index);
+            }
+            else {
+                range = job->records[ref_index];
+            }
+        }
+        else {
+            fprintf(stderr, "Unknown chunk type: %d\n", header[0]);
+            job->pos = job->length;
+            break;
+        }
+
+        if (job->record_count == job->record_capacity) {
+            int capacity = job->record_capacity ? job->record_capacity * 2 : 64;
+            stored_range_t *grown = realloc(job->records, capacity * sizeof(stored_range_t));
+            if (!grown) {
+                perror("Memory allocation failed");
+                return -1;
+            }
+            job->records = grown;
+            job->record_capacity = capacity;
+        }
+        job->records[job->record_count++] = range;
+        result = emit_restore_range(&job->stream, &range);
+    }
+    return result;
+}
+
+// Envoie la trame FILE du fichier suivant puis son contenu conservé dans le log, ou ouvre son objet
+// d'un pack ou son fichier sauvegardé, comme dans restore_backup
+static int start_stored_file(restore_job_t *job, const char *repository) {
+    log_element *current = job->next;
+    job->next = current->next;
+    // Le .backup_log vient du client : un chemin qui sortirait du dépôt n'est jamais ouvert
+    if (!is_safe_relative_path(current->path) || !is_safe_relative_path(log_object_path(current))) {
+        fprintf(stderr, "Chemin refusé dans le .backup_log : %s\n", current->path);
+        job->error = "invalid path in backup log";
+        return -1;
+    }
+    char *file_path = cut_after_first_slash(current->path);
+    if (!file_path) {
+        return 0;
+    }
+    int result = send_frame(job->stream.conn, FRAME_FILE, file_path, strlen(file_path));
+    job->stream.queued += strlen(file_path);
+    free(file_path);
+
+    pack_ref_t ref;
+    if (result == 0 && current->content) {
+        if (current->content_size > 0) {
+            result = send_frame(job->stream.conn, FRAME_DATA, current->content, current->content_size);
+        }
+        job->stream.bytes += current->content_size;
+        job->stream.queued += current->content_size;
+    }
+    else if (result == 0 && job->store && pack_store_lookup(job->store, log_object_path(current), &ref)) {
+        job->fd = pack_store_segment_fd(job->store, ref.pack);
+        job->base = ref.offset;
+        job->length = ref.length;
+        result = job->fd < 0 ? -1 : 0;
+    }
+    else if (result == 0) {
+        char *source_path = build_full_path(repository, log_object_path(current));
+        int fd = source_path ? open(source_path, O_RDONLY | O_CLOEXEC) : -1;
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            perror("Failed to open source file");
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+        else {
+            job->fd = fd;
+            job->owns_fd = 1;
+            job->base = 0;
+            job->length = st.st_size;
+        }
+        free(source_path);
+    }
+    job->pos = 0;
+    return result;
+}
+
+// Prépare l'envoi d'une sauvegarde au client ; -1 (erreur envoyée) si elle n'existe pas
+static int restore_job_open(restore_job_t *job, connection_t *conn, const char *repository, const char *backup_name) {
+    memset(job, 0, sizeof(*job));
+    job->fd = -1;
+    job->stream.conn = conn;
+    if (!is_valid_entry_name(backup_name)) {
+        send_error(conn, "invalid backup name");
+        return -1;
+    }
+    char *backup_path = build_full_path(repository, backup_name);
+    char *backup_log_path = backup_path ? build_full_path(backup_path, ".backup_log") : NULL;
+    int found = backup_log_path && access(backup_log_path, R_OK) == 0;
+    if (found) {
+        job->backup_log = read_backup_log(backup_log_path);
+    }
+    free(backup_path);
+    free(backup_log_path);
+    job->backup_name = strdup(backup_name);
+    if (!found || !job->backup_name) {
+        send_error(conn, "unknown backup");
+        return -1;
+    }
+    job->next = job->backup_log.head;
+    job->store = is_pack_repository(repository) ? pack_store_open(repository, 1) : NULL;
+    return 0;
+}
+
+// Envoie la suite de la sauvegarde : pour chaque fichier du .backup_log, FILE puis son contenu en DATA,
+// jusqu'à RESTORE_STEP_SIZE octets mis en trames. Retourne 0 s'il reste à envoyer, 1 une fois END envoyé
+static int restore_job_step(restore_job_t *job, const char *repository) {
+    int result = 0;
+    job->stream.queued = 0;
+    while (result == 0 && job->stream.queued < RESTORE_STEP_SIZE) {
+        if (job->fd >= 0) {
+            result = stream_stored_file(job, RESTORE_STEP_SIZE);
+            if (result == 0 && job->pos >= job->length) {
+                result = finish_stored_file(job);
+            }
+        }
+        else if (job->next) {
+            result = start_stored_file(job, repository);
+        }
+        else {
+            printf("|%s restored to client (%llu bytes)\n", job->backup_name, job->stream.bytes);
+            return send_frame(job->stream.conn, FRAME_END, NULL, 0) == 0 ? 1 : -1;
+        }
+    }
+    if (result != 0) {
+        send_error(job->stream.conn, job->error ? job->error : "cannot read backup");
+        return -1;
+    }
+    return 0;
+}
+
+static void restore_job_close(restore_job_t *job) {
+    if (job->owns_fd) {
+        close(job->fd);
+    }
+    free(job->records);
+    pack_store_close(job->store);
+    free_log_list(&job->backup_log);
+    free(job->backup_name);
+    memset(job, 0, sizeof(*job));
+    job->fd = -1;
+}
+
+// Dépôts dont une sauvegarde est en cours : une seule session d'écriture par dépôt
+typedef struct locked_repository {
+    char *path;
+    struct locked_repository *next;
+} locked_repository;
+
+static locked_repository *locked_repositories = NULL;
+static pthread_mutex_t locked_repositories_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Réserve un dépôt pour une sauvegarde ; -1 s'il est déjà utilisé par une autre session
+static int lock_repository(const char *path) {
+    int result = 0;
+    pthread_mutex_lock(&locked_repositories_mutex);
+    for (locked_repository *entry = locked_repositories; entry; entry = entry->next) {
+        if (strcmp(entry->path, path) == 0) {
+            result = -1;
+            break;
+        }
+    }
+    if (result == 0) {
+        locked_repository *entry = malloc(sizeof(locked_repository));
+        if (entry && (entry->path = strdup(path)) != NULL) {
+            entry->next = locked_repositories;
+            locked_repositories = entry;
+        }
+        else {
+            free(entry);
+            result = -1;
+        }
+    }
+    pthread_mutex_unlock(&locked_repositories_mutex);
+    return result;
+}
+
+static void unlock_repository(const char *path) {
+    pthread_mutex_lock(&locked_repositories_mutex);
+    for (locked_repository **link = &locked_repositories; *link; link = &(*link)->next) {
+        if (strcmp((*link)->path, path) == 0) {
+            locked_repository *entry = *link;
+            *link = entry->next;
+            free(entry->path);
+            free(entry);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&locked_repositories_mutex);
+}
+
+typedef enum {
+    SESSION_HANDSHAKE,  // En attente de la trame HELLO
+    SESSION_BACKUP,     // Réception d'une sauvegarde
+    SESSION_RESTORE,    // En attente du nom de la sauvegarde à envoyer
+    SESSION_RESTORING,  // Envoi de la sauvegarde, pas à pas
+    SESSION_FINISHED
+} session_state_t;
+
+struct server_session {
+    session_state_t state;
+    char *root;                     // Répertoire servi, sans '/' final
+    char *repository;               // Sous-dépôt du client
+    const backup_options_t *options;
+    int locked;                     // Le dépôt est réservé par cette session
+    incoming_backup_t backup;
+    restore_job_t restore;
+};
+
+server_session_t *session_create(const char *root, const backup_options_t *options) {
+    server_session_t *session = calloc(1, sizeof(server_session_t));
+    if (!session) {
+        perror("Memory allocation failed");
+        return NULL;
+    }
+    // Les références des objets sont calculées relativement au dépôt sans '/' final
+    session->root = strdup(root);
+    if (!session->root) {
+        perror("Memory allocation failed");
+        free(session);
+        return NULL;
     }
+    remove_trailing_slash(session->root);
+    session->options = options;
+    session->state = SESSION_HANDSHAKE;
+    session->restore.fd = -1;
+    return session;
+}
 
-    // Établir la connexion au serveur
-    if (connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
-        perror("Erreur de connexion");
-        close(sock);
+void session_free(server_session_t *session) {
+    if (!session) {
         return;
     }
+    // Un fichier à moitié reçu n'est pas enregistré : ses chunks déjà stockés suffiront à la reprise
+    free(session->backup.current_key);
+    pack_store_close(session->backup.store);
+    free(session->backup.full_backup_path);
+    restore_job_close(&session->restore);
+    if (session->locked) {
+        unlock_repository(session->repository);
+    }
+    free(session->repository);
+    free(session->root);
+    free(session);
+}
+
+// Choisit le sous-dépôt du client : root/<nom>, ou root si le client ne s'est pas nommé
+static int select_repository(server_session_t *session, const char *name) {
+    if (name[0] == '\0') {
+        session->repository = strdup(session->root);
+        return session->repository ? 0 : -1;
+    }
+    if (!is_valid_entry_name(name)) {
+        return -1;
+    }
+    session->repository = build_full_path(session->root, name);
+    if (!session->repository) {
+        return -1;
+    }
+    if (mkdir(session->repository, 0755) == -1 && !is_directory_accessible(session->repository)) {
+        perror("Erreur lors de la création du dépôt client");
+        return -1;
+    }
+    return 0;
+}
+
+// Prépare la réception d'une sauvegarde et envoie son nom puis le .backup_log du dépôt
+static int start_backup(server_session_t *session, connection_t *conn) {
+    if (lock_repository(session->repository) != 0) {
+        send_error(conn, "repository busy");
+        return -1;
+    }
+    session->locked = 1;
+
+    incoming_backup_t *backup = &session->backup;
+    backup->repository = session->repository;
+    generate_backup_name(backup->backup_name, sizeof(backup->backup_name));
+    backup->full_backup_path = build_full_path(session->repository, backup->backup_name);
+    if (!backup->full_backup_path) {
+        send_error(conn, "server out of memory");
+        return -1;
+    }
 
-    // Envoyer les données
-    size_t bytes_sent = send(sock, data, size, 0);
-    if (bytes_sent == (size_t)-1) {
-        perror("Erreur dans l'envoie des données");
-    } else {
-        printf("Envoyé %zd octets au serveur.\n", bytes_sent);
+    // Les chunks négociés sont adressés par empreinte : un dépôt distant utilise toujours les packs
+    int first_backup = is_directory_empty(session->repository) == 1;
+    backup->store = pack_store_open(session->repository, 0);
+    if (!backup->store) {
+        send_error(conn, "cannot open pack repository");
+        return -1;
+    }
+    if (first_backup && ensure_snapshot(backup) != 0) {
+        send_error(conn, "cannot create backup directory");
+        return -1;
     }
 
-    close(sock);
+    if (send_frame(conn, FRAME_ACK, backup->backup_name, strlen(backup->backup_name)) != 0) {
+        return -1;
+    }
+    return send_repository_log(conn, session->repository);
 }
 
-size_t receive_data(int port, size_t *size) {
-    int server_sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_sock < 0) {
-        perror("Erreur dans la création de socket");
+// Vérifie la trame HELLO, répond et lance la commande demandée
+static int handle_hello(server_session_t *session, connection_t *conn, frame_t *frame) {
+    if (frame->type != FRAME_HELLO || frame->length < HELLO_SIZE) {
+        send_error(conn, "expected HELLO");
+        return -1;
+    }
+
+    uint32_t magic;
+    uint16_t version;
+    memcpy(&magic, frame->payload, sizeof(uint32_t));
+    memcpy(&version, frame->payload + 4, sizeof(uint16_t));
+    if (ntohl(magic) != PROTOCOL_MAGIC) {
+        send_error(conn, "bad protocol magic");
+        return -1;
+    }
+    if (ntohs(version) != PROTOCOL_VERSION) {
+        send_error(conn, "unsupported protocol version");
+        return -1;
+    }
+    command_t command = (command_t)frame->payload[6];
+    if (frame->length - HELLO_SIZE > CLIENT_NAME_MAX ||
+        select_repository(session, (char*)frame->payload + HELLO_SIZE) != 0) {
+        send_error(conn, "invalid client name");
         return -1;
     }
 
-    struct sockaddr_in server_addr;
-    server_addr.sin_family = AF_INET;
-    inet_pton(AF_INET, "0.0.0.0", &(server_addr.sin_addr)) ;
-    server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(port);
-    memset(&(server_addr.sin_zero), 0, sizeof(server_addr.sin_zero));
+    // Mémoire partagée proposée par un client local : acceptée si son descripteur est arrivé
+    uint8_t flags = 0;
+    if ((frame->flags & FRAME_FLAG_SHM_OFFER) && conn->received_fd >= 0) {
+        conn->shm = shm_area_map(conn->received_fd);
+        conn->received_fd = -1;
+        if (conn->shm) {
+            conn->shm_tx = &conn->shm->rings[1];
+            conn->shm_rx = &conn->shm->rings[0];
+            flags = FRAME_FLAG_SHM_OFFER;
+        }
+    }
+    // Compression acceptée sauf en mémoire partagée ; elle ne s'applique qu'après cette réponse
+    if ((frame->flags & FRAME_FLAG_COMPRESS_OFFER) && !conn->shm && (conn->compressor = compressor_create()) != NULL) {
+        flags |= FRAME_FLAG_COMPRESS_OFFER;
+    }
 
-    // Lier le socket à l'adresse et au port
-    if (bind(server_sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
-        perror("Erreur dans la liaison du socket à l'adresse et au port");
-        close(server_sock);
+    unsigned char hello[HELLO_SIZE - 1];
+    magic = htonl(PROTOCOL_MAGIC);
+    version = htons(PROTOCOL_VERSION);
+    memcpy(hello, &magic, sizeof(uint32_t));
+    memcpy(hello + 4, &version, sizeof(uint16_t));
+    if (send_frame_flags(conn, FRAME_HELLO, flags, hello, sizeof(hello)) != 0) {
         return -1;
     }
 
-    // Écouter les connexions entrantes
-    if (listen(server_sock, 1) < 0) {
-        perror("Erreur lors de l'écoute du serveur");
-        close(server_sock);
+    switch (command) {
+    case COMMAND_BACKUP:
+        if (start_backup(session, conn) != 0) {
+            return -1;
+        }
+        session->state = SESSION_BACKUP;
+        return 0;
+    case COMMAND_RESTORE:
+        session->state = SESSION_RESTORE;
+        return 0;
+    case COMMAND_LIST:
+        session->state = SESSION_FINISHED;
+        return handle_list(conn, session->repository) == 0 ? 1 : -1;
+    default:
+        send_error(conn, "unsupported command");
+        return -1;
+    }
+}
+
+// Traite une trame de la sauvegarde en cours de réception
+static int handle_backup_frame(incoming_backup_t *backup, connection_t *conn, frame_t *frame) {
+    int result;
+    switch (frame->type) {
+    case FRAME_FILE:
+        result = open_incoming_file(backup, (char*)frame->payload);
+        if (result != 0) {
+            send_error(conn, "cannot store file");
+        }
+        return result;
+    case FRAME_CHUNK:
+        result = append_incoming_chunk(backup, frame->payload, frame->length);
+        if (result != 0) {
+            send_error(conn, "cannot store chunk");
+        }
+        return result;
+    case FRAME_HAVE:
+        close_incoming_file(backup);
+        return answer_have(conn, backup, frame->payload, frame->length);
+    case FRAME_SIGNATURES:
+        return answer_signatures(conn, backup, (char*)frame->payload);
+    case FRAME_DATA:
+        result = store_incoming_data(backup, frame->payload, frame->length);
+        if (result != 0) {
+            send_error(conn, "cannot store chunk data");
+        }
+        return result;
+    case FRAME_MANIFEST:
+        result = store_incoming_manifest(backup, frame->payload, frame->length);
+        if (result != 0) {
+            send_error(conn, "cannot store backup log");
+        }
+        return result;
+    case FRAME_END:
+        close_incoming_file(backup);
+        return send_frame(conn, FRAME_ACK, NULL, 0) == 0 ? 1 : -1;
+    default:
+        send_error(conn, "unexpected frame");
+        return -1;
+    }
+}
+
+int session_handle_frame(server_session_t *session, connection_t *conn, frame_t *frame) {
+    int result;
+    switch (session->state) {
+    case SESSION_HANDSHAKE:
+        return handle_hello(session, conn, frame);
+    case SESSION_BACKUP:
+        result = handle_backup_frame(&session->backup, conn, frame);
+        if (result == 1) {
+            session->state = SESSION_FINISHED;
+        }
+        return result;
+    case SESSION_RESTORE:
+        if (frame->type != FRAME_FILE) {
+            send_error(conn, "expected backup name");
+            return -1;
+        }
+        if (restore_job_open(&session->restore, conn, session->repository, (char*)frame->payload) != 0) {
+            session->state = SESSION_FINISHED;
+            return -1;
+        }
+        session->state = SESSION_RESTORING;
+        return session_continue(session, conn);
+    default:
+        send_error(conn, "session already finished");
+        return -1;
+    }
+}
+
+int session_pending(const server_session_t *session) {
+    return session->state == SESSION_RESTORING;
+}
+
+int session_continue(server_session_t *session, connection_t *conn) {
+    if (session->state != SESSION_RESTORING) {
+        return 0;
+    }
+    session->restore.stream.conn = conn;
+    int result = restore_job_step(&session->restore, session->repository);
+    if (result != 0) {
+        session->state = SESSION_FINISHED;
+    }
+    return result;
+}
+
+int handle_client(connection_t *conn, const char *repository, const backup_options_t *options) {
+    server_session_t *session = session_create(repository, options);
+    if (!session) {
+        send_error(conn, "server out of memory");
+        return -1;
+    }
+
+    int result = 0;
+    frame_t frame;
+    while (result == 0) {
+        if (recv_frame(conn, &frame) != 0) {
+            result = -1;
+            break;
+        }
+        result = session_handle_frame(session, conn, &frame);
+        // Connexion bloquante : la restauration est envoyée d'un trait
+        while (result == 0 && session_pending(session)) {
+            result = session_continue(session, conn);
+        }
+    }
+
+    session_free(session);
+    return result == 1 ? 0 : -1;
+}
+
+int serve_connection(const char *address, int port, const char *repository, const backup_options_t *options) {
+    if (!is_directory_accessible(repository)) {
+        fprintf(stderr, "Le répertoire de sauvegarde '%s' n'est pas accessible ou n'existe pas.\n", repository);
+        return -1;
+    }
+
+    int server_sock = net_listen(address, port);
+    if (server_sock < 0) {
         return -1;
     }
 
@@ -74,20 +2388,13 @@ size_t receive_data(int port, size_t *size) {
         close(server_sock);
         return -1;
     }
+    close(server_sock);
 
-    // Recevoir des données
-    char *buffer = malloc(*size);
-    size_t bytes_received = recv(client_sock, buffer, sizeof(buffer), 0);
-    if (bytes_received == (size_t)-1) {
-        perror("Erreur dans la réception des données");
-        close(client_sock);
-        close(server_sock);
+    connection_t *conn = connection_open(client_sock);
+    if (!conn) {
         return -1;
     }
-    free(buffer);
-    // Si des données ont bien été récupérées, elles sont retournées pour être sauvegardées/écrites
-    close(client_sock);
-    close(server_sock);
-
-    return bytes_received;
+    int result = handle_client(conn, repository, options);
+    connection_close(conn);
+    return result;
 }
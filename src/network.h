@@ -4,14 +4,399 @@
 
 #include <arpa/inet.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <string.h>
 #include <stdlib.h>
+#include "backup_manager.h"
+#include "transport.h"
+#include "compression.h"
 
-void send_data(const char *server_address, int port, const void *data, size_t size);
-size_t receive_data(int port, size_t *size);
+/** @brief Identifiant du protocole envoyé lors de la poignée de main ("LP25") */
+#define PROTOCOL_MAGIC 0x4C503235u
+/** @brief Version du protocole, refusée par le serveur si elle diffère de la sienne */
+#define PROTOCOL_VERSION 2
+/** @brief Taille de l'en-tête d'une trame : type, drapeaux, réservé (2 octets), longueur (4 octets) */
+#define FRAME_HEADER_SIZE 8
+/** @brief Taille maximale acceptée pour le contenu d'une trame */
+#define FRAME_MAX_PAYLOAD (64u * 1024 * 1024)
+/** @brief Taille des tampons d'émission et de réception d'une connexion */
+#define NET_BUFFER_SIZE (256 * 1024)
+/** @brief Le serveur écrit ses chunks reçus sur le disque après ce volume (point de reprise) */
+#define REMOTE_CHECKPOINT_BYTES (64ULL * 1024 * 1024)
+/** @brief Taille maximale d'une trame DATA de restauration (plages contiguës fusionnées) */
+#define RESTORE_MAX_FRAME (1024 * 1024)
+/** @brief Volume mis en trames par un pas de restauration avant que le démon ne reprenne la main */
+#define RESTORE_STEP_SIZE (1024 * 1024)
+/** @brief En dessous de cette taille, une plage restaurée est copiée dans le tampon plutôt qu'envoyée par sendfile */
+#define SENDFILE_MIN_SIZE 1024
+/** @brief Nombre maximal d'empreintes proposées au serveur dans une trame HAVE */
+#define HAVE_BATCH_SIZE 1024
+/** @brief Taille initiale de la file des enregistrements d'un fichier envoyé, doublée sur le budget mémoire */
+#define RECORD_QUEUE_INITIAL (16 * 1024)
+
+/** @brief Drapeau de trame : le contenu est dans l'anneau de mémoire partagée, la trame n'en porte que la position */
+#define FRAME_FLAG_SHM 0x01
+/** @brief Drapeau de la trame HELLO : mémoire partagée proposée par le client, puis acceptée par le serveur */
+#define FRAME_FLAG_SHM_OFFER 0x02
+/** @brief Drapeau de trame : le contenu est la suite du flux deflate de la connexion */
+#define FRAME_FLAG_DEFLATE 0x04
+/** @brief Drapeau de la trame HELLO : compression proposée par le client, puis acceptée par le serveur */
+#define FRAME_FLAG_COMPRESS_OFFER 0x08
+/** @brief Taille de la position d'un contenu en mémoire partagée : position (8 octets) et taille (4 octets) */
+#define SHM_DESCRIPTOR_SIZE 12
+
+/**
+ * @brief Types de trames du protocole.
+ */
+typedef enum {
+    FRAME_HELLO = 1,    // Poignée de main : magic, version, commande
+    FRAME_MANIFEST = 2, // Contenu d'un .backup_log ou liste de sauvegardes
+    FRAME_FILE = 3,     // Début d'un fichier : chemin relatif à la sauvegarde
+    FRAME_CHUNK = 4,    // Un enregistrement dédupliqué du fichier en cours
+    FRAME_HAVE = 5,     // Lot d'empreintes de chunks proposées par le client
+    FRAME_NEED = 6,     // Bitmap des chunks absents du serveur
+    FRAME_ACK = 7,      // Acquittement, avec un contenu éventuel
+    FRAME_ERROR = 8,    // Erreur : message texte, la session s'arrête
+    FRAME_END = 9,      // Fin de la session
+    FRAME_DATA = 10,    // Chunk absent du serveur : empreinte (16 octets) puis données
+    FRAME_SIGNATURES = 11 // Demande (chemin de l'ancienne version) puis liste des signatures de ses chunks
+} frame_type_t;
+
+/**
+ * @brief Commandes demandées par le client lors de la poignée de main.
+ */
+typedef enum {
+    COMMAND_BACKUP = 1,
+    COMMAND_RESTORE = 2,
+    COMMAND_LIST = 3
+} command_t;
+
+/**
+ * @brief Trame reçue. Le contenu appartient à la connexion et reste valide
+ * jusqu'à la réception suivante.
+ */
+typedef struct {
+    uint8_t type;
+    uint8_t flags;
+    uint32_t length;
+    unsigned char *payload;
+} frame_t;
+
+/**
+ * @brief Connexion persistante : les trames émises sont regroupées dans un tampon
+ * et envoyées sans attendre de réponse, les lectures sont faites par blocs.
+ * En mode non bloquant, les tampons grandissent et c'est la boucle d'événements
+ * du serveur qui les vide (write_pending) ou les remplit (read_available).
+ */
+typedef struct {
+    int fd;
+    int nonblocking;            // Socket non bloquant piloté par epoll
+    int peer_closed;            // Le pair a fermé sa moitié de la connexion
+    unsigned char *out;         // Trames en attente d'envoi
+    size_t out_used;
+    size_t out_sent;            // Octets de out déjà envoyés (mode non bloquant)
+    size_t out_capacity;
+    unsigned char *in;          // Octets reçus non encore consommés
+    size_t in_start;
+    size_t in_end;
+    size_t in_capacity;
+    unsigned char *payload;     // Contenu de la dernière trame reçue
+    size_t payload_capacity;
+    int pass_fd;                // Descripteur à joindre au prochain envoi (-1 sinon)
+    int received_fd;            // Dernier descripteur reçu du pair (-1 sinon)
+    shm_area_t *shm;            // Mémoire partagée avec un pair local (NULL sinon)
+    shm_ring_t *shm_tx;         // Anneau d'émission
+    shm_ring_t *shm_rx;         // Anneau de réception
+    uint64_t shm_release;       // Fin du contenu de la dernière trame lue dans l'anneau, à libérer
+    compressor_t *compressor;   // Compression des trames DATA et MANIFEST (NULL si non négociée)
+} connection_t;
+
+/**
+ * @brief Session côté serveur : une machine à états qui traite les trames d'un client
+ * une par une, utilisée aussi bien par le serveur bloquant que par le démon epoll.
+ */
+typedef struct server_session server_session_t;
+
+/**
+ * @brief Envoie tout un tampon, en reprenant après les écritures partielles.
+ *
+ * @param fd Le socket.
+ * @param data Les données à envoyer.
+ * @param size La taille des données.
+ * @return int 0 si succès, -1 si erreur.
+ */
+int send_all(int fd, const void *data, size_t size);
+
+/**
+ * @brief Reçoit exactement size octets.
+ *
+ * @param fd Le socket.
+ * @param data Le tampon de réception.
+ * @param size Le nombre d'octets attendus.
+ * @return int 0 si succès, -1 si erreur ou connexion fermée.
+ */
+int recv_all(int fd, void *data, size_t size);
+
+/**
+ * @brief Établit une connexion vers un serveur avec le transport de son adresse.
+ *
+ * @param server_address L'adresse IP du serveur, ou unix:CHEMIN / shm:CHEMIN pour un serveur local.
+ * @param port Le port du serveur.
+ * @return int Le socket connecté, -1 en cas d'erreur.
+ */
+int net_connect(const char *server_address, int port);
+
+/**
+ * @brief Crée un socket en écoute.
+ *
+ * @param address L'adresse IP d'écoute (NULL pour toutes les interfaces), ou unix:CHEMIN.
+ * @param port Le port d'écoute (ignoré pour un socket Unix).
+ * @return int Le socket en écoute, -1 en cas d'erreur.
+ */
+int net_listen(const char *address, int port);
+
+/**
+ * @brief Associe des tampons d'émission et de réception à un socket connecté.
+ *
+ * @param fd Le socket.
+ * @return connection_t* La connexion, NULL en cas d'erreur (le socket est alors fermé).
+ */
+connection_t *connection_open(int fd);
+
+/**
+ * @brief Passe le socket d'une connexion en mode non bloquant.
+ *
+ * @param conn La connexion.
+ * @return int 0 si succès, -1 si erreur.
+ */
+int connection_set_nonblocking(connection_t *conn);
+
+/**
+ * @brief Envoie les trames en attente, ferme le socket et libère la connexion.
+ *
+ * @param conn La connexion (peut être NULL).
+ */
+void connection_close(connection_t *conn);
+
+/**
+ * @brief Ajoute une trame au tampon d'émission (envoyé quand il est plein).
+ *
+ * @param conn La connexion.
+ * @param type Le type de trame.
+ * @param payload Le contenu de la trame.
+ * @param length La taille du contenu.
+ * @return int 0 si succès, -1 si erreur.
+ */
+int send_frame(connection_t *conn, uint8_t type, const void *payload, uint32_t length);
+
+/**
+ * @brief Ajoute au tampon d'émission une trame avec des drapeaux, sans passer par la mémoire partagée.
+ *
+ * @param conn La connexion.
+ * @param type Le type de trame.
+ * @param flags Les drapeaux de la trame.
+ * @param payload Le contenu de la trame.
+ * @param length La taille du contenu.
+ * @return int 0 si succès, -1 si erreur.
+ */
+int send_frame_flags(connection_t *conn, uint8_t type, uint8_t flags, const void *payload, uint32_t length);
+
+/**
+ * @brief Envoie une trame dont le contenu est lu dans un fichier par le noyau (sendfile),
+ * sans passer par un tampon en espace utilisateur. Les trames en attente partent avant.
+ *
+ * @param conn La connexion.
+ * @param type Le type de trame.
+ * @param fd Le fichier contenant les données.
+ * @param offset La position des données dans le fichier.
+ * @param length La taille des données.
+ * @return int 0 si succès, -1 si erreur.
+ */
+int send_frame_from_file(connection_t *conn, uint8_t type, int fd, off_t offset, uint32_t length);
+
+/**
+ * @brief Envoie immédiatement les trames en attente.
+ *
+ * @param conn La connexion.
+ * @return int 0 si succès, -1 si erreur.
+ */
+int flush_connection(connection_t *conn);
+
+/**
+ * @brief Envoie sans bloquer ce que le socket accepte du tampon d'émission.
+ *
+ * @param conn La connexion non bloquante.
+ * @return int 1 si tout est envoyé, 0 s'il reste des octets (attendre EPOLLOUT), -1 si erreur.
+ */
+int write_pending(connection_t *conn);
+
+/**
+ * @brief Lit sans bloquer tous les octets disponibles sur le socket.
+ *
+ * @param conn La connexion non bloquante.
+ * @return int 0 si succès (peer_closed est positionné si le pair a fermé), -1 si erreur.
+ */
+int read_available(connection_t *conn);
+
+/**
+ * @brief Indique si le tampon de réception contient une trame entière.
+ *
+ * @param conn La connexion.
+ * @return int 1 si next_frame peut extraire une trame (ou la rejeter), 0 sinon.
+ */
+int has_complete_frame(const connection_t *conn);
+
+/**
+ * @brief Extrait une trame complète du tampon de réception, sans lire le socket.
+ *
+ * @param conn La connexion.
+ * @param frame La trame extraite.
+ * @return int 1 si une trame est extraite, 0 si elle est incomplète, -1 si elle est invalide.
+ */
+int next_frame(connection_t *conn, frame_t *frame);
+
+/**
+ * @brief Reçoit la trame suivante, après avoir envoyé les trames en attente.
+ *
+ * @param conn La connexion.
+ * @param frame La trame reçue.
+ * @return int 0 si succès, -1 si erreur ou connexion fermée.
+ */
+int recv_frame(connection_t *conn, frame_t *frame);
+
+/**
+ * @brief Envoie une trame d'erreur contenant un message.
+ *
+ * @param conn La connexion.
+ * @param message Le message d'erreur.
+ */
+void send_error(connection_t *conn, const char *message);
+
+/**
+ * @brief Poignée de main côté client : annonce la version et la commande.
+ *
+ * @param conn La connexion.
+ * @param command La commande demandée.
+ * @return int 0 si le serveur accepte, -1 sinon.
+ */
+int client_handshake(connection_t *conn, command_t command);
+
+/**
+ * @brief Sauvegarde incrémentale d'un répertoire local vers un serveur distant.
+ *
+ * Le serveur envoie son .backup_log, seuls les fichiers modifiés sont transmis,
+ * puis le nouveau .backup_log, le tout sur une seule connexion. Pour chaque fichier,
+ * les empreintes des chunks sont proposées par lots (HAVE) et seuls les chunks que
+ * le serveur signale absents (NEED) sont envoyés ; le fichier lui-même n'est plus
+ * qu'une suite de références par empreinte. Pour un gros fichier modifié, le client
+ * demande d'abord les signatures de sa version précédente et aligne son découpage
+ * sur les blocs retrouvés : seuls les octets réellement nouveaux partent en DATA.
+ *
+ * @param source_dir Le répertoire source.
+ * @param server_address L'adresse IP du serveur.
+ * @param port Le port du serveur.
+ * @param options Les options (compression des trames ; peut être NULL).
+ * @return int 0 si succès, -1 si erreur.
+ */
+int remote_backup(const char *source_dir, const char *server_address, int port, const backup_options_t *options);
+
+/**
+ * @brief Restaure une sauvegarde d'un serveur distant dans un répertoire local.
+ *
+ * Le serveur parcourt les enregistrements de chaque fichier et envoie les données
+ * stockées directement depuis ses segments pack (sendfile), sans les recopier.
+ *
+ * @param backup_name Le nom de la sauvegarde sur le serveur.
+ * @param restore_dir Le répertoire de restauration.
+ * @param server_address L'adresse IP du serveur.
+ * @param port Le port du serveur.
+ * @param options Les options (compression des trames ; peut être NULL).
+ * @return int 0 si succès, -1 si erreur.
+ */
+int remote_restore(const char *backup_name, const char *restore_dir, const char *server_address, int port,
+                   const backup_options_t *options);
+
+/**
+ * @brief Affiche les sauvegardes présentes sur un serveur distant.
+ *
+ * @param server_address L'adresse IP du serveur.
+ * @param port Le port du serveur.
+ * @return int 0 si succès, -1 si erreur.
+ */
+int remote_list_backups(const char *server_address, int port);
+
+/**
+ * @brief Crée une session serveur en attente de la poignée de main.
+ *
+ * Le client s'annonce dans sa trame HELLO ; ses sauvegardes vont dans le sous-dépôt
+ * portant son nom, et une seule sauvegarde à la fois est acceptée par dépôt.
+ *
+ * @param root Le répertoire racine servi.
+ * @param options Les options de sauvegarde pour un dépôt vide.
+ * @return server_session_t* La session, NULL en cas d'erreur.
+ */
+server_session_t *session_create(const char *root, const backup_options_t *options);
+
+/**
+ * @brief Traite une trame reçue d'un client ; les réponses sont ajoutées au tampon d'émission.
+ *
+ * @param session La session.
+ * @param conn La connexion du client.
+ * @param frame La trame reçue.
+ * @return int 0 si la session continue, 1 si elle est terminée, -1 si erreur.
+ */
+int session_handle_frame(server_session_t *session, connection_t *conn, frame_t *frame);
+
+/**
+ * @brief Indique si la session a des données à envoyer sans attendre de trame (restauration en cours).
+ *
+ * @param session La session.
+ * @return int 1 si session_continue doit être appelée, 0 sinon.
+ */
+int session_pending(const server_session_t *session);
+
+/**
+ * @brief Poursuit une restauration : au plus RESTORE_STEP_SIZE octets sont ajoutés au tampon d'émission.
+ *
+ * Sur une connexion non bloquante, rien n'attend le réseau : ce qui ne part pas tout de suite
+ * reste dans le tampon, et le pas suivant attend qu'il se soit vidé.
+ *
+ * @param session La session.
+ * @param conn La connexion du client.
+ * @return int 0 s'il reste à envoyer, 1 si la session est terminée, -1 si erreur.
+ */
+int session_continue(server_session_t *session, connection_t *conn);
+
+/**
+ * @brief Termine une session : ferme le dépôt pack et libère le verrou du dépôt client.
+ *
+ * @param session La session (peut être NULL).
+ */
+void session_free(server_session_t *session);
+
+/**
+ * @brief Traite la commande d'un client connecté sur un dépôt de sauvegarde.
+ *
+ * @param conn La connexion du client.
+ * @param repository Le répertoire de sauvegarde du serveur.
+ * @param options Les options de sauvegarde pour un dépôt vide.
+ * @return int 0 si succès, -1 si erreur.
+ */
+int handle_client(connection_t *conn, const char *repository, const backup_options_t *options);
+
+/**
+ * @brief Attend une connexion et traite la commande du client.
+ *
+ * @param address L'adresse IP d'écoute.
+ * @param port Le port d'écoute.
+ * @param repository Le répertoire de sauvegarde du serveur.
+ * @param options Les options de sauvegarde pour un dépôt vide.
+ * @return int 0 si succès, -1 si erreur.
+ */
+int serve_connection(const char *address, int port, const char *repository, const backup_options_t *options);
 
 
 #endif // NETWORK_H
@@ -0,0 +1,496 @@
+#include "pack_store.h"
+#include "chunk_index.h"
+#include "governor.h"
+#include "deduplication.h"
+#include "utilities.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+// Hachage djb2 d'une référence pour l'index en mémoire
+static unsigned int hash_key(const char *key) {
+    unsigned int hash = 5381;
+    while (*key) {
+        hash = (hash << 5) + hash + (unsigned char)*key++;
+    }
+    return hash % PACK_INDEX_BUCKETS;
+}
+
+// Construit le chemin d'un segment à partir de son numéro
+static char *segment_path(const pack_store_t *store, unsigned int pack) {
+    char name[32];
+    snprintf(name, sizeof(name), "pack-%06u.pack", pack);
+    return build_full_path(store->dir, name);
+}
+
+// Ajoute ou remplace une entrée dans l'index en mémoire
+static int index_insert(pack_store_t *store, const char *key, const pack_ref_t *ref) {
+    unsigned int bucket = hash_key(key);
+    for (pack_entry *entry = store->buckets[bucket]; entry; entry = entry->next) {
+        if (strcmp(entry->key, key) == 0) {
+            entry->ref = *ref;
+            return 0;
+        }
+    }
+
+    pack_entry *entry = malloc(sizeof(pack_entry));
+    if (!entry) {
+        perror("Memory allocation failed");
+        return -1;
+    }
+    entry->key = strdup(key);
+    if (!entry->key) {
+        perror("Memory allocation failed");
+        free(entry);
+        return -1;
+    }
+    entry->ref = *ref;
+    entry->next = store->buckets[bucket];
+    store->buckets[bucket] = entry;
+    return 0;
+}
+
+// Les chunks reçus par le serveur sont référencés par leur empreinte MD5 en hexadécimal,
+// les fichiers par un chemin préfixé du nom de la sauvegarde
+static int is_digest_key(const char *key) {
+    size_t i = 0;
+    for (; key[i]; i++) {
+        if (i >= MD5_DIGEST_LENGTH * 2 || !((key[i] >= '0' && key[i] <= '9') || (key[i] >= 'a' && key[i] <= 'f'))) {
+            return 0;
+        }
+    }
+    return i == MD5_DIGEST_LENGTH * 2;
+}
+
+// Ajoute une entrée à l'index des chunks ou à l'index des fichiers selon sa clé
+static int store_entry(pack_store_t *store, const char *key, const pack_ref_t *ref) {
+    if (is_digest_key(key)) {
+        unsigned char digest[MD5_DIGEST_LENGTH];
+        hex_to_bytes((const unsigned char*)key, MD5_DIGEST_LENGTH, digest);
+        return chunk_index_insert(store->chunks, digest, ref);
+    }
+    return index_insert(store, key, ref);
+}
+
+// Tailles des segments, relevées à la demande pour vérifier les entrées du journal
+typedef struct {
+    uint64_t *sizes;
+    unsigned int count;
+} segment_sizes_t;
+
+// Après une interruption, le journal peut désigner des objets dont les données n'ont pas atteint le disque :
+// ces entrées sont ignorées avant que de nouveaux objets soient écrits à leur place
+static int object_on_disk(pack_store_t *store, segment_sizes_t *segments, const pack_ref_t *ref) {
+    if (ref->pack >= segments->count) {
+        unsigned int count = ref->pack + 1;
+        uint64_t *grown = realloc(segments->sizes, count * sizeof(uint64_t));
+        if (!grown) {
+            return 1;
+        }
+        segments->sizes = grown;
+        for (unsigned int pack = segments->count; pack < count; pack++) {
+            char *path = segment_path(store, pack);
+            struct stat st;
+            segments->sizes[pack] = path && stat(path, &st) == 0 ? (uint64_t)st.st_size : 0;
+            free(path);
+        }
+        segments->count = count;
+    }
+    return ref->offset + ref->length <= segments->sizes[ref->pack];
+}
+
+// Charge l'index existant : une ligne "key,pack,offset,length" par objet
+// Retourne 1 si la dernière ligne est incomplète (écriture interrompue)
+static int load_index(pack_store_t *store, const char *index_path) {
+    FILE *file = fopen(index_path, "r");
+    if (!file) {
+        return 0;
+    }
+
+    char line[4096];
+    int truncated = 0;
+    segment_sizes_t segments = { .sizes = NULL, .count = 0 };
+    while (fgets(line, sizeof(line), file)) {
+        truncated = line[strcspn(line, "\n")] != '\n';
+        line[strcspn(line, "\n")] = '\0';
+
+        // Les trois derniers champs sont numériques, la clé peut contenir des virgules
+        char *fields[3];
+        int ok = 1;
+        for (int i = 2; i >= 0; i--) {
+            char *comma = strrchr(line, ',');
+            if (!comma) {
+                ok = 0;
+                break;
+            }
+            *comma = '\0';
+            fields[i] = comma + 1;
+        }
+        if (!ok || line[0] == '\0') {
+            fprintf(stderr, "Invalid pack index line ignored\n");
+            continue;
+        }
+
+        pack_ref_t ref;
+        ref.pack = (unsigned int)strtoul(fields[0], NULL, 10);
+        ref.offset = strtoull(fields[1], NULL, 10);
+        ref.length = strtoull(fields[2], NULL, 10);
+        if (!object_on_disk(store, &segments, &ref)) {
+            fprintf(stderr, "Objet incomplet retiré de l'index : %s\n", line);
+            continue;
+        }
+        store_entry(store, line, &ref);
+    }
+
+    free(segments.sizes);
+    fclose(file);
+    return truncated;
+}
+
+// Retrouve le dernier segment existant pour continuer à y écrire
+static void find_last_segment(pack_store_t *store) {
+    DIR *dir = opendir(store->dir);
+    if (!dir) {
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        unsigned int pack;
+        if (sscanf(entry->d_name, "pack-%u.pack", &pack) == 1 && pack >= store->current_pack) {
+            store->current_pack = pack;
+        }
+    }
+    closedir(dir);
+
+    char *path = segment_path(store, store->current_pack);
+    struct stat st;
+    if (path && stat(path, &st) == 0) {
+        store->current_size = st.st_size;
+    }
+    free(path);
+}
+
+int is_pack_repository(const char *backup_dir) {
+    char *dir = build_full_path(backup_dir, PACK_DIR_NAME);
+    if (!dir) {
+        return 0;
+    }
+    struct stat st;
+    int result = stat(dir, &st) == 0 && S_ISDIR(st.st_mode);
+    free(dir);
+    return result;
+}
+
+pack_store_t *pack_store_open(const char *backup_dir, int read_only) {
+    pack_store_t *store = calloc(1, sizeof(pack_store_t));
+    if (!store) {
+        perror("Memory allocation failed");
+        return NULL;
+    }
+
+    store->repository = strdup(backup_dir);
+    store->dir = build_full_path(backup_dir, PACK_DIR_NAME);
+    if (!store->repository || !store->dir) {
+        perror("Memory allocation failed");
+        pack_store_close(store);
+        return NULL;
+    }
+    remove_trailing_slash(store->repository);
+    store->read_only = read_only;
+
+    if (!read_only && mkdir(store->dir, 0755) == -1 && !is_directory_accessible(store->dir)) {
+        perror("Erreur lors de la création du répertoire des packs");
+        pack_store_close(store);
+        return NULL;
+    }
+
+    char *index_path = build_full_path(store->dir, PACK_INDEX_NAME);
+    if (!index_path) {
+        pack_store_close(store);
+        return NULL;
+    }
+    store->chunks = chunk_index_open(store->dir, read_only);
+    if (!store->chunks) {
+        free(index_path);
+        pack_store_close(store);
+        return NULL;
+    }
+    int truncated = load_index(store, index_path);
+    if (read_only) {
+        // Sans journal ouvert, la fermeture n'écrit rien
+        free(index_path);
+        return store;
+    }
+    store->index_file = fopen(index_path, "a");
+    free(index_path);
+    if (!store->index_file) {
+        perror("Erreur lors de l'ouverture de l'index des packs");
+        pack_store_close(store);
+        return NULL;
+    }
+    // Terminer une ligne interrompue pour que la suivante ne s'y colle pas
+    if (truncated) {
+        fputc('\n', store->index_file);
+    }
+
+    find_last_segment(store);
+    return store;
+}
+
+// Réécrit le journal avec les seuls objets fichiers : les empreintes sont désormais dans les runs
+// de l'index des chunks. Le nouveau journal remplace l'ancien d'un seul rename
+static int rewrite_journal(pack_store_t *store) {
+    char *index_path = build_full_path(store->dir, PACK_INDEX_NAME);
+    char *temporary_path = build_full_path(store->dir, PACK_INDEX_NAME ".tmp");
+    FILE *file = temporary_path ? fopen(temporary_path, "w") : NULL;
+    int result = file ? 0 : -1;
+    for (size_t i = 0; i < PACK_INDEX_BUCKETS && result == 0; i++) {
+        for (pack_entry *entry = store->buckets[i]; entry; entry = entry->next) {
+            fprintf(file, "%s,%u,%llu,%llu\n", entry->key, entry->ref.pack,
+                    (unsigned long long)entry->ref.offset, (unsigned long long)entry->ref.length);
+        }
+    }
+    if (file && (fflush(file) != 0 || fsync(fileno(file)) != 0)) {
+        result = -1;
+    }
+    if (file && fclose(file) != 0) {
+        result = -1;
+    }
+    if (result == 0 && rename(temporary_path, index_path) != 0) {
+        result = -1;
+    }
+    if (result == 0) {
+        fclose(store->index_file);
+        store->index_file = fopen(index_path, "a");
+        if (!store->index_file) {
+            result = -1;
+        }
+    }
+    if (result != 0) {
+        perror("Erreur lors de la réécriture de l'index des packs");
+        if (temporary_path) {
+            unlink(temporary_path);
+        }
+    }
+    free(index_path);
+    free(temporary_path);
+    return result;
+}
+
+// Écrit les empreintes en mémoire dans un run de l'index des chunks puis les retire du journal.
+// Les segments doivent déjà être sur le disque (pack_store_sync)
+static int flush_chunk_index(pack_store_t *store) {
+    if (chunk_index_pending(store->chunks) == 0) {
+        return 0;
+    }
+    if (chunk_index_flush(store->chunks) != 0) {
+        return -1;
+    }
+    return rewrite_journal(store);
+}
+
+void pack_store_close(pack_store_t *store) {
+    if (!store) {
+        return;
+    }
+    // Les empreintes encore en mémoire rejoignent l'index des chunks : le journal reste court
+    if (store->chunks && store->index_file && chunk_index_pending(store->chunks) > 0 && pack_store_sync(store) == 0) {
+        flush_chunk_index(store);
+    }
+    // Le segment atteint le disque avant que la fin de l'index ne soit écrite : une entrée ne désigne
+    // jamais des données absentes (les lignes vidées plus tôt par le tampon sont vérifiées au chargement)
+    if (store->current) {
+        if (fflush(store->current) != 0 || fsync(fileno(store->current)) != 0) {
+            perror("Erreur lors de l'écriture du segment pack");
+        }
+        writeback_finish(&store->writeback);
+        fclose(store->current);
+    }
+    if (store->index_file) {
+        fclose(store->index_file);
+    }
+    if (store->read_file) {
+        fclose(store->read_file);
+    }
+    for (unsigned int i = 0; i < store->segment_fd_count; i++) {
+        if (store->segment_fds[i] >= 0) {
+            close(store->segment_fds[i]);
+        }
+    }
+    free(store->segment_fds);
+    chunk_index_close(store->chunks);
+    for (size_t i = 0; i < PACK_INDEX_BUCKETS; i++) {
+        pack_entry *entry = store->buckets[i];
+        while (entry) {
+            pack_entry *next = entry->next;
+            free(entry->key);
+            free(entry);
+            entry = next;
+        }
+    }
+    free(store->dir);
+    free(store->repository);
+    free(store);
+}
+
+int pack_store_begin(pack_store_t *store) {
+    if (store->read_only) {
+        fprintf(stderr, "Dépôt pack ouvert en lecture seule\n");
+        return -1;
+    }
+    if (store->current && store->current_size >= PACK_SEGMENT_SIZE) {
+        writeback_finish(&store->writeback);
+        fclose(store->current);
+        store->current = NULL;
+    }
+    if (!store->current) {
+        if (store->current_size >= PACK_SEGMENT_SIZE) {
+            store->current_pack++;
+            store->current_size = 0;
+        }
+        char *path = segment_path(store, store->current_pack);
+        if (!path) {
+            return -1;
+        }
+        store->current = fopen(path, "ab");
+        free(path);
+        if (!store->current) {
+            perror("Erreur lors de l'ouverture du segment pack");
+            return -1;
+        }
+        writeback_start(&store->writeback, store->current);
+    }
+    store->object_offset = store->current_size;
+    return 0;
+}
+
+int pack_store_append(pack_store_t *store, const void *data, size_t len) {
+    if (!store->current) {
+        return -1;
+    }
+    if (fwrite(data, 1, len, store->current) != len) {
+        perror("Failed to write pack data");
+        return -1;
+    }
+    store->current_size += len;
+    writeback_advance(&store->writeback);
+    governor_write(len);
+    return 0;
+}
+
+int pack_store_commit(pack_store_t *store, const char *key) {
+    pack_ref_t ref = {
+        .pack = store->current_pack,
+        .offset = store->object_offset,
+        .length = store->current_size - store->object_offset
+    };
+    if (store_entry(store, key, &ref) != 0) {
+        return -1;
+    }
+    fprintf(store->index_file, "%s,%u,%llu,%llu\n", key, ref.pack,
+            (unsigned long long)ref.offset, (unsigned long long)ref.length);
+    return 0;
+}
+
+int pack_store_sync(pack_store_t *store) {
+    // Les données d'abord : une entrée de l'index ne doit jamais précéder ses octets sur le disque
+    if (store->current && (fflush(store->current) != 0 || fsync(fileno(store->current)) != 0)) {
+        perror("Erreur lors de l'écriture du segment pack");
+        return -1;
+    }
+    if (fflush(store->index_file) != 0 || fsync(fileno(store->index_file)) != 0) {
+        perror("Erreur lors de l'écriture de l'index des packs");
+        return -1;
+    }
+    if (chunk_index_pending(store->chunks) >= CHUNK_INDEX_MEMTABLE_MAX) {
+        return flush_chunk_index(store);
+    }
+    return 0;
+}
+
+int pack_store_lookup(pack_store_t *store, const char *key, pack_ref_t *ref) {
+    if (is_digest_key(key)) {
+        unsigned char digest[MD5_DIGEST_LENGTH];
+        hex_to_bytes((const unsigned char*)key, MD5_DIGEST_LENGTH, digest);
+        return chunk_index_lookup(store->chunks, digest, ref);
+    }
+    for (pack_entry *entry = store->buckets[hash_key(key)]; entry; entry = entry->next) {
+        if (strcmp(entry->key, key) == 0) {
+            *ref = entry->ref;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int pack_store_contains_batch(pack_store_t *store, const unsigned char *digests, size_t count, unsigned char *found) {
+    return chunk_index_lookup_batch(store->chunks, digests, count, NULL, found);
+}
+
+void *pack_store_read(pack_store_t *store, const pack_ref_t *ref) {
+    // Le segment en écriture peut contenir l'objet demandé : vider son tampon d'abord
+    if (store->current && ref->pack == store->current_pack) {
+        fflush(store->current);
+    }
+    if (!store->read_file || store->read_pack != ref->pack) {
+        if (store->read_file) {
+            fclose(store->read_file);
+        }
+        char *path = segment_path(store, ref->pack);
+        store->read_file = path ? fopen(path, "rb") : NULL;
+        free(path);
+        if (!store->read_file) {
+            perror("Erreur lors de l'ouverture du segment pack");
+            return NULL;
+        }
+        store->read_pack = ref->pack;
+    }
+
+    void *data = malloc(ref->length ? ref->length : 1);
+    if (!data) {
+        perror("Memory allocation failed");
+        return NULL;
+    }
+    if (fseeko(store->read_file, ref->offset, SEEK_SET) != 0 ||
+        fread(data, 1, ref->length, store->read_file) != ref->length) {
+        fprintf(stderr, "Failed to read object from pack %u\n", ref->pack);
+        free(data);
+        return NULL;
+    }
+    return data;
+}
+
+int pack_store_segment_fd(pack_store_t *store, unsigned int pack) {
+    if (pack >= store->segment_fd_count) {
+        unsigned int count = pack + 1 > store->segment_fd_count * 2 ? pack + 1 : store->segment_fd_count * 2;
+        int *fds = realloc(store->segment_fds, count * sizeof(int));
+        if (!fds) {
+            perror("Memory allocation failed");
+            return -1;
+        }
+        for (unsigned int i = store->segment_fd_count; i < count; i++) {
+            fds[i] = -1;
+        }
+        store->segment_fds = fds;
+        store->segment_fd_count = count;
+    }
+    // Les données du segment en écriture doivent être sur le disque avant d'être lues par le noyau
+    if (store->current && pack == store->current_pack) {
+        fflush(store->current);
+    }
+    if (store->segment_fds[pack] < 0) {
+        char *path = segment_path(store, pack);
+        store->segment_fds[pack] = path ? open(path, O_RDONLY | O_CLOEXEC) : -1;
+        free(path);
+        if (store->segment_fds[pack] < 0) {
+            perror("Erreur lors de l'ouverture du segment pack");
+        }
+    }
+    return store->segment_fds[pack];
+}
@@ -0,0 +1,167 @@
+#ifndef PACK_STORE_H
+#define PACK_STORE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "file_handler.h"
+
+/** @brief Nom du répertoire des fichiers pack à la racine du répertoire de sauvegarde */
+#define PACK_DIR_NAME "packs"
+/** @brief Nom de l'index des objets stockés dans les packs */
+#define PACK_INDEX_NAME "index"
+/** @brief Taille à partir de laquelle un nouveau segment pack est ouvert (64 Mo) */
+#define PACK_SEGMENT_SIZE (64ULL * 1024 * 1024)
+/** @brief Nombre d'alvéoles de la table de hachage de l'index en mémoire */
+#define PACK_INDEX_BUCKETS 4096
+
+/**
+ * @brief Emplacement d'un objet dans les fichiers pack.
+ */
+typedef struct {
+    unsigned int pack; // Numéro du segment
+    uint64_t offset;   // Position du premier octet dans le segment
+    uint64_t length;   // Taille de l'objet
+} pack_ref_t;
+
+/**
+ * @brief Entrée de l'index en mémoire (liste chaînée par alvéole).
+ */
+typedef struct pack_entry {
+    char *key;         // Référence de l'objet (chemin présent dans .backup_log)
+    pack_ref_t ref;
+    struct pack_entry *next;
+} pack_entry;
+
+/**
+ * @brief Dépôt en fichiers pack : les objets sont ajoutés à la suite dans des
+ * segments de PACK_SEGMENT_SIZE octets et l'index associe chaque référence à
+ * son emplacement (pack, offset, length).
+ *
+ * Le fichier index est un journal : les objets fichiers y restent, les chunks (clés
+ * d'empreinte MD5) n'y restent que jusqu'à leur écriture dans l'index des chunks.
+ */
+typedef struct {
+    char *dir;                    // Chemin du répertoire packs
+    char *repository;             // Répertoire de sauvegarde contenant les packs
+    FILE *current;                // Segment ouvert en écriture
+    writeback_t writeback;        // Écritures de ce segment en mode --cache-neutral
+    unsigned int current_pack;    // Numéro du segment ouvert en écriture
+    uint64_t current_size;        // Taille actuelle de ce segment
+    uint64_t object_offset;       // Début de l'objet en cours d'écriture
+    FILE *index_file;             // Index ouvert en ajout
+    FILE *read_file;              // Dernier segment ouvert en lecture
+    unsigned int read_pack;       // Numéro de ce segment
+    int *segment_fds;             // Descripteurs en lecture par numéro de segment (-1 si fermé)
+    unsigned int segment_fd_count;
+    pack_entry *buckets[PACK_INDEX_BUCKETS];   // Objets fichiers
+    struct chunk_index *chunks;   // Chunks référencés par leur empreinte, index sur le disque (chunk_index.h)
+    int read_only;                // Ouvert pour une restauration : aucune écriture
+} pack_store_t;
+
+/**
+ * @brief Vérifie si un répertoire de sauvegarde utilise la disposition en fichiers pack.
+ *
+ * @param backup_dir Le répertoire de sauvegarde.
+ * @return int 1 si le répertoire packs existe, 0 sinon.
+ */
+int is_pack_repository(const char *backup_dir);
+
+/**
+ * @brief Ouvre (et crée si besoin) le dépôt pack d'un répertoire de sauvegarde.
+ *
+ * En lecture seule, rien n'est créé ni modifié, ni à l'ouverture ni à la fermeture (pas de
+ * journal ouvert en ajout, de run écrit ou fusionné, d'index réécrit) : une restauration peut
+ * lire le dépôt pendant qu'une sauvegarde y écrit.
+ *
+ * @param backup_dir Le répertoire de sauvegarde.
+ * @param read_only Ouvrir en lecture seule (restauration).
+ * @return pack_store_t* Le dépôt ouvert, ou NULL en cas d'erreur.
+ */
+pack_store_t *pack_store_open(const char *backup_dir, int read_only);
+
+/**
+ * @brief Écrit les données en attente, dont les empreintes encore en mémoire (dans un run de
+ * l'index des chunks), et libère le dépôt.
+ *
+ * @param store Le dépôt à fermer (peut être NULL).
+ */
+void pack_store_close(pack_store_t *store);
+
+/**
+ * @brief Commence un nouvel objet, en changeant de segment si le courant est plein.
+ *
+ * @param store Le dépôt.
+ * @return int 0 si succès, -1 si erreur.
+ */
+int pack_store_begin(pack_store_t *store);
+
+/**
+ * @brief Ajoute des données à l'objet en cours.
+ *
+ * @param store Le dépôt.
+ * @param data Les données à ajouter.
+ * @param len La taille des données.
+ * @return int 0 si succès, -1 si erreur.
+ */
+int pack_store_append(pack_store_t *store, const void *data, size_t len);
+
+/**
+ * @brief Termine l'objet en cours et l'enregistre dans l'index.
+ *
+ * @param store Le dépôt.
+ * @param key La référence de l'objet.
+ * @return int 0 si succès, -1 si erreur.
+ */
+int pack_store_commit(pack_store_t *store, const char *key);
+
+/**
+ * @brief Écrit sur le disque les segments puis l'index (point de reprise). Au-delà de
+ * CHUNK_INDEX_MEMTABLE_MAX empreintes en mémoire, elles sont écrites dans un run de l'index des chunks.
+ *
+ * @param store Le dépôt.
+ * @return int 0 si succès, -1 si erreur.
+ */
+int pack_store_sync(pack_store_t *store);
+
+/**
+ * @brief Cherche l'emplacement d'un objet dans l'index.
+ *
+ * @param store Le dépôt.
+ * @param key La référence de l'objet.
+ * @param ref L'emplacement trouvé.
+ * @return int 1 si trouvé, 0 sinon.
+ */
+int pack_store_lookup(pack_store_t *store, const char *key, pack_ref_t *ref);
+
+/**
+ * @brief Indique quels chunks d'un lot sont dans le dépôt, en une recherche triée dans l'index des chunks.
+ *
+ * @param store Le dépôt.
+ * @param digests Les empreintes MD5 binaires, à la suite.
+ * @param count Le nombre d'empreintes.
+ * @param found found[i] vaut 1 si le chunk i est dans le dépôt, 0 sinon.
+ * @return int 0 si succès, -1 si erreur.
+ */
+int pack_store_contains_batch(pack_store_t *store, const unsigned char *digests, size_t count, unsigned char *found);
+
+/**
+ * @brief Lit un objet depuis son segment.
+ *
+ * @param store Le dépôt.
+ * @param ref L'emplacement de l'objet.
+ * @return void* Les données allouées dynamiquement (ref->length octets), NULL en cas d'erreur.
+ */
+void *pack_store_read(pack_store_t *store, const pack_ref_t *ref);
+
+/**
+ * @brief Donne un descripteur en lecture sur un segment, pour envoyer ses données sans copie (sendfile).
+ *
+ * Les descripteurs restent ouverts jusqu'à pack_store_close.
+ *
+ * @param store Le dépôt.
+ * @param pack Le numéro du segment.
+ * @return int Le descripteur, -1 en cas d'erreur.
+ */
+int pack_store_segment_fd(pack_store_t *store, unsigned int pack);
+
+#endif // PACK_STORE_H
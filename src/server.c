@@ -0,0 +1,302 @@
+#define _GNU_SOURCE
+#include "server.h"
+#include "network.h"
+#include "utilities.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+// Client connecté au démon
+typedef struct client {
+    connection_t *conn;
+    server_session_t *session;  // NULL une fois la session terminée
+    int busy;                   // Trames confiées à un worker : le socket n'est plus surveillé
+    int finished;               // Fermer dès que les réponses sont envoyées
+    struct client *next;        // Chaînage dans la file des travaux ou des travaux terminés
+} client_t;
+
+typedef struct {
+    client_t *head;
+    client_t *tail;
+} client_queue_t;
+
+typedef struct {
+    const char *repository;
+    const backup_options_t *options;
+    int listen_fd;
+    int epoll_fd;
+    int event_fd;               // Réveille la boucle quand un worker a terminé
+    pthread_mutex_t mutex;
+    pthread_cond_t work_ready;
+    client_queue_t work;        // Clients ayant des trames à traiter
+    client_queue_t done;        // Clients rendus par les workers
+} server_t;
+
+static void queue_push(client_queue_t *queue, client_t *client) {
+    client->next = NULL;
+    if (queue->tail) {
+        queue->tail->next = client;
+    }
+    else {
+        queue->head = client;
+    }
+    queue->tail = client;
+}
+
+static client_t *queue_pop(client_queue_t *queue) {
+    client_t *client = queue->head;
+    if (client) {
+        queue->head = client->next;
+        if (!queue->head) {
+            queue->tail = NULL;
+        }
+    }
+    return client;
+}
+
+// Termine la session du client, ce qui ferme son dépôt pack et libère le verrou
+static void end_session(client_t *client) {
+    session_free(client->session);
+    client->session = NULL;
+    client->finished = 1;
+}
+
+// Traite toutes les trames complètes d'un client, ou un pas de sa restauration (exécuté par un worker)
+static void process_client(client_t *client) {
+    connection_t *conn = client->conn;
+    frame_t frame;
+    int found = 0;
+    if (session_pending(client->session)) {
+        if (session_continue(client->session, conn) != 0) {
+            end_session(client);
+        }
+        return;
+    }
+    while (!client->finished && conn->out_used < SERVER_MAX_PENDING_OUTPUT &&
+           (found = next_frame(conn, &frame)) == 1) {
+        if (session_handle_frame(client->session, conn, &frame) != 0) {
+            // Session terminée (réponse finale en attente d'envoi) ou en erreur
+            end_session(client);
+        }
+    }
+    if (found < 0) {
+        send_error(conn, "invalid frame");
+        end_session(client);
+    }
+}
+
+static void *worker_main(void *arg) {
+    server_t *server = arg;
+    while (1) {
+        pthread_mutex_lock(&server->mutex);
+        client_t *client;
+        while ((client = queue_pop(&server->work)) == NULL) {
+            pthread_cond_wait(&server->work_ready, &server->mutex);
+        }
+        pthread_mutex_unlock(&server->mutex);
+
+        process_client(client);
+
+        pthread_mutex_lock(&server->mutex);
+        queue_push(&server->done, client);
+        pthread_mutex_unlock(&server->mutex);
+        uint64_t one = 1;
+        if (write(server->event_fd, &one, sizeof(one)) != sizeof(one)) {
+            perror("Erreur lors du réveil de la boucle d'événements");
+        }
+    }
+    return NULL;
+}
+
+// Les sockets clients sont surveillés en EPOLLONESHOT : réarmés seulement quand le client n'est pas chez un worker
+static int watch_client(server_t *server, client_t *client, uint32_t events, int op) {
+    struct epoll_event event = { .events = events | EPOLLONESHOT, .data.ptr = client };
+    if (epoll_ctl(server->epoll_fd, op, client->conn->fd, &event) == -1) {
+        perror("Erreur lors de la surveillance du client");
+        return -1;
+    }
+    return 0;
+}
+
+static void drop_client(client_t *client) {
+    session_free(client->session);
+    connection_close(client->conn);
+    free(client);
+}
+
+static void schedule_client(server_t *server, client_t *client) {
+    client->busy = 1;
+    pthread_mutex_lock(&server->mutex);
+    queue_push(&server->work, client);
+    pthread_cond_signal(&server->work_ready);
+    pthread_mutex_unlock(&server->mutex);
+}
+
+// Décide de la suite pour un client qui n'est pas chez un worker : traiter, envoyer, lire ou fermer
+static void update_client(server_t *server, client_t *client) {
+    connection_t *conn = client->conn;
+    if (write_pending(conn) < 0) {
+        drop_client(client);
+        return;
+    }
+    int output_pending = conn->out_used > conn->out_sent;
+
+    if (!client->finished && conn->out_used < SERVER_MAX_PENDING_OUTPUT && has_complete_frame(conn)) {
+        schedule_client(server, client);
+        return;
+    }
+    // Restauration : le pas suivant attend que le précédent soit presque parti (EPOLLOUT)
+    if (!client->finished && session_pending(client->session) && conn->out_used - conn->out_sent < RESTORE_STEP_SIZE) {
+        schedule_client(server, client);
+        return;
+    }
+    if (!output_pending && (client->finished || conn->peer_closed)) {
+        drop_client(client);
+        return;
+    }
+
+    uint32_t events = output_pending ? EPOLLOUT : 0;
+    if (!client->finished && !conn->peer_closed) {
+        events |= EPOLLIN;
+    }
+    if (watch_client(server, client, events, EPOLL_CTL_MOD) != 0) {
+        drop_client(client);
+    }
+}
+
+static void accept_clients(server_t *server) {
+    while (1) {
+        int fd = accept(server->listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                perror("Erreur lors de l'acceptation de la connexion");
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+
+        client_t *client = calloc(1, sizeof(client_t));
+        connection_t *conn = connection_open(fd);
+        if (!client || !conn) {
+            perror("Memory allocation failed");
+            free(client);
+            if (conn) {
+                connection_close(conn);
+            }
+            continue;
+        }
+        client->conn = conn;
+        client->session = session_create(server->repository, server->options);
+        if (!client->session || connection_set_nonblocking(conn) != 0 ||
+            watch_client(server, client, EPOLLIN, EPOLL_CTL_ADD) != 0) {
+            drop_client(client);
+        }
+    }
+}
+
+// Rend la main aux clients dont les trames ont été traitées
+static void collect_finished_work(server_t *server) {
+    uint64_t count;
+    if (read(server->event_fd, &count, sizeof(count)) != sizeof(count) && errno != EAGAIN) {
+        perror("Erreur lors de la lecture de l'eventfd");
+    }
+
+    pthread_mutex_lock(&server->mutex);
+    client_t *client = server->done.head;
+    server->done.head = NULL;
+    server->done.tail = NULL;
+    pthread_mutex_unlock(&server->mutex);
+
+    while (client) {
+        client_t *next = client->next;
+        client->busy = 0;
+        update_client(server, client);
+        client = next;
+    }
+}
+
+static void handle_client_event(server_t *server, client_t *client, uint32_t events) {
+    if ((events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !client->conn->peer_closed) {
+        if (read_available(client->conn) != 0) {
+            drop_client(client);
+            return;
+        }
+    }
+    update_client(server, client);
+}
+
+int serve_forever(const char *address, int port, const char *repository, const backup_options_t *options) {
+    if (!is_directory_accessible(repository)) {
+        fprintf(stderr, "Le répertoire de sauvegarde '%s' n'est pas accessible ou n'existe pas.\n", repository);
+        return -1;
+    }
+
+    server_t server = {
+        .repository = repository,
+        .options = options,
+        .mutex = PTHREAD_MUTEX_INITIALIZER,
+        .work_ready = PTHREAD_COND_INITIALIZER
+    };
+    server.listen_fd = net_listen(address, port);
+    if (server.listen_fd < 0) {
+        return -1;
+    }
+    int flags = fcntl(server.listen_fd, F_GETFL, 0);
+    server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    server.event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (flags == -1 || fcntl(server.listen_fd, F_SETFL, flags | O_NONBLOCK) == -1 ||
+        server.epoll_fd == -1 || server.event_fd == -1) {
+        perror("Erreur lors de l'initialisation du serveur");
+        close(server.listen_fd);
+        return -1;
+    }
+
+    // Les sockets d'écoute et de réveil se distinguent des clients par l'adresse enregistrée
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = &server.listen_fd };
+    epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.listen_fd, &event);
+    event.data.ptr = &server.event_fd;
+    epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.event_fd, &event);
+
+    for (int i = 0; i < SERVER_WORKERS; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, worker_main, &server) != 0) {
+            fprintf(stderr, "Impossible de démarrer le worker %d\n", i);
+            return -1;
+        }
+        pthread_detach(thread);
+    }
+
+    printf("Serveur en écoute sur le port %d (%d workers)\n", port, SERVER_WORKERS);
+    fflush(stdout);
+
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while (1) {
+        int count = epoll_wait(server.epoll_fd, events, SERVER_MAX_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Erreur dans epoll_wait");
+            return -1;
+        }
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.ptr == &server.listen_fd) {
+                accept_clients(&server);
+            }
+            else if (events[i].data.ptr == &server.event_fd) {
+                collect_finished_work(&server);
+            }
+            else {
+                handle_client_event(&server, events[i].data.ptr, events[i].events);
+            }
+        }
+    }
+}
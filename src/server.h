@@ -0,0 +1,31 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "backup_manager.h"
+
+/** @brief Nombre de threads qui traitent les trames des clients (disque et dépôt pack) */
+#define SERVER_WORKERS 4
+/** @brief Nombre maximal d'événements lus par appel à epoll_wait */
+#define SERVER_MAX_EVENTS 64
+/** @brief Au-delà de ce volume de réponses en attente, les trames d'un client ne sont plus traitées */
+#define SERVER_MAX_PENDING_OUTPUT (8 * 1024 * 1024)
+
+/**
+ * @brief Démon de sauvegarde : accepte un nombre quelconque de clients simultanés.
+ *
+ * Un seul thread surveille les sockets non bloquants avec epoll et ne fait que
+ * lire et écrire les tampons des connexions ; dès qu'un client a des trames complètes,
+ * elles sont confiées à un pool de SERVER_WORKERS threads qui font le travail disque.
+ * Une restauration est envoyée par pas de RESTORE_STEP_SIZE octets : entre deux pas, le
+ * worker est rendu et le client attend que son socket accepte de nouveau des données.
+ * Chaque client a son sous-dépôt (nom annoncé dans sa trame HELLO).
+ *
+ * @param address L'adresse IP d'écoute (NULL pour toutes les interfaces).
+ * @param port Le port d'écoute.
+ * @param repository Le répertoire racine des dépôts des clients.
+ * @param options Les options de sauvegarde pour un dépôt vide.
+ * @return int -1 si le démon n'a pas pu démarrer (il ne s'arrête pas sinon).
+ */
+int serve_forever(const char *address, int port, const char *repository, const backup_options_t *options);
+
+#endif // SERVER_H
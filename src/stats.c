@@ -0,0 +1,141 @@
+#include "stats.h"
+#include "budget.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+// Compteurs d'une étape, incrémentés atomiquement : le serveur et le pipeline ont plusieurs threads
+typedef struct {
+    uint64_t calls;
+    uint64_t wall_ns;
+    uint64_t cpu_ns;
+    uint64_t bytes;
+    uint64_t files;
+    uint64_t chunks;
+    uint64_t hits;
+} phase_counters_t;
+
+static const struct {
+    const char *name;
+    int cpu;            // Temps CPU mesuré (étapes à l'échelle du fichier ou de la trame)
+} phase_info[STATS_PHASE_COUNT] = {
+    [STATS_WALK] = { "walk", 1 },
+    [STATS_STAT] = { "stat", 0 },
+    [STATS_HASH] = { "hash", 0 },
+    [STATS_CHUNK] = { "chunk", 1 },
+    [STATS_INDEX] = { "index", 0 },
+    [STATS_COMPRESS] = { "compress", 1 },
+    [STATS_READ] = { "read", 1 },
+    [STATS_WRITE] = { "write", 1 },
+    [STATS_NETWORK] = { "network", 0 },
+};
+
+static int enabled = 0;
+static uint64_t start_wall_ns;
+static phase_counters_t counters[STATS_PHASE_COUNT];
+
+static uint64_t clock_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void add(uint64_t *counter, uint64_t value) {
+    if (value) {
+        __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+    }
+}
+
+void stats_enable(void) {
+    enabled = 1;
+    start_wall_ns = clock_ns(CLOCK_MONOTONIC);
+}
+
+int stats_enabled(void) {
+    return enabled;
+}
+
+void stats_begin(stats_phase_t phase, stats_span_t *span) {
+    if (!enabled) {
+        return;
+    }
+    span->wall_ns = clock_ns(CLOCK_MONOTONIC);
+    span->cpu_ns = phase_info[phase].cpu ? clock_ns(CLOCK_THREAD_CPUTIME_ID) : 0;
+}
+
+void stats_end(stats_phase_t phase, const stats_span_t *span, uint64_t bytes, uint64_t files, uint64_t chunks) {
+    if (!enabled) {
+        return;
+    }
+    phase_counters_t *c = &counters[phase];
+    add(&c->wall_ns, clock_ns(CLOCK_MONOTONIC) - span->wall_ns);
+    if (phase_info[phase].cpu) {
+        add(&c->cpu_ns, clock_ns(CLOCK_THREAD_CPUTIME_ID) - span->cpu_ns);
+    }
+    add(&c->calls, 1);
+    add(&c->bytes, bytes);
+    add(&c->files, files);
+    add(&c->chunks, chunks);
+}
+
+void stats_count(stats_phase_t phase, uint64_t bytes, uint64_t files, uint64_t chunks, uint64_t hits) {
+    if (!enabled) {
+        return;
+    }
+    phase_counters_t *c = &counters[phase];
+    add(&c->bytes, bytes);
+    add(&c->files, files);
+    add(&c->chunks, chunks);
+    add(&c->hits, hits);
+}
+
+int stats_write_json(const char *path, const char *operation) {
+    if (!enabled) {
+        return 0;
+    }
+    FILE *out = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (!out) {
+        perror(path);
+        return -1;
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"operation\": \"%s\",\n", operation);
+    fprintf(out, "  \"wall_seconds\": %.6f,\n", (clock_ns(CLOCK_MONOTONIC) - start_wall_ns) / 1e9);
+    fprintf(out, "  \"user_seconds\": %.6f,\n", usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6);
+    fprintf(out, "  \"system_seconds\": %.6f,\n", usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6);
+    fprintf(out, "  \"max_rss_kb\": %ld,\n", usage.ru_maxrss);
+    uint64_t limit, current, peak;
+    budget_usage(&limit, &current, &peak);
+    fprintf(out, "  \"memory\": { \"limit_bytes\": %llu, \"current_bytes\": %llu, \"peak_bytes\": %llu },\n",
+            (unsigned long long)limit, (unsigned long long)current, (unsigned long long)peak);
+    fprintf(out, "  \"phases\": {\n");
+    for (int i = 0; i < STATS_PHASE_COUNT; i++) {
+        const phase_counters_t *c = &counters[i];
+        fprintf(out, "    \"%s\": { \"calls\": %llu, \"wall_seconds\": %.6f, ", phase_info[i].name,
+                (unsigned long long)c->calls, c->wall_ns / 1e9);
+        if (phase_info[i].cpu) {
+            fprintf(out, "\"cpu_seconds\": %.6f, ", c->cpu_ns / 1e9);
+        }
+        else {
+            fprintf(out, "\"cpu_seconds\": null, ");
+        }
+        fprintf(out, "\"bytes\": %llu, \"files\": %llu, \"chunks\": %llu, \"hits\": %llu }%s\n",
+                (unsigned long long)c->bytes, (unsigned long long)c->files, (unsigned long long)c->chunks,
+                (unsigned long long)c->hits, i + 1 < STATS_PHASE_COUNT ? "," : "");
+    }
+    fprintf(out, "  }\n}\n");
+
+    if (out == stdout) {
+        fflush(out);
+        return 0;
+    }
+    if (fclose(out) != 0) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
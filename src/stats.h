@@ -0,0 +1,87 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+/**
+ * @brief Étapes mesurées par --stats.
+ *
+ * Les étapes s'emboîtent : walk contient les stat de chaque entrée, chunk le hachage
+ * et la recherche dans l'index de chaque chunk, network les envois des trames compressées.
+ */
+typedef enum {
+    STATS_WALK,      // Parcours de la source (list_files)
+    STATS_STAT,      // stat et date de modification de chaque entrée
+    STATS_HASH,      // MD5 des fichiers entiers et des chunks
+    STATS_CHUNK,     // Découpage d'un fichier en chunks
+    STATS_INDEX,     // Recherche et ajout des chunks dans la table des MD5
+    STATS_COMPRESS,  // Compression et décompression des trames
+    STATS_READ,      // Lecture des fichiers sauvegardés à restaurer
+    STATS_WRITE,     // Écriture des fichiers sauvegardés ou restaurés
+    STATS_NETWORK,   // Envoi et attente des données sur le socket
+    STATS_PHASE_COUNT
+} stats_phase_t;
+
+/**
+ * @brief Début d'une mesure, rempli par stats_begin.
+ */
+typedef struct {
+    uint64_t wall_ns;
+    uint64_t cpu_ns;    // Temps CPU du thread, pour les étapes mesurées à l'échelle du fichier
+} stats_span_t;
+
+/**
+ * @brief Active les compteurs. Sans cet appel, les autres fonctions ne font rien.
+ */
+void stats_enable(void);
+
+/**
+ * @brief Indique si les compteurs sont actifs.
+ *
+ * @return int 1 si actifs, 0 sinon.
+ */
+int stats_enabled(void);
+
+/**
+ * @brief Commence la mesure d'une étape.
+ *
+ * Les étapes très courtes (stat, hash, index, network) ne lisent que l'horloge monotone :
+ * le temps CPU du thread coûte un appel système par lecture.
+ *
+ * @param phase L'étape.
+ * @param span La mesure à remplir.
+ */
+void stats_begin(stats_phase_t phase, stats_span_t *span);
+
+/**
+ * @brief Termine la mesure d'une étape et ajoute ses volumes aux compteurs.
+ *
+ * @param phase L'étape.
+ * @param span La mesure commencée par stats_begin.
+ * @param bytes Les octets traités.
+ * @param files Les fichiers traités.
+ * @param chunks Les chunks traités.
+ */
+void stats_end(stats_phase_t phase, const stats_span_t *span, uint64_t bytes, uint64_t files, uint64_t chunks);
+
+/**
+ * @brief Ajoute des volumes aux compteurs d'une étape sans mesure de temps.
+ *
+ * @param phase L'étape.
+ * @param bytes Les octets traités.
+ * @param files Les fichiers traités.
+ * @param chunks Les chunks traités.
+ * @param hits Les chunks déjà connus (doublons dans l'index, chunks que le serveur possède).
+ */
+void stats_count(stats_phase_t phase, uint64_t bytes, uint64_t files, uint64_t chunks, uint64_t hits);
+
+/**
+ * @brief Écrit le résumé JSON des compteurs.
+ *
+ * @param path Le fichier de sortie, "-" pour la sortie standard.
+ * @param operation Le nom de l'opération mesurée ("backup", "restore").
+ * @return int 0 si succès, -1 si erreur.
+ */
+int stats_write_json(const char *path, const char *operation);
+
+#endif // STATS_H
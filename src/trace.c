@@ -0,0 +1,199 @@
+#define _GNU_SOURCE
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+typedef struct {
+    const char *category;
+    const char *name;
+    char *detail;
+    uint64_t start_ns;
+    uint64_t duration_ns;
+    uint64_t bytes;
+} trace_event_t;
+
+typedef struct trace_block {
+    trace_event_t events[TRACE_BLOCK_EVENTS];
+    int used;
+    struct trace_block *next;
+} trace_block_t;
+
+// Tampon d'un thread : seul son thread y écrit, les tampons sont chaînés une fois pour toutes
+typedef struct trace_buffer {
+    pid_t tid;
+    trace_block_t *head;
+    trace_block_t *tail;
+    uint64_t count;
+    uint64_t dropped;
+    struct trace_buffer *next;
+} trace_buffer_t;
+
+static char *trace_path = NULL;
+static uint64_t trace_origin_ns;
+static trace_buffer_t *buffers = NULL;
+static __thread trace_buffer_t *local_buffer = NULL;
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void write_trace_at_exit(void) {
+    trace_write();
+}
+
+void trace_enable(const char *path) {
+    trace_path = strdup(path);
+    if (!trace_path) {
+        perror("Memory allocation failed");
+        return;
+    }
+    trace_origin_ns = monotonic_ns();
+    atexit(write_trace_at_exit);
+}
+
+uint64_t trace_begin(void) {
+    return trace_path ? monotonic_ns() : 0;
+}
+
+// Crée le tampon du thread à son premier événement et l'ajoute à la liste sans verrou
+static trace_buffer_t *thread_buffer(void) {
+    if (local_buffer) {
+        return local_buffer;
+    }
+    trace_buffer_t *buffer = calloc(1, sizeof(trace_buffer_t));
+    if (!buffer) {
+        return NULL;
+    }
+    buffer->tid = (pid_t)syscall(SYS_gettid);
+    buffer->next = __atomic_load_n(&buffers, __ATOMIC_ACQUIRE);
+    while (!__atomic_compare_exchange_n(&buffers, &buffer->next, buffer, 0, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+        // buffer->next a été mis à jour avec la nouvelle tête
+    }
+    local_buffer = buffer;
+    return buffer;
+}
+
+void trace_end(uint64_t start, const char *category, const char *name, const char *detail, uint64_t bytes) {
+    if (!start) {
+        return;
+    }
+    uint64_t end = monotonic_ns();
+    trace_buffer_t *buffer = thread_buffer();
+    if (!buffer) {
+        return;
+    }
+    if (buffer->count >= TRACE_MAX_EVENTS) {
+        buffer->dropped++;
+        return;
+    }
+    if (!buffer->tail || buffer->tail->used == TRACE_BLOCK_EVENTS) {
+        trace_block_t *block = malloc(sizeof(trace_block_t));
+        if (!block) {
+            buffer->dropped++;
+            return;
+        }
+        block->used = 0;
+        block->next = NULL;
+        if (buffer->tail) {
+            buffer->tail->next = block;
+        }
+        else {
+            buffer->head = block;
+        }
+        buffer->tail = block;
+    }
+    trace_event_t *event = &buffer->tail->events[buffer->tail->used++];
+    event->category = category;
+    event->name = name;
+    event->detail = detail ? strdup(detail) : NULL;
+    event->start_ns = start;
+    event->duration_ns = end - start;
+    event->bytes = bytes;
+    buffer->count++;
+}
+
+static void write_json_string(FILE *out, const char *text) {
+    fputc('"', out);
+    for (const unsigned char *c = (const unsigned char*)text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(out, "\\%c", *c);
+        }
+        else if (*c < 0x20) {
+            fprintf(out, "\\u%04x", *c);
+        }
+        else {
+            fputc(*c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+int trace_write(void) {
+    if (!trace_path) {
+        return 0;
+    }
+    FILE *out = fopen(trace_path, "w");
+    if (!out) {
+        perror(trace_path);
+        return -1;
+    }
+    pid_t pid = getpid();
+    fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    int first = 1;
+    for (trace_buffer_t *buffer = __atomic_load_n(&buffers, __ATOMIC_ACQUIRE); buffer; buffer = buffer->next) {
+        // Nom du thread affiché par le visualiseur
+        fprintf(out, "%s{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": %d, \"tid\": %d, "
+                "\"args\": {\"name\": \"%s %d\", \"dropped_events\": %llu}}",
+                first ? "" : ",\n", (int)pid, (int)buffer->tid, buffer->tid == pid ? "main" : "thread",
+                (int)buffer->tid, (unsigned long long)buffer->dropped);
+        first = 0;
+        for (trace_block_t *block = buffer->head; block; block = block->next) {
+            for (int i = 0; i < block->used; i++) {
+                const trace_event_t *event = &block->events[i];
+                fprintf(out, ",\n{\"ph\": \"X\", \"cat\": \"%s\", \"name\": \"%s\", \"pid\": %d, \"tid\": %d, "
+                        "\"ts\": %.3f, \"dur\": %.3f, \"args\": {", event->category, event->name, (int)pid,
+                        (int)buffer->tid, (event->start_ns - trace_origin_ns) / 1e3, event->duration_ns / 1e3);
+                if (event->detail) {
+                    fprintf(out, "\"path\": ");
+                    write_json_string(out, event->detail);
+                }
+                if (event->bytes) {
+                    fprintf(out, "%s\"bytes\": %llu", event->detail ? ", " : "", (unsigned long long)event->bytes);
+                }
+                fprintf(out, "}}");
+            }
+        }
+    }
+    fprintf(out, "\n]}\n");
+
+    // Les événements ne sont écrits qu'une fois
+    for (trace_buffer_t *buffer = buffers; buffer; ) {
+        trace_buffer_t *next_buffer = buffer->next;
+        for (trace_block_t *block = buffer->head; block; ) {
+            trace_block_t *next_block = block->next;
+            for (int i = 0; i < block->used; i++) {
+                free(block->events[i].detail);
+            }
+            free(block);
+            block = next_block;
+        }
+        free(buffer);
+        buffer = next_buffer;
+    }
+    buffers = NULL;
+    local_buffer = NULL;
+    free(trace_path);
+    trace_path = NULL;
+
+    if (fclose(out) != 0) {
+        perror("Erreur lors de l'écriture de la trace");
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,44 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+/** @brief Nombre d'événements par bloc du tampon d'un thread */
+#define TRACE_BLOCK_EVENTS 4096
+/** @brief Au-delà de ce nombre d'événements, un thread ne trace plus (les suivants sont comptés comme perdus) */
+#define TRACE_MAX_EVENTS (1024 * 1024)
+
+/**
+ * @brief Active l'enregistrement des événements, écrits dans un fichier à la sortie du programme.
+ *
+ * @param path Le fichier de sortie, au format « trace event » de Chrome (chrome://tracing, Perfetto).
+ */
+void trace_enable(const char *path);
+
+/**
+ * @brief Commence un événement.
+ *
+ * @return uint64_t L'horodatage du début à passer à trace_end, 0 si la trace est désactivée.
+ */
+uint64_t trace_begin(void);
+
+/**
+ * @brief Termine un événement et l'ajoute au tampon du thread appelant, sans verrou.
+ *
+ * @param start L'horodatage renvoyé par trace_begin (0 : rien n'est enregistré).
+ * @param category La catégorie (chaîne statique : "walk", "backup", "restore", "network"...).
+ * @param name Le nom de l'étape (chaîne statique).
+ * @param detail Le fichier concerné, copié (peut être NULL).
+ * @param bytes Les octets traités (0 si sans objet).
+ */
+void trace_end(uint64_t start, const char *category, const char *name, const char *detail, uint64_t bytes);
+
+/**
+ * @brief Écrit les événements de tous les threads. Appelée à la sortie du programme,
+ * quand les autres threads ont terminé.
+ *
+ * @return int 0 si succès, -1 si erreur.
+ */
+int trace_write(void);
+
+#endif // TRACE_H
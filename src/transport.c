@@ -0,0 +1,294 @@
+#define _GNU_SOURCE
+#include "transport.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+
+// Scellés exigés de la memfd : sa taille ne peut plus changer une fois projetée
+#define SHM_REQUIRED_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)
+
+// Transport TCP : adresse IPv4 et port
+static int tcp_connect(const char *server_address, int port) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        perror("Erreur dans la création du socket");
+        return -1;
+    }
+
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(port);
+
+    // Convertir l'adresse IP
+    if (inet_pton(AF_INET, server_address, &server_addr.sin_addr) <= 0) {
+        fprintf(stderr, "Adresse IP invalide : %s\n", server_address);
+        close(sock);
+        return -1;
+    }
+
+    // Établir la connexion au serveur
+    if (connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
+        perror("Erreur de connexion");
+        close(sock);
+        return -1;
+    }
+
+    return sock;
+}
+
+static int tcp_listen(const char *address, int port) {
+    int server_sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (server_sock < 0) {
+        perror("Erreur dans la création de socket");
+        return -1;
+    }
+
+    // Permettre de relancer le serveur immédiatement sur le même port
+    int reuse = 1;
+    setsockopt(server_sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = INADDR_ANY;
+    server_addr.sin_port = htons(port);
+    if (address && inet_pton(AF_INET, address, &server_addr.sin_addr) <= 0) {
+        fprintf(stderr, "Adresse IP invalide : %s\n", address);
+        close(server_sock);
+        return -1;
+    }
+
+    // Lier le socket à l'adresse et au port
+    if (bind(server_sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
+        perror("Erreur dans la liaison du socket à l'adresse et au port");
+        close(server_sock);
+        return -1;
+    }
+
+    // Écouter les connexions entrantes
+    if (listen(server_sock, SOMAXCONN) < 0) {
+        perror("Erreur lors de l'écoute du serveur");
+        close(server_sock);
+        return -1;
+    }
+
+    return server_sock;
+}
+
+// Remplit l'adresse d'un socket Unix à partir de son chemin
+static int unix_address(const char *path, struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "Chemin de socket trop long : %s\n", path);
+        return -1;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+// Transport local : socket Unix, le port est ignoré
+static int unix_connect(const char *path, int port) {
+    (void)port;
+    struct sockaddr_un addr;
+    if (unix_address(path, &addr) != 0) {
+        return -1;
+    }
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        perror("Erreur dans la création du socket");
+        return -1;
+    }
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("Erreur de connexion");
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+static int unix_listen(const char *path, int port) {
+    (void)port;
+    struct sockaddr_un addr;
+    if (unix_address(path, &addr) != 0) {
+        return -1;
+    }
+    int server_sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (server_sock < 0) {
+        perror("Erreur dans la création de socket");
+        return -1;
+    }
+
+    // Un socket laissé par un serveur précédent empêcherait bind ; un autre fichier est conservé
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(path);
+    }
+    if (bind(server_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("Erreur dans la liaison du socket à son chemin");
+        close(server_sock);
+        return -1;
+    }
+    if (listen(server_sock, SOMAXCONN) < 0) {
+        perror("Erreur lors de l'écoute du serveur");
+        close(server_sock);
+        return -1;
+    }
+    return server_sock;
+}
+
+static const transport_t tcp_transport = { "tcp", tcp_connect, tcp_listen, 0 };
+static const transport_t unix_transport = { "unix", unix_connect, unix_listen, 0 };
+// Le serveur d'un socket Unix accepte aussi la mémoire partagée : seul le client la demande
+static const transport_t shm_transport = { "shm", unix_connect, unix_listen, 1 };
+
+const transport_t *transport_select(const char *address, const char **target) {
+    *target = address;
+    if (address && strncmp(address, UNIX_ADDRESS_PREFIX, strlen(UNIX_ADDRESS_PREFIX)) == 0) {
+        *target = address + strlen(UNIX_ADDRESS_PREFIX);
+        return &unix_transport;
+    }
+    if (address && strncmp(address, SHM_ADDRESS_PREFIX, strlen(SHM_ADDRESS_PREFIX)) == 0) {
+        *target = address + strlen(SHM_ADDRESS_PREFIX);
+        return &shm_transport;
+    }
+    return &tcp_transport;
+}
+
+// Place les deux anneaux dans la zone projetée : en-tête sur sa propre page puis données
+static void layout_rings(shm_area_t *area) {
+    for (int i = 0; i < 2; i++) {
+        unsigned char *base = (unsigned char*)area->base + i * (SHM_HEADER_SIZE + (size_t)SHM_RING_SIZE);
+        area->rings[i].header = (shm_ring_header_t*)base;
+        area->rings[i].data = base + SHM_HEADER_SIZE;
+        area->rings[i].size = SHM_RING_SIZE;
+    }
+}
+
+static shm_area_t *map_area(int fd) {
+    shm_area_t *area = calloc(1, sizeof(shm_area_t));
+    if (!area) {
+        perror("Memory allocation failed");
+        close(fd);
+        return NULL;
+    }
+    area->fd = fd;
+    area->length = 2 * (SHM_HEADER_SIZE + (size_t)SHM_RING_SIZE);
+    area->base = mmap(NULL, area->length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (area->base == MAP_FAILED) {
+        perror("Erreur lors de la projection de la mémoire partagée");
+        close(fd);
+        free(area);
+        return NULL;
+    }
+    layout_rings(area);
+    return area;
+}
+
+shm_area_t *shm_area_create(void) {
+    int fd = memfd_create("lp25-transport", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        perror("Erreur lors de la création de la mémoire partagée");
+        return NULL;
+    }
+    if (ftruncate(fd, 2 * (SHM_HEADER_SIZE + (off_t)SHM_RING_SIZE)) != 0) {
+        perror("Erreur lors du dimensionnement de la mémoire partagée");
+        close(fd);
+        return NULL;
+    }
+    // Taille scellée : le pair ne peut pas tronquer la zone sous nos projections (SIGBUS)
+    if (fcntl(fd, F_ADD_SEALS, SHM_REQUIRED_SEALS) != 0) {
+        perror("Erreur lors du scellement de la mémoire partagée");
+        close(fd);
+        return NULL;
+    }
+    // Une memfd neuve est remplie de zéros : les anneaux sont vides
+    return map_area(fd);
+}
+
+shm_area_t *shm_area_map(int fd) {
+    struct stat st;
+    int seals = fcntl(fd, F_GET_SEALS);
+    if (seals < 0 || (seals & SHM_REQUIRED_SEALS) != SHM_REQUIRED_SEALS ||
+        fstat(fd, &st) != 0 || (size_t)st.st_size < 2 * (SHM_HEADER_SIZE + (size_t)SHM_RING_SIZE)) {
+        fprintf(stderr, "Mémoire partagée reçue invalide\n");
+        close(fd);
+        return NULL;
+    }
+    return map_area(fd);
+}
+
+void shm_area_close(shm_area_t *area) {
+    if (!area) {
+        return;
+    }
+    munmap(area->base, area->length);
+    close(area->fd);
+    free(area);
+}
+
+unsigned char *shm_ring_reserve(shm_ring_t *ring, size_t length, uint64_t *position) {
+    uint64_t head = atomic_load_explicit(&ring->header->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&ring->header->tail, memory_order_acquire);
+    // Une place ne fait jamais le tour de l'anneau : sauter la fin si elle est trop courte
+    uint64_t start = head;
+    if (head % ring->size + length > ring->size) {
+        start += ring->size - head % ring->size;
+    }
+    if (length > ring->size || start + length - tail > ring->size) {
+        return NULL;
+    }
+    *position = start;
+    return ring->data + start % ring->size;
+}
+
+void shm_ring_publish(shm_ring_t *ring, uint64_t position, size_t length) {
+    atomic_store_explicit(&ring->header->head, position + length, memory_order_release);
+}
+
+static long futex(_Atomic uint32_t *word, int op, uint32_t value, const struct timespec *timeout) {
+    return syscall(SYS_futex, (uint32_t*)word, op, value, timeout, NULL, 0);
+}
+
+void shm_ring_wait(shm_ring_t *ring, size_t length) {
+    uint64_t position;
+    atomic_store_explicit(&ring->header->waiting, 1, memory_order_seq_cst);
+    uint32_t released = atomic_load_explicit(&ring->header->released, memory_order_seq_cst);
+    // La place a pu se libérer avant l'annonce de l'attente : le consommateur n'aurait alors réveillé personne
+    if (!shm_ring_reserve(ring, length, &position)) {
+        struct timespec timeout = { 0, SHM_WAIT_TIMEOUT_MS * 1000000L };
+        futex(&ring->header->released, FUTEX_WAIT, released, &timeout);
+    }
+    atomic_store_explicit(&ring->header->waiting, 0, memory_order_relaxed);
+}
+
+unsigned char *shm_ring_data(shm_ring_t *ring, uint64_t position, size_t length) {
+    uint64_t head = atomic_load_explicit(&ring->header->head, memory_order_acquire);
+    uint64_t tail = atomic_load_explicit(&ring->header->tail, memory_order_relaxed);
+    if (length > ring->size || position < tail || position + length > head ||
+        position % ring->size + length > ring->size) {
+        return NULL;
+    }
+    return ring->data + position % ring->size;
+}
+
+void shm_ring_release(shm_ring_t *ring, uint64_t end) {
+    atomic_store_explicit(&ring->header->tail, end, memory_order_release);
+    atomic_fetch_add_explicit(&ring->header->released, 1, memory_order_seq_cst);
+    if (atomic_load_explicit(&ring->header->waiting, memory_order_seq_cst)) {
+        futex(&ring->header->released, FUTEX_WAKE, 1, NULL);
+    }
+}
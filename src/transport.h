@@ -0,0 +1,137 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** @brief Préfixe d'adresse d'un socket Unix local (unix:/chemin/du/socket) */
+#define UNIX_ADDRESS_PREFIX "unix:"
+/** @brief Préfixe d'adresse d'un socket Unix doublé d'une mémoire partagée (shm:/chemin/du/socket) */
+#define SHM_ADDRESS_PREFIX "shm:"
+/** @brief Taille de chacun des deux anneaux de mémoire partagée (un par sens) */
+#define SHM_RING_SIZE (16 * 1024 * 1024)
+/** @brief Taille réservée à l'en-tête partagé en tête de chaque anneau */
+#define SHM_HEADER_SIZE 4096
+/** @brief Les trames DATA plus petites restent dans le socket */
+#define SHM_MIN_PAYLOAD 1024
+/** @brief Attente maximale d'une place dans l'anneau avant de vérifier que le pair est toujours là (ms) */
+#define SHM_WAIT_TIMEOUT_MS 100
+
+/**
+ * @brief Transport : comment joindre le pair et s'il peut partager de la mémoire avec lui.
+ */
+typedef struct {
+    const char *name;
+    int (*connect)(const char *target, int port); // Socket connecté, -1 en cas d'erreur
+    int (*listen)(const char *target, int port);  // Socket en écoute, -1 en cas d'erreur
+    int shared_memory;                            // Les grosses trames passent par la mémoire partagée
+} transport_t;
+
+/**
+ * @brief En-tête partagé d'un anneau : le producteur avance head, le consommateur tail.
+ */
+typedef struct {
+    _Atomic uint64_t head;      // Octets publiés depuis la création (producteur)
+    _Atomic uint64_t tail;      // Octets libérés depuis la création (consommateur)
+    _Atomic uint32_t released;  // Compteur de libérations, sert de mot futex
+    _Atomic uint32_t waiting;   // Le producteur attend une place
+} shm_ring_header_t;
+
+/**
+ * @brief Anneau d'un sens de la connexion, projeté dans les deux processus.
+ */
+typedef struct {
+    shm_ring_header_t *header;
+    unsigned char *data;
+    uint64_t size;
+} shm_ring_t;
+
+/**
+ * @brief Zone de mémoire partagée (memfd) d'une connexion : un anneau par sens.
+ */
+typedef struct {
+    int fd;
+    void *base;
+    size_t length;
+    shm_ring_t rings[2];        // [0] client vers serveur, [1] serveur vers client
+} shm_area_t;
+
+/**
+ * @brief Choisit le transport d'une adresse : IPv4 (TCP), unix:CHEMIN ou shm:CHEMIN.
+ *
+ * @param address L'adresse donnée en ligne de commande (NULL : TCP sur toutes les interfaces).
+ * @param target L'adresse sans son préfixe, à passer à connect ou listen.
+ * @return const transport_t* Le transport (jamais NULL).
+ */
+const transport_t *transport_select(const char *address, const char **target);
+
+/**
+ * @brief Crée la mémoire partagée d'une connexion (côté client).
+ *
+ * @return shm_area_t* La zone projetée, NULL en cas d'erreur.
+ */
+shm_area_t *shm_area_create(void);
+
+/**
+ * @brief Projette la mémoire partagée reçue d'un client (côté serveur).
+ *
+ * La memfd doit être scellée contre tout changement de taille, comme le fait shm_area_create.
+ *
+ * @param fd Le descripteur memfd reçu, fermé par shm_area_close.
+ * @return shm_area_t* La zone projetée, NULL en cas d'erreur (fd est alors fermé).
+ */
+shm_area_t *shm_area_map(int fd);
+
+/**
+ * @brief Libère la projection et le descripteur de la zone.
+ *
+ * @param area La zone (peut être NULL).
+ */
+void shm_area_close(shm_area_t *area);
+
+/**
+ * @brief Réserve une place contiguë dans l'anneau, sans attendre.
+ *
+ * @param ring L'anneau.
+ * @param length La taille voulue.
+ * @param position La position absolue de la place réservée.
+ * @return unsigned char* L'adresse où écrire, NULL si l'anneau est trop plein.
+ */
+unsigned char *shm_ring_reserve(shm_ring_t *ring, size_t length, uint64_t *position);
+
+/**
+ * @brief Publie les octets écrits dans la place réservée.
+ *
+ * @param ring L'anneau.
+ * @param position La position absolue de la place.
+ * @param length La taille écrite.
+ */
+void shm_ring_publish(shm_ring_t *ring, uint64_t position, size_t length);
+
+/**
+ * @brief Attend que le consommateur libère de la place (au plus SHM_WAIT_TIMEOUT_MS).
+ *
+ * @param ring L'anneau.
+ * @param length La taille de la place attendue.
+ */
+void shm_ring_wait(shm_ring_t *ring, size_t length);
+
+/**
+ * @brief Adresse des octets d'une position publiée, si la plage est valide.
+ *
+ * @param ring L'anneau.
+ * @param position La position absolue reçue du producteur.
+ * @param length La taille de la plage.
+ * @return unsigned char* L'adresse des données, NULL si la plage est invalide.
+ */
+unsigned char *shm_ring_data(shm_ring_t *ring, uint64_t position, size_t length);
+
+/**
+ * @brief Libère tout l'anneau jusqu'à une position et réveille le producteur s'il attend.
+ *
+ * @param ring L'anneau.
+ * @param end La position absolue de fin de la dernière plage consommée.
+ */
+void shm_ring_release(shm_ring_t *ring, uint64_t end);
+
+#endif // TRANSPORT_H
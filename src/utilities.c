@@ -1,11 +1,20 @@
+#define _GNU_SOURCE // O_PATH
 #include "utilities.h"
 #include "deduplication.h"
+#include "stats.h"
+#include "pack_store.h"
+#include "budget.h"
+#include "file_handler.h"
+#include "governor.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <openssl/evp.h>
 
 // Fonction pour vérifier si un répertoire en local est accessible
 int is_directory_accessible(const char *path) {
@@ -39,6 +48,21 @@ char *build_full_path(const char *dir, const char *relative_path) {
     return full_path;
 }
 
+// Formate une date de modification au format YYYY-MM-DD-hh:mm
+int format_modification_date(time_t mtime, char *date) {
+    // Convertir le temps de modification en une structure tm
+    struct tm timeinfo;
+    if (localtime_r(&mtime, &timeinfo) == NULL) {
+        perror("Erreur lors de la conversion du temps");
+        return -1;
+    }
+    if (strftime(date, 17, "%Y-%m-%d-%H:%M", &timeinfo) == 0) {
+        perror("Erreur lors du formatage de la date");
+        return -1;
+    }
+    return 0;
+}
+
 // Fonction pour obtenir la dernière date de modification d'un fichier
 char *get_last_modification_date(const char *filepath) {
     struct stat fileStat;
@@ -47,23 +71,14 @@ char *get_last_modification_date(const char *filepath) {
         return NULL;
     }
 
-    // Convertir le temps de modification en une structure tm
-    struct tm *timeinfo = localtime(&fileStat.st_mtime);
-    if (timeinfo == NULL) {
-        perror("Erreur lors de la conversion du temps");
-        return NULL;
-    }
-
     // Allouer de la mémoire pour la chaîne de caractères de la date
-    // Le format est "\0", ce qui fait 17 caractères
+    // Le format est "YYYY-MM-DD-hh:mm\0", ce qui fait 17 caractères
     char *date_str = (char*)malloc((strlen("YYYY-MM-DD-hh:mm") + 1)  *sizeof(char));
     if (date_str == NULL) {
         perror("Erreur lors de l'allocation de mémoire");
         return NULL;
     }
-    // Formater la date dans le format YYYY-MM-DD-hh:mm
-    if (strftime(date_str, 17, "%Y-%m-%d-%H:%M", timeinfo) == 0) {
-        perror("Erreur lors du formatage de la date");
+    if (format_modification_date(fileStat.st_mtime, date_str) != 0) {
         free(date_str);
         return NULL;
     }
@@ -71,7 +86,17 @@ char *get_last_modification_date(const char *filepath) {
     return date_str;
 }
 
-//calcule le md5 d'un fichier
+//calcule le md5 d'un fichier, lu par blocs dont la taille dépend du budget mémoire
+// Hache une fenêtre d'un fichier projeté ; -1 si le fichier a été tronqué pendant la lecture (SIGBUS)
+static int hash_mapped_window(EVP_MD_CTX *mdctx, const unsigned char *data, size_t size, int *ok) {
+    if (MAPPED_GUARD() != 0) {
+        return -1;
+    }
+    *ok = EVP_DigestUpdate(mdctx, data, size) == 1;
+    mapped_guard_disarm();
+    return 0;
+}
+
 void get_md5(const char *filepath, unsigned char *md5_hex) {
 
     // Open the file to read its data
@@ -80,30 +105,79 @@ void get_md5(const char *filepath, unsigned char *md5_hex) {
         perror("Erreur lors de l'ouverture du fichier pour le calcul du MD5");
         return;
     }
-
-    // Read the file into memory and calculate the MD5
-    fseek(file, 0, SEEK_END);
-    size_t file_size = ftell(file);
-    rewind(file);
-
-    void *buffer = malloc(file_size);
-    if (!buffer) {
+    governor_op();
+
+    EVP_MD_CTX *mdctx = EVP_MD_CTX_new();
+    mapped_file_t map;
+    int mapped = mapped_file_open(&map, fileno(file)) == 0;
+    size_t buffer_size = 0;
+    void *buffer = NULL;
+    if (!mapped) {
+        buffer_size = budget_reserve_up_to(MD5_BUFFER_SIZE, MD5_MIN_BUFFER_SIZE);
+        buffer = malloc(buffer_size);
+    }
+    if ((!mapped && !buffer) || !mdctx) {
+        free(buffer);
+        EVP_MD_CTX_free(mdctx);
+        budget_release(buffer_size);
+        if (mapped) {
+            mapped_file_close(&map);
+        }
         fclose(file);
         perror("Erreur d'allocation mémoire pour le calcul du MD5");
         return;
     }
 
-    size_t bytes_read = fread(buffer, 1, file_size, file);
-    if (bytes_read != file_size) {
-        free(buffer);
-        fclose(file);
+    stats_span_t span;
+    stats_begin(STATS_HASH, &span);
+    uint64_t file_size = 0;
+    size_t bytes_read;
+    int ok = EVP_DigestInit_ex(mdctx, EVP_md5(), NULL) == 1;
+    if (mapped) {
+        // Fichier projeté : haché en place, les pages lues sont rendues au noyau au fur et à mesure
+        int truncated = 0;
+        while (ok && (off_t)file_size < map.size) {
+            bytes_read = map.size - file_size < MD5_BUFFER_SIZE ? map.size - file_size : MD5_BUFFER_SIZE;
+            if (hash_mapped_window(mdctx, map.data + file_size, bytes_read, &ok) != 0) {
+                truncated = 1;
+                break;
+            }
+            file_size += bytes_read;
+            governor_read(bytes_read);
+            mapped_file_release(&map, file_size);
+        }
+        mapped_file_close(&map);
+        if (truncated) {
+            // Fichier tronqué pendant le calcul : il est relu depuis le début, jusqu'à sa nouvelle fin
+            mapped = 0;
+            file_size = 0;
+            rewind(file);
+            buffer_size = budget_reserve_up_to(MD5_BUFFER_SIZE, MD5_MIN_BUFFER_SIZE);
+            buffer = malloc(buffer_size);
+            ok = buffer && EVP_DigestInit_ex(mdctx, EVP_md5(), NULL) == 1;
+        }
+    }
+    while (!mapped && ok && (bytes_read = fread(buffer, 1, buffer_size, file)) > 0) {
+        ok = EVP_DigestUpdate(mdctx, buffer, bytes_read) == 1;
+        file_size += bytes_read;
+        governor_read(bytes_read);
+    }
+    unsigned char md5_out[MD5_DIGEST_LENGTH];
+    if (ferror(file)) {
         perror("Erreur lors de la lecture du fichier pour le calcul du MD5");
-        return;
     }
-    fclose(file);
-    // Calculate the MD5 using compute_md5
-    compute_md5(buffer, file_size, md5_hex);
+    else if (ok && EVP_DigestFinal_ex(mdctx, md5_out, NULL) == 1) {
+        bytes_to_hex(md5_out, MD5_DIGEST_LENGTH, md5_hex);
+    }
+    else {
+        fprintf(stderr, "Failed to compute MD5 hash\n");
+    }
+    stats_end(STATS_HASH, &span, file_size, 1, 0);
+
+    EVP_MD_CTX_free(mdctx);
     free(buffer);
+    budget_release(buffer_size);
+    fclose(file);
 }
 
 
@@ -188,34 +262,143 @@ char *remove_source_dir(const char *source_dir_copy, const char *full_path) {
     }
 }
 
+// Cache des répertoires dont l'existence est connue pendant la session
+typedef struct dir_cache_entry {
+    char *path;
+    struct dir_cache_entry *next;
+} dir_cache_entry;
+
+static dir_cache_entry *dir_cache[DIR_CACHE_BUCKETS];
+
+// Hachage djb2 des len premiers caractères d'un chemin
+static unsigned int dir_cache_hash(const char *path, size_t len) {
+    unsigned int hash = 5381;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash << 5) + hash + (unsigned char)path[i];
+    }
+    return hash % DIR_CACHE_BUCKETS;
+}
+
+static int dir_cache_contains(const char *path, size_t len) {
+    for (dir_cache_entry *entry = dir_cache[dir_cache_hash(path, len)]; entry; entry = entry->next) {
+        if (strlen(entry->path) == len && strncmp(entry->path, path, len) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void dir_cache_add(const char *path, size_t len) {
+    dir_cache_entry *entry = malloc(sizeof(dir_cache_entry));
+    if (!entry) {
+        return; // Le cache n'est qu'une optimisation
+    }
+    entry->path = strndup(path, len);
+    if (!entry->path) {
+        free(entry);
+        return;
+    }
+    unsigned int bucket = dir_cache_hash(path, len);
+    entry->next = dir_cache[bucket];
+    dir_cache[bucket] = entry;
+}
+
+void reset_directory_cache(void) {
+    for (size_t i = 0; i < DIR_CACHE_BUCKETS; i++) {
+        dir_cache_entry *entry = dir_cache[i];
+        while (entry) {
+            dir_cache_entry *next = entry->next;
+            free(entry->path);
+            free(entry);
+            entry = next;
+        }
+        dir_cache[i] = NULL;
+    }
+}
+
 void create_intermediate_directories(const char *path) {
-    char *path_copy = strdup(path);
-    if (!path_copy) {
-        perror("Failed to duplicate path");
+    // Le répertoire à créer est tout ce qui précède le dernier '/'
+    const char *last_slash = strrchr(path, '/');
+    if (!last_slash || last_slash == path) {
         return;
     }
+    size_t dir_len = last_slash - path;
+    if (dir_cache_contains(path, dir_len)) {
+        return; // Cas courant : le répertoire a déjà été créé ou vérifié
+    }
 
-    char *last_slash = strrchr(path_copy, '/');
-    if (last_slash) {
-        *last_slash = '\0'; // Remove the filename part
+    // Remonter jusqu'au plus proche ancêtre connu
+    size_t known_len = dir_len;
+    while (known_len > 0) {
+        while (known_len > 0 && path[known_len] != '/') {
+            known_len--;
+        }
+        if (known_len == 0 || dir_cache_contains(path, known_len)) {
+            break;
+        }
+        known_len--;
     }
 
-    char *token = strtok(path_copy, "/");
-    char current_path[1024] = "";
+    char *dir_copy = strndup(path, dir_len);
+    if (!dir_copy) {
+        perror("Failed to duplicate path");
+        return;
+    }
 
-    while (token != NULL) {
-        strcat(current_path, token);
-        strcat(current_path, "/");
+    // Descendre depuis cet ancêtre avec mkdirat/openat, sans reparcourir tout le chemin
+    int dir_fd;
+    size_t pos;
+    if (known_len > 0) {
+        dir_copy[known_len] = '\0';
+        dir_fd = open(dir_copy, O_PATH | O_DIRECTORY);
+        dir_copy[known_len] = '/';
+        pos = known_len + 1;
+    }
+    else if (path[0] == '/') {
+        dir_fd = open("/", O_PATH | O_DIRECTORY);
+        pos = 1;
+    }
+    else {
+        dir_fd = AT_FDCWD;
+        pos = 0;
+    }
+    if (dir_fd == -1) {
+        perror("Failed to open parent directory");
+        free(dir_copy);
+        return;
+    }
 
-        struct stat st = { 0 };
-        if (stat(current_path, &st) == -1) {
-            mkdir(current_path, 0700);
+    while (pos < dir_len) {
+        size_t end = pos;
+        while (end < dir_len && dir_copy[end] != '/') {
+            end++;
         }
-
-        token = strtok(NULL, "/");
+        if (end > pos) {
+            dir_copy[end] = '\0';
+            const char *component = dir_copy + pos;
+            if (mkdirat(dir_fd, component, 0700) == -1 && errno != EEXIST) {
+                perror("Failed to create directory");
+                break;
+            }
+            int next_fd = openat(dir_fd, component, O_PATH | O_DIRECTORY);
+            if (next_fd == -1) {
+                perror("Failed to open directory");
+                break;
+            }
+            if (dir_fd != AT_FDCWD) {
+                close(dir_fd);
+            }
+            dir_fd = next_fd;
+            dir_cache_add(path, end);
+            dir_copy[end] = '/';
+        }
+        pos = end + 1;
     }
 
-    free(path_copy);
+    if (dir_fd != AT_FDCWD) {
+        close(dir_fd);
+    }
+    free(dir_copy);
 }
 
 time_t get_modification_timestamp(const char *path) {
@@ -239,7 +422,8 @@ char *get_latest_backup_dir(const char *backup_dir_copy) {
     time_t latest_time = 0;
 
     while ((entry = readdir(dir)) != NULL) {
-        if (entry->d_type == DT_DIR && strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+        if (entry->d_type == DT_DIR && strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0 &&
+            strcmp(entry->d_name, PACK_DIR_NAME) != 0) {
             char *full_path = malloc(strlen(backup_dir_copy) + strlen(entry->d_name) + 2);
             if (!full_path) {
                 perror("Memory allocation failed");
@@ -36,7 +36,21 @@ char *build_full_path(const char *dir, const char *relative_path); //utile pour
 char *get_last_modification_date(const char *filepath); //utile pour backup_manager
 
 /**
-* @brief Calcule le MD5 d'un fichier.
+* @brief Formate une date de modification comme get_last_modification_date, sans stat.
+*
+* @param mtime La date de modification.
+* @param date Le buffer de 17 caractères au moins pour la date au format "YYYY-MM-DD-hh:mm".
+* @return int 0 si succès, -1 si erreur.
+*/
+int format_modification_date(time_t mtime, char *date);
+
+/** @brief Taille du tampon de lecture du MD5 d'un fichier quand le budget mémoire le permet (1 Mo) */
+#define MD5_BUFFER_SIZE (1024 * 1024)
+/** @brief Taille minimale de ce tampon (64 Ko) */
+#define MD5_MIN_BUFFER_SIZE (64 * 1024)
+
+/**
+* @brief Calcule le MD5 d'un fichier, lu par blocs : la mémoire utilisée ne dépend pas de sa taille.
 *
 * @param filepath Le chemin du fichier.
 * @param md5_hex Le buffer pour stocker le hash en hexadécimal.
@@ -79,14 +93,26 @@ void remove_trailing_slash(char *path);
 */
 char *remove_source_dir(const char *source_dir_copy, const char *full_path);
 
+/** @brief Nombre d'alvéoles du cache des répertoires existants */
+#define DIR_CACHE_BUCKETS 4096
+
 /**
 * @brief Crée les répertoires intermédiaires d'un chemin.
 *
 * @param path Le chemin complet.
-* Crée tous les répertoires manquants du chemin.
+* Crée tous les répertoires manquants du chemin. Les répertoires déjà créés ou vérifiés
+* sont mémorisés : les appels suivants pour le même répertoire ne font aucun appel système,
+* et seuls les composants situés sous le plus proche ancêtre connu sont créés (mkdirat).
 */
 void create_intermediate_directories(const char *path);
 
+/**
+* @brief Vide le cache des répertoires existants.
+*
+* À appeler en fin de sauvegarde ou de restauration, ou si des répertoires ont été supprimés.
+*/
+void reset_directory_cache(void);
+
 /**
 * @brief Trouve le répertoire de sauvegarde le plus récent.
 *